@@ -0,0 +1,188 @@
+// Compares text decoding of raw IRC lines: QString::fromUtf8(), which the
+// client used for every field before, against IrcTextCodec's classified
+// decode (ASCII widening, UTF-8, legacy fallback).
+//
+//   irc_decode_bench trace.irc [--repeat 5] [--legacy cp1252]
+//
+// The trace is plain server traffic, one line per row, or a capture written
+// by IRCClient --capture, whose inbound lines are used. Every line is held
+// in memory first, so only decoding is timed. Each pass is run --repeat
+// times and the fastest run counts:
+//
+//   line      the whole line as one string
+//   fields    every parameter of the parsed line, as handlers decode them
+//   classify  only the ASCII / UTF-8 / invalid check
+//
+// Lines that are not valid UTF-8 come out differently on purpose: fromUtf8
+// turns their bytes into U+FFFD, the codec uses the legacy encoding.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QVector>
+#include <functional>
+#include "IrcCapture.h"
+#include "IrcMessage.h"
+#include "IrcTextCodec.h"
+
+static QVector<QByteArray> readLines(QFile *trace)
+{
+    QVector<QByteArray> lines;
+    if (IrcCapture::isCapture(trace)) {
+        IrcCaptureReader capture(trace);
+        if (!capture.readHeader()) {
+            return lines;
+        }
+        IrcCapture::Record record;
+        while (capture.next(&record)) {
+            if (record.direction == IrcCapture::Inbound) {
+                lines.append(record.line);
+            }
+        }
+        return lines;
+    }
+
+    while (!trace->atEnd()) {
+        QByteArray line = trace->readLine();
+        while (line.endsWith('\n') || line.endsWith('\r')) {
+            line.chop(1);
+        }
+        if (!line.isEmpty()) {
+            lines.append(line);
+        }
+    }
+    return lines;
+}
+
+// Fastest of repeat runs, in ns; sink keeps the results from being optimized out
+static qint64 fastestRun(int repeat, const std::function<qint64()> &pass, qint64 *sink)
+{
+    qint64 best = -1;
+    for (int run = 0; run < repeat; ++run) {
+        QElapsedTimer clock;
+        clock.start();
+        *sink += pass();
+        const qint64 ns = clock.nsecsElapsed();
+        if (best < 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times decoding of raw IRC lines, fromUtf8 against IrcTextCodec.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("trace", "Raw server traffic, one IRC line per row, or a capture.");
+    parser.addOption({ "repeat", "Runs of each pass; the fastest counts.", "count", "5" });
+    parser.addOption({ "legacy", "Encoding for lines that are not UTF-8: cp1252, latin1 or utf8.", "name", "cp1252" });
+    parser.process(app);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        parser.showHelp(1);
+    }
+    QFile trace(positional.first());
+    if (!trace.open(QIODevice::ReadOnly)) {
+        qCritical("Cannot open %s: %s", qPrintable(trace.fileName()), qPrintable(trace.errorString()));
+        return 1;
+    }
+    IrcTextCodec::Legacy legacy;
+    if (!IrcTextCodec::parseLegacy(parser.value("legacy"), &legacy)) {
+        qCritical("Unknown encoding %s", qPrintable(parser.value("legacy")));
+        return 1;
+    }
+    const int repeat = qMax(1, parser.value("repeat").toInt());
+
+    const QVector<QByteArray> lines = readLines(&trace);
+    if (lines.isEmpty()) {
+        qCritical("%s: no lines", qPrintable(trace.fileName()));
+        return 1;
+    }
+    qint64 bytes = 0;
+    qint64 mix[4] = {};
+    for (const QByteArray &line : lines) {
+        bytes += line.size();
+        ++mix[IrcTextCodec::classify(line.constData(), int(line.size()))];
+    }
+
+    // Both field passes parse again, which also forgets the codec's cached
+    // classification, so the difference between them is decoding alone
+    QVector<IrcMessage> messages;
+    messages.reserve(lines.size());
+    for (const QByteArray &line : lines) {
+        messages.append(IrcMessage(line));
+        messages.last().setLegacyEncoding(legacy);
+    }
+
+    qint64 sink = 0;
+    const qint64 lineUtf8 = fastestRun(repeat, [&]() {
+        qint64 length = 0;
+        for (const QByteArray &line : lines) {
+            length += QString::fromUtf8(line.constData(), int(line.size())).size();
+        }
+        return length;
+    }, &sink);
+    const qint64 lineCodec = fastestRun(repeat, [&]() {
+        qint64 length = 0;
+        for (const QByteArray &line : lines) {
+            length += IrcTextCodec::decode(line.constData(), int(line.size()), legacy).size();
+        }
+        return length;
+    }, &sink);
+    const qint64 fieldsUtf8 = fastestRun(repeat, [&]() {
+        qint64 length = 0;
+        for (IrcMessage &message : messages) {
+            message.parse(message.line());
+            for (int i = 0; i < message.paramCount(); ++i) {
+                const QByteArray param = message.paramBytes(i);
+                length += QString::fromUtf8(param.constData(), int(param.size())).size();
+            }
+        }
+        return length;
+    }, &sink);
+    const qint64 fieldsCodec = fastestRun(repeat, [&]() {
+        qint64 length = 0;
+        for (IrcMessage &message : messages) {
+            message.parse(message.line());
+            for (int i = 0; i < message.paramCount(); ++i) {
+                length += message.param(i).size();
+            }
+        }
+        return length;
+    }, &sink);
+    const qint64 classify = fastestRun(repeat, [&]() {
+        qint64 ascii = 0;
+        for (const QByteArray &line : lines) {
+            ascii += IrcTextCodec::classify(line.constData(), int(line.size())) == IrcTextCodec::Ascii;
+        }
+        return ascii;
+    }, &sink);
+
+    const qint64 count = lines.size();
+    QTextStream out(stdout);
+    auto row = [&](const char *name, qint64 ns) {
+        out << name << QString::number(double(ns) / double(count), 'f', 1) << " ns/line, "
+            << QString::number(double(bytes) / (double(ns) / 1e9) / (1024 * 1024), 'f', 0) << " MiB/s\n";
+    };
+    out << "trace:            " << trace.fileName() << "\n"
+        << "lines:            " << count << " (" << bytes << " bytes)\n"
+        << "ascii/utf8/other: " << mix[IrcTextCodec::Ascii] << " / " << mix[IrcTextCodec::Utf8]
+        << " / " << mix[IrcTextCodec::Invalid] << "\n"
+        << "vector path:      " << IrcTextCodec::implementation() << "\n";
+    row("line fromUtf8:    ", lineUtf8);
+    row("line codec:       ", lineCodec);
+    row("fields fromUtf8:  ", fieldsUtf8);
+    row("fields codec:     ", fieldsCodec);
+    row("classify only:    ", classify);
+    out << "speedup:          " << QString::number(double(lineUtf8) / double(lineCodec), 'f', 2) << "x line, "
+        << QString::number(double(fieldsUtf8) / double(fieldsCodec), 'f', 2) << "x fields\n";
+    out.flush();
+    return sink == 42 ? 2 : 0;
+}
@@ -0,0 +1,699 @@
+// Local IRC server stand-in for load and end-to-end latency testing.
+//
+//   irc_fake_server [--port 16667] [--channels 10] [--users 1000]
+//                   [--rate 1000] [--netsplit-every 0 | --netsplit-at 10,30]
+//                   [--netsplit-percent 30] [--netsplit-duration 5]
+//                   [--tls-cert server.pem --tls-key server.key]
+//
+// It registers clients (NICK/USER, CAP LS/REQ/END, PING), answers JOIN,
+// PART, NAMES, TOPIC, LIST, WHO and MODE queries, and relays PRIVMSG and
+// NOTICE between connected clients. The channels #load0..#loadN-1 are
+// populated with --users simulated members who, once a client has joined,
+// talk at --rate messages per second in total across the joined channels.
+// Netsplits drop --netsplit-percent of them with a split QUIT and bring
+// them back, reopped, --netsplit-duration seconds later.
+//
+// With --tls-cert it speaks TLS only, asks clients for a certificate and
+// accepts SASL EXTERNAL from those that present one.
+//
+// Every line is sent with an IRCv3 "time" tag and a microsecond
+// "qtirc.local/sent" tag, so the client can measure the full path from the
+// server's write to the line being displayed. Tags go out whether or not
+// the client negotiated message-tags; pass --no-tags for strict clients.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QHostAddress>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QSslCertificate>
+#include <QSslConfiguration>
+#include <QSslKey>
+#include <QSslSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QVector>
+#include <chrono>
+
+// Wraps accepted connections in a QSslSocket and starts the server
+// handshake when TLS is configured
+class ListenServer : public QTcpServer
+{
+public:
+    void setTls(const QSslConfiguration &config)
+    {
+        m_config = config;
+        m_tls = true;
+    }
+
+protected:
+    void incomingConnection(qintptr descriptor) override
+    {
+        if (!m_tls) {
+            QTcpServer::incomingConnection(descriptor);
+            return;
+        }
+        QSslSocket *socket = new QSslSocket(this);
+        if (!socket->setSocketDescriptor(descriptor)) {
+            delete socket;
+            return;
+        }
+        socket->setSslConfiguration(m_config);
+        addPendingConnection(socket);
+        socket->startServerEncryption();
+    }
+
+private:
+    QSslConfiguration m_config;
+    bool m_tls = false;
+};
+
+class FakeIrcServer : public QObject
+{
+public:
+    struct Options
+    {
+        int channels = 10;
+        int users = 1000;
+        double rate = 1000;
+        int netsplitEvery = 0;         // seconds, 0 = never
+        QVector<int> netsplitAt;       // seconds after start
+        int netsplitPercent = 30;
+        int netsplitDuration = 5;
+        qint64 sendQueueLimit = 16 * 1024 * 1024;
+        bool tags = true;
+        QString tlsCertificate;        // PEM files; empty for plain TCP
+        QString tlsKey;
+    };
+
+    FakeIrcServer(const Options &options, QObject *parent = nullptr);
+
+    bool listen(quint16 port);
+
+private:
+    struct Client
+    {
+        QTcpSocket *socket = nullptr;
+        QByteArray nick;
+        QByteArray user;
+        bool registered = false;
+        bool negotiating = false;
+        QSet<QByteArray> channels;  // folded names
+    };
+    struct Channel
+    {
+        QByteArray name;
+        QByteArray topic;
+        QVector<int> users;         // simulated members
+        QSet<Client *> clients;
+    };
+
+    void onNewConnection();
+    void onReadyRead(Client *client);
+    void removeClient(Client *client);
+    void handleLine(Client *client, const QByteArray &line);
+    void tryRegister(Client *client);
+    void joinChannel(Client *client, const QByteArray &name);
+    void partChannel(Client *client, const QByteArray &name, const QByteArray &reason);
+    void sendNames(Client *client, const Channel &channel);
+    void sendWho(Client *client, const Channel &channel);
+    void relay(Client *client, const QByteArray &verb, const QByteArray &target, const QByteArray &text);
+
+    void generateTraffic();
+    void startNetsplit();
+    void endNetsplit(const QVector<int> &users);
+
+    void send(Client *client, const QByteArray &line);
+    void sendToChannel(const Channel &channel, const QByteArray &line, Client *except = nullptr);
+    void reply(Client *client, const char *numeric, const QByteArray &params);
+    QByteArray tags() const;
+    QByteArray userPrefix(int user) const;
+    static QByteArray fold(const QByteArray &name) { return name.toLower(); }
+
+    Options m_options;
+    ListenServer m_server;
+    QVector<Client *> m_clients;
+    QHash<QByteArray, Channel> m_channels;      // by folded name
+    QVector<QByteArray> m_nicks;                // simulated users
+    QVector<QVector<QByteArray>> m_userChannels;
+    QVector<bool> m_split;
+    QRandomGenerator m_random;
+    QTimer m_trafficTimer;
+    QElapsedTimer m_clock;
+    qint64 m_sent;
+    qint64 m_sequence;
+};
+
+static const char *const s_serverName = "irc.fake.test";
+
+FakeIrcServer::FakeIrcServer(const Options &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_random(1)
+    , m_sent(0)
+    , m_sequence(0)
+{
+    QVector<QByteArray> channelKeys;
+    for (int i = 0; i < m_options.channels; ++i) {
+        Channel channel;
+        channel.name = "#load" + QByteArray::number(i);
+        channel.topic = "Load test channel " + QByteArray::number(i);
+        channelKeys.append(fold(channel.name));
+        m_channels.insert(channelKeys.last(), channel);
+    }
+
+    m_userChannels.resize(m_options.users);
+    m_split.fill(false, m_options.users);
+    for (int user = 0; user < m_options.users; ++user) {
+        m_nicks.append("sim" + QByteArray::number(user));
+        const int joined = channelKeys.isEmpty() ? 0 : 1 + int(m_random.bounded(qMin(3, int(channelKeys.size()))));
+        for (int i = 0; i < joined; ++i) {
+            const QByteArray &key = channelKeys.at(int(m_random.bounded(int(channelKeys.size()))));
+            if (!m_userChannels[user].contains(key)) {
+                m_userChannels[user].append(key);
+                m_channels[key].users.append(user);
+            }
+        }
+    }
+
+    connect(&m_server, &QTcpServer::newConnection, this, [this]() { onNewConnection(); });
+    connect(&m_trafficTimer, &QTimer::timeout, this, [this]() { generateTraffic(); });
+    m_trafficTimer.setInterval(10);
+}
+
+bool FakeIrcServer::listen(quint16 port)
+{
+    if (!m_options.tlsCertificate.isEmpty()) {
+        QFile keyFile(m_options.tlsKey.isEmpty() ? m_options.tlsCertificate : m_options.tlsKey);
+        const QList<QSslCertificate> certificates = QSslCertificate::fromPath(m_options.tlsCertificate);
+        if (certificates.isEmpty() || !keyFile.open(QIODevice::ReadOnly)) {
+            qCritical("Cannot load the TLS certificate and key");
+            return false;
+        }
+        const QByteArray pem = keyFile.readAll();
+        QSslKey key(pem, QSsl::Rsa);
+        if (key.isNull()) {
+            key = QSslKey(pem, QSsl::Ec);
+        }
+
+        QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+        config.setLocalCertificate(certificates.first());
+        config.setPrivateKey(key);
+        // Ask for a client certificate, for SASL EXTERNAL, but don't insist
+        config.setPeerVerifyMode(QSslSocket::QueryPeer);
+        m_server.setTls(config);
+    }
+
+    if (!m_server.listen(QHostAddress::Any, port)) {
+        qCritical("Cannot listen on port %d: %s", port, qPrintable(m_server.errorString()));
+        return false;
+    }
+    m_clock.start();
+    if (m_options.rate > 0) {
+        m_trafficTimer.start();
+    }
+
+    if (m_options.netsplitEvery > 0) {
+        QTimer *splits = new QTimer(this);
+        connect(splits, &QTimer::timeout, this, [this]() { startNetsplit(); });
+        splits->start(m_options.netsplitEvery * 1000);
+    }
+    for (int seconds : m_options.netsplitAt) {
+        QTimer::singleShot(seconds * 1000, this, [this]() { startNetsplit(); });
+    }
+
+    qInfo("Listening on port %d%s: %d channels, %d users, %g msgs/s",
+          m_server.serverPort(), m_options.tlsCertificate.isEmpty() ? "" : " (TLS)",
+          m_options.channels, m_options.users, m_options.rate);
+    return true;
+}
+
+void FakeIrcServer::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+        Client *client = new Client;
+        client->socket = socket;
+        m_clients.append(client);
+        connect(socket, &QTcpSocket::readyRead, this, [this, client]() { onReadyRead(client); });
+        // Queued: a client may drop while we are iterating over a channel
+        connect(socket, &QTcpSocket::disconnected, this, [this, client]() { removeClient(client); },
+                Qt::QueuedConnection);
+    }
+}
+
+void FakeIrcServer::removeClient(Client *client)
+{
+    if (!m_clients.removeOne(client)) {
+        return;
+    }
+    for (const QByteArray &key : client->channels) {
+        m_channels[key].clients.remove(client);
+    }
+    client->socket->disconnect(this);
+    client->socket->deleteLater();
+    delete client;
+}
+
+void FakeIrcServer::onReadyRead(Client *client)
+{
+    while (client->socket->canReadLine()) {
+        QByteArray line = client->socket->readLine();
+        while (line.endsWith('\n') || line.endsWith('\r')) {
+            line.chop(1);
+        }
+        if (!line.isEmpty()) {
+            handleLine(client, line);
+        }
+        if (client->socket->state() != QAbstractSocket::ConnectedState) {
+            return;
+        }
+    }
+}
+
+void FakeIrcServer::handleLine(Client *client, const QByteArray &line)
+{
+    // Clients send no tags or prefix worth keeping
+    QByteArray rest = line;
+    while ((rest.startsWith('@') || rest.startsWith(':')) && rest.contains(' ')) {
+        rest = rest.mid(rest.indexOf(' ') + 1);
+    }
+    const int colon = rest.indexOf(" :");
+    const QByteArray trailing = colon >= 0 ? rest.mid(colon + 2) : QByteArray();
+    QList<QByteArray> params = (colon >= 0 ? rest.left(colon) : rest).split(' ');
+    params.removeAll(QByteArray());
+    if (colon >= 0) {
+        params.append(trailing);
+    }
+    if (params.isEmpty()) {
+        return;
+    }
+    const QByteArray command = params.takeFirst().toUpper();
+    const QByteArray first = params.value(0);
+
+    if (command == "CAP") {
+        const QByteArray sub = first.toUpper();
+        if (sub == "LS") {
+            client->negotiating = true;
+            const QByteArray sasl = m_options.tlsCertificate.isEmpty() ? "" : " sasl";
+            send(client, QByteArray(":") + s_serverName + " CAP * LS :server-time message-tags" + sasl);
+        } else if (sub == "REQ") {
+            // Registration waits for CAP END, e.g. until SASL is done
+            client->negotiating = true;
+            send(client, QByteArray(":") + s_serverName + " CAP * ACK :" + params.value(1));
+        } else if (sub == "END") {
+            client->negotiating = false;
+            tryRegister(client);
+        }
+    } else if (command == "AUTHENTICATE") {
+        // SASL EXTERNAL only: the client certificate is the credential
+        const QSslSocket *tls = qobject_cast<QSslSocket *>(client->socket);
+        const QByteArray nick = client->nick.isEmpty() ? QByteArray("*") : client->nick;
+        if (first.toUpper() == "EXTERNAL") {
+            send(client, "AUTHENTICATE +");
+        } else if (first == "+" && tls && !tls->peerCertificate().isNull()) {
+            reply(client, "900", nick + ' ' + nick + "!~" + client->user + "@localhost " + nick
+                  + " :You are now logged in as " + nick);
+            reply(client, "903", nick + " :SASL authentication successful");
+        } else {
+            reply(client, "904", nick + " :SASL authentication failed");
+        }
+    } else if (command == "NICK") {
+        bool taken = m_nicks.contains(first);
+        for (const Client *other : m_clients) {
+            taken = taken || (other != client && fold(other->nick) == fold(first));
+        }
+        if (first.isEmpty() || taken) {
+            reply(client, "433", (client->nick.isEmpty() ? QByteArray("*") : client->nick) + ' ' + first
+                  + " :Nickname is already in use");
+        } else if (client->registered) {
+            send(client, ':' + client->nick + "!~" + client->user + "@localhost NICK :" + first);
+            client->nick = first;
+        } else {
+            client->nick = first;
+            tryRegister(client);
+        }
+    } else if (command == "USER") {
+        client->user = first;
+        tryRegister(client);
+    } else if (command == "PING") {
+        send(client, QByteArray(":") + s_serverName + " PONG " + s_serverName + " :" + first);
+    } else if (command == "PONG") {
+        // Nothing to do
+    } else if (command == "QUIT") {
+        send(client, "ERROR :Closing link (" + client->nick + ") [Quit: " + first + "]");
+        client->socket->disconnectFromHost();
+    } else if (!client->registered) {
+        reply(client, "451", "* :You have not registered");
+    } else if (command == "JOIN") {
+        for (const QByteArray &name : first.split(',')) {
+            joinChannel(client, name);
+        }
+    } else if (command == "PART") {
+        for (const QByteArray &name : first.split(',')) {
+            partChannel(client, name, params.value(1));
+        }
+    } else if (command == "PRIVMSG" || command == "NOTICE") {
+        relay(client, command, first, params.value(1));
+    } else if (command == "NAMES") {
+        const auto it = m_channels.constFind(fold(first));
+        if (it != m_channels.constEnd()) {
+            sendNames(client, *it);
+        } else {
+            reply(client, "366", client->nick + ' ' + first + " :End of /NAMES list.");
+        }
+    } else if (command == "TOPIC") {
+        auto it = m_channels.find(fold(first));
+        if (it == m_channels.end()) {
+            reply(client, "403", client->nick + ' ' + first + " :No such channel");
+        } else if (params.size() >= 2) {
+            it->topic = params.at(1);
+            sendToChannel(*it, ':' + client->nick + "!~" + client->user + "@localhost TOPIC "
+                          + it->name + " :" + it->topic);
+        } else if (it->topic.isEmpty()) {
+            reply(client, "331", client->nick + ' ' + it->name + " :No topic is set");
+        } else {
+            reply(client, "332", client->nick + ' ' + it->name + " :" + it->topic);
+        }
+    } else if (command == "LIST") {
+        reply(client, "321", client->nick + " Channel :Users  Name");
+        for (const Channel &channel : m_channels) {
+            reply(client, "322", client->nick + ' ' + channel.name + ' '
+                  + QByteArray::number(channel.users.size() + channel.clients.size()) + " :" + channel.topic);
+        }
+        reply(client, "323", client->nick + " :End of /LIST");
+    } else if (command == "WHO") {
+        const auto it = m_channels.constFind(fold(first));
+        if (it != m_channels.constEnd()) {
+            sendWho(client, *it);
+        }
+        reply(client, "315", client->nick + ' ' + first + " :End of /WHO list.");
+    } else if (command == "MODE") {
+        const auto it = m_channels.constFind(fold(first));
+        if (it != m_channels.constEnd() && params.size() == 1) {
+            reply(client, "324", client->nick + ' ' + it->name + " +nt");
+        } else if (first == client->nick) {
+            reply(client, "221", client->nick + " +i");
+        }
+    } else {
+        reply(client, "421", client->nick + ' ' + command + " :Unknown command");
+    }
+}
+
+void FakeIrcServer::tryRegister(Client *client)
+{
+    if (client->registered || client->negotiating || client->nick.isEmpty() || client->user.isEmpty()) {
+        return;
+    }
+    client->registered = true;
+
+    const QByteArray &nick = client->nick;
+    reply(client, "001", nick + " :Welcome to the fake network " + nick);
+    reply(client, "002", nick + " :Your host is " + s_serverName + ", running irc_fake_server");
+    reply(client, "003", nick + " :This server was created just now");
+    reply(client, "004", nick + ' ' + s_serverName + " irc_fake_server i beIklmnopstv");
+    reply(client, "005", nick + " CASEMAPPING=ascii PREFIX=(ov)@+ CHANMODES=beI,k,l,mnst CHANTYPES=#"
+          " NICKLEN=30 :are supported by this server");
+    reply(client, "375", nick + " :- " + s_serverName + " Message of the day -");
+    reply(client, "372", nick + QByteArray(" :- ") + QByteArray::number(m_channels.size())
+          + " channels with " + QByteArray::number(m_nicks.size()) + " simulated users");
+    reply(client, "376", nick + " :End of /MOTD command.");
+}
+
+void FakeIrcServer::joinChannel(Client *client, const QByteArray &name)
+{
+    if (!name.startsWith('#') || name.size() < 2) {
+        reply(client, "403", client->nick + ' ' + name + " :No such channel");
+        return;
+    }
+    const QByteArray key = fold(name);
+    if (client->channels.contains(key)) {
+        return;
+    }
+    auto it = m_channels.find(key);
+    if (it == m_channels.end()) {
+        Channel created;
+        created.name = name;
+        it = m_channels.insert(key, created);
+    }
+
+    client->channels.insert(key);
+    it->clients.insert(client);
+    sendToChannel(*it, ':' + client->nick + "!~" + client->user + "@localhost JOIN " + it->name);
+    if (it->topic.isEmpty()) {
+        reply(client, "331", client->nick + ' ' + it->name + " :No topic is set");
+    } else {
+        reply(client, "332", client->nick + ' ' + it->name + " :" + it->topic);
+    }
+    sendNames(client, *it);
+}
+
+void FakeIrcServer::partChannel(Client *client, const QByteArray &name, const QByteArray &reason)
+{
+    const QByteArray key = fold(name);
+    auto it = m_channels.find(key);
+    if (it == m_channels.end() || !client->channels.contains(key)) {
+        reply(client, "442", client->nick + ' ' + name + " :You're not on that channel");
+        return;
+    }
+    sendToChannel(*it, ':' + client->nick + "!~" + client->user + "@localhost PART " + it->name + " :" + reason);
+    it->clients.remove(client);
+    client->channels.remove(key);
+}
+
+void FakeIrcServer::sendNames(Client *client, const Channel &channel)
+{
+    const QByteArray head = client->nick + " = " + channel.name + " :";
+    QByteArray names;
+    auto flush = [&]() {
+        if (!names.isEmpty()) {
+            reply(client, "353", head + names);
+            names.clear();
+        }
+    };
+    auto add = [&](const QByteArray &name) {
+        if (head.size() + names.size() + name.size() + 40 > 510) {
+            flush();
+        }
+        if (!names.isEmpty()) {
+            names += ' ';
+        }
+        names += name;
+    };
+
+    for (const Client *member : channel.clients) {
+        add(member->nick);
+    }
+    for (int user : channel.users) {
+        if (!m_split.at(user)) {
+            add((user % 50 == 0 ? "@" : user % 10 == 0 ? "+" : "") + m_nicks.at(user));
+        }
+    }
+    flush();
+    reply(client, "366", client->nick + ' ' + channel.name + " :End of /NAMES list.");
+}
+
+void FakeIrcServer::sendWho(Client *client, const Channel &channel)
+{
+    for (int user : channel.users) {
+        if (!m_split.at(user)) {
+            reply(client, "352", client->nick + ' ' + channel.name + " ~sim sim.fake.test "
+                  + s_serverName + ' ' + m_nicks.at(user) + " H :0 Simulated user");
+        }
+    }
+    for (const Client *member : channel.clients) {
+        reply(client, "352", client->nick + ' ' + channel.name + " ~" + member->user + " localhost "
+              + s_serverName + ' ' + member->nick + " H :0 " + member->user);
+    }
+}
+
+void FakeIrcServer::relay(Client *client, const QByteArray &verb, const QByteArray &target, const QByteArray &text)
+{
+    const QByteArray line = ':' + client->nick + "!~" + client->user + "@localhost " + verb + ' ' + target + " :" + text;
+    const auto it = m_channels.constFind(fold(target));
+    if (it != m_channels.constEnd()) {
+        sendToChannel(*it, line, client);
+        return;
+    }
+    for (Client *other : m_clients) {
+        if (fold(other->nick) == fold(target)) {
+            send(other, line);
+            return;
+        }
+    }
+    reply(client, "401", client->nick + ' ' + target + " :No such nick/channel");
+}
+
+void FakeIrcServer::generateTraffic()
+{
+    // Keep to the configured rate however late the timer fires
+    const qint64 due = qint64(m_options.rate * double(m_clock.elapsed()) / 1000.0) - m_sent;
+    if (due <= 0) {
+        return;
+    }
+    m_sent += due;
+
+    QVector<const Channel *> active;
+    for (const Channel &channel : m_channels) {
+        if (!channel.clients.isEmpty() && !channel.users.isEmpty()) {
+            active.append(&channel);
+        }
+    }
+    if (active.isEmpty()) {
+        return;
+    }
+
+    for (qint64 i = 0; i < due; ++i) {
+        const Channel &channel = *active.at(int(m_random.bounded(int(active.size()))));
+        const int user = channel.users.at(int(m_random.bounded(int(channel.users.size()))));
+        if (m_split.at(user)) {
+            continue;
+        }
+        sendToChannel(channel, userPrefix(user) + " PRIVMSG " + channel.name + " :load message "
+                      + QByteArray::number(++m_sequence) + " lorem ipsum dolor sit amet");
+    }
+}
+
+void FakeIrcServer::startNetsplit()
+{
+    QVector<int> split;
+    for (int user = 0; user < m_nicks.size(); ++user) {
+        if (!m_split.at(user) && int(m_random.bounded(100)) < m_options.netsplitPercent) {
+            split.append(user);
+            m_split[user] = true;
+        }
+    }
+    qInfo("Netsplit: %d users leave for %d s", int(split.size()), m_options.netsplitDuration);
+
+    // One QUIT per client that shares at least one channel with the user
+    for (Client *client : m_clients) {
+        for (int user : split) {
+            for (const QByteArray &key : m_userChannels.at(user)) {
+                if (client->channels.contains(key)) {
+                    send(client, userPrefix(user) + " QUIT :irc.east.fake.test irc.west.fake.test");
+                    break;
+                }
+            }
+        }
+    }
+
+    QTimer::singleShot(m_options.netsplitDuration * 1000, this, [this, split]() { endNetsplit(split); });
+}
+
+void FakeIrcServer::endNetsplit(const QVector<int> &users)
+{
+    for (int user : users) {
+        m_split[user] = false;
+        for (const QByteArray &key : m_userChannels.at(user)) {
+            sendToChannel(m_channels[key], userPrefix(user) + " JOIN " + m_channels[key].name);
+        }
+    }
+    for (int user : users) {
+        if (user % 10 != 0) {
+            continue;
+        }
+        const QByteArray modes = user % 50 == 0 ? "+ov " + m_nicks.at(user) + ' ' : QByteArray("+v ");
+        for (const QByteArray &key : m_userChannels.at(user)) {
+            sendToChannel(m_channels[key], ":irc.west.fake.test MODE " + m_channels[key].name + ' '
+                          + modes + m_nicks.at(user));
+        }
+    }
+    qInfo("Netsplit over: %d users back", int(users.size()));
+}
+
+QByteArray FakeIrcServer::tags() const
+{
+    using namespace std::chrono;
+    const qint64 micros = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    const QDateTime time = QDateTime::fromMSecsSinceEpoch(micros / 1000, Qt::UTC);
+    return "@time=" + time.toString(Qt::ISODateWithMs).toLatin1()
+        + ";qtirc.local/sent=" + QByteArray::number(micros) + ' ';
+}
+
+void FakeIrcServer::send(Client *client, const QByteArray &line)
+{
+    QTcpSocket *socket = client->socket;
+    if (socket->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+
+    // A client that cannot keep up is dropped, as a real server would
+    if (socket->bytesToWrite() > m_options.sendQueueLimit) {
+        qWarning("%s: SendQ exceeded", client->nick.constData());
+        socket->write("ERROR :Closing link (SendQ exceeded)\r\n");
+        socket->disconnectFromHost();
+        return;
+    }
+
+    if (m_options.tags) {
+        socket->write(tags());
+    }
+    socket->write(line);
+    socket->write("\r\n");
+}
+
+void FakeIrcServer::sendToChannel(const Channel &channel, const QByteArray &line, Client *except)
+{
+    for (Client *client : channel.clients) {
+        if (client != except) {
+            send(client, line);
+        }
+    }
+}
+
+void FakeIrcServer::reply(Client *client, const char *numeric, const QByteArray &params)
+{
+    send(client, QByteArray(":") + s_serverName + ' ' + numeric + ' ' + params);
+}
+
+QByteArray FakeIrcServer::userPrefix(int user) const
+{
+    return ':' + m_nicks.at(user) + "!~sim@sim" + QByteArray::number(user % 997) + ".fake.test";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Local IRC server stand-in that generates load.");
+    parser.addHelpOption();
+    parser.addOption({ "port", "TCP port to listen on.", "port", "16667" });
+    parser.addOption({ "channels", "Populated channels, #load0 upwards.", "count", "10" });
+    parser.addOption({ "users", "Simulated users spread over the channels.", "count", "1000" });
+    parser.addOption({ "rate", "Channel messages per second, in total.", "msgs", "1000" });
+    parser.addOption({ "netsplit-every", "Seconds between netsplits (0 = none).", "seconds", "0" });
+    parser.addOption({ "netsplit-at", "Netsplit times in seconds, e.g. 10,30,60.", "list" });
+    parser.addOption({ "netsplit-percent", "Share of users lost in a netsplit.", "percent", "30" });
+    parser.addOption({ "netsplit-duration", "Seconds until split users return.", "seconds", "5" });
+    parser.addOption({ "sendq", "Bytes queued for a client before it is dropped.", "bytes", "16777216" });
+    parser.addOption({ "no-tags", "Do not prefix lines with time tags." });
+    parser.addOption({ "tls-cert", "Serve TLS with this certificate (PEM).", "file" });
+    parser.addOption({ "tls-key", "Private key (PEM) of the TLS certificate.", "file" });
+    parser.process(app);
+
+    FakeIrcServer::Options options;
+    options.channels = qMax(0, parser.value("channels").toInt());
+    options.users = qMax(0, parser.value("users").toInt());
+    options.rate = qMax(0.0, parser.value("rate").toDouble());
+    options.netsplitEvery = qMax(0, parser.value("netsplit-every").toInt());
+    for (const QString &seconds : parser.value("netsplit-at").split(',', Qt::SkipEmptyParts)) {
+        options.netsplitAt.append(seconds.toInt());
+    }
+    options.netsplitPercent = qBound(0, parser.value("netsplit-percent").toInt(), 100);
+    options.netsplitDuration = qMax(0, parser.value("netsplit-duration").toInt());
+    options.sendQueueLimit = parser.value("sendq").toLongLong();
+    options.tags = !parser.isSet("no-tags");
+    options.tlsCertificate = parser.value("tls-cert");
+    options.tlsKey = parser.value("tls-key");
+
+    FakeIrcServer server(options);
+    if (!server.listen(quint16(parser.value("port").toUInt()))) {
+        return 1;
+    }
+    return app.exec();
+}
@@ -0,0 +1,159 @@
+// Compares highlight and ignore matching of PRIVMSG lines: one contains()
+// per highlight word and one wildcard regex per ignore mask, as a naive
+// filter would run them, against a compiled IrcFilter.
+//
+//   irc_filter_bench trace.irc [--words 50] [--masks 500] [--repeat 5]
+//
+// The trace is plain server traffic, one line per row, as written by
+// irc_trace_gen. Only its PRIVMSG lines are used. The rules are made up:
+// words of random letters and "nick!*@*" / "*!*@host" masks, none of which
+// occur in generated traffic, so every rule is tried on every line. Each
+// pass is run --repeat times and the fastest run counts.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QVector>
+#include <functional>
+#include "IrcFilter.h"
+#include "IrcMessage.h"
+
+static QString randomWord(QRandomGenerator *random, int length)
+{
+    QString word;
+    for (int i = 0; i < length; ++i) {
+        word.append(QChar('a' + int(random->bounded(26))));
+    }
+    return word;
+}
+
+// Fastest of repeat runs, in ns; sink keeps the results from being optimized out
+static qint64 fastestRun(int repeat, const std::function<qint64()> &pass, qint64 *sink)
+{
+    qint64 best = -1;
+    for (int run = 0; run < repeat; ++run) {
+        QElapsedTimer clock;
+        clock.start();
+        *sink += pass();
+        const qint64 ns = clock.nsecsElapsed();
+        if (best < 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times highlight and ignore matching, per-rule against IrcFilter.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("trace", "Raw server traffic, one IRC line per row.");
+    parser.addOption({ "words", "Highlight words.", "count", "50" });
+    parser.addOption({ "masks", "Ignore masks.", "count", "500" });
+    parser.addOption({ "repeat", "Runs of each pass; the fastest counts.", "count", "5" });
+    parser.process(app);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        parser.showHelp(1);
+    }
+    QFile trace(positional.first());
+    if (!trace.open(QIODevice::ReadOnly)) {
+        qCritical("Cannot open %s: %s", qPrintable(trace.fileName()), qPrintable(trace.errorString()));
+        return 1;
+    }
+    const int repeat = qMax(1, parser.value("repeat").toInt());
+
+    QVector<IrcMessage> messages;
+    while (!trace.atEnd()) {
+        IrcMessage message(trace.readLine());
+        if (message.isCommand("PRIVMSG") && message.paramCount() >= 2) {
+            messages.append(message);
+        }
+    }
+    if (messages.isEmpty()) {
+        qCritical("%s: no PRIVMSG lines", qPrintable(trace.fileName()));
+        return 1;
+    }
+
+    QRandomGenerator random(42);
+    QStringList words;
+    for (int i = parser.value("words").toInt(); i > 0; --i) {
+        words.append(randomWord(&random, 5 + int(random.bounded(6))));
+    }
+    QStringList masks;
+    for (int i = parser.value("masks").toInt(); i > 0; --i) {
+        masks.append(i % 2 ? randomWord(&random, 9) + "!*@*"
+                           : "*!*@" + randomWord(&random, 8) + ".example.net");
+    }
+
+    QElapsedTimer compileClock;
+    compileClock.start();
+    const IrcFilter filter(words, masks);
+    const qint64 compileNs = compileClock.nsecsElapsed();
+
+    QVector<QRegularExpression> regexes;
+    for (const QString &mask : masks) {
+        regexes.append(QRegularExpression(QRegularExpression::wildcardToRegularExpression(mask),
+                                          QRegularExpression::CaseInsensitiveOption));
+        regexes.last().optimize();
+    }
+
+    qint64 sink = 0;
+    const qint64 naive = fastestRun(repeat, [&]() {
+        qint64 hits = 0;
+        for (const IrcMessage &message : messages) {
+            const QString prefix = message.prefix();
+            bool ignored = false;
+            for (const QRegularExpression &regex : regexes) {
+                if (regex.match(prefix).hasMatch()) {
+                    ignored = true;
+                    break;
+                }
+            }
+            if (ignored) {
+                continue;
+            }
+            const QString text = message.param(1);
+            for (const QString &word : words) {
+                if (text.contains(word, Qt::CaseInsensitive)) {
+                    ++hits;
+                    break;
+                }
+            }
+        }
+        return hits;
+    }, &sink);
+    const qint64 compiled = fastestRun(repeat, [&]() {
+        qint64 hits = 0;
+        for (const IrcMessage &message : messages) {
+            if (!filter.ignores(message.prefixBytes())) {
+                hits += filter.highlights(message.paramBytes(1));
+            }
+        }
+        return hits;
+    }, &sink);
+
+    const qint64 count = messages.size();
+    QTextStream out(stdout);
+    auto row = [&](const char *name, qint64 ns) {
+        out << name << QString::number(double(ns) / double(count), 'f', 1) << " ns/message\n";
+    };
+    out << "trace:            " << trace.fileName() << "\n"
+        << "messages:         " << count << "\n"
+        << "rules:            " << words.size() << " words, " << masks.size() << " masks\n"
+        << "compiled:         " << filter.highlightStateCount() << " + " << filter.ignoreStateCount()
+        << " states in " << QString::number(double(compileNs) / 1e6, 'f', 2) << " ms\n";
+    row("per rule:         ", naive);
+    row("IrcFilter:        ", compiled);
+    out << "speedup:          " << QString::number(double(naive) / double(compiled), 'f', 1) << "x\n";
+    out.flush();
+    return sink == 42 ? 2 : 0;
+}
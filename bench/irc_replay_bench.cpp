@@ -0,0 +1,328 @@
+// Replays a raw IRC trace through IrcConnection and reports how fast the
+// client absorbs it.
+//
+// The trace is either plain server traffic, one line per row, or a binary
+// capture written by IRCClient --capture, whose inbound lines are replayed.
+//
+// The trace is read in socket-sized chunks and handed to the session with
+// IrcConnection::injectInput(), so it goes through the real line framing,
+// parser, dispatch tables, channel state and event batching; only the
+// socket is missing. A line's latency is the time from its chunk entering
+// the session to the batch holding its events reaching the GUI side.
+//
+//   irc_replay_bench trace.irc [--chunk 16384] [--batch 1000 --latency 16]
+//                              [--widgets]
+//
+// With --widgets every event is also applied to ChatWidgets, as MainWindow
+// would (use QT_QPA_PLATFORM=offscreen where there is no display).
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QScopedPointer>
+#include <QTextStream>
+#include <QVector>
+#include <QtAlgorithms>
+#include <array>
+#include <cstring>
+#include "ChatWidget.h"
+#include "IrcCapture.h"
+#include "IrcConnection.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+// Log-linear latency histogram: 32 buckets per power of two, so any
+// percentile is within about 3% without storing every sample.
+class LatencyHistogram
+{
+public:
+    void record(quint64 ns, qint64 count)
+    {
+        m_counts[bucketOf(ns)] += count;
+        m_total += count;
+    }
+
+    quint64 percentile(double p) const
+    {
+        const qint64 rank = qint64(p * double(m_total));
+        qint64 seen = 0;
+        for (int bucket = 0; bucket < int(m_counts.size()); ++bucket) {
+            seen += m_counts[bucket];
+            if (seen > rank) {
+                return lowerBound(bucket);
+            }
+        }
+        return 0;
+    }
+
+private:
+    static int bucketOf(quint64 ns)
+    {
+        if (ns < 32) {
+            return int(ns);
+        }
+        const int exponent = 63 - int(qCountLeadingZeroBits(ns));
+        return exponent * 32 + int((ns >> (exponent - 5)) & 31);
+    }
+
+    static quint64 lowerBound(int bucket)
+    {
+        if (bucket < 32) {
+            return quint64(bucket);
+        }
+        return quint64(32 + bucket % 32) << (bucket / 32 - 5);
+    }
+
+    std::array<qint64, 64 * 32> m_counts {};
+    qint64 m_total = 0;
+};
+
+// Applies events to one ChatWidget per channel or query, like MainWindow
+class WidgetSink
+{
+public:
+    ~WidgetSink() { qDeleteAll(m_widgets); }
+
+    void apply(const IrcEventBatch &events)
+    {
+        for (const IrcEvent &event : events) {
+            switch (event.type) {
+                case IrcEvent::Message:
+                    widget(event.targetId, event.target)->addMessage(event.sender, event.text);
+                    break;
+                case IrcEvent::Join:
+                    widget(event.targetId, event.target)->addUser(event.sender);
+                    break;
+                case IrcEvent::Part:
+                    widget(event.targetId, event.target)->removeUser(event.sender);
+                    break;
+                case IrcEvent::Kick:
+                    widget(event.targetId, event.target)->removeUser(event.argument);
+                    break;
+                case IrcEvent::Quit:
+                    for (IrcStringPool::Id channel : event.channels) {
+                        if (ChatWidget *chat = m_widgets.value(channel, nullptr)) {
+                            chat->addSystemMessage(QString("%1 has quit (%2)").arg(event.sender, event.text));
+                            chat->removeUser(event.sender);
+                        }
+                    }
+                    break;
+                case IrcEvent::NickChange:
+                    for (IrcStringPool::Id channel : event.channels) {
+                        if (ChatWidget *chat = m_widgets.value(channel, nullptr)) {
+                            chat->renameUser(event.sender, event.target);
+                        }
+                    }
+                    break;
+                case IrcEvent::Names:
+                    widget(event.targetId, event.target)->setUserList(event.names);
+                    break;
+                case IrcEvent::Prefixes:
+                    widget(event.targetId, event.target)->setUserPrefixes(event.argument, event.text);
+                    break;
+                case IrcEvent::Topic:
+                    widget(event.targetId, event.target)->setTopic(event.text);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+private:
+    ChatWidget *widget(IrcStringPool::Id id, const QString &name)
+    {
+        ChatWidget *&chat = m_widgets[id];
+        if (!chat) {
+            chat = new ChatWidget(name);
+        }
+        return chat;
+    }
+
+    QHash<IrcStringPool::Id, ChatWidget *> m_widgets;
+};
+
+static qint64 peakRssKiB()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MACOS
+        return qint64(usage.ru_maxrss) / 1024;  // bytes on macOS
+#else
+        return qint64(usage.ru_maxrss);         // KiB elsewhere
+#endif
+    }
+#endif
+    return -1;
+}
+
+static int countLines(const QByteArray &chunk)
+{
+    int lines = 0;
+    const char *data = chunk.constData();
+    const char *end = data + chunk.size();
+    while ((data = static_cast<const char *>(memchr(data, '\n', size_t(end - data))))) {
+        ++lines;
+        ++data;
+    }
+    return lines;
+}
+
+int main(int argc, char *argv[])
+{
+    bool widgets = false;
+    for (int i = 1; i < argc; ++i) {
+        widgets = widgets || strcmp(argv[i], "--widgets") == 0;
+    }
+    QScopedPointer<QCoreApplication> app(widgets ? new QApplication(argc, argv)
+                                                 : new QCoreApplication(argc, argv));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a raw IRC trace through IrcConnection.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("trace", "Raw server traffic, one IRC line per row, or a capture.");
+    parser.addOption({ "chunk", "Bytes handed to the session per read.", "bytes", "16384" });
+    parser.addOption({ "batch", "Events per batch delivered to the GUI side.", "events", "1000" });
+    parser.addOption({ "latency", "Longest wait before a partial batch is delivered.", "ms", "16" });
+    parser.addOption({ "widgets", "Also apply every event to ChatWidgets." });
+    parser.addOption({ "verbose", "Log every line (irc.traffic)." });
+    parser.process(*app);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        parser.showHelp(1);
+    }
+    QFile trace(positional.first());
+    if (!trace.open(QIODevice::ReadOnly)) {
+        qCritical("Cannot open %s: %s", qPrintable(trace.fileName()), qPrintable(trace.errorString()));
+        return 1;
+    }
+
+    if (parser.isSet("verbose")) {
+        QLoggingCategory::setFilterRules("irc.traffic.debug=true");
+    }
+
+    const int chunkSize = qMax(1, parser.value("chunk").toInt());
+
+    // Captures are turned back into raw server traffic, chunk by chunk
+    QScopedPointer<IrcCaptureReader> capture;
+    if (IrcCapture::isCapture(&trace)) {
+        capture.reset(new IrcCaptureReader(&trace));
+        if (!capture->readHeader()) {
+            qCritical("%s: unsupported capture version", qPrintable(trace.fileName()));
+            return 1;
+        }
+    }
+    IrcCapture::Record record;
+    auto nextChunk = [&]() {
+        if (!capture) {
+            return trace.read(chunkSize);
+        }
+        QByteArray chunk;
+        while (chunk.size() < chunkSize && capture->next(&record)) {
+            if (record.direction == IrcCapture::Inbound) {
+                chunk += record.line;
+                chunk += "\r\n";
+            }
+        }
+        return chunk;
+    };
+
+    // No network thread: each chunk is parsed inside injectInput() and its
+    // batches arrive through the event loop, as they would on the GUI side
+    IrcConnection connection(nullptr, false);
+    connection.setBatchLimits(parser.value("batch").toInt(), parser.value("latency").toInt());
+    QCoreApplication::processEvents();
+
+    struct PendingChunk
+    {
+        qint64 startNs;
+        int lines;
+    };
+    QVector<PendingChunk> pending;
+    LatencyHistogram latencies;
+    QElapsedTimer clock;
+    qint64 events = 0;
+    qint64 batches = 0;
+    QScopedPointer<WidgetSink> sink(widgets ? new WidgetSink : nullptr);
+
+    QObject::connect(&connection, &IrcConnection::eventsReady,
+            [&](const IrcEventBatch &batch) {
+        // Everything injected so far has been parsed and drained
+        const qint64 now = clock.nsecsElapsed();
+        for (const PendingChunk &chunk : pending) {
+            latencies.record(quint64(now - chunk.startNs), chunk.lines);
+        }
+        pending.clear();
+        events += batch.size();
+        ++batches;
+        if (sink) {
+            sink->apply(batch);
+        }
+    });
+
+    qint64 totalLines = 0;
+    qint64 totalBytes = 0;
+    qint64 busyNs = 0;
+    clock.start();
+    for (;;) {
+        // Reading the trace is not part of the measurement
+        const qint64 readStart = clock.nsecsElapsed();
+        const QByteArray chunk = nextChunk();
+        if (chunk.isEmpty()) {
+            break;
+        }
+        const int lines = countLines(chunk);
+        const qint64 start = clock.nsecsElapsed();
+        busyNs -= start - readStart;
+
+        connection.injectInput(chunk);
+        pending.append({ start, lines });
+        QCoreApplication::processEvents();
+
+        totalLines += lines;
+        totalBytes += chunk.size();
+    }
+
+    busyNs += clock.nsecsElapsed();
+
+    // Let the last partial batch go out; trailing lines that produced no
+    // events at all are counted as absorbed now
+    QElapsedTimer wait;
+    wait.start();
+    while (!pending.isEmpty() && wait.elapsed() < parser.value("latency").toInt() + 1000) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 10);
+    }
+    for (const PendingChunk &chunk : pending) {
+        latencies.record(quint64(clock.nsecsElapsed() - chunk.startNs), chunk.lines);
+    }
+
+    const double seconds = double(busyNs) / 1e9;
+    const IrcStringPool::Stats strings = connection.strings().stats();
+    QTextStream out(stdout);
+    out << "trace:        " << trace.fileName() << "\n"
+        << "lines:        " << totalLines << " (" << totalBytes << " bytes)\n"
+        << "elapsed:      " << QString::number(seconds, 'f', 3) << " s\n"
+        << "throughput:   " << qint64(double(totalLines) / seconds) << " lines/s, "
+        << QString::number(double(totalBytes) / seconds / (1024 * 1024), 'f', 1) << " MiB/s\n"
+        << "latency p50:  " << QString::number(double(latencies.percentile(0.50)) / 1000, 'f', 1) << " us\n"
+        << "latency p99:  " << QString::number(double(latencies.percentile(0.99)) / 1000, 'f', 1) << " us\n"
+        << "events:       " << events << " in " << batches << " batches\n"
+        << "interned:     " << strings.uniqueStrings << " names, "
+        << strings.savedBytes() / 1024 << " KiB saved over " << strings.lookups << " lookups\n"
+        << "peak RSS:     ";
+    const qint64 rss = peakRssKiB();
+    if (rss >= 0) {
+        out << rss << " KiB\n";
+    } else {
+        out << "n/a\n";
+    }
+    return 0;
+}
@@ -0,0 +1,288 @@
+// Writes synthetic raw IRC traffic for irc_replay_bench.
+//
+//   irc_trace_gen --scenario privmsg|names|netsplit|mixed [--lines 1000000]
+//                 [--channels 20] [--users 20000] [--seed 1] [-o trace.irc]
+//                 [--legacy-percent 0]
+//
+// Every trace starts as a server would greet the nick "bench": RPL_WELCOME,
+// RPL_ISUPPORT, then a JOIN, topic and full NAMES reply for each channel.
+// After that the scenario repeats until at least --lines lines are written:
+//
+//   privmsg   channel messages from random members, a few of them ACTIONs
+//   names     the NAMES reply of one channel holding every user, again and
+//             again (a 20k-user channel is about 600 RPL_NAMREPLY lines)
+//   netsplit  half the users QUIT at once and then JOIN back, with the
+//             usual burst of +o/+v for the returning operators
+//   mixed     all of the above interleaved, plus nick changes
+//
+// --legacy-percent adds a Windows-1252 word to that share of the channel
+// messages, as old clients send, for irc_decode_bench's fallback path.
+//
+// The same seed always gives the same trace.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QVector>
+
+class TraceWriter
+{
+public:
+    TraceWriter(QFile *out, int channels, int users, bool oneChannel, quint32 seed);
+
+    qint64 lines() const { return m_lines; }
+    int randomChannel() { return int(m_random.bounded(m_channels.size())); }
+    void setLegacyPercent(int percent) { m_legacyPercent = percent; }
+    void flush();
+
+    void writeWelcome();
+    void writePrivmsgs(int count);
+    void writeNames(int channel);
+    void writeNetsplit(int percent);
+    void writeNickChanges(int count);
+
+private:
+    void writeLine(const QByteArray &line);
+    QByteArray prefix(int user) const;
+    QByteArray sentence(int minWords, int maxWords);
+
+    QFile *m_out;
+    QRandomGenerator m_random;
+    QVector<QByteArray> m_channels;
+    QVector<QByteArray> m_nicks;
+    QVector<QVector<int>> m_members;        // channel -> users
+    QVector<QVector<int>> m_userChannels;   // user -> channels
+    QByteArray m_buffer;
+    qint64 m_lines;
+    int m_legacyPercent = 0;
+};
+
+static const char *const s_words[] = {
+    "the", "a", "is", "it", "that", "to", "of", "and", "in", "you", "for", "on",
+    "with", "this", "build", "works", "broken", "patch", "kernel", "why", "does",
+    "anyone", "know", "how", "server", "client", "latency", "thread", "queue",
+    "merge", "release", "lol", "ok", "thanks", "yes", "no", "maybe", "tomorrow",
+    "benchmark", "regression",
+    "\xc3\xbc" "ber", "na\xc3\xafve", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", "\xf0\x9f\x99\x82",
+};
+
+TraceWriter::TraceWriter(QFile *out, int channels, int users, bool oneChannel, quint32 seed)
+    : m_out(out)
+    , m_random(seed)
+    , m_lines(0)
+{
+    for (int i = 0; i < channels; ++i) {
+        m_channels.append("#channel" + QByteArray::number(i));
+    }
+    m_members.resize(channels);
+    m_userChannels.resize(users);
+
+    for (int user = 0; user < users; ++user) {
+        // Mixed case, so the client's CASEMAPPING folding is exercised
+        m_nicks.append((user % 3 == 0 ? "User" : "user") + QByteArray::number(user, 36));
+
+        // Everyone shares one to three channels with us
+        const int joined = oneChannel ? 1 : 1 + int(m_random.bounded(qMin(3, channels)));
+        for (int i = 0; i < joined; ++i) {
+            const int channel = oneChannel ? 0 : int(m_random.bounded(channels));
+            if (!m_userChannels[user].contains(channel)) {
+                m_userChannels[user].append(channel);
+                m_members[channel].append(user);
+            }
+        }
+    }
+}
+
+void TraceWriter::writeLine(const QByteArray &line)
+{
+    m_buffer += line;
+    m_buffer += "\r\n";
+    ++m_lines;
+    if (m_buffer.size() >= 1024 * 1024) {
+        m_out->write(m_buffer);
+        m_buffer.clear();
+    }
+}
+
+void TraceWriter::flush()
+{
+    m_out->write(m_buffer);
+    m_buffer.clear();
+    m_out->flush();
+}
+
+QByteArray TraceWriter::prefix(int user) const
+{
+    return ':' + m_nicks.at(user) + "!~u@" + QByteArray::number(user % 997) + ".users.bench.test";
+}
+
+QByteArray TraceWriter::sentence(int minWords, int maxWords)
+{
+    const int words = minWords + int(m_random.bounded(maxWords - minWords + 1));
+    const int vocabulary = int(sizeof(s_words) / sizeof(s_words[0]));
+    QByteArray text;
+    for (int i = 0; i < words; ++i) {
+        if (i > 0) {
+            text += ' ';
+        }
+        text += s_words[m_random.bounded(vocabulary)];
+    }
+    return text;
+}
+
+void TraceWriter::writeWelcome()
+{
+    writeLine(":irc.bench.test 001 bench :Welcome to the bench network bench");
+    writeLine(":irc.bench.test 005 bench CASEMAPPING=rfc1459 PREFIX=(qaohv)~&@%+ "
+              "CHANMODES=beI,k,l,imnpst CHANTYPES=# NICKLEN=30 :are supported by this server");
+    for (int channel = 0; channel < m_channels.size(); ++channel) {
+        writeLine(":bench!~bench@bench.test JOIN " + m_channels.at(channel));
+        writeLine(":irc.bench.test 332 bench " + m_channels.at(channel) + " :" + sentence(4, 12));
+        writeNames(channel);
+    }
+}
+
+void TraceWriter::writeNames(int channel)
+{
+    const QByteArray head = ":irc.bench.test 353 bench = " + m_channels.at(channel) + " :";
+    QByteArray line = head + "@bench";
+    for (int user : m_members.at(channel)) {
+        QByteArray name;
+        if (user % 50 == 0) {
+            name += '@';
+        }
+        if (user % 10 == 0) {
+            name += '+';
+        }
+        name += m_nicks.at(user);
+
+        if (line.size() + 1 + name.size() > 510) {
+            writeLine(line);
+            line = head + name;
+        } else {
+            line += ' ' + name;
+        }
+    }
+    writeLine(line);
+    writeLine(":irc.bench.test 366 bench " + m_channels.at(channel) + " :End of /NAMES list.");
+}
+
+void TraceWriter::writePrivmsgs(int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const int channel = randomChannel();
+        const QVector<int> &members = m_members.at(channel);
+        if (members.isEmpty()) {
+            continue;
+        }
+        const int user = members.at(int(m_random.bounded(members.size())));
+        QByteArray text = sentence(3, 40);
+        if (m_random.bounded(20) == 0) {
+            text = "\001ACTION " + text + '\001';
+        }
+        // Only draws when enabled, so existing seeds give the same traces
+        if (m_legacyPercent > 0 && int(m_random.bounded(100)) < m_legacyPercent) {
+            text += " caf\xe9 \x93quoted\x94";
+        }
+        writeLine(prefix(user) + " PRIVMSG " + m_channels.at(channel) + " :" + text);
+    }
+}
+
+void TraceWriter::writeNetsplit(int percent)
+{
+    QVector<int> split;
+    for (int user = 0; user < m_nicks.size(); ++user) {
+        if (int(m_random.bounded(100)) < percent) {
+            split.append(user);
+        }
+    }
+
+    for (int user : split) {
+        writeLine(prefix(user) + " QUIT :irc.east.bench.test irc.west.bench.test");
+    }
+
+    // The servers reconnect and everyone comes back, operators reopped
+    for (int user : split) {
+        for (int channel : m_userChannels.at(user)) {
+            writeLine(prefix(user) + " JOIN " + m_channels.at(channel));
+        }
+    }
+    for (int user : split) {
+        if (user % 10 != 0) {
+            continue;
+        }
+        for (int channel : m_userChannels.at(user)) {
+            const QByteArray modes = user % 50 == 0 ? "+ov " + m_nicks.at(user) + ' ' : QByteArray("+v ");
+            writeLine(":irc.west.bench.test MODE " + m_channels.at(channel) + ' ' + modes + m_nicks.at(user));
+        }
+    }
+}
+
+void TraceWriter::writeNickChanges(int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const int user = int(m_random.bounded(m_nicks.size()));
+        const QByteArray renamed = m_nicks.at(user).endsWith('_') ? m_nicks.at(user).chopped(1)
+                                                                  : m_nicks.at(user) + '_';
+        writeLine(prefix(user) + " NICK :" + renamed);
+        m_nicks[user] = renamed;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Writes synthetic IRC server traffic for irc_replay_bench.");
+    parser.addHelpOption();
+    parser.addOption({ "scenario", "privmsg, names, netsplit or mixed.", "name", "mixed" });
+    parser.addOption({ "lines", "Lines to write, at least.", "count", "1000000" });
+    parser.addOption({ "channels", "Channels joined (names uses one).", "count", "20" });
+    parser.addOption({ "users", "Distinct users on the network.", "count", "20000" });
+    parser.addOption({ "seed", "Random seed.", "number", "1" });
+    parser.addOption({ "legacy-percent", "Channel messages with Windows-1252 text.", "percent", "0" });
+    parser.addOption({ { "o", "output" }, "Trace file to write (default: stdout).", "file" });
+    parser.process(app);
+
+    const QString scenario = parser.value("scenario");
+    if (!QStringList({ "privmsg", "names", "netsplit", "mixed" }).contains(scenario)) {
+        qCritical("Unknown scenario %s", qPrintable(scenario));
+        return 1;
+    }
+    const qint64 lines = parser.value("lines").toLongLong();
+    const int channels = qMax(1, parser.value("channels").toInt());
+    const int users = qMax(1, parser.value("users").toInt());
+
+    QFile out;
+    const bool opened = parser.isSet("output")
+        ? (out.setFileName(parser.value("output")), out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        : out.open(stdout, QIODevice::WriteOnly);
+    if (!opened) {
+        qCritical("Cannot write trace: %s", qPrintable(out.errorString()));
+        return 1;
+    }
+
+    const bool names = scenario == "names";
+    TraceWriter writer(&out, names ? 1 : channels, users, names, parser.value("seed").toUInt());
+    writer.setLegacyPercent(qBound(0, parser.value("legacy-percent").toInt(), 100));
+    writer.writeWelcome();
+    while (writer.lines() < lines) {
+        if (scenario == "privmsg") {
+            writer.writePrivmsgs(1000);
+        } else if (names) {
+            writer.writeNames(0);
+        } else if (scenario == "netsplit") {
+            writer.writeNetsplit(50);
+        } else {
+            writer.writePrivmsgs(5000);
+            writer.writeNickChanges(50);
+            writer.writeNetsplit(10);
+            writer.writeNames(writer.randomChannel());
+        }
+    }
+    writer.flush();
+    return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef CHANNELSTATE_H
+#define CHANNELSTATE_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "IrcPrefixSupport.h"
+#include "IrcStringPool.h"
+
+// Membership of every channel we are in, independent of any widget.
+//
+// IrcSession keeps one of these and turns protocol traffic into diffs:
+// NAMES chunks are buffered until RPL_ENDOFNAMES and committed at once, and
+// a reverse nick -> channels index lets QUIT and NICK touch only the
+// channels that user shares with us. Channel and nick keys are folded
+// with the server's CASEMAPPING, so "#Foo" and "#foo" are one channel.
+class ChannelState
+{
+public:
+    typedef IrcStringPool::Id Id;
+
+    struct PrefixChange
+    {
+        Id nick;
+        QString prefixes;
+    };
+
+    explicit ChannelState(IrcStringPool *strings);
+
+    // RPL_ISUPPORT tokens
+    void setCaseMapping(const QString &mapping);
+    void setPrefixSupport(const QString &prefix);
+    void setChannelModes(const QString &chanmodes);
+    void setChannelTypes(const QString &chantypes);
+    const IrcPrefixSupport &prefixSupport() const { return m_prefixes; }
+    // One "KEY=value" token; those above are taken, the rest ignored
+    void applyISupport(const QString &token);
+    QString foldCase(const QString &name) const;
+    // Whether name starts with one of the CHANTYPES, i.e. is not a nick
+    bool isChannel(const QString &name) const;
+
+    void clear();
+
+    // Id of the name a channel was joined under, for any spelling of it.
+    // Unknown channels map to themselves.
+    Id channelId(Id name) const;
+    bool sameName(Id a, Id b) const { return a == b || key(a) == key(b); }
+    bool contains(Id channel) const;
+    QVector<Id> channels() const;
+    QStringList members(Id channel) const;
+    QVector<Id> channelsOf(Id nick) const;
+
+    // JOIN creates the channel when nick is us; PART and KICK of us drop it
+    void join(Id channel, Id nick, bool self);
+    void part(Id channel, Id nick, bool self);
+    // QUIT and NICK return the channels that saw the change
+    QVector<Id> quit(Id nick);
+    QVector<Id> rename(Id oldNick, Id newNick);
+
+    // RPL_NAMREPLY chunks, then RPL_ENDOFNAMES: returns the whole list as
+    // "[prefixes]nick" once it is complete
+    void addNames(Id channel, const QStringList &names);
+    QStringList endNames(Id channel);
+
+    // Channel MODE: modes is the mode string followed by its arguments.
+    // Returns the members whose prefixes changed.
+    QVector<PrefixChange> applyMode(Id channel, const QStringList &modes);
+    // Prefixes worked out elsewhere, e.g. those of an IrcEvent::Prefixes
+    void setPrefixes(Id channel, Id nick, const QString &prefixes);
+
+private:
+    struct Member
+    {
+        Id nick;
+        QString prefixes;
+    };
+    struct Channel
+    {
+        Id name;
+        QHash<QString, Member> members;  // by folded nick
+    };
+
+    QString key(Id id) const;
+    void addMember(Channel &channel, const QString &channelKey, Id nick, const QString &prefixes);
+    void removeMember(Channel &channel, const QString &channelKey, const QString &nickKey);
+    void unlinkNick(const QString &nickKey, const QString &channelKey);
+
+    IrcStringPool *m_strings;
+    QHash<QString, Channel> m_channels;                // by folded channel name
+    QHash<QString, QVector<QString>> m_nickChannels;   // folded nick -> folded channels
+    QHash<QString, QStringList> m_pendingNames;        // NAMES chunks not yet ended
+    mutable QHash<Id, QString> m_keys;                 // folded form of recent ids, bounded
+
+    ushort m_foldLimit;  // last uppercase character folded by CASEMAPPING
+    IrcPrefixSupport m_prefixes;
+    QString m_listModes;       // CHANMODES type A: always take an argument
+    QString m_settingModes;    // type B: always take an argument
+    QString m_paramModes;      // type C: take an argument when set
+    QString m_channelTypes;
+};
+
+#endif // CHANNELSTATE_H
@@ -2,13 +2,32 @@
 #define CHATWIDGET_H
 
 #include <QWidget>
-#include <QTextEdit>
+#include <QListView>
 #include <QLineEdit>
-#include <QListWidget>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QSplitter>
+#include <QStringList>
+#include <QTimer>
+#include "CompletionIndex.h"
+#include "LogStore.h"
+#include "MessageLogModel.h"
+#include "NickListModel.h"
+#include "SessionSnapshot.h"
 
+class MessageDelegate;
+
+// One channel, query or server buffer.
+//
+// Lines, nicks and topic live in the models, which is all a buffer costs
+// until it is first shown: the views are only built then. Lines are moved
+// into the model at most frameRate() times a second while the buffer is
+// visible and once a second while it is not. A hidden buffer counts what
+// arrived instead, for the buffer list.
+//
+// Tab in the input line completes a nick (most recent speakers first), a
+// #channel of the network, or a /command at the start of the line; Tab
+// again cycles through the candidates.
 class ChatWidget : public QWidget
 {
     Q_OBJECT
@@ -17,29 +36,103 @@ public:
     explicit ChatWidget(const QString &channelName, QWidget *parent = nullptr);
     
     QString getChannelName() const { return m_channelName; }
-    void addMessage(const QString &sender, const QString &message);
+    // sentTime: when the server sent the line, in us since the epoch, if known;
+    // highlight: the line mentions us
+    void addMessage(const QString &sender, const QString &message, qint64 sentTime = 0, bool highlight = false);
     void addSystemMessage(const QString &message);
     void setUserList(const QStringList &users);
     void addUser(const QString &user);
     void removeUser(const QString &user);
+    void renameUser(const QString &oldNick, const QString &newNick);
+    void setUserPrefixes(const QString &user, const QString &prefixes) { m_users->setPrefixes(user, prefixes); }
+    bool hasUser(const QString &user) const;
+    // PREFIX from RPL_ISUPPORT, used to rank the user list
+    void setPrefixSupport(const QString &prefix) { m_users->setPrefixSupport(prefix); }
     void setTopic(const QString &topic);
+    // The network's joined channels, for completing #words; not owned
+    void setChannelCompletion(const CompletionIndex *channels) { m_channels = channels; }
+    
+    // Lines of scrollback kept; older lines are dropped
+    void setScrollbackLimit(int lines);
+    // Lines are also written to store, and scrolling to the top pages
+    // older ones back in from it
+    void setLogStore(LogStore *store);
+    
+    // The last lines, members and topic, and putting them back on the next
+    // start. Restored lines are not written to the store again: those of a
+    // saved session are in it already. History pages in from above them.
+    SessionSnapshot::Buffer snapshot(int lines) const;
+    void restore(const SessionSnapshot::Buffer &buffer);
+    
+    // Messages and highlights that arrived while hidden; reset when shown
+    int unreadCount() const { return m_unread; }
+    int highlightCount() const { return m_highlights; }
+    
+    // Cap on repaints of visible buffers, shared by all of them
+    static void setFrameRate(int fps);
+    static int frameRate();
 
 signals:
     void messageSent(const QString &message);
+    void activityChanged();
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
 
 private slots:
     void onSendMessage();
+    void flushPendingLines();
+    void onScrolled(int value);
 
 private:
     void setupUi();
-    QString formatMessage(const QString &sender, const QString &message);
-    QString getCurrentTime();
+    void appendEntry(MessageLogModel::Kind kind, const QString &sender, const QString &text);
+    void loadOlderLines();
+    // Rows went off the top, so the cursor no longer matches row 0
+    void dropHistoryCursor(int droppedRows);
+    void completeInput();
+    static const CompletionIndex &commandCompletion();
 
     QString m_channelName;
-    QTextEdit *m_chatDisplay;
+    MessageLogModel *m_log;
+    NickListModel *m_users;
+    CompletionIndex m_nicks;  // the members, ranked by who spoke last
+    const CompletionIndex *m_channels;
+    QString m_topic;
+    
+    // Built on first show; null until then
+    QListView *m_chatDisplay;
+    MessageDelegate *m_delegate;
     QLineEdit *m_inputLine;
-    QListWidget *m_userList;
+    QListView *m_userList;
     QLabel *m_topicLabel;
+    
+    // Lines added since the last flush are appended together
+    QVector<MessageLogModel::Entry> m_pendingEntries;
+    QVector<qint64> m_pendingSentTimes;  // of the tagged lines among them
+    QTimer *m_flushTimer;
+    
+    // The candidates of the last Tab, replacing [m_completionStart,
+    // m_completionEnd) of m_completedText if Tab is pressed again
+    QStringList m_completions;
+    int m_completionIndex;
+    int m_completionStart;
+    int m_completionEnd;
+    QString m_completedText;
+    
+    int m_unread;
+    int m_highlights;
+    bool m_activityChanged;  // since the last activityChanged()
+    
+    LogStore *m_store;
+    int m_scrollbackLimit;
+    bool m_historyExhausted;  // the store has nothing older than row 0
+    bool m_historyPending;    // first page of history waits for the view
+    // Where row 0 is in the store once history has been paged in; while
+    // null, the next page is found by counting the rows back from the end
+    LogStore::Cursor m_historyCursor;
+    int m_unloggedRows;       // rows restored from a core, not in the store
 };
 
 #endif // CHATWIDGET_H
@@ -0,0 +1,54 @@
+#ifndef COMPLETIONINDEX_H
+#define COMPLETIONINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Words offered by tab completion: the members of a channel, the channels
+// of a network, or the client's commands.
+//
+// Words are kept in a vector sorted by their case-folded form, so the
+// words starting with a prefix are one contiguous range found by binary
+// search, and adding, removing or renaming one moves only the tail of a
+// flat array. Recency is kept apart, as a short list of the words touched
+// last, so ranking never looks at the rest: completing in a 20k-member
+// channel costs one binary search, a walk over RecentLimit words, and one
+// step per candidate returned.
+class CompletionIndex
+{
+public:
+    enum { RecentLimit = 128 };
+
+    void reset(const QStringList &words);
+    void clear();
+    void add(const QString &word);
+    void remove(const QString &word);
+    void rename(const QString &oldWord, const QString &newWord);
+    // word was just used, e.g. its owner spoke; ranks it first from now on.
+    // Words not in the index are left alone.
+    void touch(const QString &word);
+
+    bool contains(const QString &word) const { return find(word) >= 0; }
+    int size() const { return int(m_entries.size()); }
+
+    // At most limit words starting with prefix, ignoring case: the most
+    // recently touched first, then the rest in alphabetical order
+    QStringList complete(const QString &prefix, int limit = 50) const;
+
+private:
+    struct Entry
+    {
+        QString key;   // case-folded
+        QString word;
+    };
+
+    static bool lessThan(const Entry &entry, const QString &key, const QString &word);
+    int lowerBound(const QString &key, const QString &word) const;
+    int find(const QString &word) const;
+
+    QVector<Entry> m_entries;  // sorted by (key, word)
+    QStringList m_recent;      // most recently touched last
+};
+
+#endif // COMPLETIONINDEX_H
@@ -0,0 +1,154 @@
+#ifndef DCCENGINE_H
+#define DCCENGINE_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include "DccMessage.h"
+
+class QSocketNotifier;
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+
+// What the GUI sees of one DCC file transfer
+struct DccTransfer
+{
+    enum Direction : quint8 {
+        Send,
+        Receive
+    };
+
+    enum State : quint8 {
+        Queued,      // waiting for a free slot
+        Listening,   // our SEND is out, waiting for the peer to connect
+        Resuming,    // our RESUME is out, waiting for the peer's ACCEPT
+        Connecting,
+        Running,
+        Done,
+        Failed,
+        Cancelled
+    };
+
+    int id = 0;
+    Direction direction = Send;
+    State state = Queued;
+    QString peer;             // nick, as given when the transfer was made
+    QString fileName;         // as offered
+    QString path;             // local file
+    qint64 size = -1;
+    qint64 position = 0;      // bytes of the file done, a resumed part included
+    qint64 resumedFrom = 0;
+    qint64 bytesPerSecond = 0;
+    qint64 rateLimit = 0;     // bytes per second, 0 = only the global cap
+    QString error;
+
+    bool isFinished() const { return state >= Done; }
+    // "#3 send of core.gz to bob: 41% of 1.2 GiB, 85.0 MiB/s"
+    QString describe() const;
+    static QString stateName(State state);
+    static QString formatBytes(qint64 bytes);
+    // Where a receive to path keeps its bytes until the file is complete
+    static QString partialPath(const QString &path);
+};
+
+Q_DECLARE_METATYPE(DccTransfer)
+
+struct DccOptions
+{
+    QString downloadDirectory;   // empty: the system's download location
+    QHostAddress address;        // advertised in our SENDs; null: the IRC socket's
+    quint16 firstPort = 0;       // listening ports; 0: any free port
+    quint16 lastPort = 0;
+    int maxActive = 3;           // transfers under way at once; the rest queue
+    qint64 rateLimit = 0;        // all transfers together, bytes per second; 0 = none
+};
+
+// Moves the bytes of DCC transfers, on the thread DccManager gives it.
+//
+// Sends go straight from the page cache to the socket with sendfile() on
+// Linux; elsewhere the file is mapped and written a window at a time.
+// Receives are read into a large page-aligned buffer and written out a
+// full buffer at a time. A 100 ms tick hands every transfer its share of
+// the global cap and its own, and a transfer out of budget simply stops
+// reading or writing until the next tick; TCP flow control does the rest.
+//
+// Every method here runs on the engine's thread.
+class DccEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DccEngine(const DccOptions &options, QObject *parent = nullptr);
+    ~DccEngine();
+
+    // Listens for the peer; the SEND comes back through requestReady()
+    void sendFile(int id, const QString &peer, const QString &path, const QHostAddress &address);
+    // Written to partialPath(path) and renamed to path when complete.
+    // resume: continue that partial file with a RESUME request first
+    void receiveFile(int id, const QString &peer, const DccMessage &offer, const QString &path, bool resume);
+    // The peer's RESUME for one of our sends, and its ACCEPT for our RESUME
+    void resumeRequested(const QString &peer, const DccMessage &resume);
+    void resumeAccepted(const QString &peer, const DccMessage &accept);
+    void cancel(int id);
+    void setRateLimit(int id, qint64 bytesPerSecond);
+    void setGlobalRateLimit(qint64 bytesPerSecond);
+
+signals:
+    // State changes, and progress every half second while running
+    void transferChanged(const DccTransfer &transfer);
+    // A CTCP request the GUI has to send to the transfer's peer
+    void requestReady(const DccTransfer &transfer, const DccMessage &request);
+
+private:
+    struct Job
+    {
+        DccTransfer info;
+        QFile file;
+        QHostAddress address;    // receive: where the sender listens
+        quint16 port = 0;        // the port named in the transfer's requests
+        QString token;
+        QTcpServer *server = nullptr;
+        QTcpSocket *socket = nullptr;
+        QSocketNotifier *writable = nullptr;  // sendfile() path
+        char *buffer = nullptr;  // receive: page-aligned, BufferSize bytes
+        int buffered = 0;
+        qint64 budget = -1;      // bytes left until the next tick; -1 = unlimited
+        QByteArray acks;         // partial 4-byte acknowledgements
+        qint64 acknowledged = 0;
+        qint64 reportedPosition = 0;
+        QElapsedTimer clock;     // since the last state change or report
+        QElapsedTimer running;   // since the data started moving
+    };
+
+    void start(Job *job);
+    void listen(Job *job);
+    void connectToSender(Job *job);
+    void onIncomingConnection(Job *job);
+    void pumpSend(Job *job);
+    void pumpReceive(Job *job);
+    void readAcknowledgements(Job *job);
+    void onSocketClosed(Job *job);
+    bool flushBuffer(Job *job);
+    void finish(Job *job, DccTransfer::State state, const QString &error = QString());
+    void setState(Job *job, DccTransfer::State state);
+    void startQueued();
+    void onTick();
+    qint64 tickBudget(const Job *job) const;
+    qint64 allowance(const Job *job, qint64 wanted) const;
+    void consume(Job *job, qint64 bytes);
+    int activeCount() const;
+    Job *findByPort(DccTransfer::Direction direction, const QString &peer, quint16 port,
+                    DccTransfer::State state) const;
+
+    DccOptions m_options;
+    QHash<int, Job*> m_jobs;
+    QList<int> m_queue;   // ids waiting for a slot, oldest first
+    QTimer *m_tick;
+};
+
+#endif // DCCENGINE_H
@@ -0,0 +1,59 @@
+#ifndef DCCMANAGER_H
+#define DCCMANAGER_H
+
+#include <QObject>
+#include <QString>
+#include "DccEngine.h"
+
+class QThread;
+
+// Application-wide front end to DCC file transfers.
+//
+// The transfers run in a DccEngine on a thread of their own, so moving a
+// multi-gigabyte file never competes with the GUI. Calls are queued to that
+// thread and return at once; results come back as signals on the manager's
+// thread. Transfer ids are unique across networks, and each
+// NetworkController picks out its own.
+class DccManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DccManager(const DccOptions &options, QObject *parent = nullptr);
+    // Partial receives are written out before this returns
+    ~DccManager();
+
+    // The application's manager, created on first use with the default
+    // options and owned by the QCoreApplication
+    static DccManager *shared();
+    // Only has an effect before the shared manager is created
+    static void setDefaultOptions(const DccOptions &options);
+    static DccOptions defaultOptions();
+
+    // Where offered files are saved
+    QString downloadDirectory() const;
+    qint64 globalRateLimit() const { return m_options.rateLimit; }
+
+    // Each returns the id of the new transfer. address is ours on the
+    // network the peer is on, unless the options name one.
+    int sendFile(const QString &peer, const QString &path, const QHostAddress &address);
+    int receiveFile(const QString &peer, const DccMessage &offer, const QString &path, bool resume);
+    void resumeRequested(const QString &peer, const DccMessage &resume);
+    void resumeAccepted(const QString &peer, const DccMessage &accept);
+    void cancel(int id);
+    // Bytes per second; 0 lifts the cap
+    void setRateLimit(int id, qint64 bytesPerSecond);
+    void setGlobalRateLimit(qint64 bytesPerSecond);
+
+signals:
+    void transferChanged(const DccTransfer &transfer);
+    void requestReady(const DccTransfer &transfer, const DccMessage &request);
+
+private:
+    DccOptions m_options;
+    QThread *m_thread;
+    DccEngine *m_engine;  // lives on m_thread
+    int m_nextId;
+};
+
+#endif // DCCMANAGER_H
@@ -0,0 +1,50 @@
+#ifndef DCCMESSAGE_H
+#define DCCMESSAGE_H
+
+#include <QHostAddress>
+#include <QMetaType>
+#include <QString>
+
+// One CTCP DCC request of a file transfer, without the \001 framing:
+//
+//   DCC SEND <file> <address> <port> <size> [token]
+//   DCC RESUME <file> <port> <position> [token]
+//   DCC ACCEPT <file> <port> <position> [token]
+//
+// An IPv4 address travels as a single decimal integer, an IPv6 one as
+// text. File names with spaces are quoted. A SEND with port 0 and a token
+// is a passive offer, where the receiver would have to listen; those are
+// recognised but not served.
+struct DccMessage
+{
+    enum Type : quint8 {
+        Invalid,
+        Send,
+        Resume,
+        Accept
+    };
+
+    Type type = Invalid;
+    QString fileName;
+    QHostAddress address;  // Send only
+    quint16 port = 0;
+    qint64 size = -1;      // Send; -1 if the sender did not say
+    qint64 position = 0;   // Resume and Accept
+    QString token;
+
+    bool isValid() const { return type != Invalid; }
+    bool isPassive() const { return type == Send && port == 0 && !token.isEmpty(); }
+
+    // params is what follows "DCC " in the CTCP request
+    static DccMessage parse(const QString &params);
+    // "DCC SEND ...", ready to be framed as a CTCP request
+    QString toCtcp() const;
+
+    // The offered name reduced to a plain file name that is safe to create
+    // in the download directory
+    static QString safeFileName(const QString &name);
+};
+
+Q_DECLARE_METATYPE(DccMessage)
+
+#endif // DCCMESSAGE_H
@@ -0,0 +1,88 @@
+#ifndef IRCCAPTURE_H
+#define IRCCAPTURE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+// Compact binary recording of raw IRC traffic.
+//
+// A capture starts with the 8-byte magic "QTIRCCAP", a little-endian
+// quint32 format version and the wall-clock start time as a little-endian
+// qint64 in ms since the epoch. Each line follows as one record:
+//
+//   quint8   direction (0 = from the server, 1 = to the server)
+//   varint   µs since the previous record (since the start for the first)
+//   varint   line length in bytes
+//   bytes    the line, without CR LF
+//
+// Varints are unsigned LEB128. irc_replay_bench reads captures directly.
+class IrcCapture
+{
+public:
+    enum Direction : quint8 {
+        Inbound = 0,
+        Outbound = 1
+    };
+
+    struct Record
+    {
+        Direction direction = Inbound;
+        qint64 timeUs = 0;  // since the start of the capture
+        QByteArray line;
+    };
+
+    static const char Magic[8];
+    static const quint32 Version = 1;
+    static const int HeaderSize = 20;
+
+    // True if the device, positioned at its start, holds a capture
+    static bool isCapture(QIODevice *device);
+};
+
+// Appends records to a capture file; not thread-safe
+class IrcCaptureWriter
+{
+public:
+    IrcCaptureWriter() = default;
+    ~IrcCaptureWriter() { close(); }
+
+    bool open(const QString &path, qint64 startMs);
+    void close();
+    bool isOpen() const { return m_file.isOpen(); }
+    QString errorString() const { return m_file.errorString(); }
+
+    void write(IrcCapture::Direction direction, qint64 timeUs, const char *data, int length);
+    void flush();
+
+private:
+    QFile m_file;
+    QByteArray m_buffer;
+    qint64 m_lastUs = 0;
+};
+
+// Reads records back from a device holding a capture
+class IrcCaptureReader
+{
+public:
+    explicit IrcCaptureReader(QIODevice *device) : m_device(device) {}
+
+    // Checks the header; call once before next()
+    bool readHeader();
+    qint64 startMs() const { return m_startMs; }
+
+    // False at the end of the capture or on a truncated record
+    bool next(IrcCapture::Record *record);
+
+private:
+    bool fill(int bytes);
+    bool readVarint(quint64 *value);
+
+    QIODevice *m_device;
+    QByteArray m_buffer;
+    int m_pos = 0;
+    qint64 m_startMs = 0;
+    qint64 m_timeUs = 0;
+};
+
+#endif // IRCCAPTURE_H
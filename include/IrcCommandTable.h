@@ -0,0 +1,141 @@
+#ifndef IRCCOMMANDTABLE_H
+#define IRCCOMMANDTABLE_H
+
+#include <QtGlobal>
+#include <array>
+#include <cstddef>
+#include <cstring>
+
+// Compile-time dispatch tables for IRC commands.
+//
+// Verbs go through a perfect hash whose seed is searched for by the
+// compiler, so a lookup is one hash, one table load and one compare.
+// Numerics index a flat 1000-entry table directly. Both tables are built
+// from plain arrays of { name, handler } entries; see IrcConnection.cpp.
+// Verbs must be listed in upper case.
+namespace IrcCommandTable {
+
+constexpr int NumericCount = 1000;
+
+// Commands are case-insensitive; fold ASCII letters to upper case
+constexpr char foldCase(char c)
+{
+    return (c >= 'a' && c <= 'z') ? char(c - 'a' + 'A') : c;
+}
+
+constexpr int verbLength(const char *verb)
+{
+    int length = 0;
+    while (verb[length]) {
+        ++length;
+    }
+    return length;
+}
+
+constexpr quint32 hashVerb(const char *data, int length, quint32 seed)
+{
+    quint32 hash = 2166136261u ^ seed;
+    for (int i = 0; i < length; ++i) {
+        hash ^= quint8(foldCase(data[i]));
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+constexpr std::size_t slotCountFor(std::size_t entries)
+{
+    std::size_t count = 16;
+    while (count < entries * 4) {
+        count *= 2;
+    }
+    return count;
+}
+
+template<typename Entry, std::size_t N>
+class VerbIndex
+{
+public:
+    static constexpr std::size_t SlotCount = slotCountFor(N);
+
+    constexpr explicit VerbIndex(const Entry (&entries)[N])
+    {
+        for (std::size_t i = 0; i < N; ++i) {
+            m_verbs[i] = entries[i].verb;
+            m_lengths[i] = verbLength(entries[i].verb);
+        }
+
+        // Find a seed that puts every verb in its own slot. A duplicate
+        // verb can never satisfy this and fails the constant evaluation.
+        for (quint32 seed = 0;; ++seed) {
+            for (std::size_t s = 0; s < SlotCount; ++s) {
+                m_slots[s] = -1;
+            }
+            bool collision = false;
+            for (std::size_t i = 0; i < N && !collision; ++i) {
+                const std::size_t slot = hashVerb(m_verbs[i], m_lengths[i], seed) & (SlotCount - 1);
+                collision = m_slots[slot] >= 0;
+                m_slots[slot] = qint16(i);
+            }
+            if (!collision) {
+                m_seed = seed;
+                break;
+            }
+            if (seed > 1000000u) {
+                throw "IrcCommandTable: duplicate verb or too many verbs";
+            }
+        }
+    }
+
+    // Returns the entry index for a verb, or -1 if it is not in the table
+    int find(const char *data, int length) const
+    {
+        const int index = m_slots[hashVerb(data, length, m_seed) & (SlotCount - 1)];
+        if (index < 0 || m_lengths[index] != length) {
+            return -1;
+        }
+        const char *verb = m_verbs[index];
+        for (int i = 0; i < length; ++i) {
+            if (foldCase(data[i]) != verb[i]) {
+                return -1;
+            }
+        }
+        return index;
+    }
+
+private:
+    quint32 m_seed = 0;
+    std::array<qint16, SlotCount> m_slots {};
+    std::array<const char *, N> m_verbs {};
+    std::array<int, N> m_lengths {};
+};
+
+template<typename Entry, std::size_t N>
+constexpr VerbIndex<Entry, N> makeVerbIndex(const Entry (&entries)[N])
+{
+    return VerbIndex<Entry, N>(entries);
+}
+
+// Builds a jump table covering every numeric from 000 to 999. Codes
+// without an entry dispatch to the fallback handler.
+template<typename Handler, typename Entry, std::size_t N>
+constexpr std::array<Handler, NumericCount> makeNumericTable(const Entry (&entries)[N], Handler fallback)
+{
+    std::array<Handler, NumericCount> table {};
+    for (int code = 0; code < NumericCount; ++code) {
+        table[code] = fallback;
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+        if (entries[i].code < 0 || entries[i].code >= NumericCount) {
+            throw "IrcCommandTable: numeric out of range";
+        }
+        if (table[entries[i].code] != fallback) {
+            throw "IrcCommandTable: duplicate numeric";
+        }
+        table[entries[i].code] = entries[i].handler;
+    }
+    return table;
+}
+
+} // namespace IrcCommandTable
+
+#endif // IRCCOMMANDTABLE_H
@@ -2,63 +2,156 @@
 #define IRCCONNECTION_H
 
 #include <QObject>
-#include <QTcpSocket>
 #include <QString>
-#include <QStringList>
+#include <QHash>
+#include <QHostAddress>
+#include "ChannelState.h"
+#include "IrcCoreProtocol.h"
+#include "IrcEvent.h"
+#include "IrcFilter.h"
+#include "IrcStringPool.h"
+#include "IrcTls.h"
 
+class IrcCoreLink;
+class IrcNetworkPool;
+class IrcSession;
+
+// GUI-side handle to one server connection.
+//
+// The protocol work happens in an IrcSession, by default on one of the
+// threads of the shared IrcNetworkPool. IrcConnection drains the session's event queue on its own
+// thread, turns connection state changes back into signals and delivers the
+// rest as batches.
+//
+// A connection can instead stand for a network of a headless core (see
+// IrcCoreLink): lines and settings go to the core, and the events it
+// forwards are delivered here as if a session had produced them. The core
+// registers, rejoins and reconnects by itself.
 class IrcConnection : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit IrcConnection(QObject *parent = nullptr);
+    explicit IrcConnection(QObject *parent = nullptr, bool useNetworkThread = true);
+    // Stands for network of the core behind link, starting from its state
+    IrcConnection(IrcCoreLink *link, const IrcCoreProtocol::Network &network, QObject *parent = nullptr);
     ~IrcConnection();
 
+    bool isRemote() const { return m_link != nullptr; }
+    // The core's id of the network; 0 for a local connection
+    quint32 remoteNetwork() const { return m_remoteNetwork; }
+
     // Connection methods
-    void connectToServer(const QString &host, quint16 port = 6667);
+    void connectToServer(const QString &host, quint16 port = 6667, const IrcTlsOptions &tls = IrcTlsOptions());
     void disconnect();
-    bool isConnected() const;
+    bool isConnected() const { return m_connected; }
+    QString server() const { return m_server; }
+    // Our end of the server connection, e.g. to offer DCC transfers on
+    QHostAddress localAddress() const { return m_localAddress; }
+    QString isupport(const QString &key) const { return m_isupport.value(key); }
+    // All of it, as "KEY=value" or "KEY" tokens
+    QStringList isupportTokens() const;
+
+    // Interned nicks and channels; event ids refer to this pool. It only
+    // grows, so once it holds more than the limit it is replaced by an empty
+    // one while disconnected (see stringsRenewed()).
+    static constexpr qint64 DefaultStringLimit = 16 * 1024 * 1024;
+    IrcStringPool &strings() { return *m_strings; }
+    void setStringLimit(qint64 bytes) { m_stringLimit = bytes; }
+    // Replace the pool the next time we are disconnected, whatever it holds
+    void scheduleStringRenewal() { m_renewStrings = true; }
+    // CASEMAPPING and CHANTYPES as the server announced them
+    const ChannelState &channels() const { return m_channels; }
+    bool isChannel(const QString &name) const { return m_channels.isChannel(name); }
+    bool sameName(IrcStringPool::Id a, IrcStringPool::Id b) const { return m_channels.sameName(a, b); }
+    QString foldCase(const QString &name) const { return m_channels.foldCase(name); }
+    // Per-connection figures to show next to IrcStats
+    QString statsText() const;
+
+    // Also keep the members of every channel we are in in channels(), from
+    // the events before they are delivered. Off by default: the windows
+    // keep their own lists.
+    void setTrackMembers(bool track) { m_trackMembers = track; }
+
+    // Event batching: a batch is delivered when it holds maxEvents events or
+    // when its oldest event has waited maxLatencyMs (0 = next event loop tick)
+    void setBatchLimits(int maxEvents, int maxLatencyMs);
+
+    // Flood control for outbound lines: up to burst lines at once, then one
+    // every intervalMs (0 = unlimited). PING, PONG and QUIT are never held.
+    void setFloodLimits(int burst, int intervalMs);
+
+    // How lines that are not valid UTF-8 are decoded, e.g. from clients
+    // still sending Windows-1252 (the default)
+    void setLegacyEncoding(IrcTextCodec::Legacy legacy);
+
+    // Highlight words and ignore masks, matched on the session's thread:
+    // ignored messages never reach eventsReady, and highlighted ones arrive
+    // with IrcEvent::highlight set. Our own nickname always highlights.
+    void setFilterRules(const IrcFilterRules &rules);
+
+    // Hands raw server bytes to the session as if it had read them from the
+    // socket, e.g. to replay a recorded trace. Without a network thread they
+    // are parsed before this returns.
+    void injectInput(const QByteArray &data);
 
     // IRC commands
     void sendRawMessage(const QString &message);
     void setNickname(const QString &nick);
-    void joinChannel(const QString &channel);
+    // Set before setNickname(): rejoined in one pipelined burst once the
+    // server has accepted the registration. keys[i] belongs to channels[i].
+    void setRejoinChannels(const QStringList &channels, const QStringList &keys);
+    void joinChannel(const QString &channel, const QString &key = QString());
     void partChannel(const QString &channel);
     void sendMessage(const QString &target, const QString &message);
     void sendPrivateMessage(const QString &user, const QString &message);
+    // text is framed in \001; requests go as PRIVMSG, replies as NOTICE
+    void sendCtcpRequest(const QString &target, const QString &text);
+    void sendCtcpReply(const QString &target, const QString &text);
 
 signals:
     // Connection signals
     void connected();
     void disconnected();
     void connectionError(const QString &error);
+    // strings() is a new pool: ids kept from before mean nothing now and
+    // have to be looked up again by name
+    void stringsRenewed();
 
-    // IRC message signals
-    void messageReceived(const QString &sender, const QString &target, const QString &message);
-    void noticeReceived(const QString &sender, const QString &message);
-    void joinedChannel(const QString &channel, const QString &user);
-    void partedChannel(const QString &channel, const QString &user);
-    void userListReceived(const QString &channel, const QStringList &users);
-    void topicReceived(const QString &channel, const QString &topic);
-    void serverMessageReceived(const QString &message);
-    void nickChanged(const QString &oldNick, const QString &newNick);
+    // Parsed IRC events, delivered in batches
+    void eventsReady(const IrcEventBatch &events);
 
 private slots:
-    void onConnected();
-    void onDisconnected();
-    void onReadyRead();
-    void onSocketError(QAbstractSocket::SocketError error);
+    void drainEvents();
 
 private:
-    void parseIrcMessage(const QString &line);
-    void handleNumericReply(int code, const QStringList &params);
-    QString extractNickname(const QString &prefix);
+    friend class IrcCoreLink;
+    // Events forwarded by the core, ids already from our pool
+    void deliverRemote(IrcEventBatch &events);
+    void dispatch(IrcEvent &event);
+    void track(const IrcEvent &event);
+    void postLine(const QByteArray &line);
+    void flushBatch();
+    void applyISupport(const QStringList &tokens);
+    void renewStringsIfFull();
 
-    QTcpSocket *m_socket;
-    QString m_nickname;
+    IrcStringPool *m_strings;
+    qint64 m_stringLimit;
+    bool m_renewStrings;
+    IrcSession *m_session;
+    IrcNetworkPool *m_pool;  // null when the session runs on this thread
+    IrcCoreLink *m_link;     // instead of the session, for a remote connection
+    quint32 m_remoteNetwork;
+    IrcEventBatch m_batch;
+    int m_batchSize;
     QString m_server;
     quint16 m_port;
-    QString m_buffer;
+    bool m_connected;
+    QHostAddress m_localAddress;
+    QHash<QString, QString> m_isupport;
+    ChannelState m_channels;
+    bool m_trackMembers;
+    IrcStringPool::Id m_nickId;  // ours, as far as the events tell
 };
 
 #endif // IRCCONNECTION_H
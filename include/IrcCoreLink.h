@@ -0,0 +1,71 @@
+#ifndef IRCCORELINK_H
+#define IRCCORELINK_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QLocalSocket>
+#include <QObject>
+#include <QVector>
+#include "IrcCoreProtocol.h"
+#include "IrcFilter.h"
+#include "IrcTextCodec.h"
+#include "IrcTls.h"
+
+class IrcConnection;
+
+// A window's end of the local socket to a headless core (IrcCoreServer).
+//
+// attach() blocks until the core has sent its snapshot, which arrives as
+// one networkAdded() per network, so a window that creates its remote
+// IrcConnections from that signal has them all in place before the first
+// event. Events then go straight to the connection of their network. If
+// the core goes away, each of them sees Disconnected and detached() follows.
+class IrcCoreLink : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit IrcCoreLink(QObject *parent = nullptr);
+
+    // False if no core answers under name within timeoutMs
+    bool attach(const QString &name, int timeoutMs = 3000);
+    bool isAttached() const { return m_socket->state() == QLocalSocket::ConnectedState; }
+    QString serverName() const { return m_socket->serverName(); }
+
+    // The core answers with networkAdded() to every window attached to it
+    void addNetwork(const QList<IrcServerAddress> &addresses, const QString &nickname);
+    void removeNetwork(quint32 network);
+
+    // Used by the remote IrcConnections
+    void addConnection(quint32 network, IrcConnection *connection);
+    void removeConnection(quint32 network);
+    void connectNetwork(quint32 network);
+    void disconnectNetwork(quint32 network);
+    void sendLine(quint32 network, const QByteArray &line);
+    void setLegacyEncoding(quint32 network, IrcTextCodec::Legacy legacy);
+    void setFilterRules(quint32 network, const IrcFilterRules &rules);
+
+signals:
+    // From the snapshot on attach, then as any window adds one
+    void networkAdded(const IrcCoreProtocol::Network &network);
+    void networkRemoved(quint32 network);
+    void detached();
+
+private slots:
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    bool handleFrame(IrcCoreProtocol::FrameType type, IrcCoreProtocol::Reader &in);
+    void send(IrcCoreProtocol::Writer &frame);
+    void sendId(IrcCoreProtocol::FrameType type, quint32 network);
+
+    QLocalSocket *m_socket;
+    QByteArray m_input;
+    QVector<IrcCoreProtocol::Network> m_snapshot;  // until SnapshotEnd
+    bool m_snapshotReceived;
+    QHash<quint32, IrcConnection*> m_connections;  // by the core's network id
+};
+
+#endif // IRCCORELINK_H
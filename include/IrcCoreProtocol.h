@@ -0,0 +1,171 @@
+#ifndef IRCCOREPROTOCOL_H
+#define IRCCOREPROTOCOL_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtEndian>
+#include <functional>
+#include "IrcEvent.h"
+#include "IrcFilter.h"
+#include "IrcStringPool.h"
+#include "IrcTls.h"
+
+// Wire format between the headless core (IrcCoreServer) and the windows
+// attached to it over a local socket.
+//
+// Every frame is a u32 length, then a u8 type and the payload that length
+// covers. Integers are little-endian and strings a u32 byte length + UTF-8,
+// as in the session snapshot. A window sends Hello and gets a snapshot of
+// everything the core holds: a Snapshot frame per network, each followed
+// by SnapshotLines frames with its buffers' history, so that no frame
+// comes near MaxFrameSize however large the history is, then SnapshotEnd.
+// After that the core sends each network's events as it delivers them, in
+// the IrcEvent form a local IrcConnection emits, and the window sends
+// lines and commands for a network by its id.
+//
+//   network = u32 id, u32 address count, per address: str host, u16 port,
+//             u8 tls; str nickname, u8 connected, str local address,
+//             strs RPL_ISUPPORT tokens, u32 buffer count, per buffer (the
+//             server buffer first): str name, str topic, strs members,
+//             lines
+//   lines   = u32 count, per line: i64 timestamp (ms), u8 system,
+//             str sender, str text
+//   event   = u8 type, str sender, str target, str text, str argument,
+//             strs names, strs channels, i64 sent time, u8 highlight
+//   strs    = u32 count, then that many str
+class IrcCoreProtocol
+{
+public:
+    static constexpr quint32 Version = 2;
+    // A longer frame means a broken or foreign peer
+    static constexpr quint32 MaxFrameSize = 64 * 1024 * 1024;
+
+    enum FrameType : quint8 {
+        // Window -> core
+        Hello = 1,       // u32 version
+        AddNetwork,      // u32 address count, addresses, str nickname
+        RemoveNetwork,   // u32 network
+        Connect,         // u32 network
+        Disconnect,      // u32 network
+        SendLine,        // u32 network, str line
+        SetEncoding,     // u32 network, u8 IrcTextCodec::Legacy
+        SetFilterRules,  // u32 network, strs highlight words, strs ignore masks
+
+        // Core -> window
+        Snapshot = 64,   // network, its buffers without lines
+        SnapshotLines,   // u32 network, u32 buffer index, lines; of the last Snapshot's network
+        SnapshotEnd,     // nothing; every network has been sent
+        NetworkAdded,    // network; sent to every window, the one that asked too
+        NetworkRemoved,  // u32 network
+        Events           // u32 network, u32 event count, events
+    };
+
+    struct Line
+    {
+        qint64 timestamp = 0;  // ms since the epoch, when the core got it
+        bool system = false;
+        QString sender;
+        QString text;
+    };
+
+    struct Buffer
+    {
+        QString name;
+        QString topic;
+        QStringList members;  // prefixes and nick, as in RPL_NAMREPLY
+        QVector<Line> lines;  // oldest first
+    };
+
+    struct Network
+    {
+        quint32 id = 0;
+        QList<IrcServerAddress> addresses;
+        QString nickname;
+        bool connected = false;
+        QString localAddress;
+        QStringList isupport;     // "KEY=value" or "KEY"
+        QVector<Buffer> buffers;  // the server buffer first
+    };
+
+    // Builds one frame
+    class Writer
+    {
+    public:
+        explicit Writer(FrameType type);
+
+        template <typename T>
+        void integer(T value)
+        {
+            char bytes[sizeof(T)];
+            qToLittleEndian<T>(value, bytes);
+            m_data.append(bytes, int(sizeof(T)));
+        }
+        void string(const QString &text);
+        void strings(const QStringList &list);
+        void addresses(const QList<IrcServerAddress> &addresses);
+        void lines(const QVector<Line> &lines);
+        void network(const Network &network);
+        // Channel ids are written as the names they have in strings
+        void event(const IrcEvent &event, const IrcStringPool &strings);
+
+        // The frame, with its length filled in
+        const QByteArray &frame();
+
+    private:
+        QByteArray m_data;
+    };
+
+    // Reads the body of one frame; once anything runs past its end every
+    // read fails and ok() stays false
+    class Reader
+    {
+    public:
+        Reader(const char *data, qint64 size) : m_data(data), m_size(size), m_pos(0), m_ok(true) {}
+
+        bool ok() const { return m_ok; }
+        bool atEnd() const { return m_pos == m_size; }
+
+        template <typename T>
+        T integer()
+        {
+            if (!take(sizeof(T))) {
+                return T(0);
+            }
+            return qFromLittleEndian<T>(m_data + m_pos - qint64(sizeof(T)));
+        }
+        QByteArray bytes();
+        QString string() { return QString::fromUtf8(bytes()); }
+        QStringList strings();
+        QList<IrcServerAddress> addresses();
+        QVector<Line> lines();
+        Network network();
+        // Sender, target and channels are interned in strings, so the ids
+        // are those of the receiving connection
+        IrcEvent event(IrcStringPool &strings);
+
+    private:
+        // A count of records each at least minimumSize bytes long; rejects
+        // counts the rest of the frame could not hold before allocating
+        int count(qint64 minimumSize);
+        bool take(qint64 length);
+
+        const char *m_data;
+        qint64 m_size;
+        qint64 m_pos;
+        bool m_ok;
+    };
+
+    // Hands each complete frame at the front of buffer to handle, as its
+    // type and a reader over its payload, and removes them. Returns false
+    // for a frame that cannot be real or that handle rejects; the peer
+    // should then be dropped.
+    static bool readFrames(QByteArray &buffer, const std::function<bool(FrameType, Reader &)> &handle);
+
+    // Local socket name of the current user's core
+    static QString defaultServerName();
+};
+
+#endif // IRCCOREPROTOCOL_H
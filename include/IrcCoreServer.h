@@ -0,0 +1,140 @@
+#ifndef IRCCORESERVER_H
+#define IRCCORESERVER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <deque>
+#include "IrcConnection.h"
+#include "IrcCoreProtocol.h"
+
+// The headless core: keeps the server connections, their channels and
+// recent history while no window is open, and shares them with every
+// window attached over a local socket (see IrcCoreProtocol).
+//
+// Each network is an IrcConnection, as in the client, that the core
+// registers, rejoins and reconnects with backoff by itself. Membership is
+// the connection's own ChannelState (IrcConnection::setTrackMembers), so
+// names are folded and channels told apart as the session does them.
+// Per buffer the core
+// keeps the chat lines (messages, notices and server messages), stamped on
+// arrival; join, part and mode lines are not kept, only the members and
+// topic they leave behind. The lines of all networks share one byte
+// budget, and once it is exceeded the oldest line anywhere goes first.
+//
+// A window that attaches gets a snapshot of all that and then every
+// network's events as they are delivered. A window that stops reading is
+// dropped once MaxPendingBytes beyond its snapshot are queued for it; it
+// can attach again for a fresh snapshot.
+class IrcCoreServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr qint64 MaxPendingBytes = 16 * 1024 * 1024;
+
+    explicit IrcCoreServer(qint64 historyBudget, QObject *parent = nullptr);
+    ~IrcCoreServer();
+
+    // Fails if another core already answers under name
+    bool listen(const QString &name);
+    // Lines, counted with their strings, and the eviction queue
+    qint64 historyBytes() const;
+    // Names interned by the connections, which count against the same
+    // budget but are only let go when a connection renews its pool
+    qint64 internedBytes() const;
+
+private slots:
+    void onNewConnection();
+
+private:
+    struct Buffer
+    {
+        QString name;
+        QString topic;
+        std::deque<IrcCoreProtocol::Line> lines;  // oldest first
+        qint64 bytes = 0;
+    };
+
+    struct Network
+    {
+        quint32 id = 0;
+        QList<IrcServerAddress> addresses;
+        int addressIndex = 0;
+        QString nickname;
+        IrcStringPool::Id nickId = IrcStringPool::NullId;
+        IrcConnection *connection = nullptr;
+        QStringList isupport;  // as last sent to the windows
+
+        quint32 serverBuffer = 0;
+        QVector<quint32> buffers;                // the others, oldest first
+        QHash<QString, quint32> buffersByName;   // by folded name
+        QSet<QString> joined;                    // rejoined after a reconnect
+        QHash<QString, QString> keys;            // by folded channel name
+
+        QTimer *reconnectTimer = nullptr;
+        bool autoReconnect = false;
+        int reconnectAttempts = 0;
+        QElapsedTimer connectedTime;
+    };
+
+    Network *addNetwork(const QList<IrcServerAddress> &addresses, const QString &nickname);
+    void removeNetwork(Network *network);
+    IrcConnection *createConnection(Network *network);
+    static qint64 internedBytes(Network *network);
+    void connectNetwork(Network *network);
+    void disconnectNetwork(Network *network);
+    void scheduleReconnect(Network *network);
+
+    void onConnected(Network *network);
+    void onDisconnected(Network *network);
+    void onConnectionError(Network *network, const QString &error);
+    void onEventsReady(Network *network, const IrcEventBatch &events);
+    // Keeps the lines and state of one event; false if the windows need not see it
+    bool applyEvent(Network *network, const IrcEvent &event);
+    void sendLine(Network *network, const QString &line, QLocalSocket *from);
+
+    quint32 bufferFor(Network *network, const QString &name, bool create);
+    void removeBuffer(Network *network, quint32 buffer);
+    void addLine(quint32 buffer, const QString &sender, const QString &text, bool system = false);
+    static qint64 lineCost(const IrcCoreProtocol::Line &line);
+
+    // The server buffer first
+    QVector<quint32> buffersOf(const Network *network) const;
+    // Without the buffers' lines, which a snapshot sends apart
+    IrcCoreProtocol::Network describe(const Network *network) const;
+    Network *network(quint32 id) const { return m_networks.value(id, nullptr); }
+
+    void onClientReadyRead(QLocalSocket *client);
+    bool handleFrame(QLocalSocket *client, IrcCoreProtocol::FrameType type, IrcCoreProtocol::Reader &in);
+    void sendSnapshot(QLocalSocket *client);
+    void sendTo(QLocalSocket *client, const QByteArray &frame);
+    // To every attached window except the one given
+    void broadcast(IrcCoreProtocol::Writer &frame, QLocalSocket *except = nullptr);
+    void broadcastEvents(Network *network, const IrcEventBatch &events, QLocalSocket *except = nullptr);
+
+    QLocalServer *m_server;
+    QHash<QLocalSocket*, QByteArray> m_input;  // every connected socket, with its unread bytes
+    QList<QLocalSocket*> m_clients;            // those that said Hello
+    QHash<QLocalSocket*, qint64> m_snapshotBytes;  // queued for a window that has not read its snapshot yet
+    IrcFilterRules m_filterRules;              // for networks no window has set any on
+
+    QMap<quint32, Network*> m_networks;        // by id, in the order they were added
+    quint32 m_nextNetworkId;
+
+    QHash<quint32, Buffer> m_buffers;          // by id, of all networks
+    quint32 m_nextBufferId;
+    std::deque<quint32> m_lineOrder;           // buffer of every kept line, oldest first
+    qint64 m_lineBytes;
+    qint64 m_historyBudget;
+    bool m_internedOverrun;                    // names past their share, pools renewing
+};
+
+#endif // IRCCORESERVER_H
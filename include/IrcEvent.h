@@ -0,0 +1,61 @@
+#ifndef IRCEVENT_H
+#define IRCEVENT_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "IrcStringPool.h"
+
+// One parsed IRC event, ready for the UI.
+//
+// IrcSession produces these on the network side; IrcConnection hands them
+// to the GUI in batches, so a whole burst of traffic is handled at once.
+// Sender and target are interned: the ids identify them within the
+// connection's IrcStringPool and the strings share its canonical copies.
+struct IrcEvent
+{
+    enum Type {
+        Message,        // sender -> target: text
+        Notice,         // sender: text
+        Ctcp,           // sender -> target: CTCP request argument (e.g. "DCC"), parameters text
+        Join,           // sender joined target
+        Part,           // sender left target
+        Quit,           // sender quit channels: text (reason)
+        Kick,           // sender kicked argument from target: text (reason)
+        NickChange,     // sender is now target in channels
+        Mode,           // sender set text on target; no sender: target's modes are text
+        Topic,          // topic of target is text
+        Names,          // names lists the members of target
+        Prefixes,       // argument now holds prefixes text on target
+        ServerMessage,  // text
+
+        // Connection state, kept in order with the traffic around it
+        Connected,       // text: our address on the server connection
+        Disconnected,
+        ConnectionError, // text
+        ISupport         // names holds the RPL_ISUPPORT tokens
+    };
+
+    IrcEvent(Type type = ServerMessage, const QString &sender = QString(),
+             const QString &target = QString(), const QString &text = QString(),
+             const QString &argument = QString())
+        : type(type), sender(sender), target(target), text(text), argument(argument)
+    {
+    }
+
+    Type type;
+    QString sender;
+    QString target;
+    IrcStringPool::Id senderId = IrcStringPool::NullId;
+    IrcStringPool::Id targetId = IrcStringPool::NullId;
+    QString text;
+    QString argument;
+    QStringList names;
+    QVector<IrcStringPool::Id> channels;  // channels a Quit or NickChange touched
+    qint64 sentTime = 0;  // when the server sent a Message or Notice, in us since the epoch; 0 = untagged
+    bool highlight = false;  // a Message that mentions our nick or a highlight word
+};
+
+typedef QVector<IrcEvent> IrcEventBatch;
+
+#endif // IRCEVENT_H
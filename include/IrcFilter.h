@@ -0,0 +1,88 @@
+#ifndef IRCFILTER_H
+#define IRCFILTER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// The user's highlight words and ignore masks, shared by every network
+struct IrcFilterRules
+{
+    QStringList highlightWords;
+    QStringList ignoreMasks;   // nick!user@host, with * and ?
+
+    // From the filters file in the application data directory; empty rules
+    // if there is none
+    static IrcFilterRules load();
+    bool save() const;
+
+    // "nick" -> "nick!*@*", "user@host" -> "*!user@host"
+    static QString normalizeMask(const QString &mask);
+};
+
+// Highlight words and ignore masks, compiled so that a message is matched
+// in one pass however many rules there are.
+//
+// The highlight words go into one Aho-Corasick automaton with its failure
+// links folded into a full transition table: the text is scanned once, one
+// table lookup per byte. A word only counts where it stands on its own,
+// so "bob" is found in "bob: hi" but not in "bobcat".
+//
+// The ignore masks are combined into a single DFA by subset construction,
+// so a sender's "nick!user@host" is also matched with one lookup per byte.
+// Masks that would grow it past MaxIgnoreStates are left out of it and
+// tried one by one instead.
+//
+// Both run on the raw UTF-8 bytes with ASCII case folded, so nothing is
+// decoded for a line that gets dropped. A compiled filter never changes;
+// copies share their tables.
+class IrcFilter
+{
+public:
+    enum { MaxIgnoreStates = 16384 };
+
+    // Matches nothing
+    IrcFilter() = default;
+    IrcFilter(const QStringList &highlightWords, const QStringList &ignoreMasks);
+
+    bool highlights(const QByteArray &text) const { return highlights(text.constData(), text.size()); }
+    bool highlights(const char *data, int length) const;
+    // prefix is the sender's "nick!user@host"
+    bool ignores(const QByteArray &prefix) const { return ignores(prefix.constData(), prefix.size()); }
+    bool ignores(const char *data, int length) const;
+
+    int highlightStateCount() const { return m_highlightColumns ? m_highlightNext.size() / m_highlightColumns : 0; }
+    int ignoreStateCount() const { return m_ignoreColumns ? m_ignoreNext.size() / m_ignoreColumns : 0; }
+
+private:
+    struct Word
+    {
+        int length = 0;
+        bool boundaryBefore = false;  // starts with a word character
+        bool boundaryAfter = false;   // ends with one
+    };
+
+    void compileHighlights(const QList<QByteArray> &words);
+    bool compileIgnores(const QList<QByteArray> &masks);
+    bool hasBoundaries(const char *data, int length, int end, const Word &word) const;
+
+    // Highlights: state * m_highlightColumns + class -> state; state 0 is
+    // the root. The words ending in a state, suffixes included, are
+    // m_outputWords[m_outputStart[state] .. m_outputStart[state + 1]).
+    QVector<quint16> m_highlightClasses;
+    int m_highlightColumns = 0;
+    QVector<qint32> m_highlightNext;
+    QVector<qint32> m_outputStart;
+    QVector<qint32> m_outputWords;
+    QVector<Word> m_words;
+
+    // Ignores: state 0 is the start, state 1 the dead state
+    QVector<quint16> m_ignoreClasses;
+    int m_ignoreColumns = 0;
+    QVector<qint32> m_ignoreNext;
+    QVector<bool> m_ignoreAccepts;
+    QList<QByteArray> m_slowMasks;
+};
+
+#endif // IRCFILTER_H
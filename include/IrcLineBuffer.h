@@ -0,0 +1,45 @@
+#ifndef IRCLINEBUFFER_H
+#define IRCLINEBUFFER_H
+
+#include <QByteArray>
+
+class QIODevice;
+
+// Reusable receive buffer that splits raw socket data into IRC lines.
+//
+// fill() drains everything the device has in one read into a buffer that
+// is allocated once and reused; nextLine() then walks the complete lines in
+// place. Only the trailing partial line is ever moved, back to the start of
+// the buffer, so steady-state reading does no per-line allocation.
+class IrcLineBuffer
+{
+public:
+    // Longest line kept while waiting for its newline: 512 bytes of message
+    // plus 8191 bytes of IRCv3 tags, rounded up
+    static constexpr int MaxLineLength = 16 * 1024;
+
+    explicit IrcLineBuffer(int capacity = 64 * 1024);
+
+    // Reads all bytes currently available on the device
+    qint64 fill(QIODevice *device);
+    // Appends raw bytes, e.g. from a recorded trace
+    void append(const char *data, int length);
+
+    // Returns the next complete line without its CR/LF. The pointer stays
+    // valid until the next fill() or append().
+    bool nextLine(const char **data, int *length);
+
+    int pendingBytes() const { return m_writePos - m_readPos; }
+    void clear();
+
+private:
+    char *reserve(int minimum);
+
+    QByteArray m_buffer;
+    int m_readPos;
+    int m_scanPos;
+    int m_writePos;
+    bool m_discarding;
+};
+
+#endif // IRCLINEBUFFER_H
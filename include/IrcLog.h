@@ -0,0 +1,57 @@
+#ifndef IRCLOG_H
+#define IRCLOG_H
+
+#include <QLoggingCategory>
+#include <QString>
+#include <atomic>
+#include "IrcCapture.h"
+
+// Connection lifecycle and errors; info and up are on by default
+Q_DECLARE_LOGGING_CATEGORY(lcIrcSession)
+// Every line sent and received; off unless enabled with
+// QT_LOGGING_RULES="irc.traffic.debug=true"
+Q_DECLARE_LOGGING_CATEGORY(lcIrcTraffic)
+// DCC file transfers
+Q_DECLARE_LOGGING_CATEGORY(lcDcc)
+
+// Asynchronous log writer.
+//
+// Once started, Qt log messages from every thread and traffic lines are
+// pushed into a lock-free ring and written out by a background thread, so
+// a slow terminal or disk never stalls the socket. Traffic is formatted on
+// the writer thread too. When the ring is full records are dropped and
+// counted rather than waited for.
+//
+// Traffic can also be captured to a binary IrcCapture file, independent of
+// the text log.
+class IrcLog
+{
+public:
+    // logFile empty: stderr. captureFile empty: no capture.
+    static bool start(const QString &logFile = QString(), const QString &captureFile = QString());
+    // Writes out everything queued and stops the writer thread
+    static void stop();
+
+    static bool trafficEnabled()
+    {
+        return s_capturing.load(std::memory_order_relaxed) || lcIrcTraffic().isDebugEnabled();
+    }
+    static void traffic(IrcCapture::Direction direction, const char *data, int length);
+
+private:
+    static std::atomic<bool> s_capturing;
+};
+
+// Compiled out entirely with IRCCLIENT_NO_TRAFFIC_LOG
+#ifdef IRCCLIENT_NO_TRAFFIC_LOG
+#define IRC_LOG_TRAFFIC(direction, data, length) do {} while (false)
+#else
+#define IRC_LOG_TRAFFIC(direction, data, length) \
+    do { \
+        if (IrcLog::trafficEnabled()) { \
+            IrcLog::traffic(direction, data, length); \
+        } \
+    } while (false)
+#endif
+
+#endif // IRCLOG_H
@@ -0,0 +1,107 @@
+#ifndef IRCMESSAGE_H
+#define IRCMESSAGE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVarLengthArray>
+#include "IrcTextCodec.h"
+
+// Zero-copy view over one raw IRC line.
+//
+// Parsing only records offsets into the original QByteArray for the
+// IRCv3 tags, prefix, command and parameters. Nothing is copied or decoded
+// until a field is asked for as a QString, so lines that are dropped or
+// only inspected by command never pay for UTF-16 conversion. The first
+// field decoded classifies the whole line (see IrcTextCodec), so all its
+// fields agree on one encoding.
+//
+// Grammar (RFC 1459/2812 with IRCv3 message-tags):
+//   ['@' tags ' '] [':' prefix ' '] command [params] [CR] LF
+//   params = *14(' ' middle) [' ' ':' trailing]
+//          / 14(' ' middle) [' ' [':'] trailing]
+//   tags  = tag *(';' tag)      tag = ['+'] [vendor '/'] key ['=' value]
+class IrcMessage
+{
+public:
+    // RFC 2812: at most 15 parameters, the last of which may be trailing
+    static constexpr int MaxMiddleParams = 14;
+
+    IrcMessage() = default;
+    explicit IrcMessage(const QByteArray &line);
+
+    // Parses a line, with or without its trailing CR/LF. Returns false when
+    // the line has no command; the message is then invalid.
+    bool parse(const QByteArray &line);
+    bool isValid() const { return m_command.length > 0; }
+    const QByteArray &line() const { return m_line; }
+    // Used for the fields if the line is not valid UTF-8
+    void setLegacyEncoding(IrcTextCodec::Legacy legacy) { m_legacy = legacy; }
+    IrcTextCodec::Encoding encoding() const;
+
+    // Source prefix (":nick!user@host"), without the leading colon
+    bool hasPrefix() const { return m_prefix.length > 0; }
+    QString prefix() const { return decode(m_prefix); }
+    QByteArray prefixBytes() const { return bytes(m_prefix); }
+    QString nick() const;
+    QString user() const;
+    QString host() const;
+    QByteArray nickBytes() const { return bytes(prefixPart(0, '!')); }
+
+    // Command verb or three digit numeric
+    QByteArray command() const;
+    const char *commandData() const { return m_line.constData() + m_command.offset; }
+    int commandLength() const { return m_command.length; }
+    bool isCommand(const char *verb) const;
+    bool isNumeric() const { return m_numeric >= 0; }
+    int numeric() const { return m_numeric; }
+
+    // Parameters; a trailing ":" parameter, if present, is always the last
+    int paramCount() const { return int(m_params.size()); }
+    bool hasTrailing() const { return m_hasTrailing; }
+    QString param(int index) const;
+    QByteArray paramBytes(int index) const;
+    QString joinedParams(int from = 0) const;
+
+    // IRCv3 message tags. Values are unescaped on access; duplicate keys
+    // resolve to the last occurrence as the specification requires.
+    int tagCount() const { return int(m_tags.size()); }
+    QString tagKey(int index) const;
+    QString tagValue(int index) const;
+    bool hasTag(const char *key) const { return findTag(key) >= 0; }
+    QString tag(const char *key) const;
+
+    static bool isValidTagKey(const char *data, int length);
+    static QString unescapeTagValue(const char *data, int length);
+
+private:
+    struct Span
+    {
+        int offset = 0;
+        int length = 0;
+    };
+    struct Tag
+    {
+        Span key;
+        Span value;
+    };
+
+    void parseTags(int begin, int end);
+    int findTag(const char *key) const;
+    Span prefixPart(char startDelimiter, char endDelimiter) const;
+    bool spanEquals(Span span, const char *text) const;
+    QString decode(Span span) const;
+    QByteArray bytes(Span span) const;
+
+    QByteArray m_line;
+    QVarLengthArray<Tag, 4> m_tags;
+    Span m_prefix;
+    Span m_command;
+    QVarLengthArray<Span, 15> m_params;
+    int m_numeric = -1;
+    bool m_hasTrailing = false;
+    IrcTextCodec::Legacy m_legacy = IrcTextCodec::Windows1252;
+    mutable IrcTextCodec::Encoding m_encoding = IrcTextCodec::Unknown;
+};
+
+#endif // IRCMESSAGE_H
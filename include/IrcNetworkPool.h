@@ -0,0 +1,59 @@
+#ifndef IRCNETWORKPOOL_H
+#define IRCNETWORKPOOL_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+class IrcSession;
+class QThread;
+
+// Small fixed set of network threads shared by every connection.
+//
+// A session is pinned for its lifetime to the thread carrying the fewest
+// sessions when it is adopted; that thread's event loop then serves its
+// socket and timers alongside those of the other sessions there. Ten
+// networks on two threads cost two stacks and two event loops, not ten.
+//
+// adopt() and release() are called from the thread that owns the pool.
+class IrcNetworkPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    // threadCount <= 0 picks defaultThreadCount()
+    explicit IrcNetworkPool(int threadCount = 0, QObject *parent = nullptr);
+    // All sessions must have been released
+    ~IrcNetworkPool();
+
+    // The application's pool, created on first use and owned by the
+    // QCoreApplication
+    static IrcNetworkPool *shared();
+    // Threads of the shared pool; 0 means one per two cores, at most four.
+    // Only has an effect before the pool is created.
+    static void setDefaultThreadCount(int count);
+    static int defaultThreadCount();
+
+    int threadCount() const { return int(m_workers.size()); }
+
+    // Moves session, which must have no parent, onto the least loaded thread
+    void adopt(IrcSession *session);
+    // Shuts session down and deletes it on its thread; returns when done
+    void release(IrcSession *session);
+
+    QString statsText() const;
+
+private:
+    struct Worker
+    {
+        QThread *thread;
+        QObject *context;  // lives on thread, to run release() there
+        int sessions;
+    };
+
+    QVector<Worker> m_workers;
+    QHash<IrcSession *, int> m_assigned;  // session -> index in m_workers
+};
+
+#endif // IRCNETWORKPOOL_H
@@ -0,0 +1,44 @@
+#ifndef IRCPREFIXSUPPORT_H
+#define IRCPREFIXSUPPORT_H
+
+#include <QString>
+
+// The channel member prefixes a server supports, from the RPL_ISUPPORT
+// PREFIX token, e.g. "(qaohv)~&@%+": one mode letter and one symbol per
+// rank, highest first. Shared by ChannelState and NickListModel so both
+// read PREFIX and NAMES entries the same way.
+class IrcPrefixSupport
+{
+public:
+    // The RFC 2811 set most servers use until they say otherwise
+    IrcPrefixSupport();
+
+    // False, and nothing changes, if the token is malformed
+    bool parse(const QString &prefix);
+    QString modes() const { return m_modes; }
+    QString symbols() const { return m_symbols; }
+
+    // Rank of a mode letter or symbol, 0 = highest; -1 if not a prefix
+    int modeRank(QChar mode) const { return int(m_modes.indexOf(mode)); }
+    QChar symbol(int rank) const { return m_symbols.at(rank); }
+    // Rank of the highest of some sorted prefixes; symbols().size() if none
+    int rankOf(const QString &prefixes) const;
+    // Highest first; symbols that are not prefixes here are dropped
+    QString sorted(const QString &prefixes) const;
+
+    // An RPL_NAMREPLY entry, [prefixes]nick[!user@host] with
+    // userhost-in-names: returns the nick and sets the sorted prefixes
+    QString parseName(const QString &name, QString *prefixes = nullptr) const;
+
+    bool operator==(const IrcPrefixSupport &other) const
+    {
+        return m_modes == other.m_modes && m_symbols == other.m_symbols;
+    }
+    bool operator!=(const IrcPrefixSupport &other) const { return !(*this == other); }
+
+private:
+    QString m_modes;
+    QString m_symbols;
+};
+
+#endif // IRCPREFIXSUPPORT_H
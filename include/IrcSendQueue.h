@@ -0,0 +1,70 @@
+#ifndef IRCSENDQUEUE_H
+#define IRCSENDQUEUE_H
+
+#include <QByteArray>
+#include <QQueue>
+#include <QVector>
+
+// Outbound line scheduler for one connection.
+//
+// Lines wait in two lanes: PING, PONG and QUIT go out immediately, ahead of
+// everything else; the rest is released by a token bucket and taken
+// round-robin per target, so one long paste cannot starve other channels.
+// takeWritable() packs everything that may go out into one preallocated
+// buffer so the socket sees a single write. Oversized PRIVMSG and NOTICE
+// lines are split at UTF-8 character boundaries.
+class IrcSendQueue
+{
+public:
+    // Longest line the server accepts, without CR/LF
+    static constexpr int MaxLineLength = 510;
+
+    explicit IrcSendQueue(int capacity = 8 * 1024);
+
+    // Token bucket: up to burst lines at once, then one more every
+    // intervalMs. The defaults match the usual ircd flood limits; an
+    // interval of 0 disables flood control.
+    void setFloodLimits(int burst, int intervalMs);
+    // Bytes the server prepends when relaying our messages
+    // (":nick!user@host "), which count against MaxLineLength
+    void setPrefixLength(int length);
+
+    // Queues one line without its CR/LF
+    void enqueue(const QByteArray &line);
+
+    // Returns every line the flood limits allow at nowMs, CR/LF included,
+    // as one contiguous buffer. The buffer is reused by the next call.
+    const QByteArray &takeWritable(qint64 nowMs);
+    // Milliseconds until the next queued line may go out, -1 if none is queued
+    int nextSendDelay(qint64 nowMs) const;
+
+    bool isEmpty() const { return m_pendingLines == 0; }
+    int pendingLines() const { return m_pendingLines; }
+    void clear();
+
+private:
+    struct Lane
+    {
+        QByteArray target;
+        QQueue<QByteArray> lines;
+    };
+
+    void enqueueNormal(const QByteArray &target, const QByteArray &line);
+    void append(const QByteArray &line);
+    int splitPoint(const char *text, int limit) const;
+
+    QByteArray m_writeBuffer;
+    QQueue<QByteArray> m_urgent;
+    QVector<Lane> m_lanes;
+    int m_nextLane;
+    int m_pendingLines;
+
+    // Virtual send clock: advances by m_interval per line and may run at
+    // most m_burst intervals ahead of real time
+    qint64 m_clock;
+    int m_burst;
+    int m_interval;
+    int m_prefixLength;
+};
+
+#endif // IRCSENDQUEUE_H
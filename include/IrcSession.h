@@ -0,0 +1,187 @@
+#ifndef IRCSESSION_H
+#define IRCSESSION_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSslSocket>
+#include <QString>
+#include <QTimer>
+#include <atomic>
+#include "ChannelState.h"
+#include "IrcEvent.h"
+#include "IrcFilter.h"
+#include "IrcLineBuffer.h"
+#include "IrcMessage.h"
+#include "IrcSendQueue.h"
+#include "IrcStringPool.h"
+#include "IrcTls.h"
+#include "SpscQueue.h"
+
+// Protocol engine for one server connection: socket, line framing, parsing,
+// command dispatch and PING/PONG.
+//
+// The session may live on its own network thread. Parsed events leave it
+// through a lock-free queue drained by IrcConnection on the GUI thread, and
+// outbound lines come back through a second one, so a busy GUI never holds
+// up socket reads or keepalive replies.
+class IrcSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    // strings is shared with the owning IrcConnection and must outlive us
+    explicit IrcSession(IrcStringPool *strings, QObject *parent = nullptr);
+
+    // Consumer side, callable from the owning IrcConnection's thread
+    void postLine(const QByteArray &line);
+    bool takeEvent(IrcEvent &event) { return m_events.pop(event); }
+    void acknowledgeEvents() { m_eventsNotified.store(false, std::memory_order_release); }
+
+    // Session thread only
+    void connectToServer(const QString &host, quint16 port, const IrcTlsOptions &tls = IrcTlsOptions());
+    void registerUser(const QString &nick);
+    // Rejoined in one burst as soon as the server welcomes us; keys[i] is
+    // the key of channels[i], empty if it has none
+    void setRejoinChannels(const QStringList &channels, const QStringList &keys);
+    void disconnectFromServer();
+    void shutdown();
+    void setBatchLimits(int maxEvents, int maxLatencyMs);
+    void setFloodLimits(int burst, int intervalMs);
+    // For lines that are not valid UTF-8
+    void setLegacyEncoding(IrcTextCodec::Legacy legacy);
+    // A fresh pool between connections; channel state starts over with it
+    void setStringPool(IrcStringPool *strings);
+    // Compiled here together with our nickname, and again when it changes
+    void setFilterRules(const IrcFilterRules &rules);
+    // Handles raw server bytes as if they had been read from the socket
+    void feedInput(const QByteArray &data);
+
+signals:
+    // Events are waiting in the queue; emitted once until acknowledged
+    void eventsAvailable();
+
+private slots:
+    void onConnected();
+    void onEncrypted();
+    void onSslErrors(const QList<QSslError> &errors);
+    void storeSessionTicket();
+    void onDisconnected();
+    void onReadyRead();
+    void onSocketError(QAbstractSocket::SocketError error);
+    void drainOutbound();
+    void flushSendQueue();
+    void notifyEvents();
+
+private:
+    using Handler = void (IrcSession::*)(const IrcMessage &);
+    struct VerbHandler
+    {
+        const char *verb;
+        Handler handler;
+    };
+    struct NumericHandler
+    {
+        int code;
+        Handler handler;
+    };
+
+    // Dispatch tables, defined in IrcSession.cpp
+    static const VerbHandler s_verbHandlers[];
+    static const NumericHandler s_numericHandlers[];
+
+    void startConnection();
+    QString serverKey() const { return IrcServerAddress{m_host, m_port, m_tls.enabled}.key(); }
+    void finishSasl();
+    void sendRejoinBurst();
+    static QList<QByteArray> packJoins(const QStringList &channels, const QStringList &keys);
+    void processInbound();
+    void handleMessage(const IrcMessage &message);
+    void writeLine(const QByteArray &line);
+    void setNickname(const QString &nick);
+    // The nick to try after attempt answers of ERR_NICKNAMEINUSE
+    QString alternativeNickname(int attempt) const;
+    void compileFilter();
+    bool isSelf(IrcStringPool::Id nick) const { return m_channels.sameName(nick, m_nicknameId); }
+    IrcStringPool::Id atom(const QByteArray &bytes) const { return m_strings->intern(bytes); }
+    IrcEvent makeEvent(IrcEvent::Type type, IrcStringPool::Id sender, IrcStringPool::Id target,
+                       const QString &text = QString(), const QString &argument = QString()) const;
+    void publish(const IrcEvent &event);
+    void publishServerMessage(const QString &text);
+    static qint64 sentTime(const IrcMessage &message);
+
+    // Command handlers
+    void handlePing(const IrcMessage &message);
+    void handlePrivmsg(const IrcMessage &message);
+    void handleNotice(const IrcMessage &message);
+    void handleJoin(const IrcMessage &message);
+    void handlePart(const IrcMessage &message);
+    void handleQuit(const IrcMessage &message);
+    void handleKick(const IrcMessage &message);
+    void handleNick(const IrcMessage &message);
+    void handleMode(const IrcMessage &message);
+    void handleTopic(const IrcMessage &message);
+    void handleInvite(const IrcMessage &message);
+    void handleError(const IrcMessage &message);
+    void handleCap(const IrcMessage &message);
+    void handleAuthenticate(const IrcMessage &message);
+    void handleStandardReply(const IrcMessage &message);
+    void handleIgnored(const IrcMessage &message);
+    void handleUnknownCommand(const IrcMessage &message);
+
+    // Numeric reply handlers
+    void handleWelcome(const IrcMessage &message);
+    void handleISupport(const IrcMessage &message);
+    void handleChannelModeIs(const IrcMessage &message);
+    void handleNoTopic(const IrcMessage &message);
+    void handleTopicReply(const IrcMessage &message);
+    void handleNamesReply(const IrcMessage &message);
+    void handleEndOfNames(const IrcMessage &message);
+    void handleNicknameInUse(const IrcMessage &message);
+    void handleInformationalReply(const IrcMessage &message);
+    void handleServerReply(const IrcMessage &message);
+    void handleSaslReply(const IrcMessage &message);
+
+    IrcStringPool *m_strings;
+    QSslSocket *m_socket;
+    IrcLineBuffer m_inbound;
+    IrcTextCodec::Legacy m_legacy;
+    // Ignored senders' messages are dropped before their text is decoded
+    IrcFilterRules m_filterRules;
+    IrcFilter m_filter;
+
+    // Where we connect to, kept for the pin fallback reconnect
+    QString m_host;
+    quint16 m_port;
+    IrcTlsOptions m_tls;
+    QByteArray m_expectedPin;  // checked instead of the chain, if set
+    bool m_pinRejected;        // the pin did not match: validate in full
+    quint64 m_handshakeStartNs;
+    bool m_saslPending;        // CAP REQ :sasl sent, CAP END not yet
+
+    // Session -> GUI. Events the GUI has no room for yet wait in m_overflow
+    // so the network thread never blocks on a saturated UI.
+    SpscQueue<IrcEvent> m_events;
+    IrcEventBatch m_overflow;
+    std::atomic<bool> m_eventsNotified;
+    QTimer *m_notifyTimer;
+    int m_batchSize;
+
+    // GUI -> session, then paced onto the socket by m_sendQueue
+    SpscQueue<QByteArray> m_outbound;
+    std::atomic<bool> m_outboundNotified;
+    IrcSendQueue m_sendQueue;
+    QTimer *m_sendTimer;
+    QElapsedTimer m_sendClock;
+
+    ChannelState m_channels;
+    QString m_nickname;
+    IrcStringPool::Id m_nicknameId;
+    QString m_requestedNickname;  // as the GUI knows it until 001 says otherwise
+    int m_nickRetries;            // ERR_NICKNAMEINUSE answers while registering
+    int m_nickLength;             // ISUPPORT NICKLEN; 0 until the server sends it
+    bool m_registered;
+    QStringList m_rejoinChannels;
+    QStringList m_rejoinKeys;
+};
+
+#endif // IRCSESSION_H
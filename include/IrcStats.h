@@ -0,0 +1,105 @@
+#ifndef IRCSTATS_H
+#define IRCSTATS_H
+
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <chrono>
+
+// Always-on counters and latency histograms for the hot paths.
+//
+// Every thread that records gets its own block of counters, so recording
+// is a plain load and store on memory no other thread writes: no locks and
+// no contended cache lines. A thread's block goes to the next new thread
+// when it ends, counts and all. Histograms have fixed power-of-two buckets.
+// snapshot() sums the blocks of all threads; it may run on any thread
+// while recording goes on.
+class IrcStats
+{
+public:
+    enum Counter {
+        BytesIn,
+        BytesOut,
+        LinesParsed,
+        LinesSent,
+        EventsPublished,
+        EventsDelivered,
+        BatchesDelivered,
+        Allocations,       // operator new calls, where AllocationCounter.cpp is linked in
+        LogRecordsDropped, // IrcLog ring was full
+        LinesLegacyDecoded, // not UTF-8, decoded with the network's legacy encoding
+        MessagesIgnored,   // PRIVMSG, NOTICE and CTCP dropped by an ignore mask
+        CounterCount
+    };
+
+    enum Histogram {
+        ParseNs,           // one inbound line, IrcMessage parse
+        DispatchNs,        // one inbound line, handler incl. publishing its events
+        DeliveryNs,        // one batch, MainWindow handling every event in it
+        RenderNs,          // one ChatWidget flush into the model and view
+        PaintNs,           // one message row painted by MessageDelegate
+        DisplayLatencyUs,  // server send time to ChatWidget flush, for tagged lines
+        TlsHandshakeUs,    // TCP connect to encrypted, full or resumed
+        CompletionNs,      // one Tab in a ChatWidget's input line, candidate lookup
+        HistogramCount
+    };
+
+    enum Gauge {
+        EventQueueDepth,     // session -> GUI queue, plus anything spilled
+        SendQueueDepth,      // lines held back by flood control
+        PendingRenderLines,  // lines waiting for a ChatWidget flush
+        GaugeCount
+    };
+
+    static constexpr int BucketCount = 64;  // bucket b holds values in [2^(b-1), 2^b)
+
+    static void add(Counter counter, quint64 amount = 1);
+    static void record(Histogram histogram, quint64 value);
+    static void setGauge(Gauge gauge, qint64 value);
+
+    // Monotonic clock for the ns histograms
+    static quint64 nowNs()
+    {
+        const auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+    }
+
+    // Times a scope into a histogram, in nanoseconds
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Histogram histogram) : m_histogram(histogram), m_start(nowNs()) {}
+        ~ScopedTimer() { record(m_histogram, nowNs() - m_start); }
+
+    private:
+        Histogram m_histogram;
+        quint64 m_start;
+    };
+
+    struct HistogramSnapshot
+    {
+        quint64 count = 0;
+        quint64 sum = 0;
+        quint64 buckets[BucketCount] = {};
+        quint64 percentile(double p) const;  // upper bound of the bucket
+    };
+
+    struct Snapshot
+    {
+        quint64 counters[CounterCount] = {};
+        HistogramSnapshot histograms[HistogramCount];
+        qint64 gauges[GaugeCount] = {};
+        qint64 gaugePeaks[GaugeCount] = {};
+        int threads = 0;  // recording threads alive now
+    };
+
+    static Snapshot snapshot();
+    static QString format(const Snapshot &snapshot);
+    static bool dump(const QString &path);
+
+    static const char *name(Counter counter);
+    static const char *name(Histogram histogram);
+    static const char *name(Gauge gauge);
+};
+
+#endif // IRCSTATS_H
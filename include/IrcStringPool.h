@@ -0,0 +1,77 @@
+#ifndef IRCSTRINGPOOL_H
+#define IRCSTRINGPOOL_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include "IrcTextCodec.h"
+
+// Intern table for the nicks, channels and hosts of one connection.
+//
+// Every distinct name is stored once, as an implicitly shared canonical
+// QString, and identified by a small integer. Events carry the id plus a
+// shared copy of the canonical string, so a nick that appears in a
+// thousand messages is decoded and allocated once, and routing compares
+// integers instead of strings.
+//
+// Ids stay valid for the lifetime of the pool; nothing is ever removed, so
+// IrcConnection replaces a pool that has grown too large between
+// connections. intern() may be called from any thread; string() is
+// lock-free.
+class IrcStringPool
+{
+public:
+    typedef quint32 Id;
+    static constexpr Id NullId = 0;  // the empty string
+    // Past this many names intern() returns NullId
+    static constexpr int Capacity = 4096 * 1024;
+
+    struct Stats
+    {
+        qint64 lookups = 0;
+        qint64 uniqueStrings = 0;
+        qint64 storedBytes = 0;     // canonical strings actually allocated
+        qint64 requestedBytes = 0;  // what one string per lookup would cost
+        qint64 savedBytes() const { return requestedBytes - storedBytes; }
+    };
+
+    IrcStringPool();
+    ~IrcStringPool();
+
+    IrcStringPool(const IrcStringPool &) = delete;
+    IrcStringPool &operator=(const IrcStringPool &) = delete;
+
+    // Names that are not valid UTF-8 are decoded with this
+    void setLegacyEncoding(IrcTextCodec::Legacy legacy);
+
+    // Returns the id of the raw bytes, adding them on first use
+    Id intern(const char *data, int length);
+    Id intern(const QByteArray &bytes) { return intern(bytes.constData(), int(bytes.size())); }
+    Id intern(const QString &text);
+
+    const QString &string(Id id) const;
+    int count() const { return int(m_count.load(std::memory_order_acquire)); }
+    Stats stats() const;
+
+private:
+    static constexpr int ChunkBits = 10;
+    static constexpr int ChunkSize = 1 << ChunkBits;
+    static constexpr int MaxChunks = Capacity / ChunkSize;
+
+    static qint64 allocationSize(const QString &text);
+
+    // Canonical strings live in fixed chunks that never move, so readers
+    // can index them while the writer appends
+    std::atomic<QString *> m_chunks[MaxChunks];
+    std::atomic<Id> m_count;
+
+    mutable QMutex m_mutex;
+    QHash<QByteArray, Id> m_ids;
+    Stats m_stats;
+    IrcTextCodec::Legacy m_legacy;
+    bool m_full;  // warned that intern() gives NullId
+};
+
+#endif // IRCSTRINGPOOL_H
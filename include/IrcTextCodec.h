@@ -0,0 +1,56 @@
+#ifndef IRCTEXTCODEC_H
+#define IRCTEXTCODEC_H
+
+#include <QString>
+
+// Decoding of raw IRC bytes into QStrings.
+//
+// IRC has no declared encoding. Almost all traffic is UTF-8 and most of it
+// plain ASCII, but older clients still send Latin-1 or Windows-1252. Each
+// line is classified first: pure ASCII is only widened to UTF-16, valid
+// UTF-8 goes through QString::fromUtf8(), and anything else is decoded
+// with the network's legacy encoding instead of turning into U+FFFD.
+//
+// The classification scans for non-ASCII bytes 32 (AVX2, picked at run
+// time) or 16 (SSE2) bytes at a time, with a word-at-a-time scalar loop
+// elsewhere. Multi-byte sequences are validated one by one between the
+// ASCII runs, so the cost follows the amount of non-ASCII text.
+class IrcTextCodec
+{
+public:
+    // What a line that is not valid UTF-8 is taken to be
+    enum Legacy : quint8 {
+        Windows1252,  // Latin-1 plus the typographic characters at 0x80-0x9F
+        Latin1,
+        Utf8Replace   // UTF-8 anyway, invalid sequences become U+FFFD
+    };
+
+    enum Encoding : quint8 {
+        Unknown,
+        Ascii,
+        Utf8,
+        Invalid       // not UTF-8: decoded with the legacy encoding
+    };
+
+    static Encoding classify(const char *data, int length);
+    // Bytes before the first one with the high bit set
+    static int asciiPrefixLength(const char *data, int length);
+    static bool isValidUtf8(const char *data, int length);
+
+    static QString decode(const char *data, int length, Legacy legacy = Windows1252);
+    // With the classification of the line the bytes came from
+    static QString decode(const char *data, int length, Encoding encoding, Legacy legacy);
+    static QString fromLegacy(const char *data, int length, Legacy legacy);
+
+    // "cp1252" (or "windows-1252"), "latin1" (or "iso-8859-1"), "utf8"
+    static bool parseLegacy(const QString &name, Legacy *legacy);
+    static QString legacyName(Legacy legacy);
+
+    // The vector path in use on this CPU: "avx2", "sse2" or "scalar"
+    static const char *implementation();
+    // Switches to one of those paths, so tests can hold them against each
+    // other; false if this build or CPU lacks it
+    static bool setImplementation(const char *name);
+};
+
+#endif // IRCTEXTCODEC_H
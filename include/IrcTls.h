@@ -0,0 +1,70 @@
+#ifndef IRCTLS_H
+#define IRCTLS_H
+
+#include <QByteArray>
+#include <QList>
+#include <QSslConfiguration>
+#include <QString>
+
+// Where to connect, parsed from what the user typed:
+//   irc.libera.chat            TLS on 6697
+//   irc.libera.chat:+6697      TLS on the given port
+//   irc.example.org:6667       plain TCP
+//   ircs://host[:port]         TLS, 6697 by default
+//   irc://host[:port]          plain TCP, 6667 by default
+// A network may list alternate servers, separated by commas or spaces.
+struct IrcServerAddress
+{
+    QString host;
+    quint16 port = 6697;
+    bool tls = true;
+
+    static IrcServerAddress parse(const QString &text);
+    static QList<IrcServerAddress> parseList(const QString &text);
+    // Identifies the server for the session ticket and pin caches
+    QString key() const { return host.toLower() + ':' + QString::number(port); }
+};
+
+struct IrcTlsOptions
+{
+    bool enabled = false;
+    QString caFile;           // extra trusted CA certificates (PEM), e.g. a local test CA
+    QString certificateFile;  // client certificate (PEM), used to log in with SASL EXTERNAL
+    QString keyFile;          // its private key (PEM); empty if it is in certificateFile
+    bool pinning = false;     // trust servers seen before by certificate fingerprint
+
+    bool hasClientCertificate() const { return !certificateFile.isEmpty(); }
+};
+
+// TLS state shared by every session, whichever network thread it runs on.
+//
+// Session tickets: the last ticket a server issued is kept in memory and
+// offered on the next handshake with it, so a reconnect resumes the TLS
+// session instead of repeating the full handshake.
+//
+// Pins: with pinning on, the SHA-256 fingerprint of a server certificate
+// that passed full chain validation is remembered in the pin file. Later
+// handshakes with that server skip chain validation and only compare the
+// fingerprint; on a mismatch the session reconnects with full validation
+// and pins the new certificate if it passes.
+class IrcTls
+{
+public:
+    // Base configuration for options; on failure error says why
+    static QSslConfiguration configuration(const IrcTlsOptions &options, QString *error);
+
+    static QByteArray sessionTicket(const QString &server);
+    static void storeSessionTicket(const QString &server, const QByteArray &ticket, int lifetimeHintSeconds);
+
+    // Empty path: pins are kept for this run only. Defaults to tls-pins in
+    // the application data directory.
+    static void setPinFile(const QString &path);
+    static QByteArray pinnedFingerprint(const QString &server);
+    static void pin(const QString &server, const QByteArray &fingerprint);
+
+    // Options new connections start from, e.g. set from the command line
+    static void setDefaultOptions(const IrcTlsOptions &options);
+    static IrcTlsOptions defaultOptions();
+};
+
+#endif // IRCTLS_H
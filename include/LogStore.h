@@ -0,0 +1,179 @@
+#ifndef LOGSTORE_H
+#define LOGSTORE_H
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QLockFile>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include "MessageLogModel.h"
+#include "SearchIndex.h"
+
+class LogStoreWriter;
+
+// Persistent chat history for one network.
+//
+// Lines from every buffer go into one append-only stream of segment files
+// (00000001.seg, 00000002.seg, ...) of at most SegmentSize bytes. Each
+// segment has a sparse index (.idx) of 16-byte entries: timestamp, offset
+// and buffer hash. An entry is written every IndexInterval bytes and for
+// the first line of each buffer in the segment, so the index also tells
+// which buffers a segment holds at all.
+//
+// Appends are encoded on the calling thread, batched, and written by a
+// background thread. History is read back on demand through memory-mapped
+// segments, newest first, so nothing is loaded at startup.
+//
+// The directory is locked while a LogStore has it open. A second instance
+// on the same network would pick the same next segment and interleave its
+// appends, so it gets no log at all: isOpen() is false.
+//
+// Message lines are also indexed for search (SearchIndex), in memory for
+// the segment being written and in a .fts file per sealed segment.
+// Segments from earlier runs that lack one are indexed on a second
+// background thread; search skips them until that is done.
+//
+// A record is framed by its own size at both ends so segments can be
+// walked backwards:
+//
+//   u32 size, i64 timestamp (ms), u8 kind, u8 0, u16 buffer length,
+//   u16 sender length, buffer, sender, text (UTF-8), u32 size
+class LogStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr qint64 SegmentSize = 4 * 1024 * 1024;
+    static constexpr qint64 IndexInterval = 64 * 1024;
+
+    struct SearchHit
+    {
+        QString buffer;
+        MessageLogModel::Entry line;
+    };
+
+    struct SearchResults
+    {
+        QVector<SearchHit> hits;  // newest first
+        int pendingSegments = 0;  // not indexed yet, so not searched
+    };
+
+    // Where reading a buffer's history backwards got to: the start of the
+    // oldest record read. A null cursor stands for the end of the log.
+    struct Cursor
+    {
+        int segment = 0;    // segment number; numbers start at 1
+        qint64 offset = 0;
+        bool isNull() const { return segment == 0; }
+    };
+
+    // directory is created if needed, and locked
+    explicit LogStore(const QString &directory, QObject *parent = nullptr);
+    ~LogStore() override;
+
+    bool isOpen() const { return m_open; }
+    QString directory() const { return m_dir.path(); }
+
+    void append(const QString &buffer, const QVector<MessageLogModel::Entry> &entries);
+    // Hands everything appended so far to the writer thread
+    void flush();
+
+    // Up to count lines of buffer from before cursor, oldest first, once
+    // the skip newest of them have been passed over; cursor is moved to
+    // the oldest line returned. Paging by position rather than by time
+    // loses no line to another in the same millisecond or to a buffer
+    // that was flushed late. Buffer names compare case-insensitively.
+    QVector<MessageLogModel::Entry> readBefore(const QString &buffer, Cursor *cursor, int count, int skip = 0);
+
+    // Message lines matching query, newest first, at most limit of them
+    SearchResults search(const SearchQuery &query, int limit);
+
+    // Default location for a network's log, under the application data dir
+    static QString defaultDirectory(const QString &network);
+
+private:
+    struct IndexEntry
+    {
+        qint64 timestamp;
+        quint32 offset;
+        quint32 bufferHash;
+    };
+
+    struct Segment
+    {
+        int number = 0;
+        qint64 size = 0;      // bytes of whole records
+        bool indexLoaded = false;
+        QVector<IndexEntry> index;
+        QSet<quint32> buffers;
+        qint64 lastIndexOffset = -IndexInterval;
+
+        // Read side: mapped up to mappedSize, or not at all
+        QFile *file = nullptr;
+        const uchar *map = nullptr;
+        qint64 mappedSize = 0;
+
+        SearchIndexFile *search = nullptr;  // opened when searched, or not at all
+    };
+
+    static quint32 bufferHash(const char *name, int length);
+    static bool indexRecord(Segment &segment, qint64 timestamp, quint32 offset, quint32 hash);
+    QString segmentPath(int number, const char *suffix) const;
+    void openSegments();
+    void startSegment();
+    void sealSegment();
+    bool loadSegment(int segment);
+    const uchar *mapSegment(int segment, qint64 size);
+    void unmapSegment(int segment);
+    SearchIndexFile *openSearchIndex(int segment);
+    void closeSearchIndex(int segment);
+    void sync();
+
+    QDir m_dir;
+    QLockFile *m_lock;
+    bool m_open;
+    QVector<Segment> m_segments;  // oldest first; the last one is appended to
+    QVector<int> m_mapped;        // segments with a live mapping, least recently used first
+    QVector<int> m_searchOpen;    // segments with an open .fts, least recently used first
+
+    // Encoded but not yet handed to the writer
+    QByteArray m_pendingRecords;
+    QByteArray m_pendingIndex;
+    SearchIndex m_liveSearch;  // of the segment being written
+    QTimer *m_flushTimer;
+    bool m_synced;  // the writer has caught up with every flush()
+
+    QThread m_thread;
+    LogStoreWriter *m_writer;
+    QThread m_indexThread;
+    LogStoreWriter *m_indexer;
+};
+
+// LogStore's file work: appending segments and indexes on one background
+// thread, building search indexes of old segments on another
+class LogStoreWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LogStoreWriter(QObject *parent = nullptr) : QObject(parent) {}
+
+    void write(const QString &segmentPath, const QString &indexPath,
+               const QByteArray &records, const QByteArray &index);
+    void close();
+    void writeSearchIndex(const QString &path, const SearchIndex &search);
+    // Scans a segment from an earlier run and writes its .fts
+    void buildSearchIndex(const QString &segmentPath, const QString &searchPath);
+
+private:
+    QFile m_segment;
+    QFile m_index;
+};
+
+#endif // LOGSTORE_H
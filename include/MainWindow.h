@@ -2,13 +2,22 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QTabWidget>
-#include <QMap>
+#include <QStackedWidget>
+#include <QTreeWidget>
+#include <QHash>
+#include <QList>
 #include <QMenuBar>
 #include <QMenu>
 #include <QAction>
-#include "IrcConnection.h"
+#include <QPointer>
+#include <QThread>
+#include <QTimer>
 #include "ChatWidget.h"
+#include "IrcCoreLink.h"
+#include "NetworkController.h"
+#include "SearchDialog.h"
+#include "SessionSnapshot.h"
+#include "StatsDock.h"
 
 class MainWindow : public QMainWindow
 {
@@ -16,51 +25,76 @@ class MainWindow : public QMainWindow
 
 public:
     explicit MainWindow(QWidget *parent = nullptr);
+    // Writes the session snapshot, unless attached to a core
     ~MainWindow();
 
+    // Shows the networks and buffers of the last session, before the first
+    // paint, and reconnects those that were connected
+    void restoreSession();
+    // Shows the networks of the headless core listening at name instead,
+    // and sends through it from now on. False if there is none.
+    bool attachToCore(const QString &name);
+
 private slots:
     void onConnectAction();
     void onDisconnectAction();
+    void onCloseNetworkAction();
     void onJoinChannelAction();
+    void onCloseBufferAction();
     void onQuitAction();
-    
-    // IRC connection handlers
-    void onConnected();
-    void onDisconnected();
+    void onSearchAction();
+
+    // Network handlers; the network is the sender
+    void onBufferAdded(ChatWidget *widget);
+    void onBufferRemoved(ChatWidget *widget);
+    void onNetworkStateChanged();
     void onConnectionError(const QString &error);
-    void onMessageReceived(const QString &sender, const QString &target, const QString &message);
-    void onJoinedChannel(const QString &channel, const QString &user);
-    void onPartedChannel(const QString &channel, const QString &user);
-    void onUserListReceived(const QString &channel, const QStringList &users);
-    void onTopicReceived(const QString &channel, const QString &topic);
-    void onServerMessageReceived(const QString &message);
-    
-    // Chat widget handlers
-    void onChatMessageSent(const QString &message);
-    void onTabCloseRequested(int index);
+    void onSearchRequested(const QString &query);
+    void onFilterRulesChanged(const IrcFilterRules &rules);
+
+    void onCurrentItemChanged(QTreeWidgetItem *current);
+    void onBufferActivityChanged();
+    void onSnapshotTimeout();
+
+    // Core handlers
+    void onCoreNetworkAdded(const IrcCoreProtocol::Network &network);
+    void onCoreNetworkRemoved(quint32 id);
+    void onCoreDetached();
 
 private:
     void setupUi();
     void setupMenuBar();
-    void createServerTab();
-    ChatWidget* getOrCreateChatWidget(const QString &channelName);
-    ChatWidget* getCurrentChatWidget();
+    NetworkController* addNetwork(const QList<IrcServerAddress> &addresses, const QString &nickname,
+                                  IrcConnection *connection = nullptr);
+    void closeNetwork(NetworkController *network);
+    NetworkController* networkFor(ChatWidget *widget) const;
+    NetworkController* currentNetwork() const;
+    ChatWidget* getCurrentChatWidget() const;
     void showConnectionDialog();
     void showJoinChannelDialog();
     void updateWindowTitle();
+    void updateActions();
+    void showSearch(LogStore *store, const QString &query);
+    QTreeWidgetItem* addBufferItem(ChatWidget *widget, const QString &label, QTreeWidgetItem *parent);
+    SessionSnapshot sessionSnapshot() const;
+
+    QTreeWidget *m_bufferTree;  // a top-level item per network, a child per channel or query
+    QStackedWidget *m_bufferStack;
+    QList<NetworkController*> m_networks;
+    IrcFilterRules m_filterRules;  // shared by every network
+    QHash<ChatWidget*, QTreeWidgetItem*> m_bufferItems;
+    StatsDock *m_statsDock;
+    QTimer *m_snapshotTimer;
+    QPointer<QThread> m_snapshotWriter;  // the periodic write in progress, if any
+    IrcCoreLink *m_core;  // null unless attached to a core
+    SearchDialog *m_searchDialog;
 
-    QTabWidget *m_tabWidget;
-    IrcConnection *m_ircConnection;
-    QMap<QString, ChatWidget*> m_chatWidgets;
-    ChatWidget *m_serverWidget;
-    
-    QString m_currentNickname;
-    QString m_currentServer;
-    
     // Menu actions
     QAction *m_connectAction;
     QAction *m_disconnectAction;
+    QAction *m_closeNetworkAction;
     QAction *m_joinChannelAction;
+    QAction *m_closeBufferAction;
 };
 
 #endif // MAINWINDOW_H
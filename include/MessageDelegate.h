@@ -0,0 +1,40 @@
+#ifndef MESSAGEDELEGATE_H
+#define MESSAGEDELEGATE_H
+
+#include <QHash>
+#include <QStyledItemDelegate>
+
+class QTextLayout;
+
+// Paints one MessageLogModel row: gray timestamp, bold sender and text.
+//
+// Text wider than the view wraps, indented under its own start. Row
+// heights depend on the width, so the view reports it with setWidth();
+// heights are cached by the line's serial number and thrown away when the
+// width changes. Only the rows the view asks about are measured.
+class MessageDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit MessageDelegate(QObject *parent = nullptr);
+
+    // The viewport's width, which the rows wrap to
+    void setWidth(int width);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option,
+               const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+private:
+    // Left edge of the text within a row, after the timestamp and sender
+    static int textIndent(const QStyleOptionViewItem &option, const QModelIndex &index);
+    // Wraps layout to width and returns its height
+    static int wrap(QTextLayout &layout, int width);
+    static QString rowText(const QModelIndex &index);
+
+    int m_width;
+    mutable QHash<quint32, int> m_heights;  // by serial, at m_width
+};
+
+#endif // MESSAGEDELEGATE_H
@@ -0,0 +1,69 @@
+#ifndef MESSAGELOGMODEL_H
+#define MESSAGELOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QString>
+#include <QVector>
+
+// Scrollback for one chat tab.
+//
+// Lines are kept as records in a ring buffer that never holds more than
+// lineLimit() entries; once full, each new line replaces the oldest.
+// Nothing is laid out here; each line has a serial number that stays with
+// it, so the view can cache the row's height however the rows shift.
+class MessageLogModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Kind : quint8 {
+        Message,    // <sender> text
+        System      // * text
+    };
+
+    enum Roles {
+        TimestampRole = Qt::UserRole + 1,  // qint64, ms since the epoch
+        SenderRole,
+        TextRole,
+        KindRole,
+        SerialRole   // quint32, unique to the line within this model
+    };
+
+    struct Entry
+    {
+        qint64 timestamp = 0;
+        QString sender;
+        QString text;
+        Kind kind = Message;
+        quint32 serial = 0;  // given by the model
+    };
+
+    static constexpr int DefaultLineLimit = 5000;
+
+    explicit MessageLogModel(QObject *parent = nullptr);
+
+    void append(const QVector<Entry> &entries);
+    // Older lines, e.g. paged in from a LogStore, go above the first row.
+    // Nothing is evicted: lineLimit() grows to fit until setLineLimit().
+    void prepend(const QVector<Entry> &entries);
+    void clear();
+
+    int lineLimit() const { return m_lineLimit; }
+    void setLineLimit(int limit);
+
+    const Entry &entry(int row) const { return m_entries.at((m_first + row) % m_entries.size()); }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    static QString formatTime(qint64 timestamp);
+
+private:
+    QVector<Entry> m_entries;  // ring buffer, grows up to m_lineLimit
+    int m_first;
+    int m_count;
+    int m_lineLimit;
+    quint32 m_nextSerial;
+};
+
+#endif // MESSAGELOGMODEL_H
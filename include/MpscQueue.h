@@ -0,0 +1,97 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Bounded multi-producer/single-consumer lock-free queue.
+//
+// Any number of threads may push; exactly one thread may pop. Each slot
+// carries a sequence number that says whose turn it is, so producers only
+// contend on the tail index and never wait for each other to finish
+// writing. A full queue makes push() fail instead of blocking. Capacity is
+// rounded up to a power of two.
+template<typename T>
+class MpscQueue
+{
+public:
+    explicit MpscQueue(std::size_t capacity)
+        : m_capacity(roundUp(capacity))
+        , m_mask(m_capacity - 1)
+        , m_slots(new Slot[m_capacity])
+    {
+        for (std::size_t i = 0; i < m_capacity; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    // Any thread. Returns false if the queue is full.
+    template<typename U>
+    bool push(U &&value)
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = m_slots[tail & m_mask];
+            const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t lag = std::ptrdiff_t(sequence) - std::ptrdiff_t(tail);
+            if (lag == 0) {
+                if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                    slot.value = std::forward<U>(value);
+                    slot.sequence.store(tail + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;
+            } else {
+                tail = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side. Returns false if the queue is empty, or if the next
+    // producer has claimed its slot but not finished writing it.
+    bool pop(T &value)
+    {
+        Slot &slot = m_slots[m_head & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.sequence.store(m_head + m_capacity, std::memory_order_release);
+        ++m_head;
+        return true;
+    }
+
+    std::size_t capacity() const { return m_capacity; }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    static std::size_t roundUp(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    const std::size_t m_capacity;
+    const std::size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+
+    // Shared by producers; the consumer index is private to the consumer
+    alignas(64) std::atomic<std::size_t> m_tail { 0 };
+    alignas(64) std::size_t m_head = 0;
+};
+
+#endif // MPSCQUEUE_H
@@ -0,0 +1,160 @@
+#ifndef NETWORKCONTROLLER_H
+#define NETWORKCONTROLLER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include "DccManager.h"
+#include "IrcConnection.h"
+#include "IrcTls.h"
+#include "ChatWidget.h"
+#include "LogStore.h"
+
+// Everything kept per network: the connection, its server buffer, the
+// channel and query buffers, and the history store.
+//
+// The controller routes its connection's events to its own buffers, so ids
+// from one network's string pool never meet another's. MainWindow only
+// places the buffers in its tree and sends actions to the current network.
+//
+// A connection that drops after it was up is retried with jittered
+// exponential backoff, going round the network's server addresses. The
+// buffers stay, and the channels we were in are rejoined in one burst.
+//
+// DCC offers made to us wait for "/dcc get"; the transfers themselves run
+// in the shared DccManager, and closing the network cancels its own.
+//
+// Highlight words and ignore masks are shared by all networks: /highlight
+// and /ignore edit them here and MainWindow hands the result to every
+// network, whose session matches them.
+//
+// With a remote IrcConnection the network lives in a headless core, which
+// reconnects by itself; the controller then only shows what it reports.
+class NetworkController : public QObject
+{
+    Q_OBJECT
+
+public:
+    // addresses must not be empty; the first one names the network. The
+    // controller takes connection over, or makes a local one if it is null.
+    NetworkController(const QList<IrcServerAddress> &addresses, const QString &nickname,
+                      IrcConnection *connection = nullptr, QObject *parent = nullptr);
+    ~NetworkController();
+
+    QString server() const { return m_addresses.at(m_addressIndex).host; }
+    bool hasServer(const QString &host) const;
+    // Takes effect on the next connectToServer()
+    void setAddresses(const QList<IrcServerAddress> &addresses);
+    QString nickname() const { return m_nickname; }
+    void setNickname(const QString &nickname);
+    IrcFilterRules filterRules() const { return m_filterRules; }
+    void setFilterRules(const IrcFilterRules &rules);
+    IrcConnection *connection() const { return m_connection; }
+    LogStore *logStore() const { return m_logStore; }
+    ChatWidget *serverWidget() const { return m_serverWidget; }
+    QList<ChatWidget*> chatWidgets() const { return m_chatWidgets.values(); }
+    bool owns(ChatWidget *widget) const;
+    bool isConnected() const { return m_connection->isConnected(); }
+    // Waiting to try the next server after a dropped connection
+    bool isReconnecting() const { return m_reconnectTimer->isActive(); }
+
+    void connectToServer();
+    // Also stops reconnecting
+    void disconnectFromServer();
+    void joinChannel(const QString &channel, const QString &key = QString());
+    // Parts the channel and drops its buffer; the server buffer stays
+    void closeBuffer(ChatWidget *widget);
+
+    // Addresses, nick and state; MainWindow adds the buffers in tree order
+    SessionSnapshot::Network snapshot() const;
+    // Recreates the buffers of a snapshot, the server buffer's lines
+    // included, and reconnects if the network was connected. Its channels
+    // are rejoined in the usual burst, which refreshes members and topics.
+    void restore(const SessionSnapshot::Network &network);
+
+signals:
+    void bufferAdded(ChatWidget *widget);
+    // Emitted before the widget is deleted
+    void bufferRemoved(ChatWidget *widget);
+    // Connected, disconnected or our nickname changed
+    void stateChanged();
+    void connectionError(const QString &error);
+    void searchRequested(const QString &query);
+    // Edited with /highlight or /ignore, and already saved
+    void filterRulesChanged(const IrcFilterRules &rules);
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onConnectionError(const QString &error);
+    void onEventsReady(const IrcEventBatch &events);
+    void onStringsRenewed();
+    void onChatMessageSent(const QString &message);
+    void onReconnectTimeout();
+    void onDccTransferChanged(const DccTransfer &transfer);
+    void onDccRequestReady(const DccTransfer &transfer, const DccMessage &request);
+
+private:
+    // IRC event handlers, called for each event of a batch
+    void onMessageReceived(const IrcEvent &event);
+    void onNoticeReceived(const IrcEvent &event);
+    void onJoinedChannel(const IrcEvent &event);
+    void onPartedChannel(const IrcEvent &event);
+    void onUserListReceived(const IrcEvent &event);
+    void onPrefixesChanged(const IrcEvent &event);
+    void onTopicReceived(const IrcEvent &event);
+    void onServerMessageReceived(const IrcEvent &event);
+    void onUserQuit(const IrcEvent &event);
+    void onUserKicked(const IrcEvent &event);
+    void onNickChanged(const IrcEvent &event);
+    // Whether nick is us, in any spelling the server's CASEMAPPING allows
+    bool isSelf(IrcStringPool::Id nick) const { return m_connection->sameName(nick, m_nickId); }
+    void onModeChanged(const IrcEvent &event);
+    void onCtcpReceived(const IrcEvent &event);
+
+    ChatWidget* getOrCreateChatWidget(IrcStringPool::Id name);
+    void removeChatWidget(ChatWidget *widget);
+    void showStats(ChatWidget *widget, const QStringList &arguments);
+    void scheduleReconnect();
+    void handleFilterCommand(ChatWidget *widget, const QString &command, const QStringList &arguments);
+    void handleDccCommand(ChatWidget *widget, const QStringList &arguments);
+    void acceptDccOffer(ChatWidget *widget, const QString &peer, const QString &fileName);
+    void trackDccTransfer(int id, const QString &peer, const QString &path);
+    // The peer's query buffer if there is one, else the server buffer
+    ChatWidget* dccWidget(const QString &peer) const;
+
+    QList<IrcServerAddress> m_addresses;
+    int m_addressIndex;
+    QString m_nickname;
+    IrcStringPool::Id m_nickId;
+    IrcTextCodec::Legacy m_legacyEncoding;  // for lines that are not UTF-8, set with /encoding
+    IrcFilterRules m_filterRules;
+    IrcConnection *m_connection;
+    LogStore *m_logStore;
+    ChatWidget *m_serverWidget;
+    QHash<IrcStringPool::Id, ChatWidget*> m_chatWidgets;  // by interned channel or nick
+
+    // Reconnection
+    bool m_autoReconnect;     // set once connected, cleared by disconnectFromServer()
+    int m_reconnectAttempts;  // since the last connection that stayed up
+    QTimer *m_reconnectTimer;
+    QElapsedTimer m_connectedTime;
+    QSet<IrcStringPool::Id> m_joinedChannels;  // rejoined after a reconnect
+    CompletionIndex m_channelCompletion;       // the same, for Tab in any buffer
+    QHash<QString, QString> m_channelKeys;     // by lower-case channel name
+
+    // DCC
+    struct DccOffer
+    {
+        QString peer;
+        DccMessage message;
+    };
+    QList<DccOffer> m_dccOffers;             // made to us, oldest first
+    QHash<int, DccTransfer> m_dccTransfers;  // ours, by id, finished ones too
+};
+
+#endif // NETWORKCONTROLLER_H
@@ -0,0 +1,79 @@
+#ifndef NICKLISTMODEL_H
+#define NICKLISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "IrcPrefixSupport.h"
+
+// Member list of one channel, ordered by channel rank and then by nick.
+//
+// Members are kept in a sorted vector with a nick -> rank hash beside it.
+// Finding a member's row is a binary search, and inserting or removing
+// one moves only the tail of a flat array. Nobody is ever compared one by
+// one against the whole list. reset() loads a full NAMES reply with a
+// single sort. Ranks come from the server's RPL_ISUPPORT PREFIX token.
+class NickListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles {
+        NickRole = Qt::UserRole + 1,  // nick without prefixes
+        PrefixesRole,                 // every prefix held, highest first
+        RankRole                      // 0 = highest; prefix count = none
+    };
+
+    explicit NickListModel(QObject *parent = nullptr);
+
+    // PREFIX token value, e.g. "(qaohv)~&@%+"
+    void setPrefixSupport(const QString &prefix);
+    QString prefixModes() const { return m_prefixSupport.modes(); }
+    QString prefixSymbols() const { return m_prefixSupport.symbols(); }
+
+    // Names as sent in RPL_NAMREPLY: optional prefixes, then the nick
+    void reset(const QStringList &names);
+    void clear();
+
+    bool contains(const QString &nick) const { return m_ranks.contains(nick); }
+    QString prefixes(const QString &nick) const;
+    int memberCount() const { return int(m_members.size()); }
+    // Every member's nick, in list order
+    QStringList nicks() const;
+    // The same with all their prefixes, as reset() takes them
+    QStringList names() const;
+    // The nick of a name as sent in RPL_NAMREPLY
+    QString nickOf(const QString &name) const { return m_prefixSupport.parseName(name); }
+
+    void addMember(const QString &name);
+    void removeMember(const QString &nick);
+    void renameMember(const QString &oldNick, const QString &newNick);
+    void setPrefixes(const QString &nick, const QString &prefixes);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private:
+    struct Member
+    {
+        QString nick;
+        QString prefixes;
+        int rank = 0;
+    };
+
+    Member parseName(const QString &name) const;
+    int lowerBound(int rank, const QString &nick) const;
+    int rowOf(const QString &nick) const;
+    void insertMember(const Member &member);
+
+    static bool lessThan(const Member &a, const Member &b);
+    static bool lessThan(int rankA, const QString &nickA, int rankB, const QString &nickB);
+
+    QVector<Member> m_members;     // sorted by (rank, nick)
+    QHash<QString, int> m_ranks;   // nick -> rank, for finding rows
+    IrcPrefixSupport m_prefixSupport;
+};
+
+#endif // NICKLISTMODEL_H
@@ -0,0 +1,37 @@
+#ifndef SEARCHDIALOG_H
+#define SEARCHDIALOG_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QLineEdit>
+#include <QTableWidget>
+
+class LogStore;
+
+// Searches the chat history of the current network, newest first.
+// See SearchQuery for the syntax.
+class SearchDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit SearchDialog(QWidget *parent = nullptr);
+
+    void setLogStore(LogStore *store) { m_store = store; }
+    LogStore *logStore() const { return m_store; }
+    // Fills in the query and runs it
+    void search(const QString &query);
+
+private slots:
+    void runSearch();
+
+private:
+    static constexpr int MaxResults = 500;
+
+    LogStore *m_store;
+    QLineEdit *m_queryLine;
+    QTableWidget *m_results;
+    QLabel *m_status;
+};
+
+#endif // SEARCHDIALOG_H
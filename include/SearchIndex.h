@@ -0,0 +1,79 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// What to look for: every term must match. Built by parse() from text like
+//   deploy failed from:alice in:#ops after:2024-05-01 before:2024-06-01
+struct SearchQuery
+{
+    QVector<QByteArray> terms;
+    qint64 after = 0;   // ms since the epoch, 0 for no bound
+    qint64 before = 0;
+
+    static SearchQuery parse(const QString &text);
+    bool isEmpty() const { return terms.isEmpty(); }
+};
+
+// Inverted index of the lines in one LogStore segment.
+//
+// Terms are lowercased words of the message text, plus one term for the
+// sender and one for the buffer, so nick and channel filters are just more
+// terms to intersect. A posting list holds the offsets of the records
+// that contain the term, ascending, delta-encoded as varints.
+//
+// The segment being written keeps its index in memory; sealed segments
+// have theirs serialized to a .fts file next to the segment, read through
+// SearchIndexFile.
+class SearchIndex
+{
+public:
+    void add(quint32 offset, const QVector<QByteArray> &terms);
+    bool isEmpty() const { return m_terms.isEmpty(); }
+    QVector<quint32> postings(const QByteArray &term) const;
+
+    // .fts layout: magic "QTIRCFTS", u32 version, u32 term count, u32
+    // offset of each term entry (sorted by term), then the entries:
+    // varint term length, term, varint posting count, varint posting
+    // bytes, postings. Integers are little-endian.
+    QByteArray serialize() const;
+
+    static QVector<QByteArray> terms(const QString &buffer, const QString &sender, const QString &text);
+    static QVector<QByteArray> words(const QString &text);
+    static QByteArray senderTerm(const QString &nick) { return '\x01' + nick.toLower().toUtf8(); }
+    static QByteArray bufferTerm(const QString &buffer) { return '\x02' + buffer.toLower().toUtf8(); }
+
+    // Offsets present in every list
+    static QVector<quint32> intersect(QVector<QVector<quint32>> lists);
+    static QVector<quint32> decode(const char *data, int length, int count);
+
+private:
+    struct Postings
+    {
+        QByteArray bytes;
+        quint32 last = 0;
+        int count = 0;
+    };
+
+    QHash<QByteArray, Postings> m_terms;
+};
+
+// A sealed segment's index, memory-mapped and searched in place
+class SearchIndexFile
+{
+public:
+    bool open(const QString &path);
+    QVector<quint32> postings(const QByteArray &term) const;
+
+private:
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    quint32 m_termCount = 0;
+};
+
+#endif // SEARCHINDEX_H
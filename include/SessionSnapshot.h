@@ -0,0 +1,75 @@
+#ifndef SESSIONSNAPSHOT_H
+#define SESSIONSNAPSHOT_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "IrcCoreProtocol.h"
+#include "IrcTls.h"
+#include "MessageLogModel.h"
+
+// What the window showed, so the next start can show it again at once.
+//
+// MainWindow writes one on exit and every minute. On start the file is
+// memory-mapped and decoded straight into the buffers before the window is
+// first painted; the connections then rejoin and replace the member lists
+// and topics as the server sends them. Only the last LinesPerBuffer lines
+// of each buffer are kept: older ones are in the network's LogStore and page
+// in from there as usual.
+//
+// Layout, integers little-endian, strings as u32 byte length + UTF-8:
+//
+//   "QTIRCSES", u32 version, u32 network count,
+//   i32 current network, i32 current buffer (-1 if none), then per network:
+//     u32 address count, per address: str host, u16 port, u8 tls;
+//     str nickname, u8 flags (1 = was connected), u32 buffer count,
+//     then per buffer, the server buffer first, in tree order:
+//       str name, str topic, str members (RPL_NAMREPLY form, space separated),
+//       u32 line count, per line: i64 timestamp (ms), u8 kind, str sender, str text
+struct SessionSnapshot
+{
+    static constexpr int LinesPerBuffer = 100;
+
+    struct Buffer
+    {
+        QString name;
+        QString topic;
+        QStringList members;  // prefixes and nick, as in RPL_NAMREPLY
+        QVector<MessageLogModel::Entry> lines;  // oldest first
+        bool linesInLog = true;  // also in the LogStore; not those of a core
+    };
+
+    struct Network
+    {
+        QList<IrcServerAddress> addresses;
+        QString nickname;
+        bool connected = false;  // connected or reconnecting when written
+        QVector<Buffer> buffers;  // the server buffer first
+    };
+
+    QVector<Network> networks;
+    int currentNetwork = -1;
+    int currentBuffer = -1;
+
+    bool isEmpty() const { return networks.isEmpty(); }
+
+    QByteArray serialize() const;
+    // False, with snapshot untouched, for a truncated, foreign or
+    // other-version file
+    static bool parse(const uchar *data, qint64 size, SessionSnapshot *snapshot);
+
+    // Written through a temporary file, so a crash never leaves half a snapshot
+    static bool write(const QString &path, const QByteArray &data);
+    // Empty if there is no usable snapshot at path
+    static SessionSnapshot read(const QString &path);
+    // Under the application data directory
+    static QString defaultPath();
+
+    // A network as a core sends it on attach, to be restored like a saved
+    // one. It comes back as not connected: the core keeps it up by itself.
+    static Network fromCore(const IrcCoreProtocol::Network &network);
+};
+
+#endif // SESSIONSNAPSHOT_H
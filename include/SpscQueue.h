@@ -0,0 +1,87 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded single-producer/single-consumer lock-free queue.
+//
+// Exactly one thread may push and exactly one (possibly different) thread
+// may pop. Both sides only touch their own index plus an acquire load of the
+// other's, so neither ever blocks the other. Capacity is rounded up to a
+// power of two.
+template<typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(std::size_t capacity)
+        : m_slots(roundUp(capacity))
+        , m_mask(m_slots.size() - 1)
+    {
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // Producer side. Returns false if the queue is full.
+    template<typename U>
+    bool push(U &&value)
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead > m_mask) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead > m_mask) {
+                return false;
+            }
+        }
+        m_slots[tail & m_mask] = std::forward<U>(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool pop(T &value)
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail) {
+                return false;
+            }
+        }
+        value = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called concurrently with push() or pop()
+    std::size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+    bool isEmpty() const { return size() == 0; }
+    std::size_t capacity() const { return m_slots.size(); }
+
+private:
+    static std::size_t roundUp(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    std::vector<T> m_slots;
+    const std::size_t m_mask;
+
+    // Producer and consumer indices live on separate cache lines
+    alignas(64) std::atomic<std::size_t> m_tail { 0 };
+    std::size_t m_cachedHead = 0;
+    alignas(64) std::atomic<std::size_t> m_head { 0 };
+    std::size_t m_cachedTail = 0;
+};
+
+#endif // SPSCQUEUE_H
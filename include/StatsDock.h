@@ -0,0 +1,34 @@
+#ifndef STATSDOCK_H
+#define STATSDOCK_H
+
+#include <QDockWidget>
+#include <QList>
+#include <QPlainTextEdit>
+#include <QTimer>
+
+class IrcConnection;
+
+// Debug dock showing IrcStats, refreshed once a second while it is visible
+class StatsDock : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    explicit StatsDock(QWidget *parent = nullptr);
+
+    // Connections whose own figures are listed below the totals
+    void addConnection(IrcConnection *connection);
+    void removeConnection(IrcConnection *connection);
+
+private slots:
+    void refresh();
+    void onDumpClicked();
+    void onVisibilityChanged(bool visible);
+
+private:
+    QPlainTextEdit *m_view;
+    QTimer *m_refreshTimer;
+    QList<IrcConnection*> m_connections;
+};
+
+#endif // STATSDOCK_H
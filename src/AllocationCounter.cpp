@@ -0,0 +1,27 @@
+#include "IrcStats.h"
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions to count every heap allocation
+// of the application into IrcStats::Allocations. Only the IRCClient
+// executable links this file in; the extra cost per allocation is one
+// per-thread counter increment.
+
+void *operator new(std::size_t size)
+{
+    IrcStats::add(IrcStats::Allocations);
+    if (void *memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
@@ -0,0 +1,347 @@
+#include "ChannelState.h"
+
+namespace {
+
+// Folded names kept for reuse; past this many the cache starts over, so
+// nicks that have long left do not stay in it
+const int MaxCachedKeys = 16384;
+
+} // namespace
+
+ChannelState::ChannelState(IrcStringPool *strings)
+    : m_strings(strings)
+    , m_foldLimit('^')
+    , m_listModes("beI")
+    , m_settingModes("k")
+    , m_paramModes("l")
+    , m_channelTypes("#&")
+{
+}
+
+void ChannelState::setCaseMapping(const QString &mapping)
+{
+    // rfc1459 also folds [ \ ] ^ onto { | } ~, strict-rfc1459 all but ^
+    if (mapping == "ascii") {
+        m_foldLimit = 'Z';
+    } else if (mapping == "strict-rfc1459") {
+        m_foldLimit = ']';
+    } else {
+        m_foldLimit = '^';
+    }
+    m_keys.clear();
+}
+
+void ChannelState::setPrefixSupport(const QString &prefix)
+{
+    m_prefixes.parse(prefix);
+}
+
+void ChannelState::setChannelModes(const QString &chanmodes)
+{
+    // A,B,C,D: list modes, modes with a setting, modes with a parameter
+    // when set, and flags; only the first three consume arguments
+    const QStringList types = chanmodes.split(',');
+    m_listModes = types.value(0);
+    m_settingModes = types.value(1);
+    m_paramModes = types.value(2);
+}
+
+void ChannelState::setChannelTypes(const QString &chantypes)
+{
+    m_channelTypes = chantypes;
+}
+
+void ChannelState::applyISupport(const QString &token)
+{
+    if (token.startsWith("CASEMAPPING=")) {
+        setCaseMapping(token.mid(12));
+    } else if (token.startsWith("PREFIX=")) {
+        setPrefixSupport(token.mid(7));
+    } else if (token.startsWith("CHANMODES=")) {
+        setChannelModes(token.mid(10));
+    } else if (token.startsWith("CHANTYPES=")) {
+        setChannelTypes(token.mid(10));
+    }
+}
+
+bool ChannelState::isChannel(const QString &name) const
+{
+    return !name.isEmpty() && m_channelTypes.contains(name.at(0));
+}
+
+QString ChannelState::foldCase(const QString &name) const
+{
+    int i = 0;
+    while (i < name.size() && (name.at(i).unicode() < 'A' || name.at(i).unicode() > m_foldLimit)) {
+        ++i;
+    }
+    if (i == name.size()) {
+        return name;
+    }
+
+    QString folded = name;
+    for (; i < folded.size(); ++i) {
+        const ushort c = folded.at(i).unicode();
+        if (c >= 'A' && c <= m_foldLimit) {
+            folded[i] = QChar(ushort(c + 32));
+        }
+    }
+    return folded;
+}
+
+void ChannelState::clear()
+{
+    m_channels.clear();
+    m_nickChannels.clear();
+    m_pendingNames.clear();
+    // Folded forms of every name seen; they come back as needed
+    m_keys.clear();
+}
+
+QString ChannelState::key(Id id) const
+{
+    auto it = m_keys.constFind(id);
+    if (it == m_keys.constEnd()) {
+        if (m_keys.size() >= MaxCachedKeys) {
+            m_keys.clear();
+        }
+        it = m_keys.insert(id, foldCase(m_strings->string(id)));
+    }
+    return it.value();
+}
+
+ChannelState::Id ChannelState::channelId(Id name) const
+{
+    const auto it = m_channels.constFind(key(name));
+    return it != m_channels.constEnd() ? it->name : name;
+}
+
+bool ChannelState::contains(Id channel) const
+{
+    return m_channels.contains(key(channel));
+}
+
+QVector<ChannelState::Id> ChannelState::channels() const
+{
+    QVector<Id> ids;
+    ids.reserve(m_channels.size());
+    for (const Channel &channel : m_channels) {
+        ids.append(channel.name);
+    }
+    return ids;
+}
+
+QStringList ChannelState::members(Id channel) const
+{
+    QStringList names;
+    const auto it = m_channels.constFind(key(channel));
+    if (it != m_channels.constEnd()) {
+        names.reserve(it->members.size());
+        for (const Member &member : it->members) {
+            names.append(member.prefixes + m_strings->string(member.nick));
+        }
+    }
+    return names;
+}
+
+QVector<ChannelState::Id> ChannelState::channelsOf(Id nick) const
+{
+    QVector<Id> ids;
+    for (const QString &channelKey : m_nickChannels.value(key(nick))) {
+        ids.append(m_channels.value(channelKey).name);
+    }
+    return ids;
+}
+
+void ChannelState::join(Id channel, Id nick, bool self)
+{
+    const QString channelKey = key(channel);
+    auto it = m_channels.find(channelKey);
+    if (it == m_channels.end()) {
+        // Only our own JOIN opens a channel
+        if (!self) {
+            return;
+        }
+        Channel joined;
+        joined.name = channel;
+        it = m_channels.insert(channelKey, joined);
+    }
+    addMember(*it, channelKey, nick, QString());
+}
+
+void ChannelState::part(Id channel, Id nick, bool self)
+{
+    const QString channelKey = key(channel);
+    auto it = m_channels.find(channelKey);
+    if (it == m_channels.end()) {
+        return;
+    }
+
+    if (self) {
+        for (auto member = it->members.constBegin(); member != it->members.constEnd(); ++member) {
+            unlinkNick(member.key(), channelKey);
+        }
+        m_channels.erase(it);
+        m_pendingNames.remove(channelKey);
+        return;
+    }
+    removeMember(*it, channelKey, key(nick));
+}
+
+QVector<ChannelState::Id> ChannelState::quit(Id nick)
+{
+    const QString nickKey = key(nick);
+    QVector<Id> affected;
+    for (const QString &channelKey : m_nickChannels.take(nickKey)) {
+        auto it = m_channels.find(channelKey);
+        if (it != m_channels.end()) {
+            it->members.remove(nickKey);
+            affected.append(it->name);
+        }
+    }
+    return affected;
+}
+
+QVector<ChannelState::Id> ChannelState::rename(Id oldNick, Id newNick)
+{
+    const QString oldKey = key(oldNick);
+    const QString newKey = key(newNick);
+    const QVector<QString> channelKeys = m_nickChannels.take(oldKey);
+
+    QVector<Id> affected;
+    for (const QString &channelKey : channelKeys) {
+        auto it = m_channels.find(channelKey);
+        if (it == m_channels.end()) {
+            continue;
+        }
+        Member member = it->members.take(oldKey);
+        member.nick = newNick;
+        it->members.insert(newKey, member);
+        affected.append(it->name);
+    }
+    if (!channelKeys.isEmpty()) {
+        m_nickChannels.insert(newKey, channelKeys);
+    }
+    return affected;
+}
+
+void ChannelState::addNames(Id channel, const QStringList &names)
+{
+    m_pendingNames[key(channel)] += names;
+}
+
+QStringList ChannelState::endNames(Id channel)
+{
+    const QString channelKey = key(channel);
+    const QStringList names = m_pendingNames.take(channelKey);
+    auto it = m_channels.find(channelKey);
+    if (it == m_channels.end()) {
+        // NAMES for a channel we are not in: nothing to track
+        return names;
+    }
+
+    // The complete reply replaces the membership wholesale
+    for (auto member = it->members.constBegin(); member != it->members.constEnd(); ++member) {
+        unlinkNick(member.key(), channelKey);
+    }
+    it->members.clear();
+    it->members.reserve(names.size());
+
+    for (const QString &name : names) {
+        QString prefixes;
+        const QString nick = m_prefixes.parseName(name, &prefixes);
+        if (!nick.isEmpty()) {
+            addMember(*it, channelKey, m_strings->intern(nick), prefixes);
+        }
+    }
+    return names;
+}
+
+QVector<ChannelState::PrefixChange> ChannelState::applyMode(Id channel, const QStringList &modes)
+{
+    QVector<PrefixChange> changes;
+    auto it = m_channels.find(key(channel));
+    if (it == m_channels.end() || modes.isEmpty()) {
+        return changes;
+    }
+
+    bool adding = true;
+    int argument = 1;
+    for (const QChar mode : modes.at(0)) {
+        if (mode == '+' || mode == '-') {
+            adding = mode == '+';
+            continue;
+        }
+
+        const int rank = m_prefixes.modeRank(mode);
+        if (rank < 0) {
+            // Skip over the argument of any other mode that has one
+            if (m_listModes.contains(mode) || m_settingModes.contains(mode)
+                || (adding && m_paramModes.contains(mode))) {
+                ++argument;
+            }
+            continue;
+        }
+        if (argument >= modes.size()) {
+            break;
+        }
+
+        auto member = it->members.find(foldCase(modes.at(argument++)));
+        if (member == it->members.end()) {
+            continue;
+        }
+        const QChar symbol = m_prefixes.symbol(rank);
+        QString prefixes = member->prefixes;
+        if (adding) {
+            prefixes += symbol;
+        } else {
+            prefixes.remove(symbol);
+        }
+        prefixes = m_prefixes.sorted(prefixes);
+        if (prefixes != member->prefixes) {
+            member->prefixes = prefixes;
+            changes.append({ member->nick, prefixes });
+        }
+    }
+    return changes;
+}
+
+void ChannelState::setPrefixes(Id channel, Id nick, const QString &prefixes)
+{
+    auto it = m_channels.find(key(channel));
+    if (it == m_channels.end()) {
+        return;
+    }
+    auto member = it->members.find(key(nick));
+    if (member != it->members.end()) {
+        member->prefixes = prefixes;
+    }
+}
+
+void ChannelState::addMember(Channel &channel, const QString &channelKey, Id nick, const QString &prefixes)
+{
+    const QString nickKey = key(nick);
+    if (!channel.members.contains(nickKey)) {
+        m_nickChannels[nickKey].append(channelKey);
+    }
+    channel.members.insert(nickKey, { nick, prefixes });
+}
+
+void ChannelState::removeMember(Channel &channel, const QString &channelKey, const QString &nickKey)
+{
+    if (channel.members.remove(nickKey) > 0) {
+        unlinkNick(nickKey, channelKey);
+    }
+}
+
+void ChannelState::unlinkNick(const QString &nickKey, const QString &channelKey)
+{
+    auto it = m_nickChannels.find(nickKey);
+    if (it == m_nickChannels.end()) {
+        return;
+    }
+    it->removeOne(channelKey);
+    if (it->isEmpty()) {
+        m_nickChannels.erase(it);
+    }
+}
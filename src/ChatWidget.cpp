@@ -1,13 +1,94 @@
 #include "ChatWidget.h"
+#include "IrcStats.h"
+#include "LogStore.h"
+#include "MessageDelegate.h"
 #include <QDateTime>
+#include <QKeyEvent>
 #include <QLabel>
 #include <QPushButton>
+#include <QResizeEvent>
+#include <QScrollBar>
+#include <chrono>
+
+namespace {
+
+int s_frameIntervalMs = 1000 / 60;
+// Hidden buffers still hand their lines to the store, just less often
+const int BackgroundFlushMs = 1000;
+
+// Offered after a '/' at the start of the line: the client's own commands
+// and the raw ones most often typed
+const char *const CompletedCommands[] = {
+    "join", "part", "leave", "msg", "quit", "search", "stats", "encoding", "dcc",
+    "highlight", "unhighlight", "ignore", "unignore",
+    "nick", "topic", "mode", "kick", "invite", "whois", "who", "list", "away", "notice",
+};
+
+} // namespace
 
 ChatWidget::ChatWidget(const QString &channelName, QWidget *parent)
     : QWidget(parent)
     , m_channelName(channelName)
+    , m_log(new MessageLogModel(this))
+    , m_users(new NickListModel(this))
+    , m_channels(nullptr)
+    , m_chatDisplay(nullptr)
+    , m_delegate(nullptr)
+    , m_inputLine(nullptr)
+    , m_userList(nullptr)
+    , m_topicLabel(nullptr)
+    , m_flushTimer(new QTimer(this))
+    , m_completionIndex(0)
+    , m_completionStart(0)
+    , m_completionEnd(0)
+    , m_unread(0)
+    , m_highlights(0)
+    , m_activityChanged(false)
+    , m_store(nullptr)
+    , m_scrollbackLimit(MessageLogModel::DefaultLineLimit)
+    , m_historyExhausted(false)
+    , m_historyPending(false)
+    , m_unloggedRows(0)
+{
+    m_flushTimer->setSingleShot(true);
+    connect(m_flushTimer, &QTimer::timeout, this, &ChatWidget::flushPendingLines);
+}
+
+void ChatWidget::setFrameRate(int fps)
 {
-    setupUi();
+    s_frameIntervalMs = 1000 / qBound(1, fps, 1000);
+}
+
+int ChatWidget::frameRate()
+{
+    return 1000 / s_frameIntervalMs;
+}
+
+void ChatWidget::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    
+    if (!m_chatDisplay) {
+        setupUi();
+        // Created after Qt showed our children, so shown by hand
+        for (QObject *child : children()) {
+            if (QWidget *widget = qobject_cast<QWidget *>(child)) {
+                widget->show();
+            }
+        }
+        if (m_historyPending) {
+            m_historyPending = false;
+            loadOlderLines();
+        }
+        m_chatDisplay->scrollToBottom();
+    }
+    
+    if (m_unread > 0 || m_highlights > 0) {
+        m_unread = 0;
+        m_highlights = 0;
+        m_activityChanged = true;
+    }
+    flushPendingLines();
 }
 
 void ChatWidget::setupUi()
@@ -16,26 +97,40 @@ void ChatWidget::setupUi()
     mainLayout->setContentsMargins(0, 0, 0, 0);
     
     // Topic bar
-    m_topicLabel = new QLabel(tr("No topic set"));
+    m_topicLabel = new QLabel;
     m_topicLabel->setWordWrap(true);
     m_topicLabel->setStyleSheet("QLabel { background-color: #f0f0f0; padding: 5px; border-bottom: 1px solid #ccc; }");
     m_topicLabel->setMaximumHeight(50);
     mainLayout->addWidget(m_topicLabel);
+    setTopic(m_topic);
     
     // Splitter for chat area and user list
     QSplitter *splitter = new QSplitter(Qt::Horizontal);
     
-    // Chat display area
-    m_chatDisplay = new QTextEdit();
-    m_chatDisplay->setReadOnly(true);
+    // Chat display area: one row per line, wrapped to the viewport. Rows
+    // are laid out in batches, the visible ones first, and their heights
+    // are cached by the delegate until the width changes.
+    m_chatDisplay = new QListView();
+    m_chatDisplay->setModel(m_log);
+    m_delegate = new MessageDelegate(m_chatDisplay);
+    m_chatDisplay->setItemDelegate(m_delegate);
+    m_chatDisplay->setLayoutMode(QListView::Batched);
+    m_chatDisplay->setResizeMode(QListView::Adjust);
+    m_chatDisplay->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    m_chatDisplay->viewport()->installEventFilter(this);
+    m_chatDisplay->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    m_chatDisplay->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     m_chatDisplay->setFont(QFont("Monospace", 10));
+    connect(m_chatDisplay->verticalScrollBar(), &QScrollBar::valueChanged, 
+            this, &ChatWidget::onScrolled);
     splitter->addWidget(m_chatDisplay);
     
-    // User list
-    m_userList = new QListWidget();
+    // User list, kept sorted by the model
+    m_userList = new QListView();
+    m_userList->setModel(m_users);
+    m_userList->setUniformItemSizes(true);
     m_userList->setMaximumWidth(150);
     m_userList->setMinimumWidth(100);
-    m_userList->setSortingEnabled(true);
     splitter->addWidget(m_userList);
     
     // Set splitter sizes (chat gets more space)
@@ -50,6 +145,8 @@ void ChatWidget::setupUi()
     m_inputLine = new QLineEdit();
     m_inputLine->setPlaceholderText(tr("Type a message..."));
     connect(m_inputLine, &QLineEdit::returnPressed, this, &ChatWidget::onSendMessage);
+    // Tab would move the focus before QLineEdit saw it
+    m_inputLine->installEventFilter(this);
     
     QPushButton *sendButton = new QPushButton(tr("Send"));
     connect(sendButton, &QPushButton::clicked, this, &ChatWidget::onSendMessage);
@@ -60,53 +157,237 @@ void ChatWidget::setupUi()
     mainLayout->addLayout(inputLayout);
 }
 
-void ChatWidget::addMessage(const QString &sender, const QString &message)
+void ChatWidget::addMessage(const QString &sender, const QString &message, qint64 sentTime, bool highlight)
 {
-    QString formattedMsg = formatMessage(sender, message);
-    m_chatDisplay->append(formattedMsg);
+    appendEntry(MessageLogModel::Message, sender, message);
+    m_nicks.touch(sender);
+    if (sentTime > 0) {
+        m_pendingSentTimes.append(sentTime);
+    }
+    
+    // Reported with the next flush, so a busy channel doesn't redraw the list per line
+    if (!isVisible()) {
+        ++m_unread;
+        if (highlight) {
+            ++m_highlights;
+        }
+        m_activityChanged = true;
+    }
 }
 
 void ChatWidget::addSystemMessage(const QString &message)
 {
-    QString timestamp = getCurrentTime();
-    QString formattedMsg = QString("<span style='color: green;'>[%1] * %2</span>")
-                          .arg(timestamp, message);
-    m_chatDisplay->append(formattedMsg);
+    appendEntry(MessageLogModel::System, QString(), message);
 }
 
-void ChatWidget::setUserList(const QStringList &users)
+void ChatWidget::appendEntry(MessageLogModel::Kind kind, const QString &sender, const QString &text)
 {
-    m_userList->clear();
+    // Coalesce a burst of lines into one model insert and repaint
+    if (!m_flushTimer->isActive()) {
+        m_flushTimer->start(isVisible() ? s_frameIntervalMs : BackgroundFlushMs);
+    }
     
-    for (const QString &user : users) {
-        QString cleanUser = user;
-        // Remove IRC user modes (@, +, etc.)
-        if (!cleanUser.isEmpty() && (cleanUser[0] == '@' || cleanUser[0] == '+' || 
-            cleanUser[0] == '%' || cleanUser[0] == '~' || cleanUser[0] == '&')) {
-            m_userList->addItem(cleanUser);
-        } else {
-            m_userList->addItem(cleanUser);
+    MessageLogModel::Entry entry;
+    entry.timestamp = QDateTime::currentMSecsSinceEpoch();
+    entry.sender = sender;
+    entry.text = text;
+    entry.kind = kind;
+    m_pendingEntries.append(entry);
+}
+
+void ChatWidget::flushPendingLines()
+{
+    m_flushTimer->stop();
+    if (m_activityChanged) {
+        m_activityChanged = false;
+        emit activityChanged();
+    }
+    if (m_pendingEntries.isEmpty()) {
+        return;
+    }
+    IrcStats::ScopedTimer timer(IrcStats::RenderNs);
+    IrcStats::setGauge(IrcStats::PendingRenderLines, m_pendingEntries.size());
+    
+    // Follow new lines only if the user hasn't scrolled back
+    bool atBottom = true;
+    if (m_chatDisplay) {
+        QScrollBar *scrollBar = m_chatDisplay->verticalScrollBar();
+        atBottom = scrollBar->value() == scrollBar->maximum();
+    }
+    
+    // Scrolled back, the lines being read stay put: the log grows to take the
+    // new ones instead of evicting from the top, by half again at a time so
+    // the ring is not rebuilt on every flush
+    const int rows = m_log->rowCount() + int(m_pendingEntries.size());
+    if (!atBottom && m_log->lineLimit() < rows) {
+        m_log->setLineLimit(qMax(rows, m_log->lineLimit() + m_log->lineLimit() / 2));
+    }
+    m_log->append(m_pendingEntries);
+    if (m_store) {
+        m_store->append(m_channelName, m_pendingEntries);
+    }
+    m_pendingEntries.clear();
+    
+    if (atBottom) {
+        // Back at the live end: let go of history paged in from the store
+        if (m_log->lineLimit() > m_scrollbackLimit) {
+            m_log->setLineLimit(m_scrollbackLimit);
+            m_historyExhausted = false;
+        }
+        if (m_chatDisplay) {
+            m_chatDisplay->scrollToBottom();
+        }
+    }
+    if (m_log->rowCount() < rows) {
+        dropHistoryCursor(rows - m_log->rowCount());
+    }
+    
+    // End-to-end latency of lines the server stamped with their send time;
+    // lines that went to a hidden buffer were never displayed
+    if (!isVisible()) {
+        m_pendingSentTimes.clear();
+    } else if (!m_pendingSentTimes.isEmpty()) {
+        using namespace std::chrono;
+        const qint64 now = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+        for (qint64 sentTime : m_pendingSentTimes) {
+            IrcStats::record(IrcStats::DisplayLatencyUs, quint64(qMax<qint64>(0, now - sentTime)));
         }
+        m_pendingSentTimes.clear();
     }
 }
 
-void ChatWidget::addUser(const QString &user)
+SessionSnapshot::Buffer ChatWidget::snapshot(int lines) const
 {
-    if (m_userList->findItems(user, Qt::MatchExactly).isEmpty()) {
-        m_userList->addItem(user);
+    SessionSnapshot::Buffer buffer;
+    buffer.name = m_channelName;
+    buffer.topic = m_topic;
+    buffer.members = m_users->names();
+    
+    // The model's last rows, then whatever waits for the next flush
+    const int pending = qMin(lines, int(m_pendingEntries.size()));
+    const int rows = qMin(lines - pending, m_log->rowCount());
+    buffer.lines.reserve(rows + pending);
+    for (int row = m_log->rowCount() - rows; row < m_log->rowCount(); ++row) {
+        buffer.lines.append(m_log->entry(row));
+    }
+    for (int i = int(m_pendingEntries.size()) - pending; i < m_pendingEntries.size(); ++i) {
+        buffer.lines.append(m_pendingEntries.at(i));
     }
+    return buffer;
 }
 
-void ChatWidget::removeUser(const QString &user)
+void ChatWidget::restore(const SessionSnapshot::Buffer &buffer)
+{
+    setTopic(buffer.topic);
+    setUserList(buffer.members);
+    m_log->append(buffer.lines);
+    if (!buffer.linesInLog) {
+        m_unloggedRows += int(buffer.lines.size());
+    }
+}
+
+void ChatWidget::setScrollbackLimit(int lines)
 {
-    QList<QListWidgetItem*> items = m_userList->findItems(user, Qt::MatchExactly);
-    for (QListWidgetItem *item : items) {
-        delete m_userList->takeItem(m_userList->row(item));
+    m_scrollbackLimit = qMax(1, lines);
+    const int rows = m_log->rowCount();
+    m_log->setLineLimit(m_scrollbackLimit);
+    m_historyExhausted = false;
+    dropHistoryCursor(rows - m_log->rowCount());
+}
+
+void ChatWidget::setLogStore(LogStore *store)
+{
+    // Lines already waiting belong to the store they were added under
+    flushPendingLines();
+    m_store = store;
+    m_historyExhausted = false;
+    m_historyCursor = LogStore::Cursor();
+    
+    // Show the most recent history right away, like a reopened log; a
+    // buffer nobody has looked at yet reads it when first shown
+    m_historyPending = m_store && !m_chatDisplay;
+    if (m_store && m_chatDisplay) {
+        loadOlderLines();
     }
 }
 
+void ChatWidget::onScrolled(int value)
+{
+    if (value == m_chatDisplay->verticalScrollBar()->minimum() && m_store && !m_historyExhausted) {
+        loadOlderLines();
+    }
+}
+
+void ChatWidget::loadOlderLines()
+{
+    static const int PageLines = 200;
+    
+    // The first page starts below the rows the store already holds
+    const int rows = m_log->rowCount();
+    const int skip = m_historyCursor.isNull() ? qMax(0, rows - m_unloggedRows) : 0;
+    const QVector<MessageLogModel::Entry> lines = m_store->readBefore(m_channelName, &m_historyCursor,
+                                                                      PageLines, skip);
+    if (lines.size() < PageLines) {
+        m_historyExhausted = true;
+    }
+    if (lines.isEmpty()) {
+        return;
+    }
+    
+    m_log->prepend(lines);
+    if (rows > 0) {
+        // Keep the line that was at the top where it was
+        m_chatDisplay->scrollTo(m_log->index(int(lines.size())), QAbstractItemView::PositionAtTop);
+    } else {
+        m_chatDisplay->scrollToBottom();
+    }
+}
+
+void ChatWidget::dropHistoryCursor(int droppedRows)
+{
+    if (droppedRows <= 0) {
+        return;
+    }
+    m_historyCursor = LogStore::Cursor();
+    // Restored lines are the oldest until history is paged in above them
+    m_unloggedRows = qMax(0, m_unloggedRows - droppedRows);
+}
+
+void ChatWidget::setUserList(const QStringList &users)
+{
+    m_users->reset(users);
+    m_nicks.reset(m_users->nicks());
+}
+
+void ChatWidget::addUser(const QString &user)
+{
+    m_users->addMember(user);
+    m_nicks.add(m_users->nickOf(user));
+}
+
+void ChatWidget::removeUser(const QString &user)
+{
+    m_users->removeMember(user);
+    m_nicks.remove(user);
+}
+
+void ChatWidget::renameUser(const QString &oldNick, const QString &newNick)
+{
+    m_users->renameMember(oldNick, newNick);
+    m_nicks.rename(oldNick, newNick);
+}
+
+bool ChatWidget::hasUser(const QString &user) const
+{
+    return m_users->contains(user);
+}
+
 void ChatWidget::setTopic(const QString &topic)
 {
+    m_topic = topic;
+    if (!m_topicLabel) {
+        return;
+    }
     if (topic.isEmpty()) {
         m_topicLabel->setText(tr("No topic set"));
     } else {
@@ -125,17 +406,79 @@ void ChatWidget::onSendMessage()
     m_inputLine->clear();
 }
 
-QString ChatWidget::formatMessage(const QString &sender, const QString &message)
+bool ChatWidget::eventFilter(QObject *watched, QEvent *event)
 {
-    QString timestamp = getCurrentTime();
-    QString color = sender == "SERVER" ? "blue" : "black";
-    
-    return QString("<span style='color: gray;'>[%1]</span> "
-                  "<span style='color: %2; font-weight: bold;'>&lt;%3&gt;</span> %4")
-           .arg(timestamp, color, sender, message.toHtmlEscaped());
+    // Before the view lays the rows out again for the new width
+    if (m_chatDisplay && watched == m_chatDisplay->viewport() && event->type() == QEvent::Resize) {
+        m_delegate->setWidth(static_cast<QResizeEvent *>(event)->size().width());
+    }
+    if (watched == m_inputLine && event->type() == QEvent::KeyPress) {
+        const QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+        if (keyEvent->key() == Qt::Key_Tab && keyEvent->modifiers() == Qt::NoModifier) {
+            completeInput();
+            return true;
+        }
+    }
+    return QWidget::eventFilter(watched, event);
 }
 
-QString ChatWidget::getCurrentTime()
+const CompletionIndex &ChatWidget::commandCompletion()
 {
-    return QDateTime::currentDateTime().toString("HH:mm:ss");
+    static const CompletionIndex commands = []() {
+        QStringList words;
+        for (const char *command : CompletedCommands) {
+            words.append(QString::fromLatin1(command));
+        }
+        CompletionIndex index;
+        index.reset(words);
+        return index;
+    }();
+    return commands;
+}
+
+void ChatWidget::completeInput()
+{
+    const QString text = m_inputLine->text();
+    const int cursor = m_inputLine->cursorPosition();
+    
+    // Tab again, nothing typed since: the next candidate
+    const bool cycling = !m_completions.isEmpty() && text == m_completedText && cursor == m_completionEnd;
+    if (cycling) {
+        m_completionIndex = (m_completionIndex + 1) % m_completions.size();
+    } else {
+        int start = cursor;
+        while (start > 0 && !text.at(start - 1).isSpace()) {
+            --start;
+        }
+        const QString prefix = text.mid(start, cursor - start);
+        
+        IrcStats::ScopedTimer timer(IrcStats::CompletionNs);
+        if (start == 0 && prefix.startsWith('/')) {
+            m_completions = commandCompletion().complete(prefix.mid(1));
+            for (QString &command : m_completions) {
+                command.prepend('/');
+            }
+        } else if (prefix.startsWith('#')) {
+            m_completions = m_channels ? m_channels->complete(prefix) : QStringList();
+        } else {
+            m_completions = m_nicks.complete(prefix);
+        }
+        if (m_completions.isEmpty()) {
+            return;
+        }
+        m_completionIndex = 0;
+        m_completionStart = start;
+        m_completionEnd = cursor;
+    }
+    
+    // "nick: " when addressing someone at the start of the line
+    const QString &word = m_completions.at(m_completionIndex);
+    const bool addressing = m_completionStart == 0 && !word.startsWith('/') && !word.startsWith('#');
+    const QString completion = word + (addressing ? ": " : " ");
+    const QString completed = text.left(m_completionStart) + completion + text.mid(m_completionEnd);
+    
+    m_completionEnd = m_completionStart + completion.size();
+    m_completedText = completed;
+    m_inputLine->setText(completed);
+    m_inputLine->setCursorPosition(m_completionEnd);
 }
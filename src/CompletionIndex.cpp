@@ -0,0 +1,131 @@
+#include "CompletionIndex.h"
+#include <algorithm>
+
+void CompletionIndex::reset(const QStringList &words)
+{
+    m_entries.clear();
+    m_entries.reserve(words.size());
+    for (const QString &word : words) {
+        if (!word.isEmpty()) {
+            m_entries.append({ word.toCaseFolded(), word });
+        }
+    }
+
+    // One sort for the whole list instead of one ordered insert per word
+    std::sort(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) {
+        return lessThan(a, b.key, b.word);
+    });
+    m_entries.erase(std::unique(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) {
+        return a.word == b.word;
+    }), m_entries.end());
+
+    // Keep the ranking of those still here
+    QStringList recent;
+    for (const QString &word : qAsConst(m_recent)) {
+        if (contains(word)) {
+            recent.append(word);
+        }
+    }
+    m_recent = recent;
+}
+
+void CompletionIndex::clear()
+{
+    m_entries.clear();
+    m_recent.clear();
+}
+
+void CompletionIndex::add(const QString &word)
+{
+    const QString key = word.toCaseFolded();
+    const int row = lowerBound(key, word);
+    if (word.isEmpty() || (row < m_entries.size() && m_entries.at(row).word == word)) {
+        return;
+    }
+    m_entries.insert(row, { key, word });
+}
+
+void CompletionIndex::remove(const QString &word)
+{
+    const int row = find(word);
+    if (row >= 0) {
+        m_entries.remove(row);
+        m_recent.removeOne(word);
+    }
+}
+
+void CompletionIndex::rename(const QString &oldWord, const QString &newWord)
+{
+    const int row = find(oldWord);
+    if (row < 0) {
+        return;
+    }
+    m_entries.remove(row);
+    add(newWord);
+
+    // Still the same speaker
+    const int recent = m_recent.indexOf(oldWord);
+    if (recent >= 0) {
+        m_recent[recent] = newWord;
+    }
+}
+
+void CompletionIndex::touch(const QString &word)
+{
+    if (!m_recent.isEmpty() && m_recent.last() == word) {
+        return;
+    }
+    if (!m_recent.removeOne(word) && !contains(word)) {
+        return;
+    }
+    m_recent.append(word);
+    if (m_recent.size() > RecentLimit) {
+        m_recent.removeFirst();
+    }
+}
+
+QStringList CompletionIndex::complete(const QString &prefix, int limit) const
+{
+    QStringList result;
+    for (int i = m_recent.size() - 1; i >= 0 && result.size() < limit; --i) {
+        if (m_recent.at(i).startsWith(prefix, Qt::CaseInsensitive)) {
+            result.append(m_recent.at(i));
+        }
+    }
+    const int recentCount = result.size();
+
+    const QString key = prefix.toCaseFolded();
+    for (int row = lowerBound(key, QString()); row < m_entries.size() && result.size() < limit; ++row) {
+        const Entry &entry = m_entries.at(row);
+        if (!entry.key.startsWith(key)) {
+            break;
+        }
+        // Only the recent ones can be in already
+        const auto recentEnd = result.cbegin() + recentCount;
+        if (std::find(result.cbegin(), recentEnd, entry.word) == recentEnd) {
+            result.append(entry.word);
+        }
+    }
+    return result;
+}
+
+bool CompletionIndex::lessThan(const Entry &entry, const QString &key, const QString &word)
+{
+    const int order = QString::compare(entry.key, key);
+    return order != 0 ? order < 0 : entry.word < word;
+}
+
+int CompletionIndex::lowerBound(const QString &key, const QString &word) const
+{
+    const auto it = std::lower_bound(m_entries.begin(), m_entries.end(), key,
+        [&word](const Entry &entry, const QString &k) {
+            return lessThan(entry, k, word);
+        });
+    return int(it - m_entries.begin());
+}
+
+int CompletionIndex::find(const QString &word) const
+{
+    const int row = lowerBound(word.toCaseFolded(), word);
+    return row < m_entries.size() && m_entries.at(row).word == word ? row : -1;
+}
@@ -0,0 +1,678 @@
+#include "DccEngine.h"
+#include "IrcLog.h"
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtEndian>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+
+const int TickMs = 100;
+const qint64 ReportIntervalMs = 500;
+// Receive buffer, and the most one sendfile() call or mapped window moves
+const int BufferSize = 1 << 20;
+const int BufferAlignment = 4096;
+// A fast transfer yields to the others on the thread after this much
+const qint64 MaxBytesPerWakeup = 8 * BufferSize;
+// For the peer to connect, or to answer a RESUME
+const qint64 WaitTimeoutMs = 5 * 60 * 1000;
+
+} // namespace
+
+QString DccTransfer::describe() const
+{
+    QString text = QString("#%1 %2 %3 %4 %5: %6")
+        .arg(id)
+        .arg(direction == Send ? "send of" : "receive of")
+        .arg(fileName)
+        .arg(direction == Send ? "to" : "from")
+        .arg(peer)
+        .arg(stateName(state));
+    if (state == Running) {
+        if (size > 0) {
+            text += QString(", %1% of %2").arg(position * 100 / size).arg(formatBytes(size));
+        } else {
+            text += QString(", %1 so far").arg(formatBytes(position));
+        }
+        text += QString(", %1/s").arg(formatBytes(bytesPerSecond));
+    } else if (state == Done) {
+        text += QString(", %1 at %2/s").arg(formatBytes(position)).arg(formatBytes(bytesPerSecond));
+    } else if (!error.isEmpty()) {
+        text += " (" + error + ')';
+    }
+    if (rateLimit > 0 && !isFinished()) {
+        text += QString(", capped at %1/s").arg(formatBytes(rateLimit));
+    }
+    return text;
+}
+
+QString DccTransfer::stateName(State state)
+{
+    switch (state) {
+        case Queued:
+            return "queued";
+        case Listening:
+            return "waiting for the peer";
+        case Resuming:
+            return "waiting to resume";
+        case Connecting:
+            return "connecting";
+        case Running:
+            return "running";
+        case Done:
+            return "done";
+        case Failed:
+            return "failed";
+        case Cancelled:
+            return "cancelled";
+    }
+    return QString();
+}
+
+QString DccTransfer::formatBytes(qint64 bytes)
+{
+    if (bytes < 1024) {
+        return QString("%1 B").arg(bytes);
+    }
+    static const char *const units[] = { "KiB", "MiB", "GiB", "TiB" };
+    double value = double(bytes) / 1024;
+    int unit = 0;
+    while (value >= 1024 && unit < 3) {
+        value /= 1024;
+        ++unit;
+    }
+    return QString("%1 %2").arg(value, 0, 'f', 1).arg(units[unit]);
+}
+
+QString DccTransfer::partialPath(const QString &path)
+{
+    return path + ".part";
+}
+
+DccEngine::DccEngine(const DccOptions &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_tick(new QTimer(this))
+{
+    m_tick->setInterval(TickMs);
+    connect(m_tick, &QTimer::timeout, this, &DccEngine::onTick);
+}
+
+DccEngine::~DccEngine()
+{
+    // Partial receives keep what arrived, for a RESUME next time; the
+    // sockets and servers go with our children
+    for (Job *job : qAsConst(m_jobs)) {
+        if (job->buffer) {
+            job->file.write(job->buffer, job->buffered);
+            qFreeAligned(job->buffer);
+        }
+        delete job;
+    }
+}
+
+void DccEngine::sendFile(int id, const QString &peer, const QString &path, const QHostAddress &address)
+{
+    Job *job = new Job;
+    job->info.id = id;
+    job->info.direction = DccTransfer::Send;
+    job->info.peer = peer;
+    job->info.fileName = QFileInfo(path).fileName();
+    job->info.path = path;
+    job->address = m_options.address.isNull() ? address : m_options.address;
+    m_jobs.insert(id, job);
+
+    job->file.setFileName(path);
+    if (!job->file.open(QIODevice::ReadOnly)) {
+        finish(job, DccTransfer::Failed, job->file.errorString());
+        return;
+    }
+    if (job->address.isNull()) {
+        finish(job, DccTransfer::Failed, "No address to offer; connect first or set --dcc-address");
+        return;
+    }
+    job->info.size = job->file.size();
+    start(job);
+}
+
+void DccEngine::receiveFile(int id, const QString &peer, const DccMessage &offer, const QString &path, bool resume)
+{
+    Job *job = new Job;
+    job->info.id = id;
+    job->info.direction = DccTransfer::Receive;
+    job->info.peer = peer;
+    job->info.fileName = offer.fileName;
+    job->info.path = path;
+    // Some clients send 0 when they do not know; then the end is the close
+    job->info.size = offer.size > 0 ? offer.size : -1;
+    job->address = offer.address;
+    job->port = offer.port;
+    job->token = offer.token;
+    m_jobs.insert(id, job);
+
+    // Written straight from our aligned buffer, not through QFile's own
+    job->file.setFileName(DccTransfer::partialPath(path));
+    if (!job->file.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        finish(job, DccTransfer::Failed, job->file.errorString());
+        return;
+    }
+    const qint64 existing = job->file.size();
+    if (resume && existing > 0 && existing < job->info.size) {
+        job->info.resumedFrom = existing;
+        job->info.position = existing;
+    }
+    start(job);
+}
+
+void DccEngine::resumeRequested(const QString &peer, const DccMessage &resume)
+{
+    Job *job = findByPort(DccTransfer::Send, peer, resume.port, DccTransfer::Listening);
+    if (!job || resume.position > job->info.size) {
+        return;
+    }
+    job->info.resumedFrom = resume.position;
+    job->info.position = resume.position;
+
+    // The name goes back as the peer wrote it; some clients send "file.ext"
+    DccMessage accept = resume;
+    accept.type = DccMessage::Accept;
+    emit requestReady(job->info, accept);
+}
+
+void DccEngine::resumeAccepted(const QString &peer, const DccMessage &accept)
+{
+    Job *job = findByPort(DccTransfer::Receive, peer, accept.port, DccTransfer::Resuming);
+    if (!job) {
+        return;
+    }
+    // The sender may start earlier than we asked, never later
+    const qint64 position = qMin(accept.position, job->info.resumedFrom);
+    job->info.resumedFrom = position;
+    job->info.position = position;
+    connectToSender(job);
+}
+
+void DccEngine::cancel(int id)
+{
+    if (Job *job = m_jobs.value(id, nullptr)) {
+        finish(job, DccTransfer::Cancelled);
+    }
+}
+
+void DccEngine::setRateLimit(int id, qint64 bytesPerSecond)
+{
+    Job *job = m_jobs.value(id, nullptr);
+    if (!job) {
+        return;
+    }
+    job->info.rateLimit = qMax<qint64>(0, bytesPerSecond);
+    job->budget = tickBudget(job);
+    emit transferChanged(job->info);
+}
+
+void DccEngine::setGlobalRateLimit(qint64 bytesPerSecond)
+{
+    m_options.rateLimit = qMax<qint64>(0, bytesPerSecond);
+    for (Job *job : qAsConst(m_jobs)) {
+        job->budget = tickBudget(job);
+    }
+}
+
+void DccEngine::start(Job *job)
+{
+    if (activeCount() >= qMax(1, m_options.maxActive)) {
+        m_queue.append(job->info.id);
+        setState(job, DccTransfer::Queued);
+        return;
+    }
+
+    if (job->info.direction == DccTransfer::Send) {
+        listen(job);
+    } else if (job->info.resumedFrom > 0) {
+        setState(job, DccTransfer::Resuming);
+        DccMessage resume;
+        resume.type = DccMessage::Resume;
+        resume.fileName = job->info.fileName;
+        resume.port = job->port;
+        resume.position = job->info.position;
+        resume.token = job->token;
+        emit requestReady(job->info, resume);
+    } else {
+        connectToSender(job);
+    }
+}
+
+void DccEngine::listen(Job *job)
+{
+    job->server = new QTcpServer(this);
+    bool listening = false;
+    if (m_options.firstPort == 0) {
+        listening = job->server->listen(QHostAddress::Any);
+    } else {
+        const quint16 last = qMax(m_options.firstPort, m_options.lastPort);
+        for (quint32 port = m_options.firstPort; port <= last && !listening; ++port) {
+            listening = job->server->listen(QHostAddress::Any, quint16(port));
+        }
+    }
+    if (!listening) {
+        finish(job, DccTransfer::Failed, "Cannot listen: " + job->server->errorString());
+        return;
+    }
+    job->server->setMaxPendingConnections(1);
+    job->port = job->server->serverPort();
+    connect(job->server, &QTcpServer::newConnection, this, [this, job]() {
+        onIncomingConnection(job);
+    });
+    setState(job, DccTransfer::Listening);
+
+    DccMessage send;
+    send.type = DccMessage::Send;
+    send.fileName = job->info.fileName;
+    send.address = job->address;
+    send.port = job->port;
+    send.size = job->info.size;
+    emit requestReady(job->info, send);
+}
+
+void DccEngine::connectToSender(Job *job)
+{
+    // Anything past the agreed position is dropped; a fresh transfer
+    // starts from an empty file
+    if (!job->file.resize(job->info.position) || !job->file.seek(job->info.position)) {
+        finish(job, DccTransfer::Failed, job->file.errorString());
+        return;
+    }
+    job->buffer = static_cast<char *>(qMallocAligned(BufferSize, BufferAlignment));
+    job->buffered = 0;
+
+    job->socket = new QTcpSocket(this);
+    // Only what we have budget for is taken off the socket; past this the
+    // kernel's receive window fills and the sender waits
+    job->socket->setReadBufferSize(BufferSize);
+    connect(job->socket, &QTcpSocket::connected, this, [this, job]() {
+        setState(job, DccTransfer::Running);
+    });
+    connect(job->socket, &QTcpSocket::readyRead, this, [this, job]() {
+        pumpReceive(job);
+    });
+    connect(job->socket, &QTcpSocket::disconnected, this, [this, job]() {
+        onSocketClosed(job);
+    });
+    connect(job->socket, &QTcpSocket::errorOccurred, this, [this, job](QAbstractSocket::SocketError error) {
+        // A close is handled by disconnected(), which follows
+        if (error != QAbstractSocket::RemoteHostClosedError) {
+            finish(job, DccTransfer::Failed, job->socket->errorString());
+        }
+    });
+    setState(job, DccTransfer::Connecting);
+    job->socket->connectToHost(job->address, job->port);
+}
+
+void DccEngine::onIncomingConnection(Job *job)
+{
+    QTcpSocket *socket = job->server->nextPendingConnection();
+    if (!socket) {
+        return;
+    }
+    // One peer per offer; the listener is done
+    job->server->disconnect(this);
+    job->server->close();
+    job->server->deleteLater();
+    job->server = nullptr;
+
+    socket->setParent(this);
+    job->socket = socket;
+    connect(socket, &QTcpSocket::readyRead, this, [this, job]() {
+        readAcknowledgements(job);
+    });
+    connect(socket, &QTcpSocket::disconnected, this, [this, job]() {
+        onSocketClosed(job);
+    });
+    connect(socket, &QTcpSocket::errorOccurred, this, [this, job](QAbstractSocket::SocketError error) {
+        if (error != QAbstractSocket::RemoteHostClosedError) {
+            finish(job, DccTransfer::Failed, job->socket->errorString());
+        }
+    });
+#ifdef Q_OS_LINUX
+    // sendfile() writes to the descriptor behind QTcpSocket's back; the
+    // socket itself only ever reads the acknowledgements
+    job->writable = new QSocketNotifier(socket->socketDescriptor(), QSocketNotifier::Write, socket);
+    connect(job->writable, &QSocketNotifier::activated, this, [this, job]() {
+        pumpSend(job);
+    });
+#else
+    connect(socket, &QTcpSocket::bytesWritten, this, [this, job]() {
+        pumpSend(job);
+    });
+#endif
+
+    qCInfo(lcDcc) << "Sending" << job->info.path << "to" << socket->peerAddress().toString();
+    setState(job, DccTransfer::Running);
+    pumpSend(job);
+}
+
+void DccEngine::pumpSend(Job *job)
+{
+    qint64 sentNow = 0;
+    while (job->info.position < job->info.size && sentNow < MaxBytesPerWakeup) {
+        const qint64 chunk = allowance(job, qMin<qint64>(job->info.size - job->info.position, BufferSize));
+        if (chunk == 0) {
+            // Out of budget; the next tick picks up again
+            break;
+        }
+#ifdef Q_OS_LINUX
+        off_t offset = off_t(job->info.position);
+        const ssize_t sent = ::sendfile(int(job->socket->socketDescriptor()), job->file.handle(),
+                                        &offset, size_t(chunk));
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                job->writable->setEnabled(true);
+                return;
+            }
+            finish(job, DccTransfer::Failed, QString::fromLocal8Bit(strerror(errno)));
+            return;
+        }
+        if (sent == 0) {
+            finish(job, DccTransfer::Failed, "The file got shorter while it was sent");
+            return;
+        }
+#else
+        if (job->socket->bytesToWrite() > 0) {
+            // bytesWritten() brings us back
+            return;
+        }
+        uchar *window = job->file.map(job->info.position, chunk);
+        if (!window) {
+            finish(job, DccTransfer::Failed, job->file.errorString());
+            return;
+        }
+        const qint64 sent = job->socket->write(reinterpret_cast<const char *>(window), chunk);
+        job->file.unmap(window);
+        if (sent <= 0) {
+            finish(job, DccTransfer::Failed, job->socket->errorString());
+            return;
+        }
+#endif
+        job->info.position += sent;
+        consume(job, sent);
+        sentNow += sent;
+    }
+#ifdef Q_OS_LINUX
+    // Woken up again only while there is something we may send
+    job->writable->setEnabled(job->info.position < job->info.size && allowance(job, 1) > 0);
+#endif
+}
+
+void DccEngine::readAcknowledgements(Job *job)
+{
+    // The receiver counts the bytes it has, modulo 2^32, in big-endian words
+    job->acks += job->socket->readAll();
+    const int whole = job->acks.size() / 4 * 4;
+    if (whole > 0) {
+        job->acknowledged = qFromBigEndian<quint32>(job->acks.constData() + whole - 4);
+        job->acks.remove(0, whole);
+    }
+    if (job->info.position >= job->info.size && job->acknowledged == (job->info.size & 0xffffffff)) {
+        finish(job, DccTransfer::Done);
+    }
+}
+
+void DccEngine::pumpReceive(Job *job)
+{
+    const qint64 before = job->info.position;
+    for (;;) {
+        qint64 wanted = BufferSize - job->buffered;
+        if (job->info.size >= 0) {
+            wanted = qMin(wanted, job->info.size - job->info.position);
+        }
+        const qint64 chunk = allowance(job, wanted);
+        if (chunk <= 0) {
+            break;
+        }
+        const qint64 received = job->socket->read(job->buffer + job->buffered, chunk);
+        if (received <= 0) {
+            break;
+        }
+        job->buffered += int(received);
+        job->info.position += received;
+        consume(job, received);
+        if (job->buffered == BufferSize && !flushBuffer(job)) {
+            return;
+        }
+    }
+
+    if (job->info.position != before && job->socket->state() == QAbstractSocket::ConnectedState) {
+        char ack[4];
+        qToBigEndian(quint32(job->info.position), ack);
+        job->socket->write(ack, sizeof(ack));
+    }
+    if (job->info.size >= 0 && job->info.position >= job->info.size && flushBuffer(job)) {
+        finish(job, DccTransfer::Done);
+    }
+}
+
+bool DccEngine::flushBuffer(Job *job)
+{
+    if (job->buffered == 0) {
+        return true;
+    }
+    if (job->file.write(job->buffer, job->buffered) != job->buffered) {
+        finish(job, DccTransfer::Failed, job->file.errorString());
+        return false;
+    }
+    job->buffered = 0;
+    return true;
+}
+
+void DccEngine::onSocketClosed(Job *job)
+{
+    const int id = job->info.id;
+    if (job->info.direction == DccTransfer::Receive) {
+        // What the sender wrote before closing is still to be read
+        job->budget = -1;
+        pumpReceive(job);
+        if (!m_jobs.contains(id)) {
+            return;
+        }
+        if (job->info.size < 0 && flushBuffer(job)) {
+            finish(job, DccTransfer::Done);
+            return;
+        }
+    }
+    if (!m_jobs.contains(id)) {
+        return;
+    }
+    if (job->info.direction == DccTransfer::Send && job->info.position >= job->info.size) {
+        // Not every receiver acknowledges the last bytes before closing
+        finish(job, DccTransfer::Done);
+        return;
+    }
+    finish(job, DccTransfer::Failed, QString("Connection closed after %1 of %2")
+                                     .arg(DccTransfer::formatBytes(job->info.position))
+                                     .arg(DccTransfer::formatBytes(job->info.size)));
+}
+
+void DccEngine::finish(Job *job, DccTransfer::State state, const QString &reason)
+{
+    QString error = reason;
+    if (job->buffer) {
+        // Even a failed receive keeps what arrived, so it can be resumed
+        if (job->buffered > 0) {
+            job->file.write(job->buffer, job->buffered);
+        }
+        qFreeAligned(job->buffer);
+        job->buffer = nullptr;
+    }
+    job->file.close();
+    if (job->info.direction == DccTransfer::Receive && state == DccTransfer::Done
+        && !QFile::rename(job->file.fileName(), job->info.path)) {
+        // The bytes stay in the partial file
+        state = DccTransfer::Failed;
+        error = QString("Could not rename %1 to %2").arg(job->file.fileName(), job->info.path);
+    }
+    delete job->writable;
+    job->writable = nullptr;
+
+    if (job->socket) {
+        job->socket->disconnect(this);
+        if (state == DccTransfer::Done && job->socket->state() == QAbstractSocket::ConnectedState) {
+            // Lets the last acknowledgement go out first
+            connect(job->socket, &QTcpSocket::disconnected, job->socket, &QObject::deleteLater);
+            job->socket->disconnectFromHost();
+        } else {
+            job->socket->abort();
+            job->socket->deleteLater();
+        }
+    }
+    if (job->server) {
+        job->server->disconnect(this);
+        job->server->close();
+        job->server->deleteLater();
+    }
+
+    job->info.state = state;
+    job->info.error = error;
+    if (state == DccTransfer::Done && job->running.isValid()) {
+        job->info.bytesPerSecond = (job->info.position - job->info.resumedFrom) * 1000
+            / qMax<qint64>(1, job->running.elapsed());
+    }
+    if (state == DccTransfer::Failed) {
+        qCWarning(lcDcc) << "Transfer" << job->info.id << "of" << job->info.path << "failed:" << error;
+    } else {
+        qCInfo(lcDcc) << "Transfer" << job->info.id << "of" << job->info.path << DccTransfer::stateName(state);
+    }
+    emit transferChanged(job->info);
+
+    m_jobs.remove(job->info.id);
+    m_queue.removeAll(job->info.id);
+    delete job;
+    startQueued();
+}
+
+void DccEngine::setState(Job *job, DccTransfer::State state)
+{
+    job->info.state = state;
+    job->clock.restart();
+    if (state == DccTransfer::Running) {
+        job->running.start();
+        job->reportedPosition = job->info.position;
+        job->budget = tickBudget(job);
+    }
+    if (!m_tick->isActive()) {
+        m_tick->start();
+    }
+    emit transferChanged(job->info);
+}
+
+void DccEngine::startQueued()
+{
+    while (!m_queue.isEmpty() && activeCount() < qMax(1, m_options.maxActive)) {
+        if (Job *job = m_jobs.value(m_queue.takeFirst(), nullptr)) {
+            start(job);
+        }
+    }
+}
+
+void DccEngine::onTick()
+{
+    // A transfer finishing below leaves the others where they are
+    const QList<Job*> jobs = m_jobs.values();
+    for (Job *job : jobs) {
+        const int id = job->info.id;
+        if (!m_jobs.contains(id)) {
+            continue;
+        }
+        job->budget = tickBudget(job);
+
+        const DccTransfer::State state = job->info.state;
+        if ((state == DccTransfer::Listening || state == DccTransfer::Resuming || state == DccTransfer::Connecting)
+            && job->clock.elapsed() > WaitTimeoutMs) {
+            finish(job, DccTransfer::Failed, "Timed out waiting for the peer");
+            continue;
+        }
+        if (state != DccTransfer::Running) {
+            continue;
+        }
+
+        // Transfers that ran out of budget wait for this
+        if (job->info.direction == DccTransfer::Send) {
+            pumpSend(job);
+        } else if (job->socket->bytesAvailable() > 0) {
+            pumpReceive(job);
+        }
+        if (!m_jobs.contains(id)) {
+            continue;
+        }
+        if (job->clock.elapsed() >= ReportIntervalMs) {
+            job->info.bytesPerSecond = (job->info.position - job->reportedPosition) * 1000
+                / qMax<qint64>(1, job->clock.restart());
+            job->reportedPosition = job->info.position;
+            emit transferChanged(job->info);
+        }
+    }
+    if (m_jobs.isEmpty()) {
+        m_tick->stop();
+    }
+}
+
+qint64 DccEngine::tickBudget(const Job *job) const
+{
+    qint64 budget = -1;
+    if (job->info.rateLimit > 0) {
+        budget = qMax<qint64>(1, job->info.rateLimit * TickMs / 1000);
+    }
+    if (m_options.rateLimit > 0) {
+        // The global cap is split evenly among the transfers moving data
+        int running = 0;
+        for (const Job *other : m_jobs) {
+            running += other->info.state == DccTransfer::Running;
+        }
+        const qint64 share = qMax<qint64>(1, m_options.rateLimit * TickMs / 1000 / qMax(1, running));
+        budget = budget < 0 ? share : qMin(budget, share);
+    }
+    return budget;
+}
+
+qint64 DccEngine::allowance(const Job *job, qint64 wanted) const
+{
+    return job->budget < 0 ? wanted : qMin(wanted, job->budget);
+}
+
+void DccEngine::consume(Job *job, qint64 bytes)
+{
+    if (job->budget >= 0) {
+        job->budget = qMax<qint64>(0, job->budget - bytes);
+    }
+}
+
+int DccEngine::activeCount() const
+{
+    int active = 0;
+    for (const Job *job : m_jobs) {
+        active += job->info.state != DccTransfer::Queued && !job->info.isFinished();
+    }
+    return active;
+}
+
+DccEngine::Job *DccEngine::findByPort(DccTransfer::Direction direction, const QString &peer, quint16 port,
+                                      DccTransfer::State state) const
+{
+    for (Job *job : m_jobs) {
+        if (job->info.direction == direction && job->info.state == state && job->port == port
+            && job->info.peer.compare(peer, Qt::CaseInsensitive) == 0) {
+            return job;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,123 @@
+#include "DccManager.h"
+#include <QCoreApplication>
+#include <QPointer>
+#include <QStandardPaths>
+#include <QThread>
+
+static DccOptions s_defaultOptions;
+static QPointer<DccManager> s_shared;
+
+DccManager::DccManager(const DccOptions &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_thread(new QThread(this))
+    , m_engine(new DccEngine(options))
+    , m_nextId(1)
+{
+    qRegisterMetaType<DccTransfer>();
+    qRegisterMetaType<DccMessage>();
+
+    m_thread->setObjectName("Dcc");
+    m_engine->moveToThread(m_thread);
+    // Emitted on the engine thread, delivered on ours
+    connect(m_engine, &DccEngine::transferChanged, this, &DccManager::transferChanged);
+    connect(m_engine, &DccEngine::requestReady, this, &DccManager::requestReady);
+    m_thread->start();
+}
+
+DccManager::~DccManager()
+{
+    DccEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine]() {
+        delete engine;
+    }, Qt::BlockingQueuedConnection);
+    m_thread->quit();
+    m_thread->wait();
+}
+
+DccManager *DccManager::shared()
+{
+    if (!s_shared) {
+        s_shared = new DccManager(s_defaultOptions, QCoreApplication::instance());
+    }
+    return s_shared;
+}
+
+void DccManager::setDefaultOptions(const DccOptions &options)
+{
+    s_defaultOptions = options;
+}
+
+DccOptions DccManager::defaultOptions()
+{
+    return s_defaultOptions;
+}
+
+QString DccManager::downloadDirectory() const
+{
+    if (!m_options.downloadDirectory.isEmpty()) {
+        return m_options.downloadDirectory;
+    }
+    return QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+}
+
+int DccManager::sendFile(const QString &peer, const QString &path, const QHostAddress &address)
+{
+    const int id = m_nextId++;
+    DccEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine, id, peer, path, address]() {
+        engine->sendFile(id, peer, path, address);
+    });
+    return id;
+}
+
+int DccManager::receiveFile(const QString &peer, const DccMessage &offer, const QString &path, bool resume)
+{
+    const int id = m_nextId++;
+    DccEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine, id, peer, offer, path, resume]() {
+        engine->receiveFile(id, peer, offer, path, resume);
+    });
+    return id;
+}
+
+void DccManager::resumeRequested(const QString &peer, const DccMessage &resume)
+{
+    DccEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine, peer, resume]() {
+        engine->resumeRequested(peer, resume);
+    });
+}
+
+void DccManager::resumeAccepted(const QString &peer, const DccMessage &accept)
+{
+    DccEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine, peer, accept]() {
+        engine->resumeAccepted(peer, accept);
+    });
+}
+
+void DccManager::cancel(int id)
+{
+    DccEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine, id]() {
+        engine->cancel(id);
+    });
+}
+
+void DccManager::setRateLimit(int id, qint64 bytesPerSecond)
+{
+    DccEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine, id, bytesPerSecond]() {
+        engine->setRateLimit(id, bytesPerSecond);
+    });
+}
+
+void DccManager::setGlobalRateLimit(qint64 bytesPerSecond)
+{
+    m_options.rateLimit = qMax<qint64>(0, bytesPerSecond);
+    DccEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine, bytesPerSecond]() {
+        engine->setGlobalRateLimit(bytesPerSecond);
+    });
+}
@@ -0,0 +1,125 @@
+#include "DccMessage.h"
+#include <QStringList>
+
+namespace {
+
+// Splits on spaces; a word starting with '"' runs to the next '"'
+QStringList splitWords(const QString &text)
+{
+    QStringList words;
+    int i = 0;
+    while (i < text.size()) {
+        if (text.at(i) == ' ') {
+            ++i;
+            continue;
+        }
+        if (text.at(i) == '"') {
+            int end = text.indexOf('"', i + 1);
+            if (end < 0) {
+                end = text.size();
+            }
+            words.append(text.mid(i + 1, end - i - 1));
+            i = end + 1;
+            continue;
+        }
+        int end = text.indexOf(' ', i);
+        if (end < 0) {
+            end = text.size();
+        }
+        words.append(text.mid(i, end - i));
+        i = end;
+    }
+    return words;
+}
+
+QString quoted(const QString &fileName)
+{
+    return fileName.contains(' ') ? '"' + fileName + '"' : fileName;
+}
+
+} // namespace
+
+DccMessage DccMessage::parse(const QString &params)
+{
+    DccMessage message;
+    const QStringList words = splitWords(params);
+    if (words.size() < 4) {
+        return message;
+    }
+
+    const QString verb = words.at(0).toUpper();
+    bool ok = true;
+    message.fileName = words.at(1);
+    if (verb == "SEND" && words.size() >= 5) {
+        const QString address = words.at(2);
+        bool numeric = false;
+        const quint32 ipv4 = address.toUInt(&numeric);
+        message.address = numeric ? QHostAddress(ipv4) : QHostAddress(address);
+        message.port = words.at(3).toUShort(&ok);
+        message.size = words.at(4).toLongLong();
+        message.token = words.value(5);
+        if (!ok || message.address.isNull() || message.size < 0) {
+            return DccMessage();
+        }
+        message.type = Send;
+    } else if (verb == "RESUME" || verb == "ACCEPT") {
+        message.port = words.at(2).toUShort(&ok);
+        if (!ok) {
+            return DccMessage();
+        }
+        message.position = words.at(3).toLongLong(&ok);
+        if (!ok || message.position < 0) {
+            return DccMessage();
+        }
+        message.token = words.value(4);
+        message.type = verb == "RESUME" ? Resume : Accept;
+    }
+    return message;
+}
+
+QString DccMessage::toCtcp() const
+{
+    QString text;
+    switch (type) {
+        case Send: {
+            bool ipv4 = false;
+            const quint32 number = address.toIPv4Address(&ipv4);
+            text = QString("DCC SEND %1 %2 %3 %4")
+                .arg(quoted(fileName))
+                .arg(ipv4 ? QString::number(number) : address.toString())
+                .arg(port)
+                .arg(size);
+            break;
+        }
+        case Resume:
+        case Accept:
+            text = QString("DCC %1 %2 %3 %4")
+                .arg(type == Resume ? "RESUME" : "ACCEPT")
+                .arg(quoted(fileName))
+                .arg(port)
+                .arg(position);
+            break;
+        case Invalid:
+            return QString();
+    }
+    if (!token.isEmpty()) {
+        text += ' ' + token;
+    }
+    return text;
+}
+
+QString DccMessage::safeFileName(const QString &name)
+{
+    // Whatever follows the last separator of either kind, without leading
+    // dots so nothing hidden or relative comes out of it
+    QString safe = name.mid(qMax(name.lastIndexOf('/'), name.lastIndexOf('\\')) + 1);
+    while (safe.startsWith('.')) {
+        safe.remove(0, 1);
+    }
+    for (QChar &c : safe) {
+        if (c.unicode() < 0x20 || QString(":*?\"<>|").contains(c)) {
+            c = '_';
+        }
+    }
+    return safe.isEmpty() ? QString("download") : safe;
+}
@@ -0,0 +1,145 @@
+#include "IrcCapture.h"
+#include <QtEndian>
+#include <climits>
+#include <cstring>
+
+const char IrcCapture::Magic[8] = { 'Q', 'T', 'I', 'R', 'C', 'C', 'A', 'P' };
+
+static const int WriteBufferSize = 64 * 1024;
+static const int ReadChunkSize = 64 * 1024;
+
+static void appendVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+bool IrcCapture::isCapture(QIODevice *device)
+{
+    char magic[sizeof(Magic)];
+    return device->peek(magic, sizeof(magic)) == qint64(sizeof(magic))
+        && memcmp(magic, Magic, sizeof(magic)) == 0;
+}
+
+bool IrcCaptureWriter::open(const QString &path, qint64 startMs)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    char header[IrcCapture::HeaderSize];
+    memcpy(header, IrcCapture::Magic, sizeof(IrcCapture::Magic));
+    qToLittleEndian<quint32>(IrcCapture::Version, header + 8);
+    qToLittleEndian<qint64>(startMs, header + 12);
+    m_buffer.append(header, sizeof(header));
+    m_lastUs = 0;
+    return true;
+}
+
+void IrcCaptureWriter::close()
+{
+    if (m_file.isOpen()) {
+        flush();
+        m_file.close();
+    }
+}
+
+void IrcCaptureWriter::write(IrcCapture::Direction direction, qint64 timeUs, const char *data, int length)
+{
+    // Records from several threads can arrive slightly out of order
+    const qint64 delta = qMax<qint64>(0, timeUs - m_lastUs);
+    m_lastUs = qMax(m_lastUs, timeUs);
+
+    m_buffer += char(direction);
+    appendVarint(m_buffer, quint64(delta));
+    appendVarint(m_buffer, quint64(length));
+    m_buffer.append(data, length);
+    if (m_buffer.size() >= WriteBufferSize) {
+        flush();
+    }
+}
+
+void IrcCaptureWriter::flush()
+{
+    if (!m_buffer.isEmpty()) {
+        m_file.write(m_buffer);
+        m_buffer.clear();
+    }
+    m_file.flush();
+}
+
+bool IrcCaptureReader::readHeader()
+{
+    if (!fill(IrcCapture::HeaderSize)
+        || memcmp(m_buffer.constData(), IrcCapture::Magic, sizeof(IrcCapture::Magic)) != 0) {
+        return false;
+    }
+    const char *header = m_buffer.constData();
+    if (qFromLittleEndian<quint32>(header + 8) != IrcCapture::Version) {
+        return false;
+    }
+    m_startMs = qFromLittleEndian<qint64>(header + 12);
+    m_pos = IrcCapture::HeaderSize;
+    m_timeUs = 0;
+    return true;
+}
+
+bool IrcCaptureReader::next(IrcCapture::Record *record)
+{
+    quint64 delta;
+    quint64 length;
+    if (!fill(1)) {
+        return false;
+    }
+    const quint8 direction = quint8(m_buffer.at(m_pos++));
+    if (!readVarint(&delta) || !readVarint(&length) || length > quint64(INT_MAX)
+        || !fill(int(length))) {
+        return false;
+    }
+
+    m_timeUs += qint64(delta);
+    record->direction = direction == IrcCapture::Outbound ? IrcCapture::Outbound : IrcCapture::Inbound;
+    record->timeUs = m_timeUs;
+    record->line = m_buffer.mid(m_pos, int(length));
+    m_pos += int(length);
+    return true;
+}
+
+// Makes sure at least bytes unread bytes are buffered
+bool IrcCaptureReader::fill(int bytes)
+{
+    if (m_buffer.size() - m_pos >= bytes) {
+        return true;
+    }
+    m_buffer.remove(0, m_pos);
+    m_pos = 0;
+    while (m_buffer.size() < bytes) {
+        const QByteArray chunk = m_device->read(qMax(ReadChunkSize, bytes - int(m_buffer.size())));
+        if (chunk.isEmpty()) {
+            return false;
+        }
+        m_buffer += chunk;
+    }
+    return true;
+}
+
+bool IrcCaptureReader::readVarint(quint64 *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (!fill(1)) {
+            return false;
+        }
+        const quint8 byte = quint8(m_buffer.at(m_pos++));
+        *value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -1,236 +1,441 @@
 #include "IrcConnection.h"
+#include "IrcCoreLink.h"
+#include "IrcLog.h"
+#include "IrcNetworkPool.h"
+#include "IrcSession.h"
+#include "IrcStats.h"
 #include <QDebug>
-#include <QRegularExpression>
 
-IrcConnection::IrcConnection(QObject *parent)
+IrcConnection::IrcConnection(QObject *parent, bool useNetworkThread)
     : QObject(parent)
-    , m_socket(new QTcpSocket(this))
+    , m_strings(new IrcStringPool)
+    , m_stringLimit(DefaultStringLimit)
+    , m_renewStrings(false)
+    , m_session(new IrcSession(m_strings, useNetworkThread ? nullptr : this))
+    , m_pool(nullptr)
+    , m_link(nullptr)
+    , m_remoteNetwork(0)
+    , m_batchSize(1000)
     , m_port(6667)
+    , m_connected(false)
+    , m_channels(m_strings)
+    , m_trackMembers(false)
+    , m_nickId(IrcStringPool::NullId)
 {
-    connect(m_socket, &QTcpSocket::connected, this, &IrcConnection::onConnected);
-    connect(m_socket, &QTcpSocket::disconnected, this, &IrcConnection::onDisconnected);
-    connect(m_socket, &QTcpSocket::readyRead, this, &IrcConnection::onReadyRead);
-    connect(m_socket, &QTcpSocket::errorOccurred, this, &IrcConnection::onSocketError);
+    if (useNetworkThread) {
+        m_pool = IrcNetworkPool::shared();
+        m_pool->adopt(m_session);
+    }
+    
+    // Always queued, so draining never runs inside the parser's call stack
+    connect(m_session, &IrcSession::eventsAvailable, 
+            this, &IrcConnection::drainEvents, Qt::QueuedConnection);
+}
+
+IrcConnection::IrcConnection(IrcCoreLink *link, const IrcCoreProtocol::Network &network, QObject *parent)
+    : QObject(parent)
+    , m_strings(new IrcStringPool)
+    , m_stringLimit(DefaultStringLimit)
+    , m_renewStrings(false)
+    , m_session(nullptr)
+    , m_pool(nullptr)
+    , m_link(link)
+    , m_remoteNetwork(network.id)
+    , m_batchSize(1000)
+    , m_server(network.addresses.first().host)
+    , m_port(network.addresses.first().port)
+    , m_connected(network.connected)
+    , m_localAddress(network.localAddress)
+    , m_channels(m_strings)
+    , m_trackMembers(false)
+    , m_nickId(m_strings->intern(network.nickname))
+{
+    applyISupport(network.isupport);
+    m_link->addConnection(m_remoteNetwork, this);
 }
 
 IrcConnection::~IrcConnection()
 {
-    if (m_socket->isOpen()) {
-        disconnect();
+    if (m_link) {
+        // The core keeps the network; only this window lets go of it
+        m_link->removeConnection(m_remoteNetwork);
+        delete m_strings;
+        return;
     }
+    
+    IrcSession *session = m_session;
+    if (m_pool) {
+        // Other sessions share the thread, so only this one is torn down
+        m_pool->release(session);
+    } else {
+        // Deleted here rather than as a child, while the pool still exists
+        session->shutdown();
+        delete session;
+    }
+    delete m_strings;
 }
 
-void IrcConnection::connectToServer(const QString &host, quint16 port)
+void IrcConnection::connectToServer(const QString &host, quint16 port, const IrcTlsOptions &tls)
 {
+    if (m_link) {
+        // To whichever server the core is due to try
+        m_link->connectNetwork(m_remoteNetwork);
+        return;
+    }
+    
     m_server = host;
     m_port = port;
+    if (!m_connected) {
+        renewStringsIfFull();
+    }
+    m_isupport.clear();
+    m_channels = ChannelState(m_strings);
     
-    qDebug() << "Connecting to" << host << ":" << port;
-    m_socket->connectToHost(host, port);
+    IrcSession *session = m_session;
+    QMetaObject::invokeMethod(session, [session, host, port, tls]() {
+        session->connectToServer(host, port, tls);
+    }, Qt::QueuedConnection);
 }
 
 void IrcConnection::disconnect()
 {
-    if (m_socket->isOpen()) {
+    if (m_link) {
+        // Also stops the core reconnecting
+        m_link->disconnectNetwork(m_remoteNetwork);
+        return;
+    }
+    if (m_connected) {
         sendRawMessage("QUIT :Leaving");
-        m_socket->disconnectFromHost();
+        IrcSession *session = m_session;
+        QMetaObject::invokeMethod(session, [session]() { session->disconnectFromServer(); },
+                                  Qt::QueuedConnection);
     }
 }
 
-bool IrcConnection::isConnected() const
+void IrcConnection::sendRawMessage(const QString &message)
 {
-    return m_socket->state() == QAbstractSocket::ConnectedState;
+    postLine(message.toUtf8());
 }
 
-void IrcConnection::sendRawMessage(const QString &message)
+void IrcConnection::postLine(const QByteArray &line)
 {
-    if (!isConnected()) {
-        qWarning() << "Not connected to server";
+    if (!m_connected) {
+        qCWarning(lcIrcSession) << "Not connected to server";
         return;
     }
     
-    QString msg = message + "\r\n";
-    qDebug() << ">> " << message;
-    m_socket->write(msg.toUtf8());
-    m_socket->flush();
+    if (m_link) {
+        m_link->sendLine(m_remoteNetwork, line);
+        return;
+    }
+    m_session->postLine(line);
 }
 
-void IrcConnection::setNickname(const QString &nick)
+void IrcConnection::setBatchLimits(int maxEvents, int maxLatencyMs)
 {
-    m_nickname = nick;
-    sendRawMessage(QString("NICK %1").arg(nick));
-    sendRawMessage(QString("USER %1 0 * :%1").arg(nick));
+    m_batchSize = qMax(1, maxEvents);
+    if (m_link) {
+        return;
+    }
+    
+    IrcSession *session = m_session;
+    QMetaObject::invokeMethod(session, [session, maxEvents, maxLatencyMs]() {
+        session->setBatchLimits(maxEvents, maxLatencyMs);
+    }, Qt::QueuedConnection);
 }
 
-void IrcConnection::joinChannel(const QString &channel)
+void IrcConnection::setFloodLimits(int burst, int intervalMs)
 {
-    sendRawMessage(QString("JOIN %1").arg(channel));
+    if (m_link) {
+        // The core paces its own connections
+        return;
+    }
+    IrcSession *session = m_session;
+    QMetaObject::invokeMethod(session, [session, burst, intervalMs]() {
+        session->setFloodLimits(burst, intervalMs);
+    }, Qt::QueuedConnection);
 }
 
-void IrcConnection::partChannel(const QString &channel)
+void IrcConnection::setLegacyEncoding(IrcTextCodec::Legacy legacy)
 {
-    sendRawMessage(QString("PART %1").arg(channel));
+    if (m_link) {
+        m_link->setLegacyEncoding(m_remoteNetwork, legacy);
+        return;
+    }
+    IrcSession *session = m_session;
+    QMetaObject::invokeMethod(session, [session, legacy]() {
+        session->setLegacyEncoding(legacy);
+    }, Qt::QueuedConnection);
 }
 
-void IrcConnection::sendMessage(const QString &target, const QString &message)
+void IrcConnection::setFilterRules(const IrcFilterRules &rules)
 {
-    sendRawMessage(QString("PRIVMSG %1 :%2").arg(target, message));
+    if (m_link) {
+        m_link->setFilterRules(m_remoteNetwork, rules);
+        return;
+    }
+    IrcSession *session = m_session;
+    QMetaObject::invokeMethod(session, [session, rules]() {
+        session->setFilterRules(rules);
+    }, Qt::QueuedConnection);
 }
 
-void IrcConnection::sendPrivateMessage(const QString &user, const QString &message)
+void IrcConnection::injectInput(const QByteArray &data)
 {
-    sendMessage(user, message);
+    IrcSession *session = m_session;
+    if (m_link) {
+        qCWarning(lcIrcSession) << "Cannot inject input into a network of the core";
+        return;
+    }
+    if (!m_pool) {
+        session->feedInput(data);
+        return;
+    }
+    QMetaObject::invokeMethod(session, [session, data]() { session->feedInput(data); },
+                              Qt::QueuedConnection);
 }
 
-void IrcConnection::onConnected()
+void IrcConnection::setNickname(const QString &nick)
 {
-    qDebug() << "Connected to server";
-    emit connected();
+    // The session tracks the nickname itself for registration retries; the
+    // core registers with its own
+    if (m_link) {
+        return;
+    }
+    m_nickId = m_strings->intern(nick);
+    IrcSession *session = m_session;
+    QMetaObject::invokeMethod(session, [session, nick]() { session->registerUser(nick); },
+                              Qt::QueuedConnection);
 }
 
-void IrcConnection::onDisconnected()
+void IrcConnection::setRejoinChannels(const QStringList &channels, const QStringList &keys)
 {
-    qDebug() << "Disconnected from server";
-    emit disconnected();
+    if (m_link) {
+        // The core rejoins the channels it was in
+        return;
+    }
+    IrcSession *session = m_session;
+    QMetaObject::invokeMethod(session, [session, channels, keys]() {
+        session->setRejoinChannels(channels, keys);
+    }, Qt::QueuedConnection);
 }
 
-void IrcConnection::onReadyRead()
+void IrcConnection::joinChannel(const QString &channel, const QString &key)
 {
-    while (m_socket->canReadLine()) {
-        QString line = QString::fromUtf8(m_socket->readLine()).trimmed();
-        
-        if (!line.isEmpty()) {
-            qDebug() << "<< " << line;
-            parseIrcMessage(line);
-        }
+    QByteArray line = "JOIN " + channel.toUtf8();
+    if (!key.isEmpty()) {
+        line += ' ';
+        line += key.toUtf8();
     }
+    postLine(line);
 }
 
-void IrcConnection::onSocketError(QAbstractSocket::SocketError error)
+void IrcConnection::partChannel(const QString &channel)
 {
-    QString errorStr = m_socket->errorString();
-    qWarning() << "Socket error:" << errorStr;
-    emit connectionError(errorStr);
+    postLine("PART " + channel.toUtf8());
 }
 
-QString IrcConnection::extractNickname(const QString &prefix)
+void IrcConnection::sendMessage(const QString &target, const QString &message)
 {
-    int exclamationPos = prefix.indexOf('!');
-    if (exclamationPos > 0) {
-        return prefix.left(exclamationPos);
-    }
-    return prefix;
+    // Encoded straight to bytes; the session splits anything too long
+    QByteArray line = "PRIVMSG " + target.toUtf8();
+    line += " :";
+    line += message.toUtf8();
+    postLine(line);
+}
+
+void IrcConnection::sendPrivateMessage(const QString &user, const QString &message)
+{
+    sendMessage(user, message);
+}
+
+void IrcConnection::sendCtcpRequest(const QString &target, const QString &text)
+{
+    postLine("PRIVMSG " + target.toUtf8() + " :\001" + text.toUtf8() + '\001');
 }
 
-void IrcConnection::parseIrcMessage(const QString &line)
+void IrcConnection::sendCtcpReply(const QString &target, const QString &text)
 {
-    // IRC message format: [:prefix] command [params] [:trailing]
-    QString message = line;
-    QString prefix;
+    postLine("NOTICE " + target.toUtf8() + " :\001" + text.toUtf8() + '\001');
+}
+
+void IrcConnection::drainEvents()
+{
+    // Re-arm the session's wakeup first so nothing pushed from here on is missed
+    m_session->acknowledgeEvents();
     
-    // Extract prefix if present
-    if (message.startsWith(':')) {
-        int spacePos = message.indexOf(' ');
-        prefix = message.mid(1, spacePos - 1);
-        message = message.mid(spacePos + 1).trimmed();
+    IrcEvent event;
+    while (m_session->takeEvent(event)) {
+        dispatch(event);
     }
-    
-    // Split into command and parameters
-    QStringList parts = message.split(' ');
-    if (parts.isEmpty()) return;
-    
-    QString command = parts.takeFirst();
-    
-    // Extract trailing parameter if present
-    QString trailing;
-    for (int i = 0; i < parts.size(); ++i) {
-        if (parts[i].startsWith(':')) {
-            trailing = parts.mid(i).join(' ').mid(1);
-            parts = parts.mid(0, i);
-            break;
-        }
+    flushBatch();
+}
+
+void IrcConnection::deliverRemote(IrcEventBatch &events)
+{
+    for (IrcEvent &event : events) {
+        dispatch(event);
     }
+    flushBatch();
     
-    // Handle PING (server keepalive)
-    if (command == "PING") {
-        sendRawMessage(QString("PONG %1").arg(trailing.isEmpty() ? parts.join(' ') : trailing));
-        return;
+    // The core reconnects by itself, so this is the place between connections
+    if (!m_connected) {
+        renewStringsIfFull();
     }
-    
-    // Handle numeric replies
-    bool isNumeric = false;
-    int numericCode = command.toInt(&isNumeric);
-    if (isNumeric) {
-        QStringList params = parts;
-        if (!trailing.isEmpty()) {
-            params.append(trailing);
-        }
-        handleNumericReply(numericCode, params);
+}
+
+void IrcConnection::renewStringsIfFull()
+{
+    if (!m_link) {
+        // Whatever the session queued still refers to the current pool
+        drainEvents();
+    }
+    const IrcStringPool::Stats stats = m_strings->stats();
+    if (!m_renewStrings && stats.storedBytes <= m_stringLimit
+        && m_strings->count() <= IrcStringPool::Capacity / 2) {
         return;
     }
+    m_renewStrings = false;
+    qCInfo(lcIrcSession) << "Renewing the string pool of" << m_server << "to let go of"
+                         << stats.uniqueStrings << "names," << stats.storedBytes / 1024 << "KiB";
     
-    // Handle text commands
-    if (command == "PRIVMSG") {
-        if (parts.size() >= 1) {
-            QString target = parts[0];
-            QString sender = extractNickname(prefix);
-            emit messageReceived(sender, target, trailing);
-        }
-    }
-    else if (command == "NOTICE") {
-        QString sender = extractNickname(prefix);
-        emit noticeReceived(sender, trailing);
-    }
-    else if (command == "JOIN") {
-        QString channel = trailing.isEmpty() ? parts[0] : trailing;
-        QString user = extractNickname(prefix);
-        emit joinedChannel(channel, user);
-    }
-    else if (command == "PART") {
-        if (parts.size() >= 1) {
-            QString channel = parts[0];
-            QString user = extractNickname(prefix);
-            emit partedChannel(channel, user);
-        }
-    }
-    else if (command == "NICK") {
-        QString oldNick = extractNickname(prefix);
-        QString newNick = trailing.isEmpty() ? parts[0] : trailing;
-        emit nickChanged(oldNick, newNick);
+    IrcStringPool *old = m_strings;
+    m_strings = new IrcStringPool;
+    m_channels = ChannelState(m_strings);
+    m_nickId = m_strings->intern(old->string(m_nickId));
+    if (m_link) {
+        delete old;
+    } else {
+        // The session lets go of the old pool on its own thread
+        IrcSession *session = m_session;
+        IrcStringPool *strings = m_strings;
+        QMetaObject::invokeMethod(session, [session, strings, old]() {
+            session->setStringPool(strings);
+            delete old;
+        }, Qt::QueuedConnection);
     }
+    emit stringsRenewed();
 }
 
-void IrcConnection::handleNumericReply(int code, const QStringList &params)
+void IrcConnection::dispatch(IrcEvent &event)
 {
-    switch (code) {
-        case 1: // RPL_WELCOME
-            emit serverMessageReceived(params.join(' '));
+    switch (event.type) {
+        case IrcEvent::Connected:
+            flushBatch();
+            m_connected = true;
+            m_localAddress = QHostAddress(event.text);
+            emit connected();
             break;
-            
-        case 332: // RPL_TOPIC
-            if (params.size() >= 2) {
-                QString channel = params[1];
-                QString topic = params.size() > 2 ? params.mid(2).join(' ') : "";
-                emit topicReceived(channel, topic);
-            }
+        case IrcEvent::Disconnected:
+            flushBatch();
+            m_connected = false;
+            m_channels.clear();
+            emit disconnected();
             break;
-            
-        case 353: // RPL_NAMREPLY (user list)
-            if (params.size() >= 3) {
-                QString channel = params[2];
-                QString userList = params.size() > 3 ? params.mid(3).join(' ') : "";
-                QStringList users = userList.split(' ', Qt::SkipEmptyParts);
-                emit userListReceived(channel, users);
-            }
+        case IrcEvent::ConnectionError:
+            flushBatch();
+            emit connectionError(event.text);
             break;
-            
-        case 366: // RPL_ENDOFNAMES
-            // End of NAMES list
+        case IrcEvent::ISupport:
+            applyISupport(event.names);
             break;
-            
         default:
-            // Generic server message
-            emit serverMessageReceived(QString::number(code) + " " + params.join(' '));
+            track(event);
+            m_batch.append(event);
+            if (m_batch.size() >= m_batchSize) {
+                flushBatch();
+            }
             break;
     }
 }
+
+void IrcConnection::track(const IrcEvent &event)
+{
+    const bool self = m_channels.sameName(event.senderId, m_nickId);
+    if (m_trackMembers) {
+        switch (event.type) {
+            case IrcEvent::Join:
+                m_channels.join(event.targetId, event.senderId, self);
+                break;
+            case IrcEvent::Part:
+                m_channels.part(event.targetId, event.senderId, self);
+                break;
+            case IrcEvent::Kick: {
+                const IrcStringPool::Id kicked = m_strings->intern(event.argument);
+                m_channels.part(event.targetId, kicked, m_channels.sameName(kicked, m_nickId));
+                break;
+            }
+            case IrcEvent::Quit:
+                m_channels.quit(event.senderId);
+                break;
+            case IrcEvent::NickChange:
+                m_channels.rename(event.senderId, event.targetId);
+                break;
+            case IrcEvent::Names:
+                // Already the whole list
+                m_channels.addNames(event.targetId, event.names);
+                m_channels.endNames(event.targetId);
+                break;
+            case IrcEvent::Prefixes:
+                m_channels.setPrefixes(event.targetId, m_strings->intern(event.argument), event.text);
+                break;
+            default:
+                break;
+        }
+    }
+    if (event.type == IrcEvent::NickChange && self) {
+        m_nickId = event.targetId;
+    }
+}
+
+void IrcConnection::flushBatch()
+{
+    if (m_batch.isEmpty()) {
+        return;
+    }
+    
+    IrcStats::add(IrcStats::EventsDelivered, quint64(m_batch.size()));
+    IrcStats::add(IrcStats::BatchesDelivered);
+    {
+        // Covers the receivers, which handle the batch before emit returns
+        IrcStats::ScopedTimer timer(IrcStats::DeliveryNs);
+        emit eventsReady(m_batch);
+    }
+    m_batch.clear();
+}
+
+QString IrcConnection::statsText() const
+{
+    const IrcStringPool::Stats strings = m_strings->stats();
+    return QString("String pool: %1 names, %2 KiB stored, %3 KiB saved over %4 lookups\n")
+        .arg(strings.uniqueStrings)
+        .arg(strings.storedBytes / 1024)
+        .arg(strings.savedBytes() / 1024)
+        .arg(strings.lookups);
+}
+
+QStringList IrcConnection::isupportTokens() const
+{
+    QStringList tokens;
+    for (auto it = m_isupport.constBegin(); it != m_isupport.constEnd(); ++it) {
+        tokens.append(it.value().isEmpty() ? it.key() : it.key() + '=' + it.value());
+    }
+    return tokens;
+}
+
+void IrcConnection::applyISupport(const QStringList &tokens)
+{
+    for (const QString &token : tokens) {
+        if (token.startsWith('-')) {
+            m_isupport.remove(token.mid(1));
+            continue;
+        }
+        const int equals = token.indexOf('=');
+        if (equals < 0) {
+            m_isupport.insert(token, QString());
+        } else {
+            m_isupport.insert(token.left(equals), token.mid(equals + 1));
+        }
+        m_channels.applyISupport(token);
+    }
+}
@@ -0,0 +1,208 @@
+#include "IrcCoreLink.h"
+#include "IrcConnection.h"
+#include "IrcLog.h"
+#include <QDeadlineTimer>
+
+IrcCoreLink::IrcCoreLink(QObject *parent)
+    : QObject(parent)
+    , m_socket(new QLocalSocket(this))
+    , m_snapshotReceived(false)
+{
+    connect(m_socket, &QLocalSocket::readyRead, this, &IrcCoreLink::onReadyRead);
+    connect(m_socket, &QLocalSocket::disconnected, this, &IrcCoreLink::onDisconnected);
+}
+
+bool IrcCoreLink::attach(const QString &name, int timeoutMs)
+{
+    QDeadlineTimer deadline(timeoutMs);
+    m_socket->connectToServer(name);
+    if (!m_socket->waitForConnected(int(deadline.remainingTime()))) {
+        qCWarning(lcIrcSession) << "No core at" << name << ":" << m_socket->errorString();
+        return false;
+    }
+
+    IrcCoreProtocol::Writer hello(IrcCoreProtocol::Hello);
+    hello.integer<quint32>(IrcCoreProtocol::Version);
+    send(hello);
+
+    // readyRead is emitted from inside the wait, so the frames are handled
+    // as they arrive
+    while (!m_snapshotReceived && isAttached()) {
+        if (!m_socket->waitForReadyRead(int(deadline.remainingTime()))) {
+            break;
+        }
+    }
+    if (!m_snapshotReceived) {
+        qCWarning(lcIrcSession) << "No snapshot from the core at" << name;
+        m_socket->abort();
+        return false;
+    }
+    qCInfo(lcIrcSession) << "Attached to the core at" << name << "with" << m_connections.size() << "networks";
+    return true;
+}
+
+void IrcCoreLink::addNetwork(const QList<IrcServerAddress> &addresses, const QString &nickname)
+{
+    IrcCoreProtocol::Writer frame(IrcCoreProtocol::AddNetwork);
+    frame.addresses(addresses);
+    frame.string(nickname);
+    send(frame);
+}
+
+void IrcCoreLink::removeNetwork(quint32 network)
+{
+    sendId(IrcCoreProtocol::RemoveNetwork, network);
+}
+
+void IrcCoreLink::addConnection(quint32 network, IrcConnection *connection)
+{
+    m_connections.insert(network, connection);
+}
+
+void IrcCoreLink::removeConnection(quint32 network)
+{
+    m_connections.remove(network);
+}
+
+void IrcCoreLink::connectNetwork(quint32 network)
+{
+    sendId(IrcCoreProtocol::Connect, network);
+}
+
+void IrcCoreLink::disconnectNetwork(quint32 network)
+{
+    sendId(IrcCoreProtocol::Disconnect, network);
+}
+
+void IrcCoreLink::sendLine(quint32 network, const QByteArray &line)
+{
+    IrcCoreProtocol::Writer frame(IrcCoreProtocol::SendLine);
+    frame.integer<quint32>(network);
+    frame.string(QString::fromUtf8(line));
+    send(frame);
+}
+
+void IrcCoreLink::setLegacyEncoding(quint32 network, IrcTextCodec::Legacy legacy)
+{
+    IrcCoreProtocol::Writer frame(IrcCoreProtocol::SetEncoding);
+    frame.integer<quint32>(network);
+    frame.integer<quint8>(legacy);
+    send(frame);
+}
+
+void IrcCoreLink::setFilterRules(quint32 network, const IrcFilterRules &rules)
+{
+    IrcCoreProtocol::Writer frame(IrcCoreProtocol::SetFilterRules);
+    frame.integer<quint32>(network);
+    frame.strings(rules.highlightWords);
+    frame.strings(rules.ignoreMasks);
+    send(frame);
+}
+
+void IrcCoreLink::onReadyRead()
+{
+    m_input += m_socket->readAll();
+    const bool ok = IrcCoreProtocol::readFrames(m_input, [this](IrcCoreProtocol::FrameType type,
+                                                                IrcCoreProtocol::Reader &in) {
+        return handleFrame(type, in);
+    });
+    if (!ok) {
+        qCWarning(lcIrcSession) << "Malformed frame from the core; detaching";
+        m_socket->abort();
+    }
+}
+
+bool IrcCoreLink::handleFrame(IrcCoreProtocol::FrameType type, IrcCoreProtocol::Reader &in)
+{
+    switch (type) {
+        case IrcCoreProtocol::Snapshot:
+            if (m_snapshotReceived) {
+                return false;
+            }
+            m_snapshot.append(in.network());
+            return true;
+        case IrcCoreProtocol::SnapshotLines: {
+            // Only ever for the network just sent
+            const quint32 network = in.integer<quint32>();
+            const quint32 index = in.integer<quint32>();
+            if (m_snapshotReceived || m_snapshot.isEmpty() || m_snapshot.last().id != network
+                || index >= quint32(m_snapshot.last().buffers.size())) {
+                return false;
+            }
+            m_snapshot.last().buffers[int(index)].lines += in.lines();
+            return true;
+        }
+        case IrcCoreProtocol::SnapshotEnd: {
+            if (m_snapshotReceived) {
+                return false;
+            }
+            m_snapshotReceived = true;
+            const QVector<IrcCoreProtocol::Network> networks = std::move(m_snapshot);
+            m_snapshot.clear();
+            for (const IrcCoreProtocol::Network &network : networks) {
+                emit networkAdded(network);
+            }
+            return true;
+        }
+        case IrcCoreProtocol::NetworkAdded: {
+            const IrcCoreProtocol::Network network = in.network();
+            if (in.ok()) {
+                emit networkAdded(network);
+            }
+            return true;
+        }
+        case IrcCoreProtocol::NetworkRemoved:
+            emit networkRemoved(in.integer<quint32>());
+            return true;
+        case IrcCoreProtocol::Events: {
+            IrcConnection *connection = m_connections.value(in.integer<quint32>(), nullptr);
+            if (!connection) {
+                // Removed here while the core was still sending
+                return true;
+            }
+            IrcEventBatch events;
+            const quint32 count = in.integer<quint32>();
+            for (quint32 i = 0; i < count && in.ok(); ++i) {
+                events.append(in.event(connection->strings()));
+            }
+            if (in.ok()) {
+                connection->deliverRemote(events);
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+void IrcCoreLink::onDisconnected()
+{
+    if (!m_snapshotReceived) {
+        // attach() failed and says so
+        return;
+    }
+    qCWarning(lcIrcSession) << "Lost the core at" << m_socket->serverName();
+
+    // Every network is out of reach now
+    const QList<IrcConnection*> connections = m_connections.values();
+    for (IrcConnection *connection : connections) {
+        IrcEventBatch events;
+        events.append(IrcEvent(IrcEvent::Disconnected));
+        connection->deliverRemote(events);
+    }
+    emit detached();
+}
+
+void IrcCoreLink::send(IrcCoreProtocol::Writer &frame)
+{
+    if (isAttached()) {
+        m_socket->write(frame.frame());
+    }
+}
+
+void IrcCoreLink::sendId(IrcCoreProtocol::FrameType type, quint32 network)
+{
+    IrcCoreProtocol::Writer frame(type);
+    frame.integer<quint32>(network);
+    send(frame);
+}
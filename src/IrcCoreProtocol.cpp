@@ -0,0 +1,251 @@
+#include "IrcCoreProtocol.h"
+
+namespace {
+
+// Smallest encodings, to bound counts before allocating for them
+const qint64 MinStringSize = 4;
+const qint64 MinAddressSize = MinStringSize + 2 + 1;
+const qint64 MinNetworkSize = 4 + 4 + MinStringSize + 1 + MinStringSize + 4 + 4;
+const qint64 MinBufferSize = 3 * MinStringSize + 4;
+const qint64 MinLineSize = 8 + 1 + 2 * MinStringSize;
+const qint64 MinEventSize = 1 + 4 * MinStringSize + 4 + 4 + 8 + 1;
+
+} // namespace
+
+IrcCoreProtocol::Writer::Writer(FrameType type)
+{
+    // The length goes in front once it is known
+    m_data.resize(4);
+    integer<quint8>(type);
+}
+
+void IrcCoreProtocol::Writer::string(const QString &text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    integer<quint32>(quint32(utf8.size()));
+    m_data.append(utf8);
+}
+
+void IrcCoreProtocol::Writer::strings(const QStringList &list)
+{
+    integer<quint32>(quint32(list.size()));
+    for (const QString &text : list) {
+        string(text);
+    }
+}
+
+void IrcCoreProtocol::Writer::addresses(const QList<IrcServerAddress> &addresses)
+{
+    integer<quint32>(quint32(addresses.size()));
+    for (const IrcServerAddress &address : addresses) {
+        string(address.host);
+        integer<quint16>(address.port);
+        integer<quint8>(address.tls ? 1 : 0);
+    }
+}
+
+void IrcCoreProtocol::Writer::lines(const QVector<Line> &lines)
+{
+    integer<quint32>(quint32(lines.size()));
+    for (const Line &line : lines) {
+        integer<qint64>(line.timestamp);
+        integer<quint8>(line.system ? 1 : 0);
+        string(line.sender);
+        string(line.text);
+    }
+}
+
+void IrcCoreProtocol::Writer::network(const Network &network)
+{
+    integer<quint32>(network.id);
+    addresses(network.addresses);
+    string(network.nickname);
+    integer<quint8>(network.connected ? 1 : 0);
+    string(network.localAddress);
+    strings(network.isupport);
+
+    integer<quint32>(quint32(network.buffers.size()));
+    for (const Buffer &buffer : network.buffers) {
+        string(buffer.name);
+        string(buffer.topic);
+        strings(buffer.members);
+        lines(buffer.lines);
+    }
+}
+
+void IrcCoreProtocol::Writer::event(const IrcEvent &event, const IrcStringPool &strings)
+{
+    integer<quint8>(quint8(event.type));
+    string(event.sender);
+    string(event.target);
+    string(event.text);
+    string(event.argument);
+    this->strings(event.names);
+    integer<quint32>(quint32(event.channels.size()));
+    for (IrcStringPool::Id channel : event.channels) {
+        string(strings.string(channel));
+    }
+    integer<qint64>(event.sentTime);
+    integer<quint8>(event.highlight ? 1 : 0);
+}
+
+const QByteArray &IrcCoreProtocol::Writer::frame()
+{
+    qToLittleEndian<quint32>(quint32(m_data.size() - 4), m_data.data());
+    return m_data;
+}
+
+QByteArray IrcCoreProtocol::Reader::bytes()
+{
+    const quint32 length = integer<quint32>();
+    if (!take(length)) {
+        return QByteArray();
+    }
+    return QByteArray(m_data + m_pos - length, int(length));
+}
+
+QStringList IrcCoreProtocol::Reader::strings()
+{
+    QStringList list;
+    const int n = count(MinStringSize);
+    list.reserve(n);
+    for (int i = 0; i < n && m_ok; ++i) {
+        list.append(string());
+    }
+    return list;
+}
+
+QList<IrcServerAddress> IrcCoreProtocol::Reader::addresses()
+{
+    QList<IrcServerAddress> list;
+    const int n = count(MinAddressSize);
+    for (int i = 0; i < n && m_ok; ++i) {
+        IrcServerAddress address;
+        address.host = string();
+        address.port = integer<quint16>();
+        address.tls = integer<quint8>() != 0;
+        list.append(address);
+    }
+    return list;
+}
+
+QVector<IrcCoreProtocol::Line> IrcCoreProtocol::Reader::lines()
+{
+    QVector<Line> list(count(MinLineSize));
+    for (Line &line : list) {
+        line.timestamp = integer<qint64>();
+        line.system = integer<quint8>() != 0;
+        line.sender = string();
+        line.text = string();
+    }
+    return list;
+}
+
+IrcCoreProtocol::Network IrcCoreProtocol::Reader::network()
+{
+    Network network;
+    network.id = integer<quint32>();
+    network.addresses = addresses();
+    network.nickname = string();
+    network.connected = integer<quint8>() != 0;
+    network.localAddress = string();
+    network.isupport = strings();
+
+    const int bufferCount = count(MinBufferSize);
+    network.buffers.resize(bufferCount);
+    for (Buffer &buffer : network.buffers) {
+        buffer.name = string();
+        buffer.topic = string();
+        buffer.members = strings();
+        buffer.lines = lines();
+    }
+    if (network.addresses.isEmpty() || network.buffers.isEmpty()) {
+        m_ok = false;
+    }
+    return network;
+}
+
+IrcEvent IrcCoreProtocol::Reader::event(IrcStringPool &strings)
+{
+    // The canonical copy, so routing compares ids and shares the string
+    auto intern = [&strings](const QString &text, IrcStringPool::Id *id) {
+        *id = text.isEmpty() ? IrcStringPool::NullId : strings.intern(text);
+        return *id == IrcStringPool::NullId ? QString() : strings.string(*id);
+    };
+
+    IrcEvent event;
+    const quint8 type = integer<quint8>();
+    if (type > IrcEvent::ISupport) {
+        m_ok = false;
+    }
+    event.type = IrcEvent::Type(type);
+    event.sender = intern(string(), &event.senderId);
+    event.target = intern(string(), &event.targetId);
+    event.text = string();
+    event.argument = string();
+    event.names = this->strings();
+    const int channelCount = count(MinStringSize);
+    event.channels.reserve(channelCount);
+    for (int i = 0; i < channelCount && m_ok; ++i) {
+        IrcStringPool::Id channel;
+        intern(string(), &channel);
+        event.channels.append(channel);
+    }
+    event.sentTime = integer<qint64>();
+    event.highlight = integer<quint8>() != 0;
+    return event;
+}
+
+int IrcCoreProtocol::Reader::count(qint64 minimumSize)
+{
+    const quint32 n = integer<quint32>();
+    if (m_ok && qint64(n) * minimumSize > m_size - m_pos) {
+        m_ok = false;
+    }
+    return m_ok ? int(n) : 0;
+}
+
+bool IrcCoreProtocol::Reader::take(qint64 length)
+{
+    if (!m_ok || length > m_size - m_pos) {
+        m_ok = false;
+        return false;
+    }
+    m_pos += length;
+    return true;
+}
+
+bool IrcCoreProtocol::readFrames(QByteArray &buffer, const std::function<bool(FrameType, Reader &)> &handle)
+{
+    // Frames are read in place and the buffer is shifted once at the end
+    qint64 offset = 0;
+    bool ok = true;
+    while (buffer.size() - offset >= 4) {
+        const quint32 length = qFromLittleEndian<quint32>(buffer.constData() + offset);
+        if (length == 0 || length > MaxFrameSize) {
+            ok = false;
+            break;
+        }
+        if (buffer.size() - offset - 4 < qint64(length)) {
+            break;
+        }
+        const FrameType type = FrameType(quint8(buffer.at(int(offset + 4))));
+        Reader in(buffer.constData() + offset + 5, length - 1);
+        offset += 4 + qint64(length);
+        if (!handle(type, in) || !in.ok()) {
+            ok = false;
+            break;
+        }
+    }
+    buffer.remove(0, int(offset));
+    return ok;
+}
+
+QString IrcCoreProtocol::defaultServerName()
+{
+    QString user = qEnvironmentVariable("USER");
+    if (user.isEmpty()) {
+        user = qEnvironmentVariable("USERNAME");
+    }
+    return "qtirc-core-" + user;
+}
@@ -0,0 +1,729 @@
+#include "IrcCoreServer.h"
+#include "IrcLog.h"
+#include "IrcMessage.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QRandomGenerator>
+
+namespace {
+
+// The same backoff as NetworkController: delays double from the first to
+// the last, each cut to a random 50-100%
+const int FirstReconnectDelayMs = 2000;
+const int MaxReconnectDelayMs = 5 * 60 * 1000;
+// A connection that stayed up this long starts the backoff over
+const qint64 StableConnectionMs = 60 * 1000;
+// Heap header and terminator of each string of a line, roughly
+const qint64 StringOverhead = 32;
+// A connection starts a fresh string pool between connections once its
+// pool holds more than this share of the history budget
+const int MaxInternedShare = 4;
+// However many names are interned, lines keep this share of the budget
+const int MinLineShare = 2;
+// A snapshot sends history in frames of about this size
+const qint64 SnapshotChunkBytes = 1024 * 1024;
+// Encoded size of a line besides its strings, and the most UTF-8 bytes a
+// UTF-16 unit takes
+const qint64 WireLineOverhead = 8 + 1 + 4 + 4;
+const qint64 MaxUtf8PerUnit = 3;
+
+} // namespace
+
+IrcCoreServer::IrcCoreServer(qint64 historyBudget, QObject *parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+    , m_filterRules(IrcFilterRules::load())
+    , m_nextNetworkId(1)
+    , m_nextBufferId(1)
+    , m_lineBytes(0)
+    , m_historyBudget(historyBudget)
+    , m_internedOverrun(false)
+{
+    // Only this user's windows may attach
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &IrcCoreServer::onNewConnection);
+}
+
+IrcCoreServer::~IrcCoreServer()
+{
+    while (!m_networks.isEmpty()) {
+        removeNetwork(m_networks.last());
+    }
+}
+
+bool IrcCoreServer::listen(const QString &name)
+{
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(500)) {
+        qCCritical(lcIrcSession) << "A core is already running at" << name;
+        return false;
+    }
+
+    // A socket file left behind by a core that crashed would block listen()
+    QLocalServer::removeServer(name);
+    if (!m_server->listen(name)) {
+        qCCritical(lcIrcSession) << "Cannot listen at" << name << ":" << m_server->errorString();
+        return false;
+    }
+    qCInfo(lcIrcSession) << "Core listening at" << m_server->fullServerName() << "with"
+                         << m_historyBudget / 1024 << "KiB for history";
+    return true;
+}
+
+qint64 IrcCoreServer::historyBytes() const
+{
+    return m_lineBytes + qint64(m_lineOrder.size()) * qint64(sizeof(quint32));
+}
+
+qint64 IrcCoreServer::internedBytes() const
+{
+    qint64 bytes = 0;
+    for (Network *network : m_networks) {
+        bytes += internedBytes(network);
+    }
+    return bytes;
+}
+
+qint64 IrcCoreServer::internedBytes(Network *network)
+{
+    const IrcStringPool::Stats strings = network->connection->strings().stats();
+    return strings.storedBytes + strings.uniqueStrings * StringOverhead;
+}
+
+IrcCoreServer::Network *IrcCoreServer::addNetwork(const QList<IrcServerAddress> &addresses, const QString &nickname)
+{
+    Network *network = new Network;
+    network->id = m_nextNetworkId++;
+    network->addresses = addresses;
+    network->nickname = nickname;
+    network->connection = createConnection(network);
+    network->nickId = network->connection->strings().intern(nickname);
+    network->reconnectTimer = new QTimer(this);
+    network->reconnectTimer->setSingleShot(true);
+
+    network->serverBuffer = m_nextBufferId++;
+    Buffer server;
+    server.name = "Server";
+    m_buffers.insert(network->serverBuffer, server);
+    m_networks.insert(network->id, network);
+
+    // The timer goes with the network, and its connection with it
+    connect(network->reconnectTimer, &QTimer::timeout, this, [this, network]() {
+        // Round the server list; a network with one server retries it
+        network->addressIndex = (network->addressIndex + 1) % network->addresses.size();
+        connectNetwork(network);
+    });
+    return network;
+}
+
+IrcConnection *IrcCoreServer::createConnection(Network *network)
+{
+    IrcConnection *connection = new IrcConnection(this);
+    connection->setTrackMembers(true);
+    connection->setFilterRules(m_filterRules);
+    connection->setStringLimit(m_historyBudget / MaxInternedShare);
+
+    // As the connection goes with the network, so do these
+    connect(connection, &IrcConnection::connected, this, [this, network]() {
+        onConnected(network);
+    });
+    connect(connection, &IrcConnection::disconnected, this, [this, network]() {
+        onDisconnected(network);
+    });
+    connect(connection, &IrcConnection::connectionError, this, [this, network](const QString &error) {
+        onConnectionError(network, error);
+    });
+    connect(connection, &IrcConnection::eventsReady, this, [this, network](const IrcEventBatch &events) {
+        onEventsReady(network, events);
+    });
+    connect(connection, &IrcConnection::stringsRenewed, this, [network]() {
+        // Buffers, joined channels and keys are by name, so only our nick's
+        // id refers to the old pool
+        network->nickId = network->connection->strings().intern(network->nickname);
+    });
+    return connection;
+}
+
+void IrcCoreServer::removeNetwork(Network *network)
+{
+    m_networks.remove(network->id);
+    network->connection->disconnect();
+
+    removeBuffer(network, network->serverBuffer);
+    const QVector<quint32> buffers = network->buffers;
+    for (quint32 buffer : buffers) {
+        removeBuffer(network, buffer);
+    }
+
+    delete network->connection;
+    delete network->reconnectTimer;
+    delete network;
+}
+
+void IrcCoreServer::connectNetwork(Network *network)
+{
+    network->reconnectTimer->stop();
+
+    const IrcServerAddress &address = network->addresses.at(network->addressIndex);
+    IrcTlsOptions tls = IrcTls::defaultOptions();
+    tls.enabled = address.tls;
+    qCInfo(lcIrcSession) << "Connecting to" << address.host << address.port << (tls.enabled ? "(TLS)" : "");
+    network->connection->connectToServer(address.host, address.port, tls);
+}
+
+void IrcCoreServer::disconnectNetwork(Network *network)
+{
+    network->autoReconnect = false;
+    network->reconnectAttempts = 0;
+    network->reconnectTimer->stop();
+    network->connection->disconnect();
+}
+
+void IrcCoreServer::scheduleReconnect(Network *network)
+{
+    if (network->reconnectTimer->isActive()) {
+        return;
+    }
+
+    const int backoff = qMin(MaxReconnectDelayMs, FirstReconnectDelayMs << qMin(network->reconnectAttempts, 8));
+    const int delay = backoff / 2 + int(QRandomGenerator::global()->bounded(backoff / 2 + 1));
+    ++network->reconnectAttempts;
+    network->reconnectTimer->start(delay);
+    qCInfo(lcIrcSession) << "Reconnecting to" << network->addresses.first().host << "in" << delay << "ms";
+}
+
+void IrcCoreServer::onConnected(Network *network)
+{
+    network->autoReconnect = true;
+    network->connectedTime.start();
+
+    // As NetworkController does: the channels we were in go out in one
+    // burst right after registration
+    QStringList channels;
+    QStringList keys;
+    for (const QString &key : qAsConst(network->joined)) {
+        channels.append(m_buffers.value(network->buffersByName.value(key)).name);
+        keys.append(network->keys.value(key));
+    }
+    if (!channels.isEmpty()) {
+        network->connection->setRejoinChannels(channels, keys);
+    }
+    network->connection->setNickname(network->nickname);
+
+    IrcEventBatch events;
+    events.append(IrcEvent(IrcEvent::Connected, QString(), QString(),
+                           network->connection->localAddress().toString()));
+    broadcastEvents(network, events);
+}
+
+void IrcCoreServer::onDisconnected(Network *network)
+{
+    // The buffers stay for the next connection; the connection has
+    // already dropped the members
+
+    IrcEventBatch events;
+    events.append(IrcEvent(IrcEvent::Disconnected));
+    broadcastEvents(network, events);
+
+    if (network->autoReconnect) {
+        if (network->connectedTime.isValid() && network->connectedTime.elapsed() >= StableConnectionMs) {
+            network->reconnectAttempts = 0;
+        }
+        network->connectedTime.invalidate();
+        scheduleReconnect(network);
+    }
+}
+
+void IrcCoreServer::onConnectionError(Network *network, const QString &error)
+{
+    qCWarning(lcIrcSession) << network->addresses.at(network->addressIndex).host << ":" << error;
+
+    IrcEventBatch events;
+    events.append(IrcEvent(IrcEvent::ConnectionError, QString(), QString(), error));
+    broadcastEvents(network, events);
+
+    if (network->autoReconnect) {
+        // While connected, onDisconnected() follows and schedules the retry
+        if (!network->connection->isConnected()) {
+            scheduleReconnect(network);
+        }
+    } else if (!network->connection->isConnected() && network->addressIndex + 1 < network->addresses.size()) {
+        // Never connected yet: try the alternates before giving up
+        ++network->addressIndex;
+        connectNetwork(network);
+    }
+}
+
+void IrcCoreServer::onEventsReady(Network *network, const IrcEventBatch &events)
+{
+    IrcEventBatch forwarded;
+    forwarded.reserve(events.size() + 1);
+
+    // The connection takes RPL_ISUPPORT in by itself; the windows get the
+    // whole set again whenever it changed
+    IrcConnection *connection = network->connection;
+    const QStringList isupport = connection->isupportTokens();
+    if (isupport != network->isupport) {
+        network->isupport = isupport;
+        IrcEvent event(IrcEvent::ISupport);
+        event.names = isupport;
+        forwarded.append(event);
+    }
+
+    for (const IrcEvent &event : events) {
+        if (applyEvent(network, event)) {
+            forwarded.append(event);
+        }
+    }
+    broadcastEvents(network, forwarded);
+}
+
+bool IrcCoreServer::applyEvent(Network *network, const IrcEvent &event)
+{
+    // The connection has already applied the events to its channels
+    const ChannelState &channels = network->connection->channels();
+    IrcStringPool &strings = network->connection->strings();
+    const bool self = channels.sameName(event.senderId, network->nickId);
+
+    switch (event.type) {
+        case IrcEvent::Message: {
+            // Routed as NetworkController routes it
+            quint32 buffer = 0;
+            if (network->connection->isChannel(event.target)) {
+                buffer = bufferFor(network, event.target, false);
+            } else if (channels.sameName(event.targetId, network->nickId)) {
+                buffer = bufferFor(network, event.sender, true);
+            }
+            if (buffer) {
+                addLine(buffer, event.sender, event.text);
+            } else {
+                addLine(network->serverBuffer, event.sender, QString("[%1] %2").arg(event.target, event.text));
+            }
+            return true;
+        }
+        case IrcEvent::Notice:
+            addLine(network->serverBuffer, event.sender, QString("-notice- %1").arg(event.text));
+            return true;
+        case IrcEvent::ServerMessage:
+            addLine(network->serverBuffer, QString(), event.text, true);
+            return true;
+        case IrcEvent::Ctcp:
+            // Answered once here rather than by every window, or by none
+            if (event.argument == "VERSION") {
+                network->connection->sendCtcpReply(event.sender, QString("VERSION %1 %2")
+                                                   .arg(QCoreApplication::applicationName(),
+                                                        QCoreApplication::applicationVersion()));
+                return false;
+            }
+            if (event.argument == "PING") {
+                network->connection->sendCtcpReply(event.sender, "PING " + event.text);
+                return false;
+            }
+            return true;
+        case IrcEvent::Join:
+            if (self) {
+                bufferFor(network, event.target, true);
+                network->joined.insert(channels.foldCase(event.target));
+            }
+            return true;
+        case IrcEvent::Part:
+            if (self) {
+                // Left on purpose, so its lines go too
+                const QString key = channels.foldCase(event.target);
+                network->joined.remove(key);
+                network->keys.remove(key);
+                removeBuffer(network, bufferFor(network, event.target, false));
+            }
+            return true;
+        case IrcEvent::Kick: {
+            const IrcStringPool::Id kicked = strings.intern(event.argument);
+            if (channels.sameName(kicked, network->nickId)) {
+                network->joined.remove(channels.foldCase(event.target));
+            }
+            return true;
+        }
+        case IrcEvent::NickChange:
+            if (self) {
+                network->nickId = event.targetId;
+                network->nickname = event.target;
+            }
+            return true;
+        case IrcEvent::Topic:
+            if (quint32 buffer = bufferFor(network, event.target, false)) {
+                m_buffers[buffer].topic = event.text;
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+void IrcCoreServer::sendLine(Network *network, const QString &line, QLocalSocket *from)
+{
+    network->connection->sendRawMessage(line);
+
+    const IrcMessage message(line.toUtf8());
+    if (message.isCommand("JOIN") && message.paramCount() >= 2) {
+        // "JOIN #a,#b keyA,keyB": kept for the rejoin burst
+        const QStringList names = message.param(0).split(',');
+        const QStringList keys = message.param(1).split(',');
+        for (int i = 0; i < names.size(); ++i) {
+            if (!keys.value(i).isEmpty()) {
+                network->keys.insert(network->connection->channels().foldCase(names.at(i)), keys.at(i));
+            }
+        }
+    } else if (message.isCommand("PRIVMSG") && message.paramCount() >= 2
+               && !message.param(1).startsWith('\001')) {
+        // Servers do not echo our own messages, so the core keeps them
+        const QString target = message.param(0);
+        const QString text = message.param(1);
+        const bool channel = network->connection->isChannel(target);
+        if (quint32 buffer = bufferFor(network, target, !channel)) {
+            addLine(buffer, network->nickname, text);
+        }
+
+        // The other windows show it in the channel, as the sender's window
+        // does; a query would land in their server buffer, so it is left out
+        if (channel) {
+            IrcEvent event(IrcEvent::Message, network->nickname, target, text);
+            event.senderId = network->nickId;
+            event.targetId = network->connection->strings().intern(target);
+            broadcastEvents(network, IrcEventBatch{ event }, from);
+        }
+    }
+}
+
+quint32 IrcCoreServer::bufferFor(Network *network, const QString &name, bool create)
+{
+    const QString key = network->connection->channels().foldCase(name);
+    quint32 buffer = network->buffersByName.value(key, 0);
+    if (buffer || !create || name.isEmpty()) {
+        return buffer;
+    }
+
+    buffer = m_nextBufferId++;
+    Buffer created;
+    created.name = name;
+    m_buffers.insert(buffer, created);
+    network->buffers.append(buffer);
+    network->buffersByName.insert(key, buffer);
+    return buffer;
+}
+
+void IrcCoreServer::removeBuffer(Network *network, quint32 buffer)
+{
+    auto it = m_buffers.find(buffer);
+    if (it == m_buffers.end()) {
+        return;
+    }
+
+    // Its entries in m_lineOrder are skipped when they come up
+    m_lineBytes -= it->bytes;
+    network->buffersByName.remove(network->connection->channels().foldCase(it->name));
+    network->buffers.removeOne(buffer);
+    m_buffers.erase(it);
+}
+
+void IrcCoreServer::addLine(quint32 buffer, const QString &sender, const QString &text, bool system)
+{
+    auto it = m_buffers.find(buffer);
+    if (it == m_buffers.end()) {
+        return;
+    }
+
+    IrcCoreProtocol::Line line;
+    line.timestamp = QDateTime::currentMSecsSinceEpoch();
+    line.system = system;
+    line.sender = sender;
+    line.text = text;
+    const qint64 cost = lineCost(line);
+    it->lines.push_back(line);
+    it->bytes += cost;
+    m_lineBytes += cost;
+    m_lineOrder.push_back(buffer);
+
+    // Oldest first across all networks, until back under the budget. Each
+    // buffer's entries in m_lineOrder are in the order of its lines, so the
+    // front entry always names a buffer whose first line is the oldest.
+    // The interned names cannot go, so the lines make room for them, but
+    // never below MinLineShare of the budget; past that the pools are renewed
+    // as their connections reconnect.
+    const qint64 interned = internedBytes();
+    const qint64 floor = m_historyBudget / MinLineShare;
+    if (m_historyBudget - interned < floor) {
+        if (!m_internedOverrun) {
+            m_internedOverrun = true;
+            qCWarning(lcIrcSession) << "Interned names take" << interned / 1024 << "KiB of the"
+                                    << m_historyBudget / 1024 << "KiB history budget;"
+                                    << "renewing string pools on reconnect";
+            for (Network *network : qAsConst(m_networks)) {
+                network->connection->scheduleStringRenewal();
+            }
+        }
+    } else {
+        m_internedOverrun = false;
+    }
+    const qint64 budget = qMax(m_historyBudget - interned, floor);
+    while (historyBytes() > budget && !m_lineOrder.empty()) {
+        const quint32 oldest = m_lineOrder.front();
+        m_lineOrder.pop_front();
+        auto victim = m_buffers.find(oldest);
+        if (victim == m_buffers.end() || victim->lines.empty()) {
+            continue;
+        }
+        const qint64 freed = lineCost(victim->lines.front());
+        victim->lines.pop_front();
+        victim->bytes -= freed;
+        m_lineBytes -= freed;
+    }
+}
+
+qint64 IrcCoreServer::lineCost(const IrcCoreProtocol::Line &line)
+{
+    return qint64(sizeof(IrcCoreProtocol::Line)) + 2 * StringOverhead
+        + qint64(line.sender.size() + line.text.size()) * qint64(sizeof(QChar));
+}
+
+QVector<quint32> IrcCoreServer::buffersOf(const Network *network) const
+{
+    QVector<quint32> buffers;
+    buffers.reserve(network->buffers.size() + 1);
+    buffers.append(network->serverBuffer);
+    buffers += network->buffers;
+    return buffers;
+}
+
+IrcCoreProtocol::Network IrcCoreServer::describe(const Network *network) const
+{
+    IrcCoreProtocol::Network described;
+    described.id = network->id;
+    described.addresses = network->addresses;
+    described.nickname = network->nickname;
+    described.connected = network->connection->isConnected();
+    if (described.connected) {
+        described.localAddress = network->connection->localAddress().toString();
+    }
+    described.isupport = network->connection->isupportTokens();
+
+    const QVector<quint32> buffers = buffersOf(network);
+    described.buffers.reserve(buffers.size());
+    for (quint32 id : qAsConst(buffers)) {
+        const Buffer buffer = m_buffers.value(id);
+        IrcCoreProtocol::Buffer out;
+        out.name = buffer.name;
+        out.topic = buffer.topic;
+        if (id != network->serverBuffer && network->connection->isChannel(buffer.name)) {
+            IrcConnection *connection = network->connection;
+            out.members = connection->channels().members(connection->strings().intern(buffer.name));
+        }
+        described.buffers.append(out);
+    }
+    return described;
+}
+
+void IrcCoreServer::onNewConnection()
+{
+    while (QLocalSocket *client = m_server->nextPendingConnection()) {
+        m_input.insert(client, QByteArray());
+        connect(client, &QLocalSocket::readyRead, this, [this, client]() {
+            onClientReadyRead(client);
+        });
+        connect(client, &QLocalSocket::disconnected, this, [this, client]() {
+            m_input.remove(client);
+            m_clients.removeAll(client);
+            m_snapshotBytes.remove(client);
+            client->deleteLater();
+        });
+    }
+}
+
+void IrcCoreServer::onClientReadyRead(QLocalSocket *client)
+{
+    // Taken out while frames are handled: handling one may drop a window,
+    // this one included
+    QByteArray input = m_input.take(client) + client->readAll();
+    const bool ok = IrcCoreProtocol::readFrames(input, [this, client](IrcCoreProtocol::FrameType type,
+                                                                      IrcCoreProtocol::Reader &in) {
+        return handleFrame(client, type, in);
+    });
+    if (client->state() != QLocalSocket::ConnectedState) {
+        return;
+    }
+    if (!ok) {
+        qCWarning(lcIrcSession) << "Malformed frame from a window; dropping it";
+        client->abort();
+        return;
+    }
+    m_input.insert(client, input);
+}
+
+bool IrcCoreServer::handleFrame(QLocalSocket *client, IrcCoreProtocol::FrameType type, IrcCoreProtocol::Reader &in)
+{
+    if (type != IrcCoreProtocol::Hello && !m_clients.contains(client)) {
+        return false;
+    }
+
+    switch (type) {
+        case IrcCoreProtocol::Hello: {
+            const quint32 version = in.integer<quint32>();
+            if (version != IrcCoreProtocol::Version) {
+                qCWarning(lcIrcSession) << "A window speaks protocol version" << version
+                                        << "instead of" << IrcCoreProtocol::Version;
+                return false;
+            }
+            if (!m_clients.contains(client)) {
+                m_clients.append(client);
+            }
+            sendSnapshot(client);
+            return true;
+        }
+        case IrcCoreProtocol::AddNetwork: {
+            const QList<IrcServerAddress> addresses = in.addresses();
+            const QString nickname = in.string();
+            if (!in.ok() || addresses.isEmpty() || nickname.isEmpty()) {
+                return false;
+            }
+            Network *network = addNetwork(addresses, nickname);
+            IrcCoreProtocol::Writer frame(IrcCoreProtocol::NetworkAdded);
+            frame.network(describe(network));
+            broadcast(frame);
+            connectNetwork(network);
+            return true;
+        }
+        case IrcCoreProtocol::RemoveNetwork:
+            if (Network *network = this->network(in.integer<quint32>())) {
+                const quint32 id = network->id;
+                removeNetwork(network);
+                IrcCoreProtocol::Writer frame(IrcCoreProtocol::NetworkRemoved);
+                frame.integer<quint32>(id);
+                broadcast(frame);
+            }
+            return true;
+        case IrcCoreProtocol::Connect:
+            if (Network *network = this->network(in.integer<quint32>())) {
+                if (!network->connection->isConnected()) {
+                    connectNetwork(network);
+                }
+            }
+            return true;
+        case IrcCoreProtocol::Disconnect:
+            if (Network *network = this->network(in.integer<quint32>())) {
+                disconnectNetwork(network);
+            }
+            return true;
+        case IrcCoreProtocol::SendLine: {
+            Network *network = this->network(in.integer<quint32>());
+            const QString line = in.string();
+            if (network && in.ok()) {
+                sendLine(network, line, client);
+            }
+            return true;
+        }
+        case IrcCoreProtocol::SetEncoding: {
+            Network *network = this->network(in.integer<quint32>());
+            const quint8 legacy = in.integer<quint8>();
+            if (legacy > IrcTextCodec::Utf8Replace) {
+                return false;
+            }
+            if (network) {
+                network->connection->setLegacyEncoding(IrcTextCodec::Legacy(legacy));
+            }
+            return true;
+        }
+        case IrcCoreProtocol::SetFilterRules: {
+            Network *network = this->network(in.integer<quint32>());
+            IrcFilterRules rules;
+            rules.highlightWords = in.strings();
+            rules.ignoreMasks = in.strings();
+            if (network && in.ok()) {
+                m_filterRules = rules;
+                network->connection->setFilterRules(rules);
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+void IrcCoreServer::sendSnapshot(QLocalSocket *client)
+{
+    // All of it is queued at once; sendTo() lets it past MaxPendingBytes
+    // until the window has read it
+    qint64 written = 0;
+    for (const Network *network : qAsConst(m_networks)) {
+        IrcCoreProtocol::Writer header(IrcCoreProtocol::Snapshot);
+        header.network(describe(network));
+        written += client->write(header.frame());
+
+        const QVector<quint32> buffers = buffersOf(network);
+        for (int index = 0; index < buffers.size(); ++index) {
+            const auto buffer = m_buffers.constFind(buffers.at(index));
+            if (buffer == m_buffers.constEnd()) {
+                continue;
+            }
+            auto line = buffer->lines.cbegin();
+            while (line != buffer->lines.cend()) {
+                QVector<IrcCoreProtocol::Line> chunk;
+                qint64 bytes = 0;
+                for (; line != buffer->lines.cend() && bytes < SnapshotChunkBytes; ++line) {
+                    chunk.append(*line);
+                    bytes += WireLineOverhead + MaxUtf8PerUnit * (line->sender.size() + line->text.size());
+                }
+                IrcCoreProtocol::Writer frame(IrcCoreProtocol::SnapshotLines);
+                frame.integer<quint32>(network->id);
+                frame.integer<quint32>(quint32(index));
+                frame.lines(chunk);
+                written += client->write(frame.frame());
+            }
+        }
+    }
+    IrcCoreProtocol::Writer end(IrcCoreProtocol::SnapshotEnd);
+    written += client->write(end.frame());
+    m_snapshotBytes.insert(client, written);
+}
+
+void IrcCoreServer::sendTo(QLocalSocket *client, const QByteArray &frame)
+{
+    // A window that stopped reading would otherwise grow without bound
+    const qint64 snapshot = m_snapshotBytes.value(client);
+    if (client->bytesToWrite() > MaxPendingBytes + snapshot) {
+        qCWarning(lcIrcSession) << "Dropping a window that stopped reading";
+        m_clients.removeAll(client);
+        m_snapshotBytes.remove(client);
+        client->abort();
+        return;
+    }
+    if (snapshot > 0 && client->bytesToWrite() <= MaxPendingBytes) {
+        m_snapshotBytes.remove(client);
+    }
+    client->write(frame);
+}
+
+void IrcCoreServer::broadcast(IrcCoreProtocol::Writer &frame, QLocalSocket *except)
+{
+    const QByteArray &data = frame.frame();
+    // A copy: sendTo() may drop a window
+    const QList<QLocalSocket*> clients = m_clients;
+    for (QLocalSocket *client : clients) {
+        if (client != except) {
+            sendTo(client, data);
+        }
+    }
+}
+
+void IrcCoreServer::broadcastEvents(Network *network, const IrcEventBatch &events, QLocalSocket *except)
+{
+    if (events.isEmpty() || m_clients.isEmpty()) {
+        return;
+    }
+
+    IrcCoreProtocol::Writer frame(IrcCoreProtocol::Events);
+    frame.integer<quint32>(network->id);
+    frame.integer<quint32>(quint32(events.size()));
+    for (const IrcEvent &event : events) {
+        frame.event(event, network->connection->strings());
+    }
+    broadcast(frame, except);
+}
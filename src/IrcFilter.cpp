@@ -0,0 +1,424 @@
+#include "IrcFilter.h"
+#include "IrcLog.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+
+namespace {
+
+inline char foldCase(char c)
+{
+    return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+// Letters, digits and '_'; bytes of multi-byte UTF-8 sequences count too,
+// so "café" is not found inside "cafés"
+inline bool isWordByte(char c)
+{
+    const uchar u = uchar(c);
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9')
+           || u == '_' || u >= 0x80;
+}
+
+QByteArray folded(const QString &text)
+{
+    QByteArray bytes = text.trimmed().toUtf8();
+    for (char &c : bytes) {
+        c = foldCase(c);
+    }
+    return bytes;
+}
+
+// Byte -> column: every byte that occurs in a pattern gets a column of its
+// own, upper-case letters share their lower-case one's, and all other
+// bytes share column 0. Wildcards take no column.
+int buildClasses(const QList<QByteArray> &patterns, bool wildcards, QVector<quint16> *classes)
+{
+    classes->fill(0, 256);
+    int columns = 1;
+    for (const QByteArray &pattern : patterns) {
+        for (char c : pattern) {
+            const uchar u = uchar(c);
+            if ((wildcards && (c == '*' || c == '?')) || (*classes)[u] != 0) {
+                continue;
+            }
+            (*classes)[u] = quint16(columns);
+            if (u >= 'a' && u <= 'z') {
+                (*classes)[u - 'a' + 'A'] = quint16(columns);
+            }
+            ++columns;
+        }
+    }
+    return columns;
+}
+
+// Plain backtracking glob, for the masks left out of the ignore DFA; mask
+// is already folded
+bool globMatches(const QByteArray &mask, const char *data, int length)
+{
+    int m = 0;
+    int d = 0;
+    int starMask = -1;
+    int starData = 0;
+    while (d < length) {
+        if (m < mask.size() && (mask.at(m) == '?' || mask.at(m) == foldCase(data[d]))) {
+            ++m;
+            ++d;
+        } else if (m < mask.size() && mask.at(m) == '*') {
+            starMask = m++;
+            starData = d;
+        } else if (starMask >= 0) {
+            m = starMask + 1;
+            d = ++starData;
+        } else {
+            return false;
+        }
+    }
+    while (m < mask.size() && mask.at(m) == '*') {
+        ++m;
+    }
+    return m == mask.size();
+}
+
+} // namespace
+
+IrcFilterRules IrcFilterRules::load()
+{
+    IrcFilterRules rules;
+    QFile file(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/filters");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return rules;
+    }
+
+    // "highlight <word or phrase>" and "ignore <mask>", one per line
+    while (!file.atEnd()) {
+        const QString line = QString::fromUtf8(file.readLine()).trimmed();
+        const int space = line.indexOf(' ');
+        const QString kind = line.left(space);
+        const QString value = line.mid(space + 1).trimmed();
+        if (space < 0 || value.isEmpty()) {
+            continue;
+        }
+        if (kind == "highlight") {
+            rules.highlightWords.append(value);
+        } else if (kind == "ignore") {
+            rules.ignoreMasks.append(normalizeMask(value));
+        }
+    }
+    return rules;
+}
+
+bool IrcFilterRules::save() const
+{
+    const QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/filters";
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcIrcSession) << "Cannot write" << path << ":" << file.errorString();
+        return false;
+    }
+    for (const QString &word : highlightWords) {
+        file.write("highlight " + word.toUtf8() + '\n');
+    }
+    for (const QString &mask : ignoreMasks) {
+        file.write("ignore " + mask.toUtf8() + '\n');
+    }
+    return file.commit();
+}
+
+QString IrcFilterRules::normalizeMask(const QString &mask)
+{
+    const QString trimmed = mask.trimmed();
+    const bool hasUser = trimmed.contains('!');
+    const bool hasHost = trimmed.contains('@');
+    if (trimmed.isEmpty() || (hasUser && hasHost)) {
+        return trimmed;
+    }
+    if (hasHost) {
+        return "*!" + trimmed;
+    }
+    if (hasUser) {
+        return trimmed + "@*";
+    }
+    return trimmed + "!*@*";
+}
+
+IrcFilter::IrcFilter(const QStringList &highlightWords, const QStringList &ignoreMasks)
+{
+    QList<QByteArray> words;
+    for (const QString &word : highlightWords) {
+        const QByteArray bytes = folded(word);
+        if (!bytes.isEmpty() && !words.contains(bytes)) {
+            words.append(bytes);
+        }
+    }
+    if (!words.isEmpty()) {
+        compileHighlights(words);
+    }
+
+    QList<QByteArray> masks;
+    for (const QString &mask : ignoreMasks) {
+        // Runs of '*' match what one does
+        QByteArray bytes = folded(IrcFilterRules::normalizeMask(mask));
+        while (bytes.contains("**")) {
+            bytes.replace("**", "*");
+        }
+        if (!bytes.isEmpty() && !masks.contains(bytes)) {
+            masks.append(bytes);
+        }
+    }
+
+    // Masks with fewer wildcards go into the DFA first; if it grows too
+    // big, the rest are matched one by one
+    std::stable_sort(masks.begin(), masks.end(), [](const QByteArray &a, const QByteArray &b) {
+        return a.count('*') < b.count('*');
+    });
+    while (!masks.isEmpty() && !compileIgnores(masks)) {
+        const int keep = masks.size() / 2;
+        while (masks.size() > keep) {
+            m_slowMasks.prepend(masks.takeLast());
+        }
+    }
+    if (!m_slowMasks.isEmpty()) {
+        qCWarning(lcIrcSession) << m_slowMasks.size() << "ignore masks are too complex to combine,"
+                                << "matching them one by one";
+    }
+}
+
+void IrcFilter::compileHighlights(const QList<QByteArray> &words)
+{
+    m_highlightColumns = buildClasses(words, false, &m_highlightClasses);
+    const int columns = m_highlightColumns;
+
+    // The trie, with -1 for missing edges
+    QVector<qint32> next(columns, -1);
+    QVector<QVector<qint32>> ends(1);
+    for (int w = 0; w < words.size(); ++w) {
+        const QByteArray &word = words.at(w);
+        int state = 0;
+        for (char c : word) {
+            const int column = m_highlightClasses.at(uchar(c));
+            if (next.at(state * columns + column) < 0) {
+                next[state * columns + column] = ends.size();
+                next.resize(next.size() + columns);
+                std::fill(next.end() - columns, next.end(), -1);
+                ends.append(QVector<qint32>());
+            }
+            state = next.at(state * columns + column);
+        }
+        ends[state].append(w);
+
+        Word info;
+        info.length = word.size();
+        info.boundaryBefore = isWordByte(word.at(0));
+        info.boundaryAfter = isWordByte(word.at(word.size() - 1));
+        m_words.append(info);
+    }
+
+    // Breadth first, so a state's failure link is always done before it:
+    // missing edges take the failure state's, and a state outputs its
+    // failure state's words as well as its own
+    const int stateCount = ends.size();
+    QVector<qint32> fail(stateCount, 0);
+    QVector<qint32> queue;
+    queue.reserve(stateCount);
+    for (int column = 0; column < columns; ++column) {
+        qint32 &edge = next[column];
+        if (edge < 0) {
+            edge = 0;
+        } else {
+            queue.append(edge);
+        }
+    }
+    for (int head = 0; head < queue.size(); ++head) {
+        const int state = queue.at(head);
+        ends[state] += ends.at(fail.at(state));
+        for (int column = 0; column < columns; ++column) {
+            qint32 &edge = next[state * columns + column];
+            const qint32 fallback = next.at(fail.at(state) * columns + column);
+            if (edge < 0) {
+                edge = fallback;
+            } else {
+                fail[edge] = fallback;
+                queue.append(edge);
+            }
+        }
+    }
+    m_highlightNext = next;
+
+    m_outputStart.reserve(stateCount + 1);
+    for (int state = 0; state < stateCount; ++state) {
+        m_outputStart.append(m_outputWords.size());
+        m_outputWords += ends.at(state);
+    }
+    m_outputStart.append(m_outputWords.size());
+}
+
+bool IrcFilter::compileIgnores(const QList<QByteArray> &masks)
+{
+    QVector<quint16> classes;
+    const int columns = buildClasses(masks, true, &classes);
+
+    // NFA position p of mask k is state first[k] + p; position size() accepts
+    QVector<int> first;
+    int positions = 0;
+    for (const QByteArray &mask : masks) {
+        first.append(positions);
+        positions += mask.size() + 1;
+    }
+    QVector<int> maskOf(positions);
+    QVector<bool> absorbing(positions, false);  // only '*' left: matches whatever follows
+    for (int k = 0; k < masks.size(); ++k) {
+        const QByteArray &mask = masks.at(k);
+        std::fill(maskOf.begin() + first.at(k), maskOf.begin() + first.at(k) + mask.size() + 1, k);
+        if (mask.endsWith('*')) {
+            absorbing[first.at(k) + mask.size() - 1] = true;
+        }
+    }
+
+    // A position before a '*' also stands after it, as the star may match
+    // nothing. Once a mask is down to its trailing '*' the name is ignored
+    // whatever else matches, so all such sets collapse into one per mask.
+    auto close = [&](QVector<int> *set) {
+        for (int i = 0; i < set->size(); ++i) {
+            const int position = set->at(i);
+            const int k = maskOf.at(position);
+            const int p = position - first.at(k);
+            if (p < masks.at(k).size() && masks.at(k).at(p) == '*') {
+                set->append(position + 1);
+            }
+        }
+        std::sort(set->begin(), set->end());
+        set->erase(std::unique(set->begin(), set->end()), set->end());
+        const auto found = std::find_if(set->cbegin(), set->cend(), [&](int position) {
+            return absorbing.at(position);
+        });
+        if (found != set->cend()) {
+            const int position = *found;
+            *set = { position, position + 1 };
+        }
+    };
+
+    QVector<QVector<int>> sets;
+    QHash<QVector<int>, int> stateOf;
+    QVector<int> start = first;
+    close(&start);
+    sets.append(start);
+    sets.append(QVector<int>());
+    stateOf.insert(start, 0);
+    stateOf.insert(QVector<int>(), 1);
+
+    // One representative byte per column; column 0 matches only '?' and '*'
+    QVector<int> representative(columns, -1);
+    for (int byte = 255; byte >= 0; --byte) {
+        representative[classes.at(byte)] = byte;
+    }
+
+    QVector<qint32> next;
+    QVector<bool> accepts;
+    for (int state = 0; state < sets.size(); ++state) {
+        const QVector<int> set = sets.at(state);
+        next.resize(next.size() + columns);
+        bool accepting = false;
+        for (int position : set) {
+            const int k = maskOf.at(position);
+            accepting |= position - first.at(k) == masks.at(k).size();
+        }
+        accepts.append(accepting);
+
+        for (int column = 0; column < columns; ++column) {
+            const char byte = foldCase(char(representative.at(column)));
+            QVector<int> target;
+            for (int position : set) {
+                const int k = maskOf.at(position);
+                const int p = position - first.at(k);
+                if (p == masks.at(k).size()) {
+                    continue;
+                }
+                const char c = masks.at(k).at(p);
+                if (c == '*') {
+                    target.append(position);
+                } else if (c == '?' || (column != 0 && c == byte)) {
+                    target.append(position + 1);
+                }
+            }
+            close(&target);
+
+            int targetState = stateOf.value(target, -1);
+            if (targetState < 0) {
+                if (sets.size() >= MaxIgnoreStates) {
+                    return false;
+                }
+                targetState = sets.size();
+                sets.append(target);
+                stateOf.insert(target, targetState);
+            }
+            next[state * columns + column] = targetState;
+        }
+    }
+
+    m_ignoreClasses = classes;
+    m_ignoreColumns = columns;
+    m_ignoreNext = next;
+    m_ignoreAccepts = accepts;
+    return true;
+}
+
+bool IrcFilter::hasBoundaries(const char *data, int length, int end, const Word &word) const
+{
+    const int begin = end - word.length;
+    if (word.boundaryBefore && begin > 0 && isWordByte(data[begin - 1])) {
+        return false;
+    }
+    if (word.boundaryAfter && end < length && isWordByte(data[end])) {
+        return false;
+    }
+    return true;
+}
+
+bool IrcFilter::highlights(const char *data, int length) const
+{
+    if (m_highlightColumns == 0) {
+        return false;
+    }
+
+    const quint16 *classes = m_highlightClasses.constData();
+    const qint32 *next = m_highlightNext.constData();
+    const qint32 *outputStart = m_outputStart.constData();
+    int state = 0;
+    for (int i = 0; i < length; ++i) {
+        state = next[state * m_highlightColumns + classes[uchar(data[i])]];
+        for (int o = outputStart[state]; o < outputStart[state + 1]; ++o) {
+            if (hasBoundaries(data, length, i + 1, m_words.at(m_outputWords.at(o)))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool IrcFilter::ignores(const char *data, int length) const
+{
+    if (m_ignoreColumns > 0) {
+        const quint16 *classes = m_ignoreClasses.constData();
+        const qint32 *next = m_ignoreNext.constData();
+        int state = 0;
+        for (int i = 0; i < length && state != 1; ++i) {
+            state = next[state * m_ignoreColumns + classes[uchar(data[i])]];
+        }
+        if (m_ignoreAccepts.at(state)) {
+            return true;
+        }
+    }
+    for (const QByteArray &mask : m_slowMasks) {
+        if (globMatches(mask, data, length)) {
+            return true;
+        }
+    }
+    return false;
+}
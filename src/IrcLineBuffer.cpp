@@ -0,0 +1,100 @@
+#include "IrcLineBuffer.h"
+#include <QIODevice>
+#include <cstring>
+
+IrcLineBuffer::IrcLineBuffer(int capacity)
+    : m_buffer(capacity, '\0')
+    , m_readPos(0)
+    , m_scanPos(0)
+    , m_writePos(0)
+    , m_discarding(false)
+{
+}
+
+void IrcLineBuffer::clear()
+{
+    m_readPos = 0;
+    m_scanPos = 0;
+    m_writePos = 0;
+    m_discarding = false;
+}
+
+char *IrcLineBuffer::reserve(int minimum)
+{
+    // Move the unconsumed partial line back to the front before growing
+    if (m_readPos > 0) {
+        const int pending = m_writePos - m_readPos;
+        if (pending > 0) {
+            memmove(m_buffer.data(), m_buffer.constData() + m_readPos, size_t(pending));
+        }
+        m_scanPos -= m_readPos;
+        m_writePos = pending;
+        m_readPos = 0;
+    }
+
+    if (m_buffer.size() - m_writePos < minimum) {
+        m_buffer.resize(m_writePos + minimum);
+    }
+    return m_buffer.data() + m_writePos;
+}
+
+qint64 IrcLineBuffer::fill(QIODevice *device)
+{
+    qint64 total = 0;
+    for (;;) {
+        const qint64 available = device->bytesAvailable();
+        if (available <= 0) {
+            break;
+        }
+        const int chunk = int(qMin<qint64>(available, 1024 * 1024));
+        char *space = reserve(chunk);
+        const qint64 read = device->read(space, int(m_buffer.size()) - m_writePos);
+        if (read <= 0) {
+            break;
+        }
+        m_writePos += int(read);
+        total += read;
+    }
+    return total;
+}
+
+void IrcLineBuffer::append(const char *data, int length)
+{
+    memcpy(reserve(length), data, size_t(length));
+    m_writePos += length;
+}
+
+bool IrcLineBuffer::nextLine(const char **data, int *length)
+{
+    for (;;) {
+        const char *base = m_buffer.constData();
+        const void *newline = memchr(base + m_scanPos, '\n', size_t(m_writePos - m_scanPos));
+        if (!newline) {
+            m_scanPos = m_writePos;
+
+            // Drop a runaway line rather than buffering it forever
+            if (pendingBytes() > MaxLineLength) {
+                m_readPos = m_writePos;
+                m_discarding = true;
+            }
+            return false;
+        }
+
+        const int start = m_readPos;
+        int end = int(static_cast<const char *>(newline) - base);
+        m_readPos = m_scanPos = end + 1;
+        if (end > start && base[end - 1] == '\r') {
+            --end;
+        }
+        if (m_discarding) {
+            m_discarding = false;
+            continue;
+        }
+        if (end > start) {
+            *data = base + start;
+            *length = end - start;
+            return true;
+        }
+        // Skip empty lines
+    }
+}
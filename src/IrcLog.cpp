@@ -0,0 +1,220 @@
+#include "IrcLog.h"
+#include <QDateTime>
+#include <QFile>
+#include <QSemaphore>
+#include <QThread>
+#include <cstdio>
+#include "IrcStats.h"
+#include "MpscQueue.h"
+
+Q_LOGGING_CATEGORY(lcIrcSession, "irc.session", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcIrcTraffic, "irc.traffic", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcDcc, "irc.dcc", QtInfoMsg)
+
+std::atomic<bool> IrcLog::s_capturing(false);
+
+namespace {
+
+struct LogRecord
+{
+    enum Kind : quint8 { Text, Traffic };
+
+    Kind kind = Text;
+    bool print = false;    // traffic: also goes to the text log
+    bool capture = false;  // traffic: also goes to the capture file
+    IrcCapture::Direction direction = IrcCapture::Inbound;
+    qint64 timeUs = 0;
+    QByteArray data;       // formatted message, or the raw line
+};
+
+const int RingCapacity = 64 * 1024;
+
+MpscQueue<LogRecord> &ring()
+{
+    static MpscQueue<LogRecord> queue(RingCapacity);
+    return queue;
+}
+
+std::atomic<bool> s_running(false);
+std::atomic<bool> s_idle(false);
+QSemaphore s_wake;
+quint64 s_startNs = 0;
+QtMessageHandler s_previousHandler = nullptr;
+
+class LogWriter : public QThread
+{
+public:
+    bool openLog(const QString &path)
+    {
+        if (path.isEmpty()) {
+            return m_log.open(stderr, QIODevice::WriteOnly | QIODevice::Unbuffered);
+        }
+        m_log.setFileName(path);
+        return m_log.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+    bool openCapture(const QString &path)
+    {
+        return m_capture.open(path, QDateTime::currentMSecsSinceEpoch());
+    }
+    QString errorString() const { return m_log.errorString(); }
+    QString captureErrorString() const { return m_capture.errorString(); }
+
+    void stop()
+    {
+        m_stopping.store(true, std::memory_order_release);
+        s_wake.release();
+        wait();
+    }
+
+protected:
+    void run() override
+    {
+        LogRecord record;
+        for (;;) {
+            bool wrote = false;
+            while (ring().pop(record)) {
+                write(record);
+                wrote = true;
+            }
+            if (wrote) {
+                m_log.flush();
+                continue;
+            }
+            if (m_stopping.load(std::memory_order_acquire)) {
+                break;
+            }
+
+            // Producers wake us only while this is set; look once more in
+            // case one pushed just before seeing it
+            s_idle.store(true);
+            if (ring().pop(record)) {
+                s_idle.store(false);
+                write(record);
+                continue;
+            }
+            s_wake.tryAcquire(1, 100);
+            s_idle.store(false);
+        }
+        m_log.flush();
+        m_capture.close();
+    }
+
+private:
+    void write(const LogRecord &record)
+    {
+        if (record.kind == LogRecord::Text) {
+            m_log.write(record.data);
+            return;
+        }
+        if (record.capture) {
+            m_capture.write(record.direction, record.timeUs, record.data.constData(), int(record.data.size()));
+        }
+        if (record.print) {
+            // Formatted here rather than on the I/O thread
+            const QMessageLogContext context(nullptr, 0, nullptr, lcIrcTraffic().categoryName());
+            const QString text = (record.direction == IrcCapture::Inbound ? "<< " : ">> ")
+                               + QString::fromUtf8(record.data);
+            m_log.write(qFormatLogMessage(QtDebugMsg, context, text).toLocal8Bit() + '\n');
+        }
+    }
+
+    QFile m_log;
+    IrcCaptureWriter m_capture;
+    std::atomic<bool> m_stopping { false };
+};
+
+LogWriter *s_writer = nullptr;
+
+void push(LogRecord &&record)
+{
+    if (!ring().push(std::move(record))) {
+        IrcStats::add(IrcStats::LogRecordsDropped);
+        return;
+    }
+    if (s_idle.load(std::memory_order_relaxed) && s_idle.exchange(false)) {
+        s_wake.release();
+    }
+}
+
+void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    QByteArray text = qFormatLogMessage(type, context, message).toLocal8Bit();
+    text += '\n';
+
+    // Qt aborts as soon as we return from a fatal message
+    if (type == QtFatalMsg || !s_running.load(std::memory_order_acquire)) {
+        fwrite(text.constData(), 1, size_t(text.size()), stderr);
+        fflush(stderr);
+        return;
+    }
+
+    LogRecord record;
+    record.data = text;
+    push(std::move(record));
+}
+
+} // namespace
+
+bool IrcLog::start(const QString &logFile, const QString &captureFile)
+{
+    if (s_writer) {
+        return true;
+    }
+
+    LogWriter *writer = new LogWriter;
+    if (!writer->openLog(logFile)) {
+        qCWarning(lcIrcSession) << "Cannot open log file" << logFile << ":" << writer->errorString();
+        delete writer;
+        return false;
+    }
+    if (!captureFile.isEmpty() && !writer->openCapture(captureFile)) {
+        qCWarning(lcIrcSession) << "Cannot open capture file" << captureFile << ":" << writer->captureErrorString();
+        delete writer;
+        return false;
+    }
+
+    s_startNs = IrcStats::nowNs();
+    s_writer = writer;
+    s_writer->setObjectName("IrcLog");
+    s_writer->start();
+    s_capturing.store(!captureFile.isEmpty(), std::memory_order_relaxed);
+    s_running.store(true, std::memory_order_release);
+    s_previousHandler = qInstallMessageHandler(messageHandler);
+    return true;
+}
+
+void IrcLog::stop()
+{
+    if (!s_writer) {
+        return;
+    }
+
+    qInstallMessageHandler(s_previousHandler);
+    s_running.store(false, std::memory_order_release);
+    s_capturing.store(false, std::memory_order_relaxed);
+    s_writer->stop();
+    delete s_writer;
+    s_writer = nullptr;
+}
+
+void IrcLog::traffic(IrcCapture::Direction direction, const char *data, int length)
+{
+    const bool print = lcIrcTraffic().isDebugEnabled();
+    if (!s_running.load(std::memory_order_acquire)) {
+        // No writer thread, e.g. in the benchmarks: log in place
+        if (print) {
+            qCDebug(lcIrcTraffic).noquote() << (direction == IrcCapture::Inbound ? "<<" : ">>")
+                                            << QString::fromUtf8(data, length);
+        }
+        return;
+    }
+
+    LogRecord record;
+    record.kind = LogRecord::Traffic;
+    record.print = print;
+    record.capture = s_capturing.load(std::memory_order_relaxed);
+    record.direction = direction;
+    record.timeUs = qint64(IrcStats::nowNs() - s_startNs) / 1000;
+    record.data = QByteArray(data, length);
+    push(std::move(record));
+}
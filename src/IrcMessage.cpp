@@ -0,0 +1,325 @@
+#include "IrcMessage.h"
+#include "IrcStats.h"
+#include <cstring>
+
+IrcMessage::IrcMessage(const QByteArray &line)
+{
+    parse(line);
+}
+
+bool IrcMessage::parse(const QByteArray &line)
+{
+    m_line = line;
+    m_tags.clear();
+    m_params.clear();
+    m_prefix = Span();
+    m_command = Span();
+    m_numeric = -1;
+    m_hasTrailing = false;
+    m_encoding = IrcTextCodec::Unknown;
+
+    const char *data = m_line.constData();
+    int end = int(m_line.size());
+    while (end > 0 && (data[end - 1] == '\n' || data[end - 1] == '\r')) {
+        --end;
+    }
+
+    int pos = 0;
+    auto skipSpaces = [&]() {
+        while (pos < end && data[pos] == ' ') {
+            ++pos;
+        }
+    };
+    auto scanWord = [&]() {
+        const int start = pos;
+        while (pos < end && data[pos] != ' ') {
+            ++pos;
+        }
+        return Span{start, pos - start};
+    };
+
+    skipSpaces();
+
+    // IRCv3 message tags
+    if (pos < end && data[pos] == '@') {
+        ++pos;
+        const Span tags = scanWord();
+        parseTags(tags.offset, tags.offset + tags.length);
+        skipSpaces();
+    }
+
+    // Prefix
+    if (pos < end && data[pos] == ':') {
+        ++pos;
+        m_prefix = scanWord();
+        skipSpaces();
+    }
+
+    // Command
+    m_command = scanWord();
+    if (m_command.length == 0) {
+        return false;
+    }
+    if (m_command.length == 3) {
+        const char *c = data + m_command.offset;
+        if (c[0] >= '0' && c[0] <= '9' && c[1] >= '0' && c[1] <= '9' && c[2] >= '0' && c[2] <= '9') {
+            m_numeric = (c[0] - '0') * 100 + (c[1] - '0') * 10 + (c[2] - '0');
+        }
+    }
+
+    // Middle parameters and the optional trailing parameter. After 14
+    // middles the rest of the line is the trailing one, colon or not.
+    for (;;) {
+        skipSpaces();
+        if (pos >= end) {
+            break;
+        }
+        if (data[pos] == ':' || m_params.size() == MaxMiddleParams) {
+            const int start = data[pos] == ':' ? pos + 1 : pos;
+            m_params.append(Span{start, end - start});
+            m_hasTrailing = true;
+            break;
+        }
+        m_params.append(scanWord());
+    }
+
+    return true;
+}
+
+void IrcMessage::parseTags(int begin, int end)
+{
+    const char *data = m_line.constData();
+    int pos = begin;
+    while (pos < end) {
+        int tagEnd = pos;
+        while (tagEnd < end && data[tagEnd] != ';') {
+            ++tagEnd;
+        }
+
+        int equals = pos;
+        while (equals < tagEnd && data[equals] != '=') {
+            ++equals;
+        }
+
+        Tag tag;
+        tag.key = Span{pos, equals - pos};
+        if (equals < tagEnd) {
+            tag.value = Span{equals + 1, tagEnd - equals - 1};
+        }
+
+        // Malformed keys are dropped rather than invalidating the whole line
+        if (isValidTagKey(data + tag.key.offset, tag.key.length)) {
+            m_tags.append(tag);
+        }
+        pos = tagEnd + 1;
+    }
+}
+
+bool IrcMessage::isValidTagKey(const char *data, int length)
+{
+    int pos = 0;
+    if (pos < length && data[pos] == '+') {
+        ++pos;
+    }
+
+    // Optional vendor: a hostname terminated by '/'
+    int nameStart = pos;
+    for (int i = pos; i < length; ++i) {
+        if (data[i] == '/') {
+            if (i == pos) {
+                return false;
+            }
+            for (int j = pos; j < i; ++j) {
+                const char c = data[j];
+                const bool hostChar = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                                      || (c >= '0' && c <= '9') || c == '-' || c == '.';
+                if (!hostChar) {
+                    return false;
+                }
+            }
+            nameStart = i + 1;
+            break;
+        }
+    }
+
+    if (nameStart >= length) {
+        return false;
+    }
+    for (int i = nameStart; i < length; ++i) {
+        const char c = data[i];
+        const bool keyChar = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                             || (c >= '0' && c <= '9') || c == '-';
+        if (!keyChar) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QString IrcMessage::unescapeTagValue(const char *data, int length)
+{
+    // Fast path: nothing to unescape
+    if (!memchr(data, '\\', size_t(length))) {
+        return IrcTextCodec::decode(data, length, IrcTextCodec::Utf8Replace);
+    }
+
+    QByteArray value;
+    value.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        if (data[i] != '\\') {
+            value.append(data[i]);
+            continue;
+        }
+        if (++i >= length) {
+            break; // A lone trailing backslash is dropped
+        }
+        switch (data[i]) {
+            case ':':  value.append(';');  break;
+            case 's':  value.append(' ');  break;
+            case '\\': value.append('\\'); break;
+            case 'r':  value.append('\r'); break;
+            case 'n':  value.append('\n'); break;
+            default:   value.append(data[i]); break;
+        }
+    }
+    return QString::fromUtf8(value);
+}
+
+int IrcMessage::findTag(const char *key) const
+{
+    for (int i = int(m_tags.size()) - 1; i >= 0; --i) {
+        if (spanEquals(m_tags[i].key, key)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QString IrcMessage::tagKey(int index) const
+{
+    if (index < 0 || index >= m_tags.size()) {
+        return QString();
+    }
+    return decode(m_tags[index].key);
+}
+
+QString IrcMessage::tagValue(int index) const
+{
+    if (index < 0 || index >= m_tags.size()) {
+        return QString();
+    }
+    const Span value = m_tags[index].value;
+    return unescapeTagValue(m_line.constData() + value.offset, value.length);
+}
+
+QString IrcMessage::tag(const char *key) const
+{
+    return tagValue(findTag(key));
+}
+
+IrcMessage::Span IrcMessage::prefixPart(char startDelimiter, char endDelimiter) const
+{
+    const char *data = m_line.constData() + m_prefix.offset;
+    int start = 0;
+    if (startDelimiter) {
+        while (start < m_prefix.length && data[start] != startDelimiter) {
+            ++start;
+        }
+        if (start == m_prefix.length) {
+            return Span();
+        }
+        ++start;
+    }
+
+    int end = start;
+    while (end < m_prefix.length && data[end] != endDelimiter
+           && (startDelimiter || data[end] != '@')) {
+        ++end;
+    }
+    return Span{m_prefix.offset + start, end - start};
+}
+
+QString IrcMessage::nick() const
+{
+    return decode(prefixPart(0, '!'));
+}
+
+QString IrcMessage::user() const
+{
+    return decode(prefixPart('!', '@'));
+}
+
+QString IrcMessage::host() const
+{
+    return decode(prefixPart('@', '\0'));
+}
+
+QByteArray IrcMessage::command() const
+{
+    return bytes(m_command);
+}
+
+bool IrcMessage::isCommand(const char *verb) const
+{
+    return spanEquals(m_command, verb);
+}
+
+QString IrcMessage::param(int index) const
+{
+    if (index < 0 || index >= m_params.size()) {
+        return QString();
+    }
+    return decode(m_params[index]);
+}
+
+QByteArray IrcMessage::paramBytes(int index) const
+{
+    if (index < 0 || index >= m_params.size()) {
+        return QByteArray();
+    }
+    return bytes(m_params[index]);
+}
+
+QString IrcMessage::joinedParams(int from) const
+{
+    QString joined;
+    for (int i = qMax(from, 0); i < m_params.size(); ++i) {
+        if (!joined.isEmpty()) {
+            joined += ' ';
+        }
+        joined += decode(m_params[i]);
+    }
+    return joined;
+}
+
+bool IrcMessage::spanEquals(Span span, const char *text) const
+{
+    const size_t length = strlen(text);
+    return size_t(span.length) == length
+           && memcmp(m_line.constData() + span.offset, text, length) == 0;
+}
+
+IrcTextCodec::Encoding IrcMessage::encoding() const
+{
+    if (m_encoding == IrcTextCodec::Unknown) {
+        m_encoding = IrcTextCodec::classify(m_line.constData(), int(m_line.size()));
+        if (m_encoding == IrcTextCodec::Invalid) {
+            IrcStats::add(IrcStats::LinesLegacyDecoded);
+        }
+    }
+    return m_encoding;
+}
+
+QString IrcMessage::decode(Span span) const
+{
+    if (span.length == 0) {
+        return QString();
+    }
+    return IrcTextCodec::decode(m_line.constData() + span.offset, span.length, encoding(), m_legacy);
+}
+
+QByteArray IrcMessage::bytes(Span span) const
+{
+    // Shares m_line's storage; only valid while this message is alive
+    return QByteArray::fromRawData(m_line.constData() + span.offset, span.length);
+}
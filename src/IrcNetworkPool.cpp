@@ -0,0 +1,107 @@
+#include "IrcNetworkPool.h"
+#include "IrcSession.h"
+#include <QCoreApplication>
+#include <QPointer>
+#include <QStringList>
+#include <QThread>
+
+static int s_defaultThreadCount = 0;
+static QPointer<IrcNetworkPool> s_shared;
+
+IrcNetworkPool::IrcNetworkPool(int threadCount, QObject *parent)
+    : QObject(parent)
+{
+    if (threadCount <= 0) {
+        threadCount = defaultThreadCount();
+    }
+
+    m_workers.reserve(threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        Worker worker;
+        worker.thread = new QThread(this);
+        worker.thread->setObjectName(QString("IrcNetwork%1").arg(i));
+        worker.context = new QObject;
+        worker.context->moveToThread(worker.thread);
+        connect(worker.thread, &QThread::finished, worker.context, &QObject::deleteLater);
+        worker.sessions = 0;
+        worker.thread->start();
+        m_workers.append(worker);
+    }
+}
+
+IrcNetworkPool::~IrcNetworkPool()
+{
+    Q_ASSERT(m_assigned.isEmpty());
+    for (const Worker &worker : qAsConst(m_workers)) {
+        worker.thread->quit();
+    }
+    for (const Worker &worker : qAsConst(m_workers)) {
+        worker.thread->wait();
+    }
+}
+
+IrcNetworkPool *IrcNetworkPool::shared()
+{
+    if (!s_shared) {
+        s_shared = new IrcNetworkPool(s_defaultThreadCount, QCoreApplication::instance());
+    }
+    return s_shared;
+}
+
+void IrcNetworkPool::setDefaultThreadCount(int count)
+{
+    s_defaultThreadCount = qMax(0, count);
+}
+
+int IrcNetworkPool::defaultThreadCount()
+{
+    if (s_defaultThreadCount > 0) {
+        return s_defaultThreadCount;
+    }
+    // Sessions mostly wait on sockets; a couple of threads keep up with
+    // many networks and leave the cores to the GUI
+    return qBound(1, QThread::idealThreadCount() / 2, 4);
+}
+
+void IrcNetworkPool::adopt(IrcSession *session)
+{
+    int least = 0;
+    for (int i = 1; i < m_workers.size(); ++i) {
+        if (m_workers.at(i).sessions < m_workers.at(least).sessions) {
+            least = i;
+        }
+    }
+
+    ++m_workers[least].sessions;
+    m_assigned.insert(session, least);
+    session->moveToThread(m_workers.at(least).thread);
+}
+
+void IrcNetworkPool::release(IrcSession *session)
+{
+    const auto it = m_assigned.find(session);
+    if (it == m_assigned.end()) {
+        return;
+    }
+    Worker &worker = m_workers[it.value()];
+    m_assigned.erase(it);
+    --worker.sessions;
+
+    // The socket and timers belong to the pool thread, so they go away there;
+    // calls still queued for the session are dropped with it
+    QMetaObject::invokeMethod(worker.context, [session]() {
+        session->shutdown();
+        delete session;
+    }, Qt::BlockingQueuedConnection);
+}
+
+QString IrcNetworkPool::statsText() const
+{
+    QStringList sessions;
+    for (const Worker &worker : m_workers) {
+        sessions.append(QString::number(worker.sessions));
+    }
+    return QString("Network threads: %1, sessions per thread: %2\n")
+        .arg(m_workers.size())
+        .arg(sessions.join(' '));
+}
@@ -0,0 +1,52 @@
+#include "IrcPrefixSupport.h"
+
+IrcPrefixSupport::IrcPrefixSupport()
+    : m_modes("qaohv")
+    , m_symbols("~&@%+")
+{
+}
+
+bool IrcPrefixSupport::parse(const QString &prefix)
+{
+    // "(modes)symbols": one symbol per mode
+    const int close = prefix.indexOf(')');
+    if (!prefix.startsWith('(') || close < 0 || prefix.size() - close - 1 != close - 1) {
+        return false;
+    }
+    m_modes = prefix.mid(1, close - 1);
+    m_symbols = prefix.mid(close + 1);
+    return true;
+}
+
+int IrcPrefixSupport::rankOf(const QString &prefixes) const
+{
+    return prefixes.isEmpty() ? int(m_symbols.size()) : int(m_symbols.indexOf(prefixes.at(0)));
+}
+
+QString IrcPrefixSupport::sorted(const QString &prefixes) const
+{
+    if (prefixes.size() <= 1) {
+        return prefixes.isEmpty() || m_symbols.contains(prefixes) ? prefixes : QString();
+    }
+
+    QString sorted;
+    for (const QChar symbol : m_symbols) {
+        if (prefixes.contains(symbol)) {
+            sorted += symbol;
+        }
+    }
+    return sorted;
+}
+
+QString IrcPrefixSupport::parseName(const QString &name, QString *prefixes) const
+{
+    int start = 0;
+    while (start < name.size() && m_symbols.contains(name.at(start))) {
+        ++start;
+    }
+    const int bang = name.indexOf('!', start);
+    if (prefixes) {
+        *prefixes = sorted(name.left(start));
+    }
+    return start == 0 && bang < 0 ? name : name.mid(start, bang < 0 ? -1 : bang - start);
+}
@@ -0,0 +1,181 @@
+#include "IrcSendQueue.h"
+#include "IrcMessage.h"
+#include <cstring>
+
+IrcSendQueue::IrcSendQueue(int capacity)
+    : m_nextLane(0)
+    , m_pendingLines(0)
+    , m_clock(0)
+    , m_burst(5)
+    , m_interval(2000)
+    , m_prefixLength(100)
+{
+    // Reserved capacity survives resize(0), so the buffer is allocated once
+    m_writeBuffer.reserve(capacity);
+}
+
+void IrcSendQueue::setFloodLimits(int burst, int intervalMs)
+{
+    m_burst = qMax(1, burst);
+    m_interval = qMax(0, intervalMs);
+}
+
+void IrcSendQueue::setPrefixLength(int length)
+{
+    m_prefixLength = qBound(0, length, MaxLineLength / 2);
+}
+
+void IrcSendQueue::clear()
+{
+    m_urgent.clear();
+    m_lanes.clear();
+    m_nextLane = 0;
+    m_pendingLines = 0;
+    m_clock = 0;
+}
+
+void IrcSendQueue::enqueue(const QByteArray &line)
+{
+    IrcMessage message(line);
+    if (message.isCommand("PONG") || message.isCommand("PING") || message.isCommand("QUIT")) {
+        m_urgent.enqueue(line);
+        ++m_pendingLines;
+        return;
+    }
+
+    // Lines are queued per target, i.e. their first middle parameter
+    QByteArray target;
+    if (message.paramCount() > 1 || (message.paramCount() == 1 && !message.hasTrailing())) {
+        target = message.paramBytes(0);
+    }
+
+    const int limit = MaxLineLength - m_prefixLength;
+    if (line.size() <= limit || message.paramCount() != 2 || !message.hasTrailing()
+        || !(message.isCommand("PRIVMSG") || message.isCommand("NOTICE"))) {
+        enqueueNormal(target, line);
+        return;
+    }
+
+    // Repeat "PRIVMSG <target> :" on every piece, plus the CTCP framing
+    // for an oversized ACTION
+    // The trailing parameter always runs to the end of the line
+    const QByteArray text = message.paramBytes(1);
+    QByteArray head = line.left(line.size() - text.size());
+    QByteArray tail;
+    const char *data = text.constData();
+    int length = text.size();
+    if (length > 2 && data[0] == '\x01' && data[length - 1] == '\x01') {
+        const void *space = memchr(data, ' ', size_t(length));
+        if (space) {
+            const int keyword = int(static_cast<const char *>(space) - data) + 1;
+            head.append(data, keyword);
+            tail = "\x01";
+            data += keyword;
+            length -= keyword + 1;
+        }
+    }
+
+    const int room = limit - head.size() - tail.size();
+    if (room < 64) {
+        // Target name alone nearly fills the line; let the server truncate
+        enqueueNormal(target, line);
+        return;
+    }
+
+    while (length > 0) {
+        const int piece = length <= room ? length : splitPoint(data, room);
+        QByteArray chunk;
+        chunk.reserve(head.size() + piece + tail.size());
+        chunk.append(head).append(data, piece).append(tail);
+        enqueueNormal(target, chunk);
+
+        data += piece;
+        length -= piece;
+        // The space a piece was broken at is not carried over
+        if (length > 0 && *data == ' ') {
+            ++data;
+            --length;
+        }
+    }
+}
+
+void IrcSendQueue::enqueueNormal(const QByteArray &target, const QByteArray &line)
+{
+    ++m_pendingLines;
+    for (Lane &lane : m_lanes) {
+        if (lane.target == target) {
+            lane.lines.enqueue(line);
+            return;
+        }
+    }
+
+    // target may point into the caller's line; the lane keeps its own copy
+    Lane lane;
+    lane.target = QByteArray(target.constData(), target.size());
+    lane.lines.enqueue(line);
+    m_lanes.append(lane);
+}
+
+int IrcSendQueue::splitPoint(const char *text, int limit) const
+{
+    // text runs past limit, so text[limit] is the first byte left over.
+    // Prefer breaking between words, if that keeps at least half the room
+    for (int i = limit; i > limit / 2; --i) {
+        if (text[i] == ' ') {
+            return i;
+        }
+    }
+
+    // Otherwise never start the next piece on a UTF-8 continuation byte
+    int i = limit;
+    while (i > 0 && (static_cast<unsigned char>(text[i]) & 0xC0) == 0x80) {
+        --i;
+    }
+    return i > 0 ? i : limit;
+}
+
+void IrcSendQueue::append(const QByteArray &line)
+{
+    m_writeBuffer.append(line).append("\r\n", 2);
+    m_clock += m_interval;
+    --m_pendingLines;
+}
+
+const QByteArray &IrcSendQueue::takeWritable(qint64 nowMs)
+{
+    m_writeBuffer.resize(0);
+    m_clock = qMax(m_clock, nowMs);
+
+    // Urgent lines never wait, but still count against the bucket
+    while (!m_urgent.isEmpty()) {
+        append(m_urgent.dequeue());
+    }
+
+    const qint64 allowance = qint64(m_burst - 1) * m_interval;
+    while (!m_lanes.isEmpty() && m_clock - nowMs <= allowance) {
+        if (m_nextLane >= m_lanes.size()) {
+            m_nextLane = 0;
+        }
+        Lane &lane = m_lanes[m_nextLane];
+        append(lane.lines.dequeue());
+        if (lane.lines.isEmpty()) {
+            // The following lane slides into this index
+            m_lanes.remove(m_nextLane);
+        } else {
+            ++m_nextLane;
+        }
+    }
+    return m_writeBuffer;
+}
+
+int IrcSendQueue::nextSendDelay(qint64 nowMs) const
+{
+    if (!m_urgent.isEmpty()) {
+        return 0;
+    }
+    if (m_lanes.isEmpty()) {
+        return -1;
+    }
+    const qint64 wait = qMax(m_clock, nowMs) - nowMs - qint64(m_burst - 1) * m_interval;
+    return int(qMax<qint64>(0, wait));
+}
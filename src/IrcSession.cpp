@@ -0,0 +1,933 @@
+#include "IrcSession.h"
+#include "IrcCommandTable.h"
+#include "IrcLog.h"
+#include "IrcStats.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QThread>
+#include <cstring>
+
+namespace {
+
+// ERR_NICKNAMEINUSE retries while registering, before giving up
+const int MaxNickRetries = 5;
+// RFC 1459's NICKLEN, for servers that have not sent ISUPPORT yet
+const int DefaultNickLength = 9;
+
+} // namespace
+
+// Command dispatch. Adding support for a verb or numeric is one line here
+// plus its handler; the lookup tables are generated at compile time.
+constexpr IrcSession::VerbHandler IrcSession::s_verbHandlers[] = {
+    // RFC 1459 / 2812
+    { "PING",         &IrcSession::handlePing },
+    { "PONG",         &IrcSession::handleIgnored },
+    { "PRIVMSG",      &IrcSession::handlePrivmsg },
+    { "NOTICE",       &IrcSession::handleNotice },
+    { "JOIN",         &IrcSession::handleJoin },
+    { "PART",         &IrcSession::handlePart },
+    { "QUIT",         &IrcSession::handleQuit },
+    { "KICK",         &IrcSession::handleKick },
+    { "NICK",         &IrcSession::handleNick },
+    { "MODE",         &IrcSession::handleMode },
+    { "TOPIC",        &IrcSession::handleTopic },
+    { "INVITE",       &IrcSession::handleInvite },
+    { "KILL",         &IrcSession::handleError },
+    { "ERROR",        &IrcSession::handleError },
+    { "WALLOPS",      &IrcSession::handleUnknownCommand },
+
+    // IRCv3
+    { "CAP",          &IrcSession::handleCap },
+    { "AUTHENTICATE", &IrcSession::handleAuthenticate },
+    { "ACCOUNT",      &IrcSession::handleIgnored },
+    { "AWAY",         &IrcSession::handleIgnored },
+    { "CHGHOST",      &IrcSession::handleIgnored },
+    { "SETNAME",      &IrcSession::handleIgnored },
+    { "BATCH",        &IrcSession::handleIgnored },
+    { "TAGMSG",       &IrcSession::handleIgnored },
+    { "FAIL",         &IrcSession::handleStandardReply },
+    { "WARN",         &IrcSession::handleStandardReply },
+    { "NOTE",         &IrcSession::handleStandardReply },
+};
+
+constexpr IrcSession::NumericHandler IrcSession::s_numericHandlers[] = {
+    {   1, &IrcSession::handleWelcome },               // RPL_WELCOME
+    {   5, &IrcSession::handleISupport },              // RPL_ISUPPORT
+    { 311, &IrcSession::handleInformationalReply },    // RPL_WHOISUSER
+    { 312, &IrcSession::handleInformationalReply },    // RPL_WHOISSERVER
+    { 313, &IrcSession::handleInformationalReply },    // RPL_WHOISOPERATOR
+    { 314, &IrcSession::handleInformationalReply },    // RPL_WHOWASUSER
+    { 315, &IrcSession::handleInformationalReply },    // RPL_ENDOFWHO
+    { 317, &IrcSession::handleInformationalReply },    // RPL_WHOISIDLE
+    { 318, &IrcSession::handleInformationalReply },    // RPL_ENDOFWHOIS
+    { 319, &IrcSession::handleInformationalReply },    // RPL_WHOISCHANNELS
+    { 321, &IrcSession::handleInformationalReply },    // RPL_LISTSTART
+    { 322, &IrcSession::handleInformationalReply },    // RPL_LIST
+    { 323, &IrcSession::handleInformationalReply },    // RPL_LISTEND
+    { 324, &IrcSession::handleChannelModeIs },         // RPL_CHANNELMODEIS
+    { 329, &IrcSession::handleIgnored },               // RPL_CREATIONTIME
+    { 331, &IrcSession::handleNoTopic },               // RPL_NOTOPIC
+    { 332, &IrcSession::handleTopicReply },            // RPL_TOPIC
+    { 333, &IrcSession::handleIgnored },               // RPL_TOPICWHOTIME
+    { 352, &IrcSession::handleInformationalReply },    // RPL_WHOREPLY
+    { 353, &IrcSession::handleNamesReply },            // RPL_NAMREPLY
+    { 354, &IrcSession::handleInformationalReply },    // RPL_WHOSPCRPL (WHOX)
+    { 366, &IrcSession::handleEndOfNames },            // RPL_ENDOFNAMES
+    { 372, &IrcSession::handleInformationalReply },    // RPL_MOTD
+    { 375, &IrcSession::handleInformationalReply },    // RPL_MOTDSTART
+    { 376, &IrcSession::handleInformationalReply },    // RPL_ENDOFMOTD
+    { 433, &IrcSession::handleNicknameInUse },         // ERR_NICKNAMEINUSE
+    { 900, &IrcSession::handleInformationalReply },    // RPL_LOGGEDIN
+    { 902, &IrcSession::handleSaslReply },             // ERR_NICKLOCKED
+    { 903, &IrcSession::handleSaslReply },             // RPL_SASLSUCCESS
+    { 904, &IrcSession::handleSaslReply },             // ERR_SASLFAIL
+    { 905, &IrcSession::handleSaslReply },             // ERR_SASLTOOLONG
+    { 906, &IrcSession::handleSaslReply },             // ERR_SASLABORTED
+    { 907, &IrcSession::handleSaslReply },             // ERR_SASLALREADY
+};
+IrcSession::IrcSession(IrcStringPool *strings, QObject *parent)
+    : QObject(parent)
+    , m_strings(strings)
+    , m_socket(new QSslSocket(this))
+    , m_legacy(IrcTextCodec::Windows1252)
+    , m_port(0)
+    , m_pinRejected(false)
+    , m_handshakeStartNs(0)
+    , m_saslPending(false)
+    , m_events(4096)
+    , m_eventsNotified(false)
+    , m_notifyTimer(new QTimer(this))
+    , m_batchSize(1000)
+    , m_outbound(1024)
+    , m_outboundNotified(false)
+    , m_sendTimer(new QTimer(this))
+    , m_channels(strings)
+    , m_nicknameId(IrcStringPool::NullId)
+    , m_nickRetries(0)
+    , m_nickLength(0)
+    , m_registered(false)
+{
+    m_notifyTimer->setSingleShot(true);
+    m_notifyTimer->setInterval(16);
+    m_sendTimer->setSingleShot(true);
+    m_sendClock.start();
+    
+    connect(m_socket, &QSslSocket::connected, this, &IrcSession::onConnected);
+    connect(m_socket, &QSslSocket::encrypted, this, &IrcSession::onEncrypted);
+    connect(m_socket, QOverload<const QList<QSslError> &>::of(&QSslSocket::sslErrors),
+            this, &IrcSession::onSslErrors);
+    connect(m_socket, &QSslSocket::newSessionTicketReceived, this, &IrcSession::storeSessionTicket);
+    connect(m_socket, &QSslSocket::disconnected, this, &IrcSession::onDisconnected);
+    connect(m_socket, &QSslSocket::readyRead, this, &IrcSession::onReadyRead);
+    connect(m_socket, &QSslSocket::errorOccurred, this, &IrcSession::onSocketError);
+    connect(m_notifyTimer, &QTimer::timeout, this, &IrcSession::notifyEvents);
+    connect(m_sendTimer, &QTimer::timeout, this, &IrcSession::flushSendQueue);
+}
+
+void IrcSession::postLine(const QByteArray &line)
+{
+    while (!m_outbound.push(line)) {
+        // Full: give the session a chance to write before trying again
+        if (QThread::currentThread() == thread()) {
+            drainOutbound();
+        } else {
+            QThread::yieldCurrentThread();
+        }
+    }
+    
+    if (!m_outboundNotified.exchange(true, std::memory_order_acq_rel)) {
+        QMetaObject::invokeMethod(this, &IrcSession::drainOutbound, Qt::QueuedConnection);
+    }
+}
+
+void IrcSession::connectToServer(const QString &host, quint16 port, const IrcTlsOptions &tls)
+{
+    m_registered = false;
+    m_rejoinChannels.clear();
+    m_rejoinKeys.clear();
+    m_inbound.clear();
+    m_sendQueue.clear();
+    m_channels.clear();
+    
+    m_host = host;
+    m_port = port;
+    m_tls = tls;
+    m_pinRejected = false;
+    startConnection();
+}
+
+void IrcSession::startConnection()
+{
+    if (!m_tls.enabled) {
+        qCInfo(lcIrcSession) << "Connecting to" << m_host << ":" << m_port;
+        m_socket->connectToHost(m_host, m_port);
+        return;
+    }
+    
+    QString error;
+    QSslConfiguration config = IrcTls::configuration(m_tls, &error);
+    if (!error.isEmpty()) {
+        qCWarning(lcIrcSession) << "TLS setup failed:" << error;
+        publish(IrcEvent(IrcEvent::ConnectionError, QString(), QString(), error));
+        notifyEvents();
+        return;
+    }
+    
+    // A ticket from the last connection turns the handshake into a resumption
+    const QString server = serverKey();
+    config.setSessionTicket(IrcTls::sessionTicket(server));
+    m_expectedPin = m_tls.pinning && !m_pinRejected ? IrcTls::pinnedFingerprint(server) : QByteArray();
+    if (!m_expectedPin.isEmpty()) {
+        // Known server: onEncrypted() compares the fingerprint instead
+        config.setPeerVerifyMode(QSslSocket::VerifyNone);
+    }
+    m_socket->setSslConfiguration(config);
+    
+    qCInfo(lcIrcSession) << "Connecting to" << m_host << ":" << m_port << "with TLS"
+                         << (m_expectedPin.isEmpty() ? "" : "(pinned)");
+    m_socket->connectToHostEncrypted(m_host, m_port);
+}
+
+void IrcSession::registerUser(const QString &nick)
+{
+    m_requestedNickname = nick;
+    m_nickRetries = 0;
+    setNickname(nick);
+    
+    // Logging in with the client certificate: the server holds registration
+    // until CAP END, which finishSasl() sends
+    m_saslPending = m_tls.enabled && m_tls.hasClientCertificate();
+    if (m_saslPending) {
+        writeLine("CAP REQ :sasl");
+    }
+    writeLine(QString("NICK %1").arg(nick).toUtf8());
+    writeLine(QString("USER %1 0 * :%1").arg(nick).toUtf8());
+    flushSendQueue();
+}
+
+void IrcSession::setRejoinChannels(const QStringList &channels, const QStringList &keys)
+{
+    m_rejoinChannels = channels;
+    m_rejoinKeys = keys;
+}
+
+void IrcSession::sendRejoinBurst()
+{
+    if (m_rejoinChannels.isEmpty()) {
+        return;
+    }
+    
+    // Packed JOINs, then the mode queries behind them without waiting for
+    // any reply: the whole state comes back in about one round trip
+    for (const QByteArray &line : packJoins(m_rejoinChannels, m_rejoinKeys)) {
+        writeLine(line);
+    }
+    for (const QString &channel : qAsConst(m_rejoinChannels)) {
+        writeLine("MODE " + channel.toUtf8());
+    }
+    qCInfo(lcIrcSession) << "Rejoining" << m_rejoinChannels.size() << "channels";
+    m_rejoinChannels.clear();
+    m_rejoinKeys.clear();
+}
+
+QList<QByteArray> IrcSession::packJoins(const QStringList &channels, const QStringList &keys)
+{
+    // Keys are matched to channels by position, so keyed channels go first
+    QList<QPair<QByteArray, QByteArray>> keyed;
+    QList<QByteArray> open;
+    for (int i = 0; i < channels.size(); ++i) {
+        const QByteArray key = keys.value(i).toUtf8();
+        if (key.isEmpty()) {
+            open.append(channels.at(i).toUtf8());
+        } else {
+            keyed.append(qMakePair(channels.at(i).toUtf8(), key));
+        }
+    }
+    for (const QByteArray &channel : qAsConst(open)) {
+        keyed.append(qMakePair(channel, QByteArray()));
+    }
+    
+    // "JOIN #a,#b,#c key1,key2", as many channels per line as fit
+    const auto joinLine = [](const QByteArray &names, const QByteArray &keyList) {
+        return "JOIN " + names + (keyList.isEmpty() ? QByteArray() : ' ' + keyList);
+    };
+    QList<QByteArray> lines;
+    QByteArray names;
+    QByteArray keyList;
+    for (const auto &entry : qAsConst(keyed)) {
+        QByteArray nextNames = names.isEmpty() ? entry.first : names + ',' + entry.first;
+        QByteArray nextKeys = keyList;
+        if (!entry.second.isEmpty()) {
+            nextKeys = keyList.isEmpty() ? entry.second : keyList + ',' + entry.second;
+        }
+        if (!names.isEmpty() && joinLine(nextNames, nextKeys).size() > IrcSendQueue::MaxLineLength) {
+            lines.append(joinLine(names, keyList));
+            nextNames = entry.first;
+            nextKeys = entry.second;
+        }
+        names = nextNames;
+        keyList = nextKeys;
+    }
+    if (!names.isEmpty()) {
+        lines.append(joinLine(names, keyList));
+    }
+    return lines;
+}
+
+void IrcSession::disconnectFromServer()
+{
+    if (m_socket->isOpen()) {
+        drainOutbound();
+        m_socket->disconnectFromHost();
+    }
+}
+
+void IrcSession::shutdown()
+{
+    if (m_socket->state() == QAbstractSocket::ConnectedState) {
+        drainOutbound();
+        writeLine("QUIT :Leaving");
+        flushSendQueue();
+        m_socket->disconnectFromHost();
+    }
+}
+
+void IrcSession::setBatchLimits(int maxEvents, int maxLatencyMs)
+{
+    m_batchSize = qMax(1, maxEvents);
+    m_notifyTimer->setInterval(qMax(0, maxLatencyMs));
+}
+
+void IrcSession::setFloodLimits(int burst, int intervalMs)
+{
+    m_sendQueue.setFloodLimits(burst, intervalMs);
+    flushSendQueue();
+}
+
+void IrcSession::setLegacyEncoding(IrcTextCodec::Legacy legacy)
+{
+    m_legacy = legacy;
+    m_strings->setLegacyEncoding(legacy);
+}
+
+void IrcSession::setStringPool(IrcStringPool *strings)
+{
+    m_strings = strings;
+    m_strings->setLegacyEncoding(m_legacy);
+    m_channels = ChannelState(strings);
+    m_nicknameId = m_strings->intern(m_nickname);
+}
+
+void IrcSession::setFilterRules(const IrcFilterRules &rules)
+{
+    m_filterRules = rules;
+    compileFilter();
+}
+
+void IrcSession::compileFilter()
+{
+    QStringList words = m_filterRules.highlightWords;
+    if (!m_nickname.isEmpty()) {
+        words.append(m_nickname);
+    }
+    m_filter = IrcFilter(words, m_filterRules.ignoreMasks);
+}
+
+void IrcSession::onConnected()
+{
+    if (m_tls.enabled) {
+        // Connected once the handshake is done, in onEncrypted()
+        m_handshakeStartNs = IrcStats::nowNs();
+        return;
+    }
+    qCInfo(lcIrcSession) << "Connected to server";
+    publish(IrcEvent(IrcEvent::Connected, QString(), QString(), m_socket->localAddress().toString()));
+    notifyEvents();
+}
+
+void IrcSession::onEncrypted()
+{
+    IrcStats::record(IrcStats::TlsHandshakeUs, (IrcStats::nowNs() - m_handshakeStartNs) / 1000);
+    
+    const QString server = serverKey();
+    const QByteArray fingerprint = m_socket->peerCertificate().digest(QCryptographicHash::Sha256);
+    if (!m_expectedPin.isEmpty() && fingerprint != m_expectedPin) {
+        // New certificate, or someone else's: start over and validate it
+        qCWarning(lcIrcSession) << "Certificate of" << server << "does not match its pin, validating it";
+        m_pinRejected = true;
+        m_socket->blockSignals(true);
+        m_socket->abort();
+        m_socket->blockSignals(false);
+        startConnection();
+        return;
+    }
+    if (m_expectedPin.isEmpty() && m_tls.pinning) {
+        // The chain was validated for this handshake
+        IrcTls::pin(server, fingerprint);
+    }
+    storeSessionTicket();
+    
+    qCInfo(lcIrcSession) << "Connected to server with TLS";
+    publish(IrcEvent(IrcEvent::Connected, QString(), QString(), m_socket->localAddress().toString()));
+    notifyEvents();
+}
+
+void IrcSession::onSslErrors(const QList<QSslError> &errors)
+{
+    // Not ignored: the handshake fails and onSocketError() reports it
+    for (const QSslError &error : errors) {
+        qCWarning(lcIrcSession) << "TLS error:" << error.errorString();
+    }
+}
+
+void IrcSession::storeSessionTicket()
+{
+    // TLS 1.3 servers send tickets after the handshake, so this runs again then
+    const QSslConfiguration config = m_socket->sslConfiguration();
+    const QByteArray ticket = config.sessionTicket();
+    if (!ticket.isEmpty()) {
+        IrcTls::storeSessionTicket(serverKey(), ticket, config.sessionTicketLifeTimeHint());
+    }
+}
+
+void IrcSession::onDisconnected()
+{
+    qCInfo(lcIrcSession) << "Disconnected from server";
+    m_saslPending = false;
+    m_sendQueue.clear();
+    m_sendTimer->stop();
+    m_channels.clear();
+    publish(IrcEvent(IrcEvent::Disconnected));
+    notifyEvents();
+}
+
+void IrcSession::feedInput(const QByteArray &data)
+{
+    m_inbound.append(data.constData(), int(data.size()));
+    IrcStats::add(IrcStats::BytesIn, quint64(data.size()));
+    processInbound();
+}
+
+void IrcSession::onReadyRead()
+{
+    // Drain the socket in one go, then parse every complete line in place
+    IrcStats::add(IrcStats::BytesIn, quint64(m_inbound.fill(m_socket)));
+    processInbound();
+}
+
+void IrcSession::processInbound()
+{
+    const char *data;
+    int length;
+    while (m_inbound.nextLine(&data, &length)) {
+        const quint64 parseStart = IrcStats::nowNs();
+        IRC_LOG_TRAFFIC(IrcCapture::Inbound, data, length);
+        IrcMessage message(QByteArray::fromRawData(data, length));
+        message.setLegacyEncoding(m_legacy);
+        IrcStats::record(IrcStats::ParseNs, IrcStats::nowNs() - parseStart);
+        IrcStats::add(IrcStats::LinesParsed);
+        
+        if (message.isValid()) {
+            IrcStats::ScopedTimer timer(IrcStats::DispatchNs);
+            handleMessage(message);
+        }
+    }
+    
+    // PONG and anything handlers queued go out in one write
+    flushSendQueue();
+}
+
+void IrcSession::onSocketError(QAbstractSocket::SocketError error)
+{
+    QString errorStr = m_socket->errorString();
+    qCWarning(lcIrcSession) << "Socket error:" << errorStr;
+    publish(IrcEvent(IrcEvent::ConnectionError, QString(), QString(), errorStr));
+    notifyEvents();
+}
+
+void IrcSession::drainOutbound()
+{
+    m_outboundNotified.store(false, std::memory_order_release);
+    
+    QByteArray line;
+    while (m_outbound.pop(line)) {
+        writeLine(line);
+    }
+    flushSendQueue();
+}
+
+void IrcSession::writeLine(const QByteArray &line)
+{
+    if (m_socket->state() != QAbstractSocket::ConnectedState) {
+        qCWarning(lcIrcSession) << "Not connected to server";
+        return;
+    }
+    
+    IRC_LOG_TRAFFIC(IrcCapture::Outbound, line.constData(), int(line.size()));
+    m_sendQueue.enqueue(line);
+}
+
+void IrcSession::flushSendQueue()
+{
+    if (m_socket->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+    
+    const qint64 now = m_sendClock.elapsed();
+    const QByteArray &bytes = m_sendQueue.takeWritable(now);
+    if (!bytes.isEmpty()) {
+        m_socket->write(bytes);
+        m_socket->flush();
+        IrcStats::add(IrcStats::BytesOut, quint64(bytes.size()));
+        IrcStats::add(IrcStats::LinesSent, quint64(bytes.count('\n')));
+    }
+    IrcStats::setGauge(IrcStats::SendQueueDepth, m_sendQueue.pendingLines());
+    
+    // Throttled lines go out when the bucket has refilled
+    const int delay = m_sendQueue.nextSendDelay(now);
+    if (delay >= 0) {
+        m_sendTimer->start(delay);
+    } else {
+        m_sendTimer->stop();
+    }
+}
+
+void IrcSession::setNickname(const QString &nick)
+{
+    const bool changed = nick != m_nickname;
+    m_nickname = nick;
+    m_nicknameId = m_strings->intern(nick);
+    
+    // ":nick!user@host " as relayed by the server; user and host are
+    // unknown here, so assume the common maximums of 10 and 63 bytes
+    m_sendQueue.setPrefixLength(m_nickname.toUtf8().size() + 10 + 63 + 4);
+    
+    if (changed) {
+        compileFilter();
+    }
+}
+
+void IrcSession::publish(const IrcEvent &event)
+{
+    // Keep order: once anything has spilled, everything spills behind it
+    if (!m_overflow.isEmpty() || !m_events.push(event)) {
+        m_overflow.append(event);
+    }
+    IrcStats::add(IrcStats::EventsPublished);
+    IrcStats::setGauge(IrcStats::EventQueueDepth, qint64(m_events.size()) + m_overflow.size());
+    
+    if (m_events.size() >= size_t(m_batchSize)) {
+        notifyEvents();
+    } else if (!m_notifyTimer->isActive()) {
+        m_notifyTimer->start();
+    }
+}
+
+IrcEvent IrcSession::makeEvent(IrcEvent::Type type, IrcStringPool::Id sender, IrcStringPool::Id target,
+                               const QString &text, const QString &argument) const
+{
+    IrcEvent event(type, m_strings->string(sender), m_strings->string(target), text, argument);
+    event.senderId = sender;
+    event.targetId = target;
+    return event;
+}
+
+void IrcSession::publishServerMessage(const QString &text)
+{
+    publish(IrcEvent(IrcEvent::ServerMessage, QString(), QString(), text));
+}
+
+qint64 IrcSession::sentTime(const IrcMessage &message)
+{
+    // Untagged lines, the usual case, stop here
+    if (message.tagCount() == 0) {
+        return 0;
+    }
+    
+    // irc_fake_server adds a microsecond stamp; servers in general only
+    // have IRCv3 server-time, to the millisecond
+    bool ok = false;
+    const qint64 micros = message.tag("qtirc.local/sent").toLongLong(&ok);
+    if (ok) {
+        return micros;
+    }
+    const QString time = message.tag("time");
+    if (time.isEmpty()) {
+        return 0;
+    }
+    const QDateTime parsed = QDateTime::fromString(time, Qt::ISODateWithMs);
+    return parsed.isValid() ? parsed.toMSecsSinceEpoch() * 1000 : 0;
+}
+
+void IrcSession::notifyEvents()
+{
+    m_notifyTimer->stop();
+    
+    // Move spilled events across now that the GUI may have made room
+    int moved = 0;
+    while (moved < m_overflow.size() && m_events.push(m_overflow.at(moved))) {
+        ++moved;
+    }
+    m_overflow.remove(0, moved);
+    if (!m_overflow.isEmpty()) {
+        m_notifyTimer->start();
+    }
+    
+    if (!m_events.isEmpty() && !m_eventsNotified.exchange(true, std::memory_order_acq_rel)) {
+        emit eventsAvailable();
+    }
+}
+
+void IrcSession::handleMessage(const IrcMessage &message)
+{
+    static constexpr auto verbs = IrcCommandTable::makeVerbIndex(s_verbHandlers);
+    static constexpr auto numerics = IrcCommandTable::makeNumericTable<Handler>(
+        s_numericHandlers, &IrcSession::handleServerReply);
+
+    Handler handler;
+    if (message.isNumeric()) {
+        handler = numerics[message.numeric()];
+    } else {
+        const int index = verbs.find(message.commandData(), message.commandLength());
+        handler = index >= 0 ? s_verbHandlers[index].handler : &IrcSession::handleUnknownCommand;
+    }
+    (this->*handler)(message);
+}
+
+void IrcSession::handlePing(const IrcMessage &message)
+{
+    // Answered straight from the session, whatever the GUI is doing
+    writeLine("PONG :" + message.paramBytes(0));
+}
+
+void IrcSession::handlePrivmsg(const IrcMessage &message)
+{
+    if (message.paramCount() >= 1) {
+        if (m_filter.ignores(message.prefixBytes())) {
+            IrcStats::add(IrcStats::MessagesIgnored);
+            return;
+        }
+        const IrcStringPool::Id target = m_channels.channelId(atom(message.paramBytes(0)));
+        const QByteArray text = message.paramBytes(1);
+        if (text.startsWith('\001') && !text.startsWith("\001ACTION ")) {
+            // CTCP request; ACTIONs stay messages
+            QString request = message.param(1).mid(1);
+            if (request.endsWith(QChar('\001'))) {
+                request.chop(1);
+            }
+            const int space = request.indexOf(' ');
+            publish(makeEvent(IrcEvent::Ctcp, atom(message.nickBytes()), target,
+                              space < 0 ? QString() : request.mid(space + 1),
+                              request.left(space).toUpper()));
+            return;
+        }
+        IrcEvent event = makeEvent(IrcEvent::Message, atom(message.nickBytes()), target, message.param(1));
+        event.sentTime = sentTime(message);
+        event.highlight = m_filter.highlights(text);
+        publish(event);
+    }
+}
+
+void IrcSession::handleNotice(const IrcMessage &message)
+{
+    if (message.paramCount() < 2) {
+        return;
+    }
+    if (m_filter.ignores(message.prefixBytes())) {
+        IrcStats::add(IrcStats::MessagesIgnored);
+        return;
+    }
+    const IrcStringPool::Id target = m_channels.channelId(atom(message.paramBytes(0)));
+    IrcEvent event = makeEvent(IrcEvent::Notice, atom(message.nickBytes()), target, message.param(1));
+    event.sentTime = sentTime(message);
+    publish(event);
+}
+
+void IrcSession::handleJoin(const IrcMessage &message)
+{
+    if (message.paramCount() >= 1) {
+        const IrcStringPool::Id nick = atom(message.nickBytes());
+        const IrcStringPool::Id channel = m_channels.channelId(atom(message.paramBytes(0)));
+        m_channels.join(channel, nick, isSelf(nick));
+        publish(makeEvent(IrcEvent::Join, nick, channel));
+    }
+}
+
+void IrcSession::handlePart(const IrcMessage &message)
+{
+    if (message.paramCount() >= 1) {
+        const IrcStringPool::Id nick = atom(message.nickBytes());
+        const IrcStringPool::Id channel = m_channels.channelId(atom(message.paramBytes(0)));
+        m_channels.part(channel, nick, isSelf(nick));
+        publish(makeEvent(IrcEvent::Part, nick, channel, message.param(1)));
+    }
+}
+
+void IrcSession::handleQuit(const IrcMessage &message)
+{
+    const IrcStringPool::Id nick = atom(message.nickBytes());
+    IrcEvent event = makeEvent(IrcEvent::Quit, nick, IrcStringPool::NullId, message.param(0));
+    event.channels = m_channels.quit(nick);
+    publish(event);
+}
+
+void IrcSession::handleKick(const IrcMessage &message)
+{
+    if (message.paramCount() >= 2) {
+        const IrcStringPool::Id kicked = atom(message.paramBytes(1));
+        const IrcStringPool::Id channel = m_channels.channelId(atom(message.paramBytes(0)));
+        m_channels.part(channel, kicked, isSelf(kicked));
+        publish(makeEvent(IrcEvent::Kick, atom(message.nickBytes()), channel, message.param(2), m_strings->string(kicked)));
+    }
+}
+
+void IrcSession::handleNick(const IrcMessage &message)
+{
+    if (message.paramCount() < 1) {
+        return;
+    }
+    const IrcStringPool::Id oldNick = atom(message.nickBytes());
+    const IrcStringPool::Id newNick = atom(message.paramBytes(0));
+    if (isSelf(oldNick)) {
+        setNickname(m_strings->string(newNick));
+    }
+    IrcEvent event = makeEvent(IrcEvent::NickChange, oldNick, newNick, m_strings->string(newNick));
+    event.channels = m_channels.rename(oldNick, newNick);
+    publish(event);
+}
+
+void IrcSession::handleMode(const IrcMessage &message)
+{
+    if (message.paramCount() >= 2) {
+        const IrcStringPool::Id channel = m_channels.channelId(atom(message.paramBytes(0)));
+        publish(makeEvent(IrcEvent::Mode, atom(message.nickBytes()), channel, message.joinedParams(1)));
+        if (!m_channels.contains(channel)) {
+            return;
+        }
+        
+        // Follow up with the member prefixes the modes changed
+        QStringList modes;
+        for (int i = 1; i < message.paramCount(); ++i) {
+            modes.append(message.param(i));
+        }
+        for (const ChannelState::PrefixChange &change : m_channels.applyMode(channel, modes)) {
+            publish(makeEvent(IrcEvent::Prefixes, IrcStringPool::NullId, channel,
+                              change.prefixes, m_strings->string(change.nick)));
+        }
+    }
+}
+
+void IrcSession::handleTopic(const IrcMessage &message)
+{
+    if (message.paramCount() >= 1) {
+        const IrcStringPool::Id channel = m_channels.channelId(atom(message.paramBytes(0)));
+        publish(makeEvent(IrcEvent::Topic, atom(message.nickBytes()), channel, message.param(1)));
+    }
+}
+
+void IrcSession::handleInvite(const IrcMessage &message)
+{
+    publishServerMessage(QString("%1 invited you to %2").arg(message.nick(), message.param(1)));
+}
+
+void IrcSession::handleError(const IrcMessage &message)
+{
+    publishServerMessage(QString("Error: %1").arg(message.joinedParams()));
+}
+
+void IrcSession::handleCap(const IrcMessage &message)
+{
+    // CAP <nick> ACK|NAK :<capabilities>; we only ever request sasl
+    if (!m_saslPending) {
+        return;
+    }
+    const QByteArray subcommand = message.paramBytes(1).toUpper();
+    const bool sasl = message.paramBytes(2).split(' ').contains("sasl");
+    if (subcommand == "ACK" && sasl) {
+        writeLine("AUTHENTICATE EXTERNAL");
+    } else if (subcommand == "NAK") {
+        publishServerMessage("The server does not support SASL, continuing without logging in");
+        finishSasl();
+    }
+}
+
+void IrcSession::handleAuthenticate(const IrcMessage &message)
+{
+    // EXTERNAL takes the identity from the client certificate: empty response
+    if (m_saslPending && message.paramBytes(0) == "+") {
+        writeLine("AUTHENTICATE +");
+    }
+}
+
+void IrcSession::handleSaslReply(const IrcMessage &message)
+{
+    // Success or failure, registration goes on
+    handleInformationalReply(message);
+    finishSasl();
+}
+
+void IrcSession::finishSasl()
+{
+    if (m_saslPending) {
+        m_saslPending = false;
+        writeLine("CAP END");
+    }
+}
+
+void IrcSession::handleStandardReply(const IrcMessage &message)
+{
+    // FAIL/WARN/NOTE <command> <code> [context...] :<description>
+    publishServerMessage(QString::fromLatin1(message.command()) + " " + message.joinedParams());
+}
+
+void IrcSession::handleIgnored(const IrcMessage &)
+{
+}
+
+void IrcSession::handleUnknownCommand(const IrcMessage &message)
+{
+    publishServerMessage(QString::fromLatin1(message.command()) + " " + message.joinedParams());
+}
+
+void IrcSession::handleWelcome(const IrcMessage &message)
+{
+    // The server tells us which nickname we actually ended up with. 433
+    // retries changed ours without telling the GUI, so compare against the
+    // one it asked for.
+    m_registered = true;
+    const QString nick = message.param(0);
+    if (!nick.isEmpty()) {
+        setNickname(nick);
+        const IrcStringPool::Id requested = m_strings->intern(m_requestedNickname);
+        if (requested != m_nicknameId) {
+            publish(makeEvent(IrcEvent::NickChange, requested, m_nicknameId, nick));
+        }
+        m_requestedNickname = nick;
+    }
+    publishServerMessage(message.joinedParams());
+    sendRejoinBurst();
+}
+
+void IrcSession::handleISupport(const IrcMessage &message)
+{
+    // <nick> TOKEN[=value] ... :are supported by this server
+    IrcEvent event(IrcEvent::ISupport);
+    for (int i = 1; i < message.paramCount() - 1; ++i) {
+        const QString token = message.param(i);
+        event.names.append(token);
+        m_channels.applyISupport(token);
+        if (token.startsWith("NICKLEN=")) {
+            m_nickLength = token.mid(8).toInt();
+        }
+    }
+    publish(event);
+    handleServerReply(message);
+}
+
+void IrcSession::handleChannelModeIs(const IrcMessage &message)
+{
+    // <nick> <channel> <modes> [args...]; a Mode event without a sender
+    if (message.paramCount() >= 3) {
+        const IrcStringPool::Id channel = m_channels.channelId(atom(message.paramBytes(1)));
+        publish(makeEvent(IrcEvent::Mode, IrcStringPool::NullId, channel, message.joinedParams(2)));
+    }
+}
+
+void IrcSession::handleNoTopic(const IrcMessage &message)
+{
+    // <nick> <channel> :No topic is set
+    if (message.paramCount() < 2) {
+        return;
+    }
+    publish(makeEvent(IrcEvent::Topic, IrcStringPool::NullId, m_channels.channelId(atom(message.paramBytes(1)))));
+}
+
+void IrcSession::handleTopicReply(const IrcMessage &message)
+{
+    if (message.paramCount() >= 2) {
+        const IrcStringPool::Id channel = m_channels.channelId(atom(message.paramBytes(1)));
+        publish(makeEvent(IrcEvent::Topic, IrcStringPool::NullId, channel, message.param(2)));
+    }
+}
+
+void IrcSession::handleNamesReply(const IrcMessage &message)
+{
+    // <nick> <symbol> <channel> :[prefix]<nick> ...
+    if (message.paramCount() >= 4) {
+        QStringList names;
+        
+        // Intern each nick straight from the raw bytes, without its prefix
+        // symbols, so "@bob" and "bob" are one name in the pool
+        const QString symbols = m_channels.prefixSupport().symbols();
+        const QByteArray list = message.paramBytes(3);
+        const char *data = list.constData();
+        const char *end = data + list.size();
+        while (data < end) {
+            const char *space = static_cast<const char *>(memchr(data, ' ', size_t(end - data)));
+            const char *stop = space ? space : end;
+            const char *nick = data;
+            while (nick < stop && symbols.contains(QLatin1Char(*nick))) {
+                ++nick;
+            }
+            if (stop > nick) {
+                const QString &name = m_strings->string(m_strings->intern(nick, int(stop - nick)));
+                names.append(nick == data ? name : QString::fromLatin1(data, int(nick - data)) + name);
+            }
+            data = stop + 1;
+        }
+        
+        // Held back until RPL_ENDOFNAMES so the list is applied in one go
+        m_channels.addNames(atom(message.paramBytes(2)), names);
+    }
+}
+
+void IrcSession::handleEndOfNames(const IrcMessage &message)
+{
+    // <nick> <channel> :End of /NAMES list
+    if (message.paramCount() >= 2) {
+        const IrcStringPool::Id channel = m_channels.channelId(atom(message.paramBytes(1)));
+        IrcEvent event = makeEvent(IrcEvent::Names, IrcStringPool::NullId, channel);
+        event.names = m_channels.endNames(channel);
+        publish(event);
+    }
+}
+
+void IrcSession::handleNicknameInUse(const IrcMessage &message)
+{
+    handleServerReply(message);
+
+    // Still registering: try again with an alternative nickname, a few times
+    if (m_registered) {
+        return;
+    }
+    if (m_nickRetries >= MaxNickRetries) {
+        const QString error = QString("Nickname %1 and its alternatives are in use").arg(m_requestedNickname);
+        qCWarning(lcIrcSession) << error;
+        publish(IrcEvent(IrcEvent::ConnectionError, QString(), QString(), error));
+        disconnectFromServer();
+        return;
+    }
+    setNickname(alternativeNickname(++m_nickRetries));
+    writeLine(QString("NICK %1").arg(m_nickname).toUtf8());
+}
+
+QString IrcSession::alternativeNickname(int attempt) const
+{
+    // "nick_", "nick_2", "nick_3", ...; the end of the nick gives way to the
+    // counter where NICKLEN would cut it off, so every try differs
+    const QString suffix = attempt > 1 ? '_' + QString::number(attempt) : QString("_");
+    const int limit = m_nickLength > 0 ? m_nickLength : qMax(DefaultNickLength, int(m_requestedNickname.size()));
+    return m_requestedNickname.left(qMax(1, limit - int(suffix.size()))) + suffix;
+}
+
+void IrcSession::handleInformationalReply(const IrcMessage &message)
+{
+    // WHOIS, WHO, LIST and MOTD lines: drop our own nick and show the rest
+    publishServerMessage(message.joinedParams(1));
+}
+
+void IrcSession::handleServerReply(const IrcMessage &message)
+{
+    // Generic server message
+    publishServerMessage(QString::fromLatin1(message.command()) + " " + message.joinedParams());
+}
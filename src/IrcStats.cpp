@@ -0,0 +1,244 @@
+#include "IrcStats.h"
+#include <QDateTime>
+#include <QFile>
+#include <QTextStream>
+#include <QtAlgorithms>
+
+namespace {
+
+struct alignas(64) Block
+{
+    std::atomic<quint64> counters[IrcStats::CounterCount];
+    std::atomic<quint64> counts[IrcStats::HistogramCount];
+    std::atomic<quint64> sums[IrcStats::HistogramCount];
+    std::atomic<quint64> buckets[IrcStats::HistogramCount][IrcStats::BucketCount];
+};
+
+// One block per live recording thread. A thread gives its slot back when
+// it ends and the next new thread adds on top of the counts left there, so
+// short-lived threads do not use up the slots. Threads beyond MaxThreads
+// share an overflow block and pay for atomic read-modify-writes.
+constexpr int MaxThreads = 64;
+constexpr int NoSlot = -1;
+Block s_blocks[MaxThreads];
+Block s_shared;
+std::atomic<bool> s_slotTaken[MaxThreads];
+std::atomic<int> s_slotsUsed(0);    // highest slot ever taken + 1
+std::atomic<int> s_threadCount(0);  // threads holding a slot or the shared block
+
+// Plain int: no constructor, so it is safe to touch from operator new.
+// MaxThreads stands for the shared block.
+thread_local int t_slot = NoSlot;
+
+// Gives the slot back at thread exit. Whatever the thread still records
+// after that, e.g. from other thread_local destructors, goes to the
+// shared block.
+struct SlotRelease
+{
+    bool armed = false;
+
+    ~SlotRelease()
+    {
+        const int slot = t_slot;
+        t_slot = MaxThreads;
+        if (slot >= 0 && slot < MaxThreads) {
+            s_slotTaken[slot].store(false, std::memory_order_release);
+        }
+        s_threadCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+thread_local SlotRelease t_release;
+
+int takeSlot()
+{
+    for (int slot = 0; slot < MaxThreads; ++slot) {
+        bool taken = false;
+        if (!s_slotTaken[slot].load(std::memory_order_relaxed)
+            && s_slotTaken[slot].compare_exchange_strong(taken, true, std::memory_order_acquire)) {
+            int used = s_slotsUsed.load(std::memory_order_relaxed);
+            while (used <= slot
+                   && !s_slotsUsed.compare_exchange_weak(used, slot + 1, std::memory_order_relaxed)) {
+            }
+            return slot;
+        }
+    }
+    return MaxThreads;
+}
+
+std::atomic<qint64> s_gauges[IrcStats::GaugeCount];
+std::atomic<qint64> s_gaugePeaks[IrcStats::GaugeCount];
+
+Block &threadBlock(bool *shared)
+{
+    int slot = t_slot;
+    if (slot == NoSlot) {
+        slot = takeSlot();
+        t_slot = slot;
+        s_threadCount.fetch_add(1, std::memory_order_relaxed);
+        // Set after t_slot, in case registering the destructor allocates
+        t_release.armed = true;
+    }
+    *shared = slot >= MaxThreads;
+    return *shared ? s_shared : s_blocks[slot];
+}
+
+inline void bump(std::atomic<quint64> &value, quint64 amount, bool shared)
+{
+    if (shared) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    } else {
+        // Only this thread writes here
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+}
+
+inline int bucketOf(quint64 value)
+{
+    if (value == 0) {
+        return 0;
+    }
+    return qMin(IrcStats::BucketCount - 1, 64 - int(qCountLeadingZeroBits(value)));
+}
+
+} // namespace
+
+void IrcStats::add(Counter counter, quint64 amount)
+{
+    bool shared;
+    Block &block = threadBlock(&shared);
+    bump(block.counters[counter], amount, shared);
+}
+
+void IrcStats::record(Histogram histogram, quint64 value)
+{
+    bool shared;
+    Block &block = threadBlock(&shared);
+    bump(block.counts[histogram], 1, shared);
+    bump(block.sums[histogram], value, shared);
+    bump(block.buckets[histogram][bucketOf(value)], 1, shared);
+}
+
+void IrcStats::setGauge(Gauge gauge, qint64 value)
+{
+    s_gauges[gauge].store(value, std::memory_order_relaxed);
+    qint64 peak = s_gaugePeaks[gauge].load(std::memory_order_relaxed);
+    while (value > peak
+           && !s_gaugePeaks[gauge].compare_exchange_weak(peak, value, std::memory_order_relaxed)) {
+    }
+}
+
+quint64 IrcStats::HistogramSnapshot::percentile(double p) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    const quint64 rank = qMin(count - 1, quint64(p * double(count)));
+    quint64 seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket) {
+        seen += buckets[bucket];
+        if (seen > rank) {
+            return bucket == 0 ? 0 : (quint64(1) << bucket) - 1;
+        }
+    }
+    return 0;
+}
+
+IrcStats::Snapshot IrcStats::snapshot()
+{
+    Snapshot snapshot;
+    snapshot.threads = s_threadCount.load(std::memory_order_relaxed);
+
+    auto collect = [&snapshot](const Block &block) {
+        for (int i = 0; i < CounterCount; ++i) {
+            snapshot.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < HistogramCount; ++i) {
+            HistogramSnapshot &histogram = snapshot.histograms[i];
+            histogram.count += block.counts[i].load(std::memory_order_relaxed);
+            histogram.sum += block.sums[i].load(std::memory_order_relaxed);
+            for (int bucket = 0; bucket < BucketCount; ++bucket) {
+                histogram.buckets[bucket] += block.buckets[i][bucket].load(std::memory_order_relaxed);
+            }
+        }
+    };
+    // Free slots too: they keep the counts of the threads that had them
+    const int slots = s_slotsUsed.load(std::memory_order_relaxed);
+    for (int slot = 0; slot < slots; ++slot) {
+        collect(s_blocks[slot]);
+    }
+    collect(s_shared);
+
+    for (int i = 0; i < GaugeCount; ++i) {
+        snapshot.gauges[i] = s_gauges[i].load(std::memory_order_relaxed);
+        snapshot.gaugePeaks[i] = s_gaugePeaks[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+QString IrcStats::format(const Snapshot &snapshot)
+{
+    auto label = [](const char *name) { return QString("  ") + QString(name).leftJustified(20); };
+    auto cell = [](quint64 value) { return QString::number(value).rightJustified(12); };
+
+    QString text = QString("Counters (%1 threads)\n").arg(snapshot.threads);
+    for (int i = 0; i < CounterCount; ++i) {
+        text += label(name(Counter(i))) + cell(snapshot.counters[i]) + "\n";
+    }
+
+    text += QString("Histograms").leftJustified(22) + QString("count").rightJustified(12)
+          + QString("mean").rightJustified(12) + QString("p50").rightJustified(12)
+          + QString("p99").rightJustified(12) + QString("max").rightJustified(12) + "\n";
+    for (int i = 0; i < HistogramCount; ++i) {
+        const HistogramSnapshot &histogram = snapshot.histograms[i];
+        const quint64 mean = histogram.count ? histogram.sum / histogram.count : 0;
+        text += label(name(Histogram(i))) + cell(histogram.count) + cell(mean)
+              + cell(histogram.percentile(0.50)) + cell(histogram.percentile(0.99))
+              + cell(histogram.percentile(1.0)) + "\n";
+    }
+
+    text += QString("Gauges").leftJustified(22) + QString("now").rightJustified(12)
+          + QString("peak").rightJustified(12) + "\n";
+    for (int i = 0; i < GaugeCount; ++i) {
+        text += label(name(Gauge(i))) + cell(quint64(snapshot.gauges[i])) + cell(quint64(snapshot.gaugePeaks[i])) + "\n";
+    }
+    return text;
+}
+
+bool IrcStats::dump(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream out(&file);
+    out << "# " << QDateTime::currentDateTime().toString(Qt::ISODate) << "\n"
+        << format(snapshot());
+    return true;
+}
+
+const char *IrcStats::name(Counter counter)
+{
+    static const char *const names[CounterCount] = {
+        "bytes in", "bytes out", "lines parsed", "lines sent",
+        "events published", "events delivered", "batches delivered", "allocations",
+        "log records dropped", "lines legacy-decoded", "messages ignored",
+    };
+    return names[counter];
+}
+
+const char *IrcStats::name(Histogram histogram)
+{
+    static const char *const names[HistogramCount] = {
+        "parse ns", "dispatch ns", "delivery ns", "render ns", "paint ns", "display latency us",
+        "tls handshake us", "completion ns",
+    };
+    return names[histogram];
+}
+
+const char *IrcStats::name(Gauge gauge)
+{
+    static const char *const names[GaugeCount] = {
+        "event queue", "send queue", "pending render",
+    };
+    return names[gauge];
+}
@@ -0,0 +1,103 @@
+#include "IrcStringPool.h"
+#include "IrcLog.h"
+#include <QMutexLocker>
+
+IrcStringPool::IrcStringPool()
+    : m_count(1)
+    , m_legacy(IrcTextCodec::Windows1252)
+    , m_full(false)
+{
+    for (std::atomic<QString *> &chunk : m_chunks) {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+    // Slot 0 is NullId, the empty string
+    m_chunks[0].store(new QString[ChunkSize], std::memory_order_release);
+}
+
+IrcStringPool::~IrcStringPool()
+{
+    for (std::atomic<QString *> &chunk : m_chunks) {
+        delete[] chunk.load(std::memory_order_relaxed);
+    }
+}
+
+void IrcStringPool::setLegacyEncoding(IrcTextCodec::Legacy legacy)
+{
+    QMutexLocker locker(&m_mutex);
+    m_legacy = legacy;
+}
+
+IrcStringPool::Id IrcStringPool::intern(const char *data, int length)
+{
+    if (length <= 0) {
+        return NullId;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    ++m_stats.lookups;
+
+    // Look up without copying; only a new name allocates its key
+    const Id existing = m_ids.value(QByteArray::fromRawData(data, length), NullId);
+    if (existing != NullId) {
+        m_stats.requestedBytes += allocationSize(string(existing));
+        return existing;
+    }
+
+    const Id id = m_count.load(std::memory_order_relaxed);
+    const int chunkIndex = int(id >> ChunkBits);
+    if (chunkIndex >= MaxChunks) {
+        // Every name from here on becomes NullId and is routed nowhere
+        if (!m_full) {
+            m_full = true;
+            qCCritical(lcIrcSession) << "String pool is full at" << Capacity
+                                     << "names; new names are dropped until it is renewed";
+        }
+        return NullId;
+    }
+    QString *chunk = m_chunks[chunkIndex].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new QString[ChunkSize];
+        m_chunks[chunkIndex].store(chunk, std::memory_order_release);
+    }
+
+    QString &text = chunk[id & (ChunkSize - 1)];
+    text = IrcTextCodec::decode(data, length, m_legacy);
+    m_ids.insert(QByteArray(data, length), id);
+
+    // Publish the slot only once the string is in place
+    m_count.store(id + 1, std::memory_order_release);
+
+    const qint64 bytes = allocationSize(text);
+    ++m_stats.uniqueStrings;
+    m_stats.storedBytes += bytes;
+    m_stats.requestedBytes += bytes;
+    return id;
+}
+
+IrcStringPool::Id IrcStringPool::intern(const QString &text)
+{
+    const QByteArray bytes = text.toUtf8();
+    return intern(bytes.constData(), int(bytes.size()));
+}
+
+const QString &IrcStringPool::string(Id id) const
+{
+    static const QString empty;
+    if (id >= m_count.load(std::memory_order_acquire)) {
+        return empty;
+    }
+    const QString *chunk = m_chunks[id >> ChunkBits].load(std::memory_order_acquire);
+    return chunk[id & (ChunkSize - 1)];
+}
+
+IrcStringPool::Stats IrcStringPool::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+qint64 IrcStringPool::allocationSize(const QString &text)
+{
+    // UTF-16 payload plus terminator and the shared array header
+    return qint64(text.size() + 1) * 2 + 24;
+}
@@ -0,0 +1,266 @@
+#include "IrcTextCodec.h"
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IRC_TEXT_SSE2
+#endif
+
+// GCC and Clang can build an AVX2 variant without -mavx2 and pick it at run time
+#if defined(IRC_TEXT_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define IRC_TEXT_AVX2
+#endif
+
+namespace {
+
+int asciiPrefixScalar(const char *data, int length)
+{
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        quint64 word;
+        memcpy(&word, data + i, sizeof(word));
+        if (word & Q_UINT64_C(0x8080808080808080)) {
+            break;
+        }
+    }
+    while (i < length && uchar(data[i]) < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef IRC_TEXT_SSE2
+int asciiPrefixSse2(const char *data, int length)
+{
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const uint mask = uint(_mm_movemask_epi8(block));
+        if (mask) {
+            return i + int(qCountTrailingZeroBits(mask));
+        }
+    }
+    return i + asciiPrefixScalar(data + i, length - i);
+}
+#endif
+
+#ifdef IRC_TEXT_AVX2
+__attribute__((target("avx2")))
+int asciiPrefixAvx2(const char *data, int length)
+{
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const uint mask = uint(_mm256_movemask_epi8(block));
+        if (mask) {
+            return i + int(qCountTrailingZeroBits(mask));
+        }
+    }
+    return i + asciiPrefixSse2(data + i, length - i);
+}
+#endif
+
+typedef int (*AsciiScan)(const char *data, int length);
+
+AsciiScan pickAsciiScan()
+{
+#ifdef IRC_TEXT_AVX2
+    // Runs from a static constructor, possibly before libgcc's own
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return asciiPrefixAvx2;
+    }
+#endif
+#ifdef IRC_TEXT_SSE2
+    return asciiPrefixSse2;
+#else
+    return asciiPrefixScalar;
+#endif
+}
+
+AsciiScan s_asciiScan = pickAsciiScan();
+
+// Length of the well-formed sequence at a non-ASCII lead byte, 0 if there
+// is none: no stray continuation bytes, overlong forms, surrogates or code
+// points past U+10FFFF (RFC 3629)
+int sequenceLength(const uchar *p, const uchar *end)
+{
+    const uchar lead = p[0];
+    if (lead < 0xC2) {
+        return 0;
+    }
+    if (lead < 0xE0) {
+        return end - p >= 2 && (p[1] & 0xC0) == 0x80 ? 2 : 0;
+    }
+    if (lead < 0xF0) {
+        if (end - p < 3) {
+            return 0;
+        }
+        const uchar low = lead == 0xE0 ? 0xA0 : 0x80;
+        const uchar high = lead == 0xED ? 0x9F : 0xBF;
+        return p[1] >= low && p[1] <= high && (p[2] & 0xC0) == 0x80 ? 3 : 0;
+    }
+    if (lead < 0xF5) {
+        if (end - p < 4) {
+            return 0;
+        }
+        const uchar low = lead == 0xF0 ? 0x90 : 0x80;
+        const uchar high = lead == 0xF4 ? 0x8F : 0xBF;
+        return p[1] >= low && p[1] <= high && (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80 ? 4 : 0;
+    }
+    return 0;
+}
+
+// Windows-1252 0x80-0x9F; the five unassigned bytes map to the C1 controls
+const ushort s_cp1252High[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+};
+
+} // namespace
+
+int IrcTextCodec::asciiPrefixLength(const char *data, int length)
+{
+    return s_asciiScan(data, length);
+}
+
+bool IrcTextCodec::isValidUtf8(const char *data, int length)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    const uchar *end = bytes + length;
+    int i = 0;
+    while (i < length) {
+        i += s_asciiScan(data + i, length - i);
+        // A run of multi-byte characters, say a word of Cyrillic, is
+        // checked here without going back to the vector scan in between
+        while (i < length && bytes[i] >= 0x80) {
+            const int sequence = sequenceLength(bytes + i, end);
+            if (sequence == 0) {
+                return false;
+            }
+            i += sequence;
+        }
+    }
+    return true;
+}
+
+IrcTextCodec::Encoding IrcTextCodec::classify(const char *data, int length)
+{
+    const int ascii = s_asciiScan(data, length);
+    if (ascii == length) {
+        return Ascii;
+    }
+    return isValidUtf8(data + ascii, length - ascii) ? Utf8 : Invalid;
+}
+
+QString IrcTextCodec::decode(const char *data, int length, Legacy legacy)
+{
+    if (length <= 0) {
+        return QString();
+    }
+    return decode(data, length, classify(data, length), legacy);
+}
+
+QString IrcTextCodec::decode(const char *data, int length, Encoding encoding, Legacy legacy)
+{
+    switch (encoding) {
+        case Ascii:
+            // Widening only; Latin-1 and UTF-8 agree on ASCII
+            return QString::fromLatin1(data, length);
+        case Utf8:
+            return QString::fromUtf8(data, length);
+        case Invalid:
+            return fromLegacy(data, length, legacy);
+        case Unknown:
+            break;
+    }
+    return decode(data, length, legacy);
+}
+
+QString IrcTextCodec::fromLegacy(const char *data, int length, Legacy legacy)
+{
+    switch (legacy) {
+        case Latin1:
+            return QString::fromLatin1(data, length);
+        case Utf8Replace:
+            return QString::fromUtf8(data, length);
+        case Windows1252:
+            break;
+    }
+
+    QString text(length, Qt::Uninitialized);
+    QChar *out = text.data();
+    for (int i = 0; i < length; ++i) {
+        const uchar byte = uchar(data[i]);
+        out[i] = QChar(byte >= 0x80 && byte < 0xA0 ? s_cp1252High[byte - 0x80] : ushort(byte));
+    }
+    return text;
+}
+
+bool IrcTextCodec::parseLegacy(const QString &name, Legacy *legacy)
+{
+    const QString key = name.toLower().remove('-').remove('_');
+    if (key == "cp1252" || key == "windows1252") {
+        *legacy = Windows1252;
+    } else if (key == "latin1" || key == "iso88591") {
+        *legacy = Latin1;
+    } else if (key == "utf8") {
+        *legacy = Utf8Replace;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+QString IrcTextCodec::legacyName(Legacy legacy)
+{
+    switch (legacy) {
+        case Windows1252:
+            return "cp1252";
+        case Latin1:
+            return "latin1";
+        case Utf8Replace:
+            return "utf8";
+    }
+    return QString();
+}
+
+const char *IrcTextCodec::implementation()
+{
+#ifdef IRC_TEXT_AVX2
+    if (s_asciiScan == asciiPrefixAvx2) {
+        return "avx2";
+    }
+#endif
+#ifdef IRC_TEXT_SSE2
+    if (s_asciiScan == asciiPrefixSse2) {
+        return "sse2";
+    }
+#endif
+    return "scalar";
+}
+
+bool IrcTextCodec::setImplementation(const char *name)
+{
+    if (qstrcmp(name, "scalar") == 0) {
+        s_asciiScan = asciiPrefixScalar;
+        return true;
+    }
+#ifdef IRC_TEXT_SSE2
+    if (qstrcmp(name, "sse2") == 0) {
+        s_asciiScan = asciiPrefixSse2;
+        return true;
+    }
+#endif
+#ifdef IRC_TEXT_AVX2
+    if (qstrcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        s_asciiScan = asciiPrefixAvx2;
+        return true;
+    }
+#endif
+    return false;
+}
@@ -0,0 +1,255 @@
+#include "IrcTls.h"
+#include "IrcLog.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QSslCertificate>
+#include <QSslKey>
+#include <QStandardPaths>
+
+namespace {
+
+struct Ticket
+{
+    QByteArray data;
+    qint64 expiresMs = 0;
+};
+
+// Servers that give no lifetime hint get this one
+const int DefaultTicketLifetimeSeconds = 3600;
+
+QMutex s_mutex;
+QHash<QString, Ticket> s_tickets;
+QHash<QString, QByteArray> s_pins;
+bool s_pinsLoaded = false;
+bool s_pinFileSet = false;
+QString s_pinFile;
+IrcTlsOptions s_defaultOptions;
+
+// With s_mutex held
+QString pinFile()
+{
+    if (!s_pinFileSet) {
+        s_pinFile = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/tls-pins";
+        s_pinFileSet = true;
+    }
+    return s_pinFile;
+}
+
+// With s_mutex held. One "server sha256-hex" pair per line.
+void loadPins()
+{
+    if (s_pinsLoaded) {
+        return;
+    }
+    s_pinsLoaded = true;
+
+    QFile file(pinFile());
+    if (pinFile().isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    while (!file.atEnd()) {
+        const QList<QByteArray> fields = file.readLine().trimmed().split(' ');
+        if (fields.size() == 2) {
+            s_pins.insert(QString::fromUtf8(fields.at(0)), QByteArray::fromHex(fields.at(1)));
+        }
+    }
+}
+
+// With s_mutex held
+void savePins()
+{
+    const QString path = pinFile();
+    if (path.isEmpty()) {
+        return;
+    }
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcIrcSession) << "Cannot write" << path << ":" << file.errorString();
+        return;
+    }
+    for (auto it = s_pins.constBegin(); it != s_pins.constEnd(); ++it) {
+        file.write(it.key().toUtf8() + ' ' + it.value().toHex() + '\n');
+    }
+    if (!file.commit()) {
+        qCWarning(lcIrcSession) << "Cannot write" << path << ":" << file.errorString();
+    }
+}
+
+} // namespace
+
+IrcServerAddress IrcServerAddress::parse(const QString &text)
+{
+    IrcServerAddress address;
+    QString rest = text.trimmed();
+    bool schemeGiven = true;
+    if (rest.startsWith("ircs://", Qt::CaseInsensitive)) {
+        rest = rest.mid(7);
+    } else if (rest.startsWith("irc://", Qt::CaseInsensitive)) {
+        rest = rest.mid(6);
+        address.tls = false;
+        address.port = 6667;
+    } else {
+        schemeGiven = false;
+    }
+    rest = rest.section('/', 0, 0);
+
+    // host, host:port, [v6]:port; a bare v6 address has no port
+    QString port;
+    if (rest.startsWith('[') && rest.contains(']')) {
+        const int close = rest.indexOf(']');
+        address.host = rest.mid(1, close - 1);
+        if (rest.mid(close + 1).startsWith(':')) {
+            port = rest.mid(close + 2);
+        }
+    } else if (rest.count(':') == 1) {
+        address.host = rest.section(':', 0, 0);
+        port = rest.section(':', 1);
+    } else {
+        address.host = rest;
+    }
+
+    if (!port.isEmpty()) {
+        // "+port" is the usual way to ask for TLS; a plain port means no TLS
+        // unless the scheme said otherwise
+        if (port.startsWith('+')) {
+            address.tls = true;
+            port = port.mid(1);
+        } else if (!schemeGiven) {
+            address.tls = false;
+        }
+        const uint number = port.toUInt();
+        if (number > 0 && number <= 65535) {
+            address.port = quint16(number);
+        } else if (!address.tls) {
+            address.port = 6667;
+        }
+    }
+    return address;
+}
+
+QList<IrcServerAddress> IrcServerAddress::parseList(const QString &text)
+{
+    QList<IrcServerAddress> addresses;
+    const QStringList entries = text.split(QRegularExpression("[,\\s]+"), Qt::SkipEmptyParts);
+    for (const QString &entry : entries) {
+        const IrcServerAddress address = parse(entry);
+        if (!address.host.isEmpty()) {
+            addresses.append(address);
+        }
+    }
+    return addresses;
+}
+
+QSslConfiguration IrcTls::configuration(const IrcTlsOptions &options, QString *error)
+{
+    QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+    // Keeps the session ticket readable after the handshake, for reuse
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+
+    if (!options.caFile.isEmpty()) {
+        const QList<QSslCertificate> authorities = QSslCertificate::fromPath(options.caFile);
+        if (authorities.isEmpty()) {
+            *error = QString("No CA certificates in %1").arg(options.caFile);
+            return config;
+        }
+        config.addCaCertificates(authorities);
+    }
+
+    if (options.hasClientCertificate()) {
+        const QList<QSslCertificate> certificates = QSslCertificate::fromPath(options.certificateFile);
+        if (certificates.isEmpty()) {
+            *error = QString("No certificate in %1").arg(options.certificateFile);
+            return config;
+        }
+        QFile keyFile(options.keyFile.isEmpty() ? options.certificateFile : options.keyFile);
+        if (!keyFile.open(QIODevice::ReadOnly)) {
+            *error = QString("Cannot read %1: %2").arg(keyFile.fileName(), keyFile.errorString());
+            return config;
+        }
+        const QByteArray pem = keyFile.readAll();
+        QSslKey key(pem, QSsl::Rsa);
+        if (key.isNull()) {
+            key = QSslKey(pem, QSsl::Ec);
+        }
+        if (key.isNull()) {
+            *error = QString("No RSA or EC private key in %1").arg(keyFile.fileName());
+            return config;
+        }
+        config.setLocalCertificate(certificates.first());
+        config.setPrivateKey(key);
+    }
+    return config;
+}
+
+QByteArray IrcTls::sessionTicket(const QString &server)
+{
+    QMutexLocker locker(&s_mutex);
+    const auto it = s_tickets.find(server);
+    if (it == s_tickets.end()) {
+        return QByteArray();
+    }
+    if (it->expiresMs <= QDateTime::currentMSecsSinceEpoch()) {
+        s_tickets.erase(it);
+        return QByteArray();
+    }
+    return it->data;
+}
+
+void IrcTls::storeSessionTicket(const QString &server, const QByteArray &ticket, int lifetimeHintSeconds)
+{
+    const int lifetime = lifetimeHintSeconds > 0 ? lifetimeHintSeconds : DefaultTicketLifetimeSeconds;
+    Ticket entry;
+    entry.data = ticket;
+    entry.expiresMs = QDateTime::currentMSecsSinceEpoch() + qint64(lifetime) * 1000;
+
+    QMutexLocker locker(&s_mutex);
+    s_tickets.insert(server, entry);
+}
+
+void IrcTls::setPinFile(const QString &path)
+{
+    QMutexLocker locker(&s_mutex);
+    s_pinFile = path;
+    s_pinFileSet = true;
+    s_pinsLoaded = false;
+    s_pins.clear();
+}
+
+QByteArray IrcTls::pinnedFingerprint(const QString &server)
+{
+    QMutexLocker locker(&s_mutex);
+    loadPins();
+    return s_pins.value(server);
+}
+
+void IrcTls::pin(const QString &server, const QByteArray &fingerprint)
+{
+    QMutexLocker locker(&s_mutex);
+    loadPins();
+    if (s_pins.value(server) == fingerprint) {
+        return;
+    }
+    s_pins.insert(server, fingerprint);
+    savePins();
+}
+
+void IrcTls::setDefaultOptions(const IrcTlsOptions &options)
+{
+    QMutexLocker locker(&s_mutex);
+    s_defaultOptions = options;
+}
+
+IrcTlsOptions IrcTls::defaultOptions()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_defaultOptions;
+}
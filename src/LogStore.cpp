@@ -0,0 +1,642 @@
+#include "LogStore.h"
+#include "IrcLog.h"
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <algorithm>
+
+static const int HeaderSize = 18;
+static const int RecordOverhead = HeaderSize + 4;
+static const int IndexEntrySize = 16;
+static const int FlushBytes = 64 * 1024;
+static const int FlushIntervalMs = 1000;
+static const int MaxMappedSegments = 8;
+static const int MaxOpenSearchIndexes = 8;
+
+namespace {
+
+// The fields of one record, pointing into the segment
+struct RecordView
+{
+    qint64 timestamp;
+    quint8 kind;
+    const char *buffer;
+    int bufferLength;
+    const char *sender;
+    int senderLength;
+    const char *text;
+    int textLength;
+};
+
+bool viewRecord(const uchar *record, quint32 size, RecordView *view)
+{
+    if (size < quint32(RecordOverhead)) {
+        return false;
+    }
+    view->timestamp = qFromLittleEndian<qint64>(record + 4);
+    view->kind = record[12];
+    view->bufferLength = qFromLittleEndian<quint16>(record + 14);
+    view->senderLength = qFromLittleEndian<quint16>(record + 16);
+    view->textLength = int(size) - RecordOverhead - view->bufferLength - view->senderLength;
+    if (view->textLength < 0) {
+        return false;
+    }
+    view->buffer = reinterpret_cast<const char *>(record) + HeaderSize;
+    view->sender = view->buffer + view->bufferLength;
+    view->text = view->sender + view->senderLength;
+    return true;
+}
+
+MessageLogModel::Entry toEntry(const RecordView &view)
+{
+    MessageLogModel::Entry line;
+    line.timestamp = view.timestamp;
+    line.kind = view.kind == MessageLogModel::System ? MessageLogModel::System : MessageLogModel::Message;
+    line.sender = QString::fromUtf8(view.sender, view.senderLength);
+    line.text = QString::fromUtf8(view.text, view.textLength);
+    return line;
+}
+
+// Bytes of whole records at the start of a segment; a crash can leave a
+// partial one at the end
+qint64 validLength(const uchar *data, qint64 size)
+{
+    qint64 end = 0;
+    while (end + RecordOverhead <= size) {
+        const quint32 length = qFromLittleEndian<quint32>(data + end);
+        if (length < quint32(RecordOverhead) || end + length > size
+            || qFromLittleEndian<quint32>(data + end + length - 4) != length) {
+            break;
+        }
+        end += length;
+    }
+    return end;
+}
+
+} // namespace
+
+LogStore::LogStore(const QString &directory, QObject *parent)
+    : QObject(parent)
+    , m_dir(directory)
+    , m_lock(nullptr)
+    , m_open(false)
+    , m_flushTimer(new QTimer(this))
+    , m_synced(true)
+    , m_writer(new LogStoreWriter)
+    , m_indexer(new LogStoreWriter)
+{
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(FlushIntervalMs);
+    connect(m_flushTimer, &QTimer::timeout, this, &LogStore::flush);
+
+    m_writer->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_writer, &QObject::deleteLater);
+    m_thread.setObjectName("LogStore");
+    m_thread.start();
+    m_indexer->moveToThread(&m_indexThread);
+    connect(&m_indexThread, &QThread::finished, m_indexer, &QObject::deleteLater);
+    m_indexThread.setObjectName("LogStore indexer");
+    m_indexThread.start(QThread::LowPriority);
+
+    if (!m_dir.mkpath(".")) {
+        qCWarning(lcIrcSession) << "Cannot create log directory" << directory;
+        return;
+    }
+    // Held for as long as we run; only a dead owner makes it stale
+    m_lock = new QLockFile(m_dir.filePath("lock"));
+    m_lock->setStaleLockTime(0);
+    if (!m_lock->tryLock(0)) {
+        qCWarning(lcIrcSession) << "Chat log" << directory << "is in use by another instance; not logging";
+        return;
+    }
+    m_open = true;
+    openSegments();
+
+    // Segments from before search existed, or from a run that crashed
+    LogStoreWriter *indexer = m_indexer;
+    for (const Segment &segment : qAsConst(m_segments)) {
+        const QString searchPath = segmentPath(segment.number, "fts");
+        if (!QFileInfo::exists(searchPath)) {
+            const QString path = segmentPath(segment.number, "seg");
+            QMetaObject::invokeMethod(indexer, [=]() {
+                indexer->buildSearchIndex(path, searchPath);
+            }, Qt::QueuedConnection);
+        }
+    }
+    startSegment();
+}
+
+LogStore::~LogStore()
+{
+    m_indexThread.requestInterruption();
+    m_indexThread.quit();
+    m_indexThread.wait();
+
+    if (m_open) {
+        sealSegment();
+    }
+    LogStoreWriter *writer = m_writer;
+    QMetaObject::invokeMethod(writer, [writer]() { writer->close(); }, Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+
+    for (int segment = 0; segment < m_segments.size(); ++segment) {
+        unmapSegment(segment);
+        closeSearchIndex(segment);
+    }
+    delete m_lock;
+}
+
+QString LogStore::defaultDirectory(const QString &network)
+{
+    QString name = network.toLower();
+    for (QChar &c : name) {
+        if (!c.isLetterOrNumber() && c != '.' && c != '-') {
+            c = '_';
+        }
+    }
+    const QDir base(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    return base.filePath("logs/" + name);
+}
+
+// FNV-1a over the ASCII-lowercased name, stable across runs and Qt versions
+quint32 LogStore::bufferHash(const char *name, int length)
+{
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < length; ++i) {
+        char c = name[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = char(c - 'A' + 'a');
+        }
+        hash = (hash ^ quint8(c)) * 16777619u;
+    }
+    return hash;
+}
+
+// Whether a record at offset needs an index entry; records it if so
+bool LogStore::indexRecord(Segment &segment, qint64 timestamp, quint32 offset, quint32 hash)
+{
+    if (qint64(offset) - segment.lastIndexOffset < IndexInterval && segment.buffers.contains(hash)) {
+        return false;
+    }
+    segment.index.append({ timestamp, offset, hash });
+    segment.buffers.insert(hash);
+    segment.lastIndexOffset = offset;
+    return true;
+}
+
+QString LogStore::segmentPath(int number, const char *suffix) const
+{
+    return m_dir.filePath(QString("%1.%2").arg(number, 8, 10, QChar('0')).arg(suffix));
+}
+
+void LogStore::openSegments()
+{
+    const QStringList names = m_dir.entryList(QStringList() << "*.seg", QDir::Files, QDir::Name);
+    for (const QString &name : names) {
+        bool ok;
+        const int number = name.left(name.size() - 4).toInt(&ok);
+        if (!ok) {
+            continue;
+        }
+        Segment segment;
+        segment.number = number;
+        segment.size = QFileInfo(m_dir.filePath(name)).size();
+        m_segments.append(segment);
+    }
+}
+
+// Every run appends to a fresh segment, so an existing one is never
+// written to again
+void LogStore::startSegment()
+{
+    Segment segment;
+    segment.number = m_segments.isEmpty() ? 1 : m_segments.last().number + 1;
+    segment.indexLoaded = true;
+    m_segments.append(segment);
+}
+
+// Writes out the segment being appended to, with its search index
+void LogStore::sealSegment()
+{
+    flush();
+    if (m_liveSearch.isEmpty()) {
+        return;
+    }
+
+    LogStoreWriter *writer = m_writer;
+    const QString path = segmentPath(m_segments.last().number, "fts");
+    const SearchIndex search = m_liveSearch;
+    QMetaObject::invokeMethod(writer, [=]() {
+        writer->writeSearchIndex(path, search);
+    }, Qt::QueuedConnection);
+    m_liveSearch = SearchIndex();
+    m_synced = false;
+}
+
+void LogStore::append(const QString &buffer, const QVector<MessageLogModel::Entry> &entries)
+{
+    if (!m_open || entries.isEmpty()) {
+        return;
+    }
+
+    const QByteArray name = buffer.toUtf8().left(0xffff);
+    const quint32 hash = bufferHash(name.constData(), int(name.size()));
+    for (const MessageLogModel::Entry &entry : entries) {
+        const QByteArray sender = entry.sender.toUtf8().left(0xffff);
+        const QByteArray text = entry.text.toUtf8();
+        const qint64 size = RecordOverhead + name.size() + sender.size() + text.size();
+        if (m_segments.last().size > 0 && m_segments.last().size + size > SegmentSize) {
+            sealSegment();
+            startSegment();
+        }
+
+        Segment &segment = m_segments.last();
+        const quint32 offset = quint32(segment.size);
+        if (indexRecord(segment, entry.timestamp, offset, hash)) {
+            char index[IndexEntrySize];
+            qToLittleEndian<qint64>(entry.timestamp, index);
+            qToLittleEndian<quint32>(offset, index + 8);
+            qToLittleEndian<quint32>(hash, index + 12);
+            m_pendingIndex.append(index, IndexEntrySize);
+        }
+
+        char header[HeaderSize];
+        qToLittleEndian<quint32>(quint32(size), header);
+        qToLittleEndian<qint64>(entry.timestamp, header + 4);
+        header[12] = char(entry.kind);
+        header[13] = 0;
+        qToLittleEndian<quint16>(quint16(name.size()), header + 14);
+        qToLittleEndian<quint16>(quint16(sender.size()), header + 16);
+        m_pendingRecords.append(header, HeaderSize);
+        m_pendingRecords.append(name);
+        m_pendingRecords.append(sender);
+        m_pendingRecords.append(text);
+        m_pendingRecords.append(header, 4);
+        segment.size += size;
+
+        if (entry.kind == MessageLogModel::Message) {
+            m_liveSearch.add(offset, SearchIndex::terms(buffer, entry.sender, entry.text));
+        }
+    }
+
+    if (m_pendingRecords.size() >= FlushBytes) {
+        flush();
+    } else if (!m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+}
+
+void LogStore::flush()
+{
+    m_flushTimer->stop();
+    if (m_pendingRecords.isEmpty()) {
+        return;
+    }
+
+    LogStoreWriter *writer = m_writer;
+    const int number = m_segments.last().number;
+    const QString segment = segmentPath(number, "seg");
+    const QString index = segmentPath(number, "idx");
+    const QByteArray records = m_pendingRecords;
+    const QByteArray entries = m_pendingIndex;
+    QMetaObject::invokeMethod(writer, [=]() {
+        writer->write(segment, index, records, entries);
+    }, Qt::QueuedConnection);
+
+    m_pendingRecords.clear();
+    m_pendingIndex.clear();
+    m_synced = false;
+}
+
+// Waits until everything flushed is on disk and can be mapped
+void LogStore::sync()
+{
+    flush();
+    if (!m_synced) {
+        QMetaObject::invokeMethod(m_writer, []() {}, Qt::BlockingQueuedConnection);
+        m_synced = true;
+    }
+}
+
+// Loads the index of a segment from an earlier run, checking its tail
+bool LogStore::loadSegment(int number)
+{
+    Segment &segment = m_segments[number];
+    if (segment.indexLoaded) {
+        return true;
+    }
+    segment.indexLoaded = true;
+    if (segment.size < RecordOverhead) {
+        segment.size = 0;
+        return false;
+    }
+    const uchar *data = mapSegment(number, segment.size);
+    if (!data) {
+        return false;
+    }
+
+    // After a crash, cut back to the last whole record and rebuild the
+    // index from the records themselves
+    bool rebuild = false;
+    const quint32 tail = qFromLittleEndian<quint32>(data + segment.size - 4);
+    if (tail < quint32(RecordOverhead) || tail > segment.size
+        || qFromLittleEndian<quint32>(data + segment.size - tail) != tail) {
+        segment.size = validLength(data, segment.size);
+        rebuild = true;
+    }
+
+    QFile index(segmentPath(segment.number, "idx"));
+    if (!rebuild && index.open(QIODevice::ReadOnly)) {
+        const QByteArray bytes = index.readAll();
+        const uchar *entry = reinterpret_cast<const uchar *>(bytes.constData());
+        for (int i = 0; i + IndexEntrySize <= bytes.size(); i += IndexEntrySize, entry += IndexEntrySize) {
+            const IndexEntry indexEntry = {
+                qFromLittleEndian<qint64>(entry),
+                qFromLittleEndian<quint32>(entry + 8),
+                qFromLittleEndian<quint32>(entry + 12),
+            };
+            if (indexEntry.offset < segment.size) {
+                segment.index.append(indexEntry);
+                segment.buffers.insert(indexEntry.bufferHash);
+            }
+        }
+    } else {
+        RecordView view;
+        for (qint64 offset = 0; offset < segment.size;) {
+            const quint32 size = qFromLittleEndian<quint32>(data + offset);
+            if (viewRecord(data + offset, size, &view)) {
+                indexRecord(segment, view.timestamp, quint32(offset), bufferHash(view.buffer, view.bufferLength));
+            }
+            offset += size;
+        }
+    }
+    return true;
+}
+
+const uchar *LogStore::mapSegment(int number, qint64 size)
+{
+    Segment &segment = m_segments[number];
+    if (segment.map && segment.mappedSize >= size) {
+        m_mapped.removeOne(number);
+        m_mapped.append(number);
+        return segment.map;
+    }
+
+    unmapSegment(number);
+    segment.file = new QFile(segmentPath(segment.number, "seg"));
+    if (!segment.file->open(QIODevice::ReadOnly) || !(segment.map = segment.file->map(0, size))) {
+        qCWarning(lcIrcSession) << "Cannot map" << segment.file->fileName() << ":" << segment.file->errorString();
+        delete segment.file;
+        segment.file = nullptr;
+        return nullptr;
+    }
+    segment.mappedSize = size;
+
+    m_mapped.append(number);
+    while (m_mapped.size() > MaxMappedSegments) {
+        unmapSegment(m_mapped.first());
+    }
+    return segment.map;
+}
+
+void LogStore::unmapSegment(int number)
+{
+    Segment &segment = m_segments[number];
+    if (segment.file) {
+        segment.file->unmap(const_cast<uchar *>(segment.map));
+        delete segment.file;
+        segment.file = nullptr;
+        segment.map = nullptr;
+        segment.mappedSize = 0;
+        m_mapped.removeOne(number);
+    }
+}
+
+// Like the segments, at most MaxOpenSearchIndexes stay open, so searching
+// months of history does not keep a file and a mapping per segment
+SearchIndexFile *LogStore::openSearchIndex(int number)
+{
+    Segment &segment = m_segments[number];
+    if (segment.search) {
+        m_searchOpen.removeOne(number);
+        m_searchOpen.append(number);
+        return segment.search;
+    }
+
+    segment.search = new SearchIndexFile;
+    if (!segment.search->open(segmentPath(segment.number, "fts"))) {
+        delete segment.search;
+        segment.search = nullptr;
+        return nullptr;
+    }
+    m_searchOpen.append(number);
+    while (m_searchOpen.size() > MaxOpenSearchIndexes) {
+        closeSearchIndex(m_searchOpen.first());
+    }
+    return segment.search;
+}
+
+void LogStore::closeSearchIndex(int number)
+{
+    Segment &segment = m_segments[number];
+    if (segment.search) {
+        delete segment.search;
+        segment.search = nullptr;
+        m_searchOpen.removeOne(number);
+    }
+}
+
+QVector<MessageLogModel::Entry> LogStore::readBefore(const QString &buffer, Cursor *cursor, int count, int skip)
+{
+    QVector<MessageLogModel::Entry> lines;  // newest first until the end
+    if (!m_open || count <= 0) {
+        return lines;
+    }
+    sync();
+
+    // The segment the cursor is in, or the live one
+    int first = m_segments.size() - 1;
+    if (!cursor->isNull()) {
+        while (first >= 0 && m_segments.at(first).number > cursor->segment) {
+            --first;
+        }
+        if (first < 0 || m_segments.at(first).number != cursor->segment) {
+            return lines;
+        }
+    }
+
+    const QByteArray name = buffer.toUtf8().left(0xffff);
+    const quint32 hash = bufferHash(name.constData(), int(name.size()));
+    for (int number = first; number >= 0 && lines.size() < count; --number) {
+        if (!loadSegment(number)) {
+            continue;
+        }
+        const Segment &segment = m_segments.at(number);
+        if (!segment.buffers.contains(hash)) {
+            continue;
+        }
+
+        qint64 end = number == first && !cursor->isNull() ? qMin(cursor->offset, segment.size) : segment.size;
+        const uchar *data = mapSegment(number, segment.size);
+        if (!data) {
+            continue;
+        }
+        RecordView view;
+        while (end > 0 && lines.size() < count) {
+            const quint32 size = qFromLittleEndian<quint32>(data + end - 4);
+            if (size < quint32(RecordOverhead) || size > end) {
+                break;
+            }
+            end -= size;
+            if (viewRecord(data + end, size, &view) && view.bufferLength == name.size()
+                && qstrnicmp(view.buffer, name.constData(), size_t(view.bufferLength)) == 0) {
+                if (skip > 0) {
+                    --skip;
+                } else {
+                    lines.append(toEntry(view));
+                }
+                *cursor = { segment.number, end };
+            }
+        }
+    }
+
+    std::reverse(lines.begin(), lines.end());
+    return lines;
+}
+
+LogStore::SearchResults LogStore::search(const SearchQuery &query, int limit)
+{
+    SearchResults results;
+    if (!m_open || query.isEmpty() || limit <= 0) {
+        return results;
+    }
+    sync();
+
+    // Segments are in time order, so the time bounds cut whole segments
+    qint64 newerStart = 0;
+    for (int number = m_segments.size() - 1; number >= 0 && results.hits.size() < limit; --number) {
+        if (query.after > 0 && newerStart > 0 && newerStart <= query.after) {
+            break;
+        }
+        if (!loadSegment(number) || m_segments.at(number).index.isEmpty()) {
+            continue;
+        }
+        Segment &segment = m_segments[number];
+        newerStart = segment.index.first().timestamp;
+        if (query.before > 0 && newerStart >= query.before) {
+            continue;
+        }
+
+        const bool live = number == m_segments.size() - 1;
+        const SearchIndexFile *searchIndex = live ? nullptr : openSearchIndex(number);
+        if (!live && !searchIndex) {
+            ++results.pendingSegments;
+            continue;
+        }
+        QVector<QVector<quint32>> lists;
+        for (const QByteArray &term : query.terms) {
+            lists.append(live ? m_liveSearch.postings(term) : searchIndex->postings(term));
+        }
+        const QVector<quint32> offsets = SearchIndex::intersect(lists);
+        if (offsets.isEmpty()) {
+            continue;
+        }
+
+        const uchar *data = mapSegment(number, segment.size);
+        if (!data) {
+            continue;
+        }
+        RecordView view;
+        for (int i = int(offsets.size()) - 1; i >= 0 && results.hits.size() < limit; --i) {
+            const qint64 offset = offsets.at(i);
+            if (offset + RecordOverhead > segment.size) {
+                continue;
+            }
+            const quint32 size = qFromLittleEndian<quint32>(data + offset);
+            if (offset + size > segment.size || !viewRecord(data + offset, size, &view)
+                || (query.after > 0 && view.timestamp < query.after)
+                || (query.before > 0 && view.timestamp >= query.before)) {
+                continue;
+            }
+            SearchHit hit;
+            hit.buffer = QString::fromUtf8(view.buffer, view.bufferLength);
+            hit.line = toEntry(view);
+            results.hits.append(hit);
+        }
+    }
+    return results;
+}
+
+void LogStoreWriter::write(const QString &segmentPath, const QString &indexPath,
+                           const QByteArray &records, const QByteArray &index)
+{
+    if (m_segment.fileName() != segmentPath) {
+        close();
+        m_segment.setFileName(segmentPath);
+        m_index.setFileName(indexPath);
+        if (!m_segment.open(QIODevice::WriteOnly | QIODevice::Append)
+            || !m_index.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qCWarning(lcIrcSession) << "Cannot write chat log" << segmentPath << ":" << m_segment.errorString();
+            close();
+            return;
+        }
+    }
+    if (!m_segment.isOpen()) {
+        return;
+    }
+
+    // Records first: an index entry never points past what is on disk
+    m_segment.write(records);
+    m_segment.flush();
+    m_index.write(index);
+    m_index.flush();
+}
+
+void LogStoreWriter::close()
+{
+    m_segment.close();
+    m_index.close();
+}
+
+void LogStoreWriter::writeSearchIndex(const QString &path, const SearchIndex &search)
+{
+    // Searches only ever see a complete file
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcIrcSession) << "Cannot write search index" << path << ":" << file.errorString();
+        return;
+    }
+    file.write(search.serialize());
+    file.commit();
+}
+
+void LogStoreWriter::buildSearchIndex(const QString &segmentPath, const QString &searchPath)
+{
+    QFile segment(segmentPath);
+    if (!segment.open(QIODevice::ReadOnly) || segment.size() < RecordOverhead) {
+        return;
+    }
+    const uchar *data = segment.map(0, segment.size());
+    if (!data) {
+        return;
+    }
+
+    SearchIndex search;
+    RecordView view;
+    const qint64 size = validLength(data, segment.size());
+    for (qint64 offset = 0; offset < size;) {
+        if (QThread::currentThread()->isInterruptionRequested()) {
+            return;
+        }
+        const quint32 length = qFromLittleEndian<quint32>(data + offset);
+        if (viewRecord(data + offset, length, &view) && view.kind == MessageLogModel::Message) {
+            const QString buffer = QString::fromUtf8(view.buffer, view.bufferLength);
+            const QString sender = QString::fromUtf8(view.sender, view.senderLength);
+            search.add(quint32(offset), SearchIndex::terms(buffer, sender, QString::fromUtf8(view.text, view.textLength)));
+        }
+        offset += length;
+    }
+    writeSearchIndex(searchPath, search);
+}
@@ -1,42 +1,53 @@
 #include "MainWindow.h"
+#include "IrcLog.h"
 #include <QInputDialog>
 #include <QMessageBox>
+#include <QSplitter>
 #include <QStatusBar>
 #include <QApplication>
+#include <QElapsedTimer>
+
+namespace {
+
+// How often the session snapshot is written besides on exit
+const int SnapshotIntervalMs = 60 * 1000;
+
+} // namespace
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
-    , m_ircConnection(new IrcConnection(this))
-    , m_serverWidget(nullptr)
+    , m_statsDock(nullptr)
+    , m_searchDialog(nullptr)
+    , m_filterRules(IrcFilterRules::load())
+    , m_snapshotTimer(new QTimer(this))
+    , m_core(nullptr)
 {
     setupUi();
     setupMenuBar();
     
-    // Connect IRC signals
-    connect(m_ircConnection, &IrcConnection::connected, 
-            this, &MainWindow::onConnected);
-    connect(m_ircConnection, &IrcConnection::disconnected, 
-            this, &MainWindow::onDisconnected);
-    connect(m_ircConnection, &IrcConnection::connectionError, 
-            this, &MainWindow::onConnectionError);
-    connect(m_ircConnection, &IrcConnection::messageReceived, 
-            this, &MainWindow::onMessageReceived);
-    connect(m_ircConnection, &IrcConnection::joinedChannel, 
-            this, &MainWindow::onJoinedChannel);
-    connect(m_ircConnection, &IrcConnection::partedChannel, 
-            this, &MainWindow::onPartedChannel);
-    connect(m_ircConnection, &IrcConnection::userListReceived, 
-            this, &MainWindow::onUserListReceived);
-    connect(m_ircConnection, &IrcConnection::topicReceived, 
-            this, &MainWindow::onTopicReceived);
-    connect(m_ircConnection, &IrcConnection::serverMessageReceived, 
-            this, &MainWindow::onServerMessageReceived);
-    
+    updateActions();
     updateWindowTitle();
+    
+    connect(m_snapshotTimer, &QTimer::timeout, this, &MainWindow::onSnapshotTimeout);
+    m_snapshotTimer->start(SnapshotIntervalMs);
 }
 
 MainWindow::~MainWindow()
 {
+    m_snapshotTimer->stop();
+    if (m_snapshotWriter) {
+        m_snapshotWriter->wait();
+    }
+    // The core keeps its networks; the snapshot stays the one of the
+    // last session without it
+    if (!m_core) {
+        SessionSnapshot::write(SessionSnapshot::defaultPath(), sessionSnapshot().serialize());
+    }
+    
+    // Before the widgets go: each network flushes its buffers into its log
+    while (!m_networks.isEmpty()) {
+        closeNetwork(m_networks.last());
+    }
 }
 
 void MainWindow::setupUi()
@@ -44,21 +55,29 @@ void MainWindow::setupUi()
     setWindowTitle(tr("IRC Client"));
     resize(900, 600);
     
-    // Central widget with tab widget
-    m_tabWidget = new QTabWidget(this);
-    m_tabWidget->setTabsClosable(true);
-    m_tabWidget->setMovable(true);
+    // Networks and their channels on the left, the selected buffer on the right
+    m_bufferTree = new QTreeWidget;
+    m_bufferTree->setHeaderHidden(true);
+    m_bufferTree->setColumnCount(1);
+    m_bufferStack = new QStackedWidget;
     
-    connect(m_tabWidget, &QTabWidget::tabCloseRequested, 
-            this, &MainWindow::onTabCloseRequested);
+    connect(m_bufferTree, &QTreeWidget::currentItemChanged,
+            this, &MainWindow::onCurrentItemChanged);
     
-    setCentralWidget(m_tabWidget);
+    QSplitter *splitter = new QSplitter(Qt::Horizontal, this);
+    splitter->addWidget(m_bufferTree);
+    splitter->addWidget(m_bufferStack);
+    splitter->setStretchFactor(1, 1);
+    splitter->setSizes({180, 720});
+    setCentralWidget(splitter);
     
     // Status bar
     statusBar()->showMessage(tr("Not connected"));
     
-    // Create server tab
-    createServerTab();
+    // Statistics, hidden until asked for
+    m_statsDock = new StatsDock(this);
+    addDockWidget(Qt::RightDockWidgetArea, m_statsDock);
+    m_statsDock->hide();
 }
 
 void MainWindow::setupMenuBar()
@@ -72,9 +91,11 @@ void MainWindow::setupMenuBar()
     connect(m_connectAction, &QAction::triggered, this, &MainWindow::onConnectAction);
     
     m_disconnectAction = serverMenu->addAction(tr("&Disconnect"));
-    m_disconnectAction->setEnabled(false);
     connect(m_disconnectAction, &QAction::triggered, this, &MainWindow::onDisconnectAction);
     
+    m_closeNetworkAction = serverMenu->addAction(tr("Close &Network"));
+    connect(m_closeNetworkAction, &QAction::triggered, this, &MainWindow::onCloseNetworkAction);
+    
     serverMenu->addSeparator();
     
     QAction *quitAction = serverMenu->addAction(tr("&Quit"));
@@ -85,50 +106,236 @@ void MainWindow::setupMenuBar()
     QMenu *channelMenu = menuBar->addMenu(tr("&Channel"));
     
     m_joinChannelAction = channelMenu->addAction(tr("&Join Channel..."));
-    m_joinChannelAction->setEnabled(false);
     connect(m_joinChannelAction, &QAction::triggered, this, &MainWindow::onJoinChannelAction);
     
+    m_closeBufferAction = channelMenu->addAction(tr("&Close"));
+    m_closeBufferAction->setShortcut(QKeySequence::Close);
+    connect(m_closeBufferAction, &QAction::triggered, this, &MainWindow::onCloseBufferAction);
+    
+    // View menu
+    QMenu *viewMenu = menuBar->addMenu(tr("&View"));
+    viewMenu->addAction(m_statsDock->toggleViewAction());
+    
+    QAction *searchAction = viewMenu->addAction(tr("Search &History..."));
+    searchAction->setShortcut(QKeySequence::Find);
+    connect(searchAction, &QAction::triggered, this, &MainWindow::onSearchAction);
+    
     setMenuBar(menuBar);
 }
 
-void MainWindow::createServerTab()
+NetworkController* MainWindow::addNetwork(const QList<IrcServerAddress> &addresses, const QString &nickname,
+                                          IrcConnection *connection)
+{
+    NetworkController *network = new NetworkController(addresses, nickname, connection, this);
+    m_networks.append(network);
+    
+    connect(network, &NetworkController::bufferAdded,
+            this, &MainWindow::onBufferAdded);
+    connect(network, &NetworkController::bufferRemoved,
+            this, &MainWindow::onBufferRemoved);
+    connect(network, &NetworkController::stateChanged,
+            this, &MainWindow::onNetworkStateChanged);
+    connect(network, &NetworkController::connectionError,
+            this, &MainWindow::onConnectionError);
+    connect(network, &NetworkController::searchRequested,
+            this, &MainWindow::onSearchRequested);
+    connect(network, &NetworkController::filterRulesChanged,
+            this, &MainWindow::onFilterRulesChanged);
+    network->setFilterRules(m_filterRules);
+    
+    // The server buffer is the network's node in the tree
+    QTreeWidgetItem *item = addBufferItem(network->serverWidget(), addresses.first().host, nullptr);
+    item->setExpanded(true);
+    
+    m_statsDock->addConnection(network->connection());
+    return network;
+}
+
+void MainWindow::closeNetwork(NetworkController *network)
 {
-    m_serverWidget = new ChatWidget("Server", this);
-    m_tabWidget->addTab(m_serverWidget, "Server");
-    m_tabWidget->setTabsClosable(true);
+    m_networks.removeAll(network);
+    m_statsDock->removeConnection(network->connection());
+    if (m_searchDialog && m_searchDialog->logStore() == network->logStore()) {
+        m_searchDialog->setLogStore(nullptr);
+    }
     
-    // Server tab should not be closable
-    m_tabWidget->tabBar()->setTabButton(0, QTabBar::RightSide, nullptr);
+    QTreeWidgetItem *networkItem = m_bufferItems.value(network->serverWidget());
+    QList<ChatWidget*> widgets = network->chatWidgets();
+    widgets.append(network->serverWidget());
+    for (ChatWidget *widget : widgets) {
+        m_bufferItems.remove(widget);
+        m_bufferStack->removeWidget(widget);
+    }
+    delete networkItem;
+    
+    // Quits the server and deletes the buffers
+    delete network;
+    
+    updateActions();
+    updateWindowTitle();
 }
 
-ChatWidget* MainWindow::getOrCreateChatWidget(const QString &channelName)
+void MainWindow::restoreSession()
 {
-    if (m_chatWidgets.contains(channelName)) {
-        return m_chatWidgets[channelName];
+    QElapsedTimer clock;
+    clock.start();
+    const SessionSnapshot snapshot = SessionSnapshot::read(SessionSnapshot::defaultPath());
+    
+    QTreeWidgetItem *current = nullptr;
+    int buffers = 0;
+    for (int n = 0; n < snapshot.networks.size(); ++n) {
+        const SessionSnapshot::Network &saved = snapshot.networks.at(n);
+        NetworkController *network = addNetwork(saved.addresses, saved.nickname);
+        // Adds the buffers to the tree in their saved order
+        network->restore(saved);
+        buffers += saved.buffers.size();
+        
+        if (n == snapshot.currentNetwork) {
+            QTreeWidgetItem *networkItem = m_bufferItems.value(network->serverWidget());
+            current = snapshot.currentBuffer > 0 ? networkItem->child(snapshot.currentBuffer - 1) : networkItem;
+        }
+    }
+    if (current) {
+        m_bufferTree->setCurrentItem(current);
     }
     
-    ChatWidget *chatWidget = new ChatWidget(channelName, this);
-    m_chatWidgets[channelName] = chatWidget;
+    if (!snapshot.isEmpty()) {
+        qCInfo(lcIrcSession) << "Restored" << snapshot.networks.size() << "networks and" << buffers
+                             << "buffers in" << clock.elapsed() << "ms";
+    }
+    updateActions();
+    updateWindowTitle();
+}
+
+bool MainWindow::attachToCore(const QString &name)
+{
+    m_core = new IrcCoreLink(this);
+    connect(m_core, &IrcCoreLink::networkAdded, this, &MainWindow::onCoreNetworkAdded);
+    connect(m_core, &IrcCoreLink::networkRemoved, this, &MainWindow::onCoreNetworkRemoved);
+    connect(m_core, &IrcCoreLink::detached, this, &MainWindow::onCoreDetached);
+    
+    // The snapshot's networks are added from inside attach()
+    QElapsedTimer clock;
+    clock.start();
+    if (!m_core->attach(name)) {
+        delete m_core;
+        m_core = nullptr;
+        return false;
+    }
+    m_snapshotTimer->stop();
+    qCInfo(lcIrcSession) << "Attached to" << name << "with" << m_networks.size() << "networks in"
+                         << clock.elapsed() << "ms";
     
-    connect(chatWidget, &ChatWidget::messageSent, 
-            this, &MainWindow::onChatMessageSent);
+    updateActions();
+    updateWindowTitle();
+    return true;
+}
+
+void MainWindow::onCoreNetworkAdded(const IrcCoreProtocol::Network &network)
+{
+    IrcConnection *connection = new IrcConnection(m_core, network);
+    NetworkController *controller = addNetwork(network.addresses, network.nickname, connection);
+    controller->restore(SessionSnapshot::fromCore(network));
+    updateActions();
+}
+
+void MainWindow::onCoreNetworkRemoved(quint32 id)
+{
+    for (NetworkController *network : qAsConst(m_networks)) {
+        if (network->connection()->remoteNetwork() == id) {
+            closeNetwork(network);
+            return;
+        }
+    }
+}
+
+void MainWindow::onCoreDetached()
+{
+    statusBar()->showMessage(tr("Lost the core at %1").arg(m_core->serverName()));
+}
+
+SessionSnapshot MainWindow::sessionSnapshot() const
+{
+    QHash<QTreeWidgetItem*, ChatWidget*> widgets;
+    for (auto it = m_bufferItems.constBegin(); it != m_bufferItems.constEnd(); ++it) {
+        widgets.insert(it.value(), it.key());
+    }
     
-    int index = m_tabWidget->addTab(chatWidget, channelName);
-    m_tabWidget->setCurrentIndex(index);
+    // Networks and buffers in tree order, each network's server buffer first
+    SessionSnapshot snapshot;
+    QTreeWidgetItem *current = m_bufferTree->currentItem();
+    for (int n = 0; n < m_bufferTree->topLevelItemCount(); ++n) {
+        QTreeWidgetItem *networkItem = m_bufferTree->topLevelItem(n);
+        NetworkController *network = networkFor(widgets.value(networkItem));
+        if (!network) {
+            continue;
+        }
+        
+        SessionSnapshot::Network saved = network->snapshot();
+        if (networkItem == current) {
+            snapshot.currentNetwork = snapshot.networks.size();
+            snapshot.currentBuffer = 0;
+        }
+        saved.buffers.append(network->serverWidget()->snapshot(SessionSnapshot::LinesPerBuffer));
+        for (int b = 0; b < networkItem->childCount(); ++b) {
+            QTreeWidgetItem *item = networkItem->child(b);
+            ChatWidget *widget = widgets.value(item);
+            if (!widget) {
+                continue;
+            }
+            if (item == current) {
+                snapshot.currentNetwork = snapshot.networks.size();
+                snapshot.currentBuffer = saved.buffers.size();
+            }
+            saved.buffers.append(widget->snapshot(SessionSnapshot::LinesPerBuffer));
+        }
+        snapshot.networks.append(saved);
+    }
+    return snapshot;
+}
+
+void MainWindow::onSnapshotTimeout()
+{
+    if (m_snapshotWriter || m_core) {
+        // The last one is still being written
+        return;
+    }
     
-    return chatWidget;
+    // Taken here, written out on a thread of its own
+    const QByteArray data = sessionSnapshot().serialize();
+    const QString path = SessionSnapshot::defaultPath();
+    m_snapshotWriter = QThread::create([path, data]() {
+        SessionSnapshot::write(path, data);
+    });
+    connect(m_snapshotWriter, &QThread::finished, m_snapshotWriter, &QObject::deleteLater);
+    m_snapshotWriter->start(QThread::LowPriority);
 }
 
-ChatWidget* MainWindow::getCurrentChatWidget()
+NetworkController* MainWindow::networkFor(ChatWidget *widget) const
 {
-    return qobject_cast<ChatWidget*>(m_tabWidget->currentWidget());
+    for (NetworkController *network : m_networks) {
+        if (network->owns(widget)) {
+            return network;
+        }
+    }
+    return nullptr;
+}
+
+NetworkController* MainWindow::currentNetwork() const
+{
+    return networkFor(getCurrentChatWidget());
+}
+
+ChatWidget* MainWindow::getCurrentChatWidget() const
+{
+    return qobject_cast<ChatWidget*>(m_bufferStack->currentWidget());
 }
 
 void MainWindow::showConnectionDialog()
 {
     bool ok;
     QString server = QInputDialog::getText(this, tr("Connect to Server"),
-                                          tr("Server address:"), 
+                                          tr("Server address, then any alternates (TLS on port 6697 unless a plain :port is given):"),
                                           QLineEdit::Normal,
                                           "irc.libera.chat", &ok);
     if (!ok || server.isEmpty()) {
@@ -136,233 +343,248 @@ void MainWindow::showConnectionDialog()
     }
     
     QString nickname = QInputDialog::getText(this, tr("Set Nickname"),
-                                            tr("Nickname:"), 
+                                            tr("Nickname:"),
                                             QLineEdit::Normal,
                                             "QtIRCUser", &ok);
     if (!ok || nickname.isEmpty()) {
         return;
     }
     
-    m_currentNickname = nickname;
-    m_currentServer = server;
+    const QList<IrcServerAddress> addresses = IrcServerAddress::parseList(server);
+    if (addresses.isEmpty()) {
+        return;
+    }
     
-    m_serverWidget->addSystemMessage(QString("Connecting to %1...").arg(server));
-    m_ircConnection->connectToServer(server);
+    // One network per server, so reconnecting keeps its buffers and history
+    NetworkController *network = nullptr;
+    for (NetworkController *existing : qAsConst(m_networks)) {
+        if (existing->hasServer(addresses.first().host)) {
+            network = existing;
+            break;
+        }
+    }
+    
+    if (!network && m_core) {
+        // Shown once the core has it, in every window attached to it
+        m_core->addNetwork(addresses, nickname);
+        return;
+    }
+    
+    if (!network) {
+        network = addNetwork(addresses, nickname);
+    } else if (network->isConnected()) {
+        network->serverWidget()->addSystemMessage(QString("Already connected to %1").arg(network->server()));
+        m_bufferTree->setCurrentItem(m_bufferItems.value(network->serverWidget()));
+        return;
+    } else {
+        network->setAddresses(addresses);
+        network->setNickname(nickname);
+    }
+    
+    m_bufferTree->setCurrentItem(m_bufferItems.value(network->serverWidget()));
+    network->connectToServer();
+}
+
+void MainWindow::onSearchAction()
+{
+    NetworkController *network = currentNetwork();
+    showSearch(network ? network->logStore() : nullptr, QString());
+}
+
+void MainWindow::onSearchRequested(const QString &query)
+{
+    NetworkController *network = qobject_cast<NetworkController*>(sender());
+    if (network) {
+        showSearch(network->logStore(), query);
+    }
+}
+
+void MainWindow::onFilterRulesChanged(const IrcFilterRules &rules)
+{
+    m_filterRules = rules;
+    for (NetworkController *network : qAsConst(m_networks)) {
+        network->setFilterRules(rules);
+    }
+}
+
+void MainWindow::showSearch(LogStore *store, const QString &query)
+{
+    if (!m_searchDialog) {
+        m_searchDialog = new SearchDialog(this);
+    }
+    m_searchDialog->setLogStore(store);
+    m_searchDialog->show();
+    m_searchDialog->raise();
+    m_searchDialog->activateWindow();
+    if (!query.isEmpty()) {
+        m_searchDialog->search(query);
+    }
 }
 
 void MainWindow::showJoinChannelDialog()
 {
+    NetworkController *network = currentNetwork();
+    if (!network) return;
+    
     bool ok;
     QString channel = QInputDialog::getText(this, tr("Join Channel"),
-                                           tr("Channel name (e.g., #general):"), 
+                                           tr("Channel name (e.g., #general):"),
                                            QLineEdit::Normal,
                                            "#general", &ok);
     if (ok && !channel.isEmpty()) {
-        if (!channel.startsWith('#')) {
+        if (!network->connection()->isChannel(channel)) {
             channel = "#" + channel;
         }
-        m_ircConnection->joinChannel(channel);
-        m_serverWidget->addSystemMessage(QString("Joining %1...").arg(channel));
+        network->joinChannel(channel);
     }
 }
 
 void MainWindow::updateWindowTitle()
 {
     QString title = "IRC Client";
-    if (!m_currentServer.isEmpty()) {
-        title += QString(" - %1@%2").arg(m_currentNickname, m_currentServer);
+    if (NetworkController *network = currentNetwork()) {
+        title += QString(" - %1@%2").arg(network->nickname(), network->server());
     }
     setWindowTitle(title);
 }
 
-void MainWindow::onConnectAction()
+void MainWindow::updateActions()
 {
-    showConnectionDialog();
+    // Everything but Connect acts on the network of the selected buffer
+    NetworkController *network = currentNetwork();
+    const bool connected = network && network->isConnected();
+    const bool reconnecting = network && network->isReconnecting();
+    
+    // Disconnect also cancels a pending reconnect
+    m_disconnectAction->setEnabled(connected || reconnecting);
+    m_closeNetworkAction->setEnabled(network != nullptr);
+    m_joinChannelAction->setEnabled(connected);
+    m_closeBufferAction->setEnabled(network && getCurrentChatWidget() != network->serverWidget());
+    
+    if (connected) {
+        statusBar()->showMessage(tr("Connected to %1").arg(network->server()));
+    } else if (reconnecting) {
+        statusBar()->showMessage(tr("Reconnecting to %1...").arg(network->server()));
+    } else {
+        statusBar()->showMessage(tr("Not connected"));
+    }
 }
 
-void MainWindow::onDisconnectAction()
+void MainWindow::onConnectAction()
 {
-    m_ircConnection->disconnect();
+    showConnectionDialog();
 }
 
-void MainWindow::onJoinChannelAction()
+void MainWindow::onDisconnectAction()
 {
-    showJoinChannelDialog();
+    if (NetworkController *network = currentNetwork()) {
+        network->disconnectFromServer();
+    }
 }
 
-void MainWindow::onQuitAction()
+void MainWindow::onCloseNetworkAction()
 {
-    QApplication::quit();
+    NetworkController *network = currentNetwork();
+    if (network && network->connection()->isRemote()) {
+        // Closed here and in the other windows once the core has dropped it
+        m_core->removeNetwork(network->connection()->remoteNetwork());
+    } else if (network) {
+        closeNetwork(network);
+    }
 }
 
-void MainWindow::onConnected()
+void MainWindow::onJoinChannelAction()
 {
-    m_serverWidget->addSystemMessage("Connected to server!");
-    statusBar()->showMessage(tr("Connected to %1").arg(m_currentServer));
-    
-    // Set nickname
-    m_ircConnection->setNickname(m_currentNickname);
-    
-    // Update UI
-    m_connectAction->setEnabled(false);
-    m_disconnectAction->setEnabled(true);
-    m_joinChannelAction->setEnabled(true);
-    
-    updateWindowTitle();
+    showJoinChannelDialog();
 }
 
-void MainWindow::onDisconnected()
+void MainWindow::onCloseBufferAction()
 {
-    m_serverWidget->addSystemMessage("Disconnected from server");
-    statusBar()->showMessage(tr("Not connected"));
-    
-    // Update UI
-    m_connectAction->setEnabled(true);
-    m_disconnectAction->setEnabled(false);
-    m_joinChannelAction->setEnabled(false);
-    
-    // Clear channel tabs (keep server tab)
-    while (m_tabWidget->count() > 1) {
-        m_tabWidget->removeTab(1);
+    if (NetworkController *network = currentNetwork()) {
+        // Ignored for the server buffer
+        network->closeBuffer(getCurrentChatWidget());
     }
-    m_chatWidgets.clear();
 }
 
-void MainWindow::onConnectionError(const QString &error)
+void MainWindow::onQuitAction()
 {
-    m_serverWidget->addSystemMessage(QString("Connection error: %1").arg(error));
-    QMessageBox::warning(this, tr("Connection Error"), error);
+    QApplication::quit();
 }
 
-void MainWindow::onMessageReceived(const QString &sender, const QString &target, const QString &message)
+void MainWindow::onBufferAdded(ChatWidget *widget)
 {
-    // Determine which widget to display the message in
-    ChatWidget *widget = nullptr;
-    
-    if (target.startsWith('#')) {
-        // Channel message
-        widget = m_chatWidgets.value(target, nullptr);
-    } else if (target == m_currentNickname) {
-        // Private message to us
-        widget = getOrCreateChatWidget(sender);
-    }
-    
-    if (widget) {
-        widget->addMessage(sender, message);
-    } else {
-        m_serverWidget->addMessage(sender, QString("[%1] %2").arg(target, message));
+    NetworkController *network = qobject_cast<NetworkController*>(sender());
+    if (!network) return;
+    
+    QTreeWidgetItem *networkItem = m_bufferItems.value(network->serverWidget());
+    QTreeWidgetItem *item = addBufferItem(widget, widget->getChannelName(), networkItem);
+    // Only taken from the server buffer: of a burst of joins just the first
+    // comes forward, and the others are not built until looked at
+    if (!m_bufferTree->currentItem() || m_bufferTree->currentItem() == networkItem) {
+        m_bufferTree->setCurrentItem(item);
     }
 }
 
-void MainWindow::onJoinedChannel(const QString &channel, const QString &user)
+QTreeWidgetItem* MainWindow::addBufferItem(ChatWidget *widget, const QString &label, QTreeWidgetItem *parent)
 {
-    ChatWidget *widget = getOrCreateChatWidget(channel);
-    
-    if (user == m_currentNickname) {
-        widget->addSystemMessage(QString("You have joined %1").arg(channel));
+    QTreeWidgetItem *item = new QTreeWidgetItem(QStringList(label));
+    item->setData(0, Qt::UserRole, label);
+    if (parent) {
+        parent->addChild(item);
     } else {
-        widget->addSystemMessage(QString("%1 has joined").arg(user));
-        widget->addUser(user);
+        m_bufferTree->addTopLevelItem(item);
     }
-}
-
-void MainWindow::onPartedChannel(const QString &channel, const QString &user)
-{
-    ChatWidget *widget = m_chatWidgets.value(channel, nullptr);
-    if (!widget) return;
+    m_bufferItems.insert(widget, item);
     
-    if (user == m_currentNickname) {
-        widget->addSystemMessage(QString("You have left %1").arg(channel));
-        // Optionally close the tab
-    } else {
-        widget->addSystemMessage(QString("%1 has left").arg(user));
-        widget->removeUser(user);
-    }
+    // Added to the stack bare; the buffer builds its views when first shown
+    m_bufferStack->addWidget(widget);
+    connect(widget, &ChatWidget::activityChanged,
+            this, &MainWindow::onBufferActivityChanged);
+    return item;
 }
 
-void MainWindow::onUserListReceived(const QString &channel, const QStringList &users)
+void MainWindow::onBufferActivityChanged()
 {
-    ChatWidget *widget = m_chatWidgets.value(channel, nullptr);
-    if (widget) {
-        widget->setUserList(users);
-    }
+    ChatWidget *widget = qobject_cast<ChatWidget*>(sender());
+    QTreeWidgetItem *item = m_bufferItems.value(widget, nullptr);
+    if (!item) return;
+    
+    // "#channel (12)": bold while unread, red once we were mentioned
+    const QString label = item->data(0, Qt::UserRole).toString();
+    const int unread = widget->unreadCount();
+    item->setText(0, unread > 0 ? QString("%1 (%2)").arg(label).arg(unread) : label);
+    QFont font = item->font(0);
+    font.setBold(unread > 0);
+    item->setFont(0, font);
+    item->setForeground(0, widget->highlightCount() > 0 ? QBrush(Qt::red) : QBrush());
 }
 
-void MainWindow::onTopicReceived(const QString &channel, const QString &topic)
+void MainWindow::onBufferRemoved(ChatWidget *widget)
 {
-    ChatWidget *widget = m_chatWidgets.value(channel, nullptr);
-    if (widget) {
-        widget->setTopic(topic);
-        widget->addSystemMessage(QString("Topic: %1").arg(topic));
-    }
+    // Taken out of the map first, so selecting the next item doesn't find it
+    QTreeWidgetItem *item = m_bufferItems.take(widget);
+    m_bufferStack->removeWidget(widget);
+    delete item;
 }
 
-void MainWindow::onServerMessageReceived(const QString &message)
+void MainWindow::onNetworkStateChanged()
 {
-    m_serverWidget->addSystemMessage(message);
+    updateActions();
+    updateWindowTitle();
 }
 
-void MainWindow::onChatMessageSent(const QString &message)
+void MainWindow::onConnectionError(const QString &error)
 {
-    ChatWidget *sender = qobject_cast<ChatWidget*>(QObject::sender());
-    if (!sender) return;
-    
-    QString target = sender->getChannelName();
-    
-    // Handle IRC commands
-    if (message.startsWith('/')) {
-        QStringList parts = message.mid(1).split(' ', Qt::SkipEmptyParts);
-        if (parts.isEmpty()) return;
-        
-        QString command = parts[0].toUpper();
-        
-        if (command == "JOIN" && parts.size() > 1) {
-            QString channel = parts[1];
-            if (!channel.startsWith('#')) channel = "#" + channel;
-            m_ircConnection->joinChannel(channel);
-        }
-        else if (command == "PART" || command == "LEAVE") {
-            m_ircConnection->partChannel(target);
-        }
-        else if (command == "QUIT") {
-            m_ircConnection->disconnect();
-        }
-        else if (command == "MSG" && parts.size() > 2) {
-            QString recipient = parts[1];
-            QString msg = parts.mid(2).join(' ');
-            m_ircConnection->sendMessage(recipient, msg);
-            sender->addMessage(m_currentNickname, msg);
-        }
-        else {
-            // Raw IRC command
-            m_ircConnection->sendRawMessage(message.mid(1));
-        }
-    } else {
-        // Regular message
-        m_ircConnection->sendMessage(target, message);
-        sender->addMessage(m_currentNickname, message);
-    }
+    NetworkController *network = qobject_cast<NetworkController*>(sender());
+    const QString server = network ? network->server() : QString();
+    QMessageBox::warning(this, tr("Connection Error"), QString("%1: %2").arg(server, error));
 }
 
-void MainWindow::onTabCloseRequested(int index)
+void MainWindow::onCurrentItemChanged(QTreeWidgetItem *current)
 {
-    if (index == 0) {
-        // Don't close server tab
-        return;
-    }
-    
-    ChatWidget *widget = qobject_cast<ChatWidget*>(m_tabWidget->widget(index));
-    if (widget) {
-        QString channelName = widget->getChannelName();
-        
-        // Part the channel if it's a channel (starts with #)
-        if (channelName.startsWith('#')) {
-            m_ircConnection->partChannel(channelName);
-        }
-        
-        // Remove from our map and delete the widget
-        m_chatWidgets.remove(channelName);
-        m_tabWidget->removeTab(index);
-        widget->deleteLater();
+    if (ChatWidget *widget = m_bufferItems.key(current, nullptr)) {
+        m_bufferStack->setCurrentWidget(widget);
     }
+    updateActions();
+    updateWindowTitle();
 }
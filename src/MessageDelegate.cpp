@@ -0,0 +1,142 @@
+#include "MessageDelegate.h"
+#include "IrcStats.h"
+#include "MessageLogModel.h"
+#include <QApplication>
+#include <QPainter>
+#include <QTextLayout>
+#include <QtMath>
+
+namespace {
+
+// Inside the row's rectangle
+const int Margin = 4;
+// Text keeps at least this share of the row, however long the sender
+const int MinTextShare = 3;
+// Heights of evicted lines pile up; past this many the cache starts over
+const int MaxCachedHeights = 50000;
+
+} // namespace
+
+MessageDelegate::MessageDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+    , m_width(0)
+{
+}
+
+void MessageDelegate::setWidth(int width)
+{
+    if (width != m_width) {
+        m_width = width;
+        m_heights.clear();
+    }
+}
+
+QString MessageDelegate::rowText(const QModelIndex &index)
+{
+    const QString text = index.data(MessageLogModel::TextRole).toString();
+    if (index.data(MessageLogModel::KindRole).toInt() == MessageLogModel::System) {
+        return "* " + text;
+    }
+    return text;
+}
+
+int MessageDelegate::textIndent(const QStyleOptionViewItem &option, const QModelIndex &index)
+{
+    const qint64 timestamp = index.data(MessageLogModel::TimestampRole).toLongLong();
+    const QString time = QString("[%1] ").arg(MessageLogModel::formatTime(timestamp));
+    int indent = QFontMetrics(option.font).horizontalAdvance(time);
+    if (index.data(MessageLogModel::KindRole).toInt() != MessageLogModel::System) {
+        QFont bold = option.font;
+        bold.setBold(true);
+        const QString nick = QString("<%1> ").arg(index.data(MessageLogModel::SenderRole).toString());
+        indent += QFontMetrics(bold).horizontalAdvance(nick);
+    }
+    return indent;
+}
+
+int MessageDelegate::wrap(QTextLayout &layout, int width)
+{
+    QTextOption textOption;
+    textOption.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    layout.setTextOption(textOption);
+
+    qreal height = 0;
+    layout.beginLayout();
+    for (QTextLine line = layout.createLine(); line.isValid(); line = layout.createLine()) {
+        line.setLineWidth(width);
+        line.setPosition(QPointF(0, height));
+        height += line.height();
+    }
+    layout.endLayout();
+    return qCeil(height);
+}
+
+void MessageDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option,
+                            const QModelIndex &index) const
+{
+    IrcStats::ScopedTimer timer(IrcStats::PaintNs);
+    
+    // Let the style draw selection and hover, then the text on top
+    QStyleOptionViewItem opt = option;
+    initStyleOption(&opt, index);
+    opt.text.clear();
+    const QWidget *widget = opt.widget;
+    QStyle *style = widget ? widget->style() : QApplication::style();
+    style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+    
+    const bool selected = opt.state & QStyle::State_Selected;
+    const QColor textColor = opt.palette.color(selected ? QPalette::HighlightedText : QPalette::Text);
+    const int flags = Qt::AlignLeft | Qt::AlignTop | Qt::TextSingleLine;
+    const QFontMetrics metrics(opt.font);
+    const bool system = index.data(MessageLogModel::KindRole).toInt() == MessageLogModel::System;
+    
+    const qint64 timestamp = index.data(MessageLogModel::TimestampRole).toLongLong();
+    const QString sender = index.data(MessageLogModel::SenderRole).toString();
+    const QString time = QString("[%1] ").arg(MessageLogModel::formatTime(timestamp));
+    
+    painter->save();
+    painter->setFont(opt.font);
+    QRect rect = opt.rect.adjusted(Margin, 1, -Margin, -1);
+    
+    painter->setPen(selected ? textColor : QColor(system ? Qt::darkGreen : Qt::gray));
+    painter->drawText(rect, flags, time);
+    
+    if (!system) {
+        QFont bold = opt.font;
+        bold.setBold(true);
+        painter->setFont(bold);
+        painter->setPen(selected || sender != "SERVER" ? textColor : QColor(Qt::blue));
+        painter->drawText(rect.adjusted(metrics.horizontalAdvance(time), 0, 0, 0), flags,
+                          QString("<%1> ").arg(sender));
+        painter->setFont(opt.font);
+        painter->setPen(textColor);
+    }
+    
+    // Wrapped lines hang under the start of the text
+    const int indent = qMin(textIndent(opt, index), rect.width() - rect.width() / MinTextShare);
+    QTextLayout layout(rowText(index), opt.font);
+    wrap(layout, qMax(1, rect.width() - indent));
+    layout.draw(painter, QPointF(rect.left() + indent, rect.top()));
+    painter->restore();
+}
+
+QSize MessageDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const int lineHeight = QFontMetrics(option.font).height() + 2;
+    if (m_width <= 0) {
+        return QSize(0, lineHeight);
+    }
+    
+    const quint32 serial = index.data(MessageLogModel::SerialRole).toUInt();
+    auto it = m_heights.constFind(serial);
+    if (it == m_heights.constEnd()) {
+        if (m_heights.size() >= MaxCachedHeights) {
+            m_heights.clear();
+        }
+        const int width = m_width - 2 * Margin;
+        const int indent = qMin(textIndent(option, index), width - width / MinTextShare);
+        QTextLayout layout(rowText(index), option.font);
+        it = m_heights.insert(serial, qMax(lineHeight, wrap(layout, qMax(1, width - indent)) + 2));
+    }
+    return QSize(0, it.value());
+}
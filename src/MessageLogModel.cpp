@@ -0,0 +1,139 @@
+#include "MessageLogModel.h"
+#include <QDateTime>
+
+MessageLogModel::MessageLogModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_first(0)
+    , m_count(0)
+    , m_lineLimit(DefaultLineLimit)
+    , m_nextSerial(1)
+{
+}
+
+void MessageLogModel::append(const QVector<Entry> &entries)
+{
+    if (entries.isEmpty()) {
+        return;
+    }
+    
+    // Of a batch larger than the whole log only the newest lines survive
+    const int incoming = qMin(int(entries.size()), m_lineLimit);
+    const int evicted = qMax(0, m_count + incoming - m_lineLimit);
+    if (evicted > 0) {
+        beginRemoveRows(QModelIndex(), 0, evicted - 1);
+        if (m_entries.size() < m_lineLimit) {
+            m_entries.resize(m_lineLimit);
+        }
+        m_first = (m_first + evicted) % m_lineLimit;
+        m_count -= evicted;
+        endRemoveRows();
+    }
+    
+    beginInsertRows(QModelIndex(), m_count, m_count + incoming - 1);
+    for (int i = int(entries.size()) - incoming; i < entries.size(); ++i) {
+        if (m_entries.size() < m_lineLimit) {
+            // Still filling up: nothing has wrapped yet
+            m_entries.append(entries.at(i));
+        } else {
+            m_entries[(m_first + m_count) % m_lineLimit] = entries.at(i);
+        }
+        m_entries[(m_first + m_count) % m_entries.size()].serial = m_nextSerial++;
+        ++m_count;
+    }
+    endInsertRows();
+}
+
+void MessageLogModel::prepend(const QVector<Entry> &entries)
+{
+    if (entries.isEmpty()) {
+        return;
+    }
+    
+    beginInsertRows(QModelIndex(), 0, int(entries.size()) - 1);
+    QVector<Entry> lines;
+    lines.reserve(int(entries.size()) + m_count);
+    lines += entries;
+    for (Entry &line : lines) {
+        line.serial = m_nextSerial++;
+    }
+    for (int row = 0; row < m_count; ++row) {
+        lines.append(entry(row));
+    }
+    m_entries.swap(lines);
+    m_first = 0;
+    m_count = int(m_entries.size());
+    m_lineLimit = qMax(m_lineLimit, m_count);
+    endInsertRows();
+}
+
+void MessageLogModel::clear()
+{
+    beginResetModel();
+    m_entries.clear();
+    m_first = 0;
+    m_count = 0;
+    endResetModel();
+}
+
+void MessageLogModel::setLineLimit(int limit)
+{
+    limit = qMax(1, limit);
+    if (limit == m_lineLimit) {
+        return;
+    }
+    
+    // Unwrap the ring so it can grow or shrink to the new size
+    const int evicted = qMax(0, m_count - limit);
+    if (evicted > 0) {
+        beginRemoveRows(QModelIndex(), 0, evicted - 1);
+    }
+    QVector<Entry> kept;
+    kept.reserve(m_count - evicted);
+    for (int row = evicted; row < m_count; ++row) {
+        kept.append(entry(row));
+    }
+    m_entries.swap(kept);
+    m_first = 0;
+    m_count = int(m_entries.size());
+    m_lineLimit = limit;
+    if (evicted > 0) {
+        endRemoveRows();
+    }
+}
+
+int MessageLogModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_count;
+}
+
+QVariant MessageLogModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_count) {
+        return QVariant();
+    }
+    
+    const Entry &line = entry(index.row());
+    switch (role) {
+        case Qt::DisplayRole:
+            if (line.kind == System) {
+                return QString("[%1] * %2").arg(formatTime(line.timestamp), line.text);
+            }
+            return QString("[%1] <%2> %3").arg(formatTime(line.timestamp), line.sender, line.text);
+        case TimestampRole:
+            return line.timestamp;
+        case SenderRole:
+            return line.sender;
+        case TextRole:
+            return line.text;
+        case KindRole:
+            return int(line.kind);
+        case SerialRole:
+            return line.serial;
+    }
+    return QVariant();
+}
+
+QString MessageLogModel::formatTime(qint64 timestamp)
+{
+    return QDateTime::fromMSecsSinceEpoch(timestamp).toString("HH:mm:ss");
+}
@@ -0,0 +1,851 @@
+#include "NetworkController.h"
+#include "IrcNetworkPool.h"
+#include "IrcStats.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <algorithm>
+
+namespace {
+
+// Reconnect delays double from the first to the last and stay there. Each
+// is cut to a random 50-100% so networks that dropped together spread out.
+const int FirstReconnectDelayMs = 2000;
+const int MaxReconnectDelayMs = 5 * 60 * 1000;
+// A connection that stayed up this long starts the backoff over
+const qint64 StableConnectionMs = 60 * 1000;
+// DCC offers kept for /dcc get; older ones are forgotten
+const int MaxDccOffers = 20;
+
+// path, or "name (1).ext", "name (2).ext", ... if it exists
+QString unusedPath(const QString &path)
+{
+    const QFileInfo info(path);
+    QString candidate = path;
+    // Nor one whose partial receive is still around, which could be resumed
+    for (int n = 1; QFileInfo::exists(candidate) || QFileInfo::exists(DccTransfer::partialPath(candidate)); ++n) {
+        const QString suffix = info.suffix().isEmpty() ? QString() : '.' + info.suffix();
+        candidate = info.dir().filePath(QString("%1 (%2)%3").arg(info.completeBaseName()).arg(n).arg(suffix));
+    }
+    return candidate;
+}
+
+} // namespace
+
+NetworkController::NetworkController(const QList<IrcServerAddress> &addresses, const QString &nickname,
+                                     IrcConnection *connection, QObject *parent)
+    : QObject(parent)
+    , m_addresses(addresses)
+    , m_addressIndex(0)
+    , m_nickId(IrcStringPool::NullId)
+    , m_legacyEncoding(IrcTextCodec::Windows1252)
+    , m_connection(connection ? connection : new IrcConnection(this))
+    , m_logStore(new LogStore(LogStore::defaultDirectory(addresses.first().host), this))
+    , m_serverWidget(new ChatWidget("Server"))
+    , m_autoReconnect(false)
+    , m_reconnectAttempts(0)
+    , m_reconnectTimer(new QTimer(this))
+{
+    m_connection->setParent(this);
+    setNickname(nickname);
+    m_serverWidget->setLogStore(m_logStore);
+    m_serverWidget->setChannelCompletion(&m_channelCompletion);
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, &QTimer::timeout,
+            this, &NetworkController::onReconnectTimeout);
+
+    // Commands typed here go to the server, e.g. /stats or /whois
+    connect(m_serverWidget, &ChatWidget::messageSent,
+            this, &NetworkController::onChatMessageSent);
+
+    connect(m_connection, &IrcConnection::connected,
+            this, &NetworkController::onConnected);
+    connect(m_connection, &IrcConnection::disconnected,
+            this, &NetworkController::onDisconnected);
+    connect(m_connection, &IrcConnection::connectionError,
+            this, &NetworkController::onConnectionError);
+    connect(m_connection, &IrcConnection::eventsReady,
+            this, &NetworkController::onEventsReady);
+    connect(m_connection, &IrcConnection::stringsRenewed,
+            this, &NetworkController::onStringsRenewed);
+
+    // Shared by all networks; each picks out its own transfers by id
+    connect(DccManager::shared(), &DccManager::transferChanged,
+            this, &NetworkController::onDccTransferChanged);
+    connect(DccManager::shared(), &DccManager::requestReady,
+            this, &NetworkController::onDccRequestReady);
+}
+
+NetworkController::~NetworkController()
+{
+    for (const DccTransfer &transfer : qAsConst(m_dccTransfers)) {
+        if (!transfer.isFinished()) {
+            DccManager::shared()->cancel(transfer.id);
+        }
+    }
+
+    // The buffers hand their last lines to the store before it is sealed
+    QList<ChatWidget*> widgets = m_chatWidgets.values();
+    widgets.append(m_serverWidget);
+    for (ChatWidget *widget : widgets) {
+        widget->setLogStore(nullptr);
+        delete widget;
+    }
+}
+
+void NetworkController::setNickname(const QString &nickname)
+{
+    m_nickname = nickname;
+    m_nickId = m_connection->strings().intern(nickname);
+}
+
+void NetworkController::setFilterRules(const IrcFilterRules &rules)
+{
+    m_filterRules = rules;
+    m_connection->setFilterRules(rules);
+}
+
+bool NetworkController::hasServer(const QString &host) const
+{
+    for (const IrcServerAddress &address : m_addresses) {
+        if (address.host.compare(host, Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void NetworkController::setAddresses(const QList<IrcServerAddress> &addresses)
+{
+    m_addresses = addresses;
+    m_addressIndex = 0;
+    m_reconnectAttempts = 0;
+}
+
+bool NetworkController::owns(ChatWidget *widget) const
+{
+    return widget && (widget == m_serverWidget
+                      || m_chatWidgets.key(widget, IrcStringPool::NullId) != IrcStringPool::NullId);
+}
+
+void NetworkController::connectToServer()
+{
+    m_reconnectTimer->stop();
+
+    const IrcServerAddress &address = m_addresses.at(m_addressIndex);
+    IrcTlsOptions tls = IrcTls::defaultOptions();
+    tls.enabled = address.tls;
+
+    m_serverWidget->addSystemMessage(QString("Connecting to %1:%2%3...")
+                                     .arg(address.host)
+                                     .arg(address.port)
+                                     .arg(tls.enabled ? " (TLS)" : ""));
+    m_connection->connectToServer(address.host, address.port, tls);
+}
+
+void NetworkController::disconnectFromServer()
+{
+    m_autoReconnect = false;
+    m_reconnectAttempts = 0;
+    if (m_reconnectTimer->isActive()) {
+        m_reconnectTimer->stop();
+        m_serverWidget->addSystemMessage("Stopped reconnecting");
+        emit stateChanged();
+    }
+    m_connection->disconnect();
+}
+
+void NetworkController::joinChannel(const QString &channel, const QString &key)
+{
+    if (!key.isEmpty()) {
+        m_channelKeys.insert(channel.toLower(), key);
+    }
+    m_connection->joinChannel(channel, key);
+    m_serverWidget->addSystemMessage(QString("Joining %1...").arg(channel));
+}
+
+void NetworkController::closeBuffer(ChatWidget *widget)
+{
+    if (widget == m_serverWidget || !owns(widget)) {
+        return;
+    }
+
+    // Part the channel if it's a channel rather than a query
+    const QString channelName = widget->getChannelName();
+    if (m_connection->isChannel(channelName) && m_connection->isConnected()) {
+        m_connection->partChannel(channelName);
+    }
+    m_joinedChannels.remove(m_chatWidgets.key(widget));
+    m_channelCompletion.remove(channelName);
+    m_channelKeys.remove(channelName.toLower());
+    removeChatWidget(widget);
+}
+
+SessionSnapshot::Network NetworkController::snapshot() const
+{
+    SessionSnapshot::Network network;
+    network.addresses = m_addresses;
+    network.nickname = m_nickname;
+    network.connected = isConnected() || isReconnecting();
+    return network;
+}
+
+void NetworkController::restore(const SessionSnapshot::Network &network)
+{
+    for (int i = 0; i < network.buffers.size(); ++i) {
+        const SessionSnapshot::Buffer &buffer = network.buffers.at(i);
+        if (i == 0) {
+            m_serverWidget->restore(buffer);
+            continue;
+        }
+        const IrcStringPool::Id name = m_connection->strings().intern(buffer.name);
+        getOrCreateChatWidget(name)->restore(buffer);
+        if (m_connection->isChannel(buffer.name)) {
+            m_joinedChannels.insert(name);
+            m_channelCompletion.add(buffer.name);
+        }
+    }
+
+    if (network.connected) {
+        connectToServer();
+    }
+}
+
+ChatWidget* NetworkController::getOrCreateChatWidget(IrcStringPool::Id name)
+{
+    if (ChatWidget *existing = m_chatWidgets.value(name, nullptr)) {
+        return existing;
+    }
+
+    const QString channelName = m_connection->strings().string(name);
+    ChatWidget *chatWidget = new ChatWidget(channelName);
+    chatWidget->setPrefixSupport(m_connection->isupport("PREFIX"));
+    chatWidget->setLogStore(m_logStore);
+    chatWidget->setChannelCompletion(&m_channelCompletion);
+    m_chatWidgets.insert(name, chatWidget);
+
+    connect(chatWidget, &ChatWidget::messageSent,
+            this, &NetworkController::onChatMessageSent);
+
+    emit bufferAdded(chatWidget);
+    return chatWidget;
+}
+
+void NetworkController::removeChatWidget(ChatWidget *widget)
+{
+    m_chatWidgets.remove(m_chatWidgets.key(widget));
+    emit bufferRemoved(widget);
+    widget->deleteLater();
+}
+
+void NetworkController::onConnected()
+{
+    m_serverWidget->addSystemMessage("Connected to server!");
+    // A core retries by itself
+    m_autoReconnect = !m_connection->isRemote();
+    m_connectedTime.start();
+
+    // The channels we were in go out right after registration; their
+    // buffers pick up again when the joins come back
+    QStringList channels;
+    QStringList keys;
+    for (IrcStringPool::Id channel : qAsConst(m_joinedChannels)) {
+        const QString name = m_connection->strings().string(channel);
+        channels.append(name);
+        keys.append(m_channelKeys.value(name.toLower()));
+    }
+    if (!channels.isEmpty()) {
+        m_serverWidget->addSystemMessage(QString("Rejoining %1 channels...").arg(channels.size()));
+        m_connection->setRejoinChannels(channels, keys);
+    }
+    m_connection->setNickname(m_nickname);
+    emit stateChanged();
+}
+
+void NetworkController::onDisconnected()
+{
+    m_serverWidget->addSystemMessage("Disconnected from server");
+
+    // The buffers stay for the next connection; only their nick lists go stale
+    for (ChatWidget *widget : qAsConst(m_chatWidgets)) {
+        widget->addSystemMessage("Disconnected from server");
+        widget->setUserList(QStringList());
+    }
+
+    if (m_autoReconnect) {
+        if (m_connectedTime.isValid() && m_connectedTime.elapsed() >= StableConnectionMs) {
+            m_reconnectAttempts = 0;
+        }
+        m_connectedTime.invalidate();
+        scheduleReconnect();
+    }
+    emit stateChanged();
+}
+
+void NetworkController::onConnectionError(const QString &error)
+{
+    m_serverWidget->addSystemMessage(QString("Connection error: %1").arg(error));
+
+    if (m_connection->isRemote()) {
+        // The core goes round the servers itself
+        return;
+    }
+    if (m_autoReconnect) {
+        // While connected, onDisconnected() follows and schedules the retry
+        if (!isConnected()) {
+            scheduleReconnect();
+        }
+        return;
+    }
+    if (!isConnected() && m_addressIndex + 1 < m_addresses.size()) {
+        // Never connected yet: try the alternates before giving up
+        ++m_addressIndex;
+        connectToServer();
+        return;
+    }
+    emit connectionError(error);
+}
+
+void NetworkController::scheduleReconnect()
+{
+    if (m_reconnectTimer->isActive()) {
+        return;
+    }
+
+    const int backoff = qMin(MaxReconnectDelayMs, FirstReconnectDelayMs << qMin(m_reconnectAttempts, 8));
+    const int delay = backoff / 2 + int(QRandomGenerator::global()->bounded(backoff / 2 + 1));
+    ++m_reconnectAttempts;
+    m_reconnectTimer->start(delay);
+    m_serverWidget->addSystemMessage(QString("Reconnecting in %1 seconds...").arg((delay + 999) / 1000));
+    emit stateChanged();
+}
+
+void NetworkController::onReconnectTimeout()
+{
+    // Round the server list; a network with one server retries it
+    m_addressIndex = (m_addressIndex + 1) % m_addresses.size();
+    connectToServer();
+}
+
+void NetworkController::onStringsRenewed()
+{
+    // Every buffer knows its own name, so the ids can be had again from it
+    IrcStringPool &strings = m_connection->strings();
+    QHash<IrcStringPool::Id, ChatWidget*> widgets;
+    QSet<IrcStringPool::Id> joined;
+    for (auto it = m_chatWidgets.constBegin(); it != m_chatWidgets.constEnd(); ++it) {
+        const IrcStringPool::Id name = strings.intern(it.value()->getChannelName());
+        widgets.insert(name, it.value());
+        if (m_joinedChannels.contains(it.key())) {
+            joined.insert(name);
+        }
+    }
+    m_chatWidgets.swap(widgets);
+    m_joinedChannels.swap(joined);
+    m_nickId = strings.intern(m_nickname);
+}
+
+void NetworkController::onEventsReady(const IrcEventBatch &events)
+{
+    for (const IrcEvent &event : events) {
+        switch (event.type) {
+            case IrcEvent::Message:
+                onMessageReceived(event);
+                break;
+            case IrcEvent::Notice:
+                onNoticeReceived(event);
+                break;
+            case IrcEvent::Ctcp:
+                onCtcpReceived(event);
+                break;
+            case IrcEvent::Join:
+                onJoinedChannel(event);
+                break;
+            case IrcEvent::Part:
+                onPartedChannel(event);
+                break;
+            case IrcEvent::Quit:
+                onUserQuit(event);
+                break;
+            case IrcEvent::Kick:
+                onUserKicked(event);
+                break;
+            case IrcEvent::NickChange:
+                onNickChanged(event);
+                break;
+            case IrcEvent::Mode:
+                onModeChanged(event);
+                break;
+            case IrcEvent::Topic:
+                onTopicReceived(event);
+                break;
+            case IrcEvent::Names:
+                onUserListReceived(event);
+                break;
+            case IrcEvent::Prefixes:
+                onPrefixesChanged(event);
+                break;
+            case IrcEvent::ServerMessage:
+                onServerMessageReceived(event);
+                break;
+            default:
+                // Connection state events arrive as IrcConnection signals
+                break;
+        }
+    }
+}
+
+void NetworkController::onMessageReceived(const IrcEvent &event)
+{
+    // Determine which widget to display the message in
+    ChatWidget *widget = nullptr;
+
+    if (m_connection->isChannel(event.target)) {
+        // Channel message; busy channels come first when completing
+        widget = m_chatWidgets.value(event.targetId, nullptr);
+        m_channelCompletion.touch(event.target);
+    } else if (isSelf(event.targetId)) {
+        // Private message to us
+        widget = getOrCreateChatWidget(event.senderId);
+    }
+
+    if (widget) {
+        // Private messages always count as mentions; the session has
+        // matched our nick and the highlight words
+        const bool highlight = widget->getChannelName() == event.sender || event.highlight;
+        widget->addMessage(event.sender, event.text, event.sentTime, highlight);
+    } else {
+        m_serverWidget->addMessage(event.sender, QString("[%1] %2").arg(event.target, event.text));
+    }
+}
+
+void NetworkController::onNoticeReceived(const IrcEvent &event)
+{
+    m_serverWidget->addMessage(event.sender, QString("-notice- %1").arg(event.text));
+}
+
+void NetworkController::onCtcpReceived(const IrcEvent &event)
+{
+    if (event.argument == "DCC") {
+        const DccMessage message = DccMessage::parse(event.text);
+        if (message.type == DccMessage::Resume) {
+            DccManager::shared()->resumeRequested(event.sender, message);
+        } else if (message.type == DccMessage::Accept) {
+            DccManager::shared()->resumeAccepted(event.sender, message);
+        } else if (message.type != DccMessage::Send) {
+            m_serverWidget->addSystemMessage(QString("Unsupported DCC request from %1: %2")
+                                             .arg(event.sender, event.text));
+        } else if (message.isPassive()) {
+            dccWidget(event.sender)->addSystemMessage(QString("%1 offers %2 by passive DCC, which is not supported")
+                                                      .arg(event.sender, message.fileName));
+        } else {
+            if (m_dccOffers.size() >= MaxDccOffers) {
+                m_dccOffers.removeFirst();
+            }
+            m_dccOffers.append({ event.sender, message });
+            getOrCreateChatWidget(event.senderId)->addSystemMessage(
+                QString("%1 offers %2 (%3); accept with /dcc get %1")
+                .arg(event.sender, message.fileName, DccTransfer::formatBytes(message.size)));
+        }
+    } else if (event.argument == "VERSION") {
+        m_connection->sendCtcpReply(event.sender, QString("VERSION %1 %2")
+                                    .arg(QCoreApplication::applicationName(),
+                                         QCoreApplication::applicationVersion()));
+    } else if (event.argument == "PING") {
+        m_connection->sendCtcpReply(event.sender, "PING " + event.text);
+    } else {
+        m_serverWidget->addSystemMessage(QString("CTCP %1 from %2").arg(event.argument, event.sender));
+    }
+}
+
+void NetworkController::onJoinedChannel(const IrcEvent &event)
+{
+    ChatWidget *widget = getOrCreateChatWidget(event.targetId);
+
+    if (isSelf(event.senderId)) {
+        m_joinedChannels.insert(event.targetId);
+        m_channelCompletion.add(event.target);
+        widget->addSystemMessage(QString("You have joined %1").arg(event.target));
+    } else {
+        widget->addSystemMessage(QString("%1 has joined").arg(event.sender));
+        widget->addUser(event.sender);
+    }
+}
+
+void NetworkController::onPartedChannel(const IrcEvent &event)
+{
+    ChatWidget *widget = m_chatWidgets.value(event.targetId, nullptr);
+    if (!widget) return;
+
+    if (isSelf(event.senderId)) {
+        m_joinedChannels.remove(event.targetId);
+        m_channelCompletion.remove(event.target);
+        widget->addSystemMessage(QString("You have left %1").arg(event.target));
+    } else {
+        widget->addSystemMessage(QString("%1 has left").arg(event.sender));
+        widget->removeUser(event.sender);
+    }
+}
+
+void NetworkController::onUserListReceived(const IrcEvent &event)
+{
+    ChatWidget *widget = m_chatWidgets.value(event.targetId, nullptr);
+    if (widget) {
+        widget->setUserList(event.names);
+    }
+}
+
+void NetworkController::onPrefixesChanged(const IrcEvent &event)
+{
+    ChatWidget *widget = m_chatWidgets.value(event.targetId, nullptr);
+    if (widget) {
+        widget->setUserPrefixes(event.argument, event.text);
+    }
+}
+
+void NetworkController::onTopicReceived(const IrcEvent &event)
+{
+    ChatWidget *widget = m_chatWidgets.value(event.targetId, nullptr);
+    if (widget) {
+        widget->setTopic(event.text);
+        widget->addSystemMessage(QString("Topic: %1").arg(event.text));
+    }
+}
+
+void NetworkController::onServerMessageReceived(const IrcEvent &event)
+{
+    m_serverWidget->addSystemMessage(event.text);
+}
+
+void NetworkController::onUserQuit(const IrcEvent &event)
+{
+    // Only the channels the user shared with us
+    for (IrcStringPool::Id channel : event.channels) {
+        ChatWidget *widget = m_chatWidgets.value(channel, nullptr);
+        if (widget) {
+            widget->addSystemMessage(QString("%1 has quit (%2)").arg(event.sender, event.text));
+            widget->removeUser(event.sender);
+        }
+    }
+}
+
+void NetworkController::onUserKicked(const IrcEvent &event)
+{
+    ChatWidget *widget = m_chatWidgets.value(event.targetId, nullptr);
+    if (!widget) return;
+
+    const QString &user = event.argument;
+    if (isSelf(m_connection->strings().intern(user))) {
+        m_joinedChannels.remove(event.targetId);
+        m_channelCompletion.remove(event.target);
+        widget->addSystemMessage(QString("You were kicked from %1 by %2 (%3)").arg(event.target, event.sender, event.text));
+    } else {
+        widget->addSystemMessage(QString("%1 was kicked by %2 (%3)").arg(user, event.sender, event.text));
+        widget->removeUser(user);
+    }
+}
+
+void NetworkController::onNickChanged(const IrcEvent &event)
+{
+    if (isSelf(event.senderId)) {
+        m_nickname = event.target;
+        m_nickId = event.targetId;
+        emit stateChanged();
+    }
+
+    for (IrcStringPool::Id channel : event.channels) {
+        ChatWidget *widget = m_chatWidgets.value(channel, nullptr);
+        if (widget) {
+            widget->addSystemMessage(QString("%1 is now known as %2").arg(event.sender, event.target));
+            widget->renameUser(event.sender, event.target);
+        }
+    }
+}
+
+void NetworkController::onModeChanged(const IrcEvent &event)
+{
+    ChatWidget *widget = m_chatWidgets.value(event.targetId, nullptr);
+    if (widget && event.sender.isEmpty()) {
+        // Answer to a MODE query, e.g. after rejoining
+        widget->addSystemMessage(QString("Mode: %1").arg(event.text));
+    } else if (widget) {
+        widget->addSystemMessage(QString("%1 sets mode %2").arg(event.sender, event.text));
+    } else {
+        m_serverWidget->addSystemMessage(QString("%1 sets mode %2 on %3").arg(event.sender, event.text, event.target));
+    }
+}
+
+void NetworkController::onChatMessageSent(const QString &message)
+{
+    ChatWidget *sender = qobject_cast<ChatWidget*>(QObject::sender());
+    if (!sender) return;
+
+    QString target = sender->getChannelName();
+
+    // Handle IRC commands
+    if (message.startsWith('/')) {
+        QStringList parts = message.mid(1).split(' ', Qt::SkipEmptyParts);
+        if (parts.isEmpty()) return;
+
+        QString command = parts[0].toUpper();
+
+        if (command == "JOIN" && parts.size() > 1) {
+            QString channel = parts[1];
+            if (!m_connection->isChannel(channel)) channel = "#" + channel;
+            const QString key = parts.value(2);
+            if (!key.isEmpty()) {
+                m_channelKeys.insert(channel.toLower(), key);
+            }
+            m_connection->joinChannel(channel, key);
+        }
+        else if (command == "PART" || command == "LEAVE") {
+            m_connection->partChannel(target);
+        }
+        else if (command == "QUIT") {
+            disconnectFromServer();
+        }
+        else if (command == "STATS" && (parts.size() == 1 || parts[1].toLower() == "dump")) {
+            // Client statistics; "/stats <query>" still goes to the server
+            showStats(sender, parts.mid(1));
+        }
+        else if (command == "ENCODING") {
+            IrcTextCodec::Legacy legacy;
+            if (parts.size() > 1 && IrcTextCodec::parseLegacy(parts[1], &legacy)) {
+                m_legacyEncoding = legacy;
+                m_connection->setLegacyEncoding(legacy);
+                sender->addSystemMessage(QString("Lines that are not UTF-8 are now read as %1")
+                                         .arg(IrcTextCodec::legacyName(legacy)));
+            } else {
+                sender->addSystemMessage(QString("Usage: /encoding cp1252|latin1|utf8 (now %1)")
+                                         .arg(IrcTextCodec::legacyName(m_legacyEncoding)));
+            }
+        }
+        else if (command == "HIGHLIGHT" || command == "UNHIGHLIGHT"
+                 || command == "IGNORE" || command == "UNIGNORE") {
+            handleFilterCommand(sender, command, parts.mid(1));
+        }
+        else if (command == "DCC") {
+            handleDccCommand(sender, parts.mid(1));
+        }
+        else if (command == "SEARCH") {
+            emit searchRequested(parts.mid(1).join(' '));
+        }
+        else if (command == "MSG" && parts.size() > 2) {
+            QString recipient = parts[1];
+            QString msg = parts.mid(2).join(' ');
+            m_connection->sendMessage(recipient, msg);
+            sender->addMessage(m_nickname, msg);
+        }
+        else {
+            // Raw IRC command
+            m_connection->sendRawMessage(message.mid(1));
+        }
+    } else if (sender == m_serverWidget) {
+        sender->addSystemMessage(tr("The server tab only takes /commands"));
+    } else {
+        // Regular message
+        m_connection->sendMessage(target, message);
+        sender->addMessage(m_nickname, message);
+    }
+}
+
+void NetworkController::showStats(ChatWidget *widget, const QStringList &arguments)
+{
+    if (arguments.isEmpty()) {
+        const QString text = IrcStats::format(IrcStats::snapshot())
+            + IrcNetworkPool::shared()->statsText() + m_connection->statsText();
+        for (const QString &line : text.split('\n', Qt::SkipEmptyParts)) {
+            widget->addSystemMessage(line);
+        }
+        return;
+    }
+
+    // /stats dump [file]
+    const QString path = arguments.size() > 1 ? arguments.mid(1).join(' ')
+                                              : QDir::home().filePath("irc-stats.txt");
+    if (IrcStats::dump(path)) {
+        widget->addSystemMessage(QString("Statistics written to %1").arg(path));
+    } else {
+        widget->addSystemMessage(QString("Could not write %1").arg(path));
+    }
+}
+
+void NetworkController::handleFilterCommand(ChatWidget *widget, const QString &command, const QStringList &arguments)
+{
+    const bool highlight = command.endsWith("HIGHLIGHT");
+    QStringList &rules = highlight ? m_filterRules.highlightWords : m_filterRules.ignoreMasks;
+    if (arguments.isEmpty()) {
+        if (rules.isEmpty()) {
+            widget->addSystemMessage(highlight ? "No highlight words" : "Nobody is ignored");
+        }
+        for (const QString &rule : qAsConst(rules)) {
+            widget->addSystemMessage(QString(highlight ? "Highlight: %1" : "Ignored: %1").arg(rule));
+        }
+        return;
+    }
+
+    // Words may be phrases; a nick or partial mask is widened to nick!user@host
+    const QString rule = highlight ? arguments.join(' ') : IrcFilterRules::normalizeMask(arguments.first());
+    if (command.startsWith("UN")) {
+        if (rules.removeAll(rule) == 0) {
+            widget->addSystemMessage(QString("%1 is not in the list").arg(rule));
+            return;
+        }
+        widget->addSystemMessage(QString(highlight ? "No longer highlighting %1" : "No longer ignoring %1").arg(rule));
+    } else {
+        if (rules.contains(rule)) {
+            return;
+        }
+        rules.append(rule);
+        widget->addSystemMessage(QString(highlight ? "Highlighting %1" : "Ignoring %1").arg(rule));
+    }
+
+    if (!m_filterRules.save()) {
+        widget->addSystemMessage("Could not save the filters; they only last for this session");
+    }
+    emit filterRulesChanged(m_filterRules);
+}
+
+void NetworkController::handleDccCommand(ChatWidget *widget, const QStringList &arguments)
+{
+    DccManager *dcc = DccManager::shared();
+    const QString verb = arguments.value(0).toLower();
+    bool ok = false;
+
+    if (verb == "send" && arguments.size() > 2) {
+        if (!isConnected()) {
+            widget->addSystemMessage("Not connected");
+            return;
+        }
+        QString path = arguments.mid(2).join(' ');
+        if (path.startsWith("~/")) {
+            path = path.mid(2);
+        }
+        path = QDir::home().absoluteFilePath(path);
+        if (!QFileInfo(path).isFile()) {
+            widget->addSystemMessage(QString("No such file: %1").arg(path));
+            return;
+        }
+        const QString &peer = arguments.at(1);
+        trackDccTransfer(dcc->sendFile(peer, path, m_connection->localAddress()), peer, path);
+    } else if (verb == "get" && arguments.size() > 1) {
+        acceptDccOffer(widget, arguments.at(1), arguments.mid(2).join(' '));
+    } else if (verb == "list") {
+        QList<int> ids = m_dccTransfers.keys();
+        std::sort(ids.begin(), ids.end());
+        for (int id : qAsConst(ids)) {
+            widget->addSystemMessage(m_dccTransfers.value(id).describe());
+        }
+        for (const DccOffer &offer : qAsConst(m_dccOffers)) {
+            widget->addSystemMessage(QString("Offered by %1: %2 (%3)")
+                                     .arg(offer.peer, offer.message.fileName,
+                                          DccTransfer::formatBytes(offer.message.size)));
+        }
+        if (ids.isEmpty() && m_dccOffers.isEmpty()) {
+            widget->addSystemMessage("No DCC transfers or offers");
+        }
+    } else if (verb == "cancel" && arguments.size() > 1) {
+        const int id = QString(arguments.at(1)).remove('#').toInt();
+        if (m_dccTransfers.contains(id)) {
+            dcc->cancel(id);
+        } else {
+            widget->addSystemMessage(QString("No DCC transfer %1").arg(arguments.at(1)));
+        }
+    } else if (verb == "rate" && arguments.size() == 2) {
+        const qint64 kib = arguments.at(1).toLongLong(&ok);
+        if (ok) {
+            dcc->setGlobalRateLimit(kib * 1024);
+            widget->addSystemMessage(kib > 0 ? QString("DCC transfers together now capped at %1/s")
+                                               .arg(DccTransfer::formatBytes(kib * 1024))
+                                             : QString("DCC transfers are no longer capped"));
+        }
+    } else if (verb == "rate" && arguments.size() > 2) {
+        const int id = QString(arguments.at(1)).remove('#').toInt();
+        const qint64 kib = arguments.at(2).toLongLong(&ok);
+        if (ok && m_dccTransfers.contains(id)) {
+            dcc->setRateLimit(id, kib * 1024);
+        }
+    } else {
+        ok = true;
+        widget->addSystemMessage("Usage: /dcc send <nick> <file> | get <nick> [file] | list | cancel <id>"
+                                 " | rate [id] <KiB/s>");
+    }
+    if (verb == "rate" && !ok) {
+        widget->addSystemMessage("Usage: /dcc rate [id] <KiB/s> (0 lifts the cap)");
+    }
+}
+
+void NetworkController::acceptDccOffer(ChatWidget *widget, const QString &peer, const QString &fileName)
+{
+    // The newest offer from peer, of that file if one is named
+    for (int i = m_dccOffers.size() - 1; i >= 0; --i) {
+        const DccOffer &offer = m_dccOffers.at(i);
+        if (offer.peer.compare(peer, Qt::CaseInsensitive) != 0
+            || (!fileName.isEmpty() && offer.message.fileName != fileName)) {
+            continue;
+        }
+        const DccMessage message = offer.message;
+        const QString sender = offer.peer;
+        m_dccOffers.removeAt(i);
+
+        QDir directory(DccManager::shared()->downloadDirectory());
+        directory.mkpath(".");
+        QString path = directory.filePath(DccMessage::safeFileName(message.fileName));
+        // Only the partial file of an unfinished receive is resumed, never a
+        // complete file that happens to share the name
+        const QFileInfo partial(DccTransfer::partialPath(path));
+        const bool resume = !QFileInfo::exists(path) && partial.exists()
+            && partial.size() > 0 && partial.size() < message.size;
+        if (!resume) {
+            path = unusedPath(path);
+        }
+        trackDccTransfer(DccManager::shared()->receiveFile(sender, message, path, resume), sender, path);
+        return;
+    }
+    widget->addSystemMessage(QString("No DCC offer from %1").arg(peer));
+}
+
+void NetworkController::trackDccTransfer(int id, const QString &peer, const QString &path)
+{
+    // Filled in by the engine's first report
+    DccTransfer transfer;
+    transfer.id = id;
+    transfer.peer = peer;
+    transfer.path = path;
+    transfer.fileName = QFileInfo(path).fileName();
+    m_dccTransfers.insert(id, transfer);
+}
+
+ChatWidget* NetworkController::dccWidget(const QString &peer) const
+{
+    const IrcStringPool::Id id = m_connection->strings().intern(peer);
+    return m_chatWidgets.value(id, m_serverWidget);
+}
+
+void NetworkController::onDccTransferChanged(const DccTransfer &transfer)
+{
+    const auto it = m_dccTransfers.find(transfer.id);
+    if (it == m_dccTransfers.end()) {
+        return;
+    }
+    const DccTransfer::State previous = it->state;
+    *it = transfer;
+
+    // Progress reports only update /dcc list
+    if (transfer.state != previous || transfer.state == DccTransfer::Queued) {
+        dccWidget(transfer.peer)->addSystemMessage("DCC " + transfer.describe());
+    }
+}
+
+void NetworkController::onDccRequestReady(const DccTransfer &transfer, const DccMessage &request)
+{
+    if (!m_dccTransfers.contains(transfer.id)) {
+        return;
+    }
+    if (!isConnected()) {
+        DccManager::shared()->cancel(transfer.id);
+        return;
+    }
+    m_connection->sendCtcpRequest(transfer.peer, request.toCtcp());
+}
@@ -0,0 +1,222 @@
+#include "NickListModel.h"
+#include <algorithm>
+
+NickListModel::NickListModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+}
+
+void NickListModel::setPrefixSupport(const QString &prefix)
+{
+    IrcPrefixSupport support;
+    if (!support.parse(prefix) || support == m_prefixSupport) {
+        return;
+    }
+
+    beginResetModel();
+    m_prefixSupport = support;
+    m_ranks.clear();
+    for (Member &member : m_members) {
+        member.prefixes = m_prefixSupport.sorted(member.prefixes);
+        member.rank = m_prefixSupport.rankOf(member.prefixes);
+        m_ranks.insert(member.nick, member.rank);
+    }
+    std::sort(m_members.begin(), m_members.end(),
+              [](const Member &a, const Member &b) { return lessThan(a, b); });
+    endResetModel();
+}
+
+void NickListModel::reset(const QStringList &names)
+{
+    beginResetModel();
+    m_members.clear();
+    m_ranks.clear();
+    m_members.reserve(names.size());
+    m_ranks.reserve(names.size());
+
+    for (const QString &name : names) {
+        const Member member = parseName(name);
+        if (member.nick.isEmpty() || m_ranks.contains(member.nick)) {
+            continue;
+        }
+        m_members.append(member);
+        m_ranks.insert(member.nick, member.rank);
+    }
+
+    // One sort for the whole list instead of one ordered insert per name
+    std::sort(m_members.begin(), m_members.end(),
+              [](const Member &a, const Member &b) { return lessThan(a, b); });
+    endResetModel();
+}
+
+void NickListModel::clear()
+{
+    beginResetModel();
+    m_members.clear();
+    m_ranks.clear();
+    endResetModel();
+}
+
+QStringList NickListModel::nicks() const
+{
+    QStringList nicks;
+    nicks.reserve(m_members.size());
+    for (const Member &member : m_members) {
+        nicks.append(member.nick);
+    }
+    return nicks;
+}
+
+QStringList NickListModel::names() const
+{
+    QStringList names;
+    names.reserve(m_members.size());
+    for (const Member &member : m_members) {
+        names.append(member.prefixes + member.nick);
+    }
+    return names;
+}
+
+QString NickListModel::prefixes(const QString &nick) const
+{
+    const int row = rowOf(nick);
+    return row >= 0 ? m_members.at(row).prefixes : QString();
+}
+
+void NickListModel::addMember(const QString &name)
+{
+    const Member member = parseName(name);
+    if (member.nick.isEmpty() || m_ranks.contains(member.nick)) {
+        return;
+    }
+    insertMember(member);
+}
+
+void NickListModel::removeMember(const QString &nick)
+{
+    const int row = rowOf(nick);
+    if (row < 0) {
+        return;
+    }
+
+    beginRemoveRows(QModelIndex(), row, row);
+    m_members.remove(row);
+    m_ranks.remove(nick);
+    endRemoveRows();
+}
+
+void NickListModel::renameMember(const QString &oldNick, const QString &newNick)
+{
+    const int row = rowOf(oldNick);
+    if (row < 0 || m_ranks.contains(newNick)) {
+        return;
+    }
+
+    Member member = m_members.at(row);
+    removeMember(oldNick);
+    member.nick = newNick;
+    insertMember(member);
+}
+
+void NickListModel::setPrefixes(const QString &nick, const QString &prefixes)
+{
+    const int row = rowOf(nick);
+    if (row < 0) {
+        return;
+    }
+
+    Member member = m_members.at(row);
+    member.prefixes = m_prefixSupport.sorted(prefixes);
+    if (member.prefixes == m_members.at(row).prefixes) {
+        return;
+    }
+
+    member.rank = m_prefixSupport.rankOf(member.prefixes);
+    if (member.rank == m_members.at(row).rank) {
+        // Same position, e.g. a lower mode added under a higher one
+        m_members[row] = member;
+        const QModelIndex changed = index(row);
+        emit dataChanged(changed, changed);
+        return;
+    }
+
+    removeMember(nick);
+    insertMember(member);
+}
+
+int NickListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(m_members.size());
+}
+
+QVariant NickListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_members.size()) {
+        return QVariant();
+    }
+
+    const Member &member = m_members.at(index.row());
+    switch (role) {
+        case Qt::DisplayRole:
+            return member.prefixes.left(1) + member.nick;
+        case Qt::ToolTipRole:
+            return member.prefixes + member.nick;
+        case NickRole:
+            return member.nick;
+        case PrefixesRole:
+            return member.prefixes;
+        case RankRole:
+            return member.rank;
+    }
+    return QVariant();
+}
+
+NickListModel::Member NickListModel::parseName(const QString &name) const
+{
+    Member member;
+    member.nick = m_prefixSupport.parseName(name, &member.prefixes);
+    member.rank = m_prefixSupport.rankOf(member.prefixes);
+    return member;
+}
+
+int NickListModel::lowerBound(int rank, const QString &nick) const
+{
+    const auto it = std::lower_bound(m_members.begin(), m_members.end(), nick,
+        [rank](const Member &member, const QString &key) {
+            return lessThan(member.rank, member.nick, rank, key);
+        });
+    return int(it - m_members.begin());
+}
+
+int NickListModel::rowOf(const QString &nick) const
+{
+    const auto rank = m_ranks.constFind(nick);
+    if (rank == m_ranks.constEnd()) {
+        return -1;
+    }
+    const int row = lowerBound(rank.value(), nick);
+    return row < m_members.size() && m_members.at(row).nick == nick ? row : -1;
+}
+
+void NickListModel::insertMember(const Member &member)
+{
+    const int row = lowerBound(member.rank, member.nick);
+    beginInsertRows(QModelIndex(), row, row);
+    m_members.insert(row, member);
+    m_ranks.insert(member.nick, member.rank);
+    endInsertRows();
+}
+
+bool NickListModel::lessThan(const Member &a, const Member &b)
+{
+    return lessThan(a.rank, a.nick, b.rank, b.nick);
+}
+
+bool NickListModel::lessThan(int rankA, const QString &nickA, int rankB, const QString &nickB)
+{
+    if (rankA != rankB) {
+        return rankA < rankB;
+    }
+    const int order = QString::compare(nickA, nickB, Qt::CaseInsensitive);
+    return order != 0 ? order < 0 : nickA < nickB;
+}
@@ -0,0 +1,77 @@
+#include "SearchDialog.h"
+#include "LogStore.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHeaderView>
+#include <QVBoxLayout>
+
+SearchDialog::SearchDialog(QWidget *parent)
+    : QDialog(parent)
+    , m_store(nullptr)
+    , m_queryLine(new QLineEdit)
+    , m_results(new QTableWidget(0, 4))
+    , m_status(new QLabel)
+{
+    setWindowTitle(tr("Search History"));
+    resize(800, 500);
+    
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    
+    m_queryLine->setPlaceholderText(tr("words  from:nick  in:#channel  after:2024-01-31  before:2024-02-29"));
+    m_queryLine->setClearButtonEnabled(true);
+    connect(m_queryLine, &QLineEdit::returnPressed, this, &SearchDialog::runSearch);
+    layout->addWidget(m_queryLine);
+    
+    m_results->setHorizontalHeaderLabels({ tr("Time"), tr("Buffer"), tr("Nick"), tr("Message") });
+    m_results->horizontalHeader()->setStretchLastSection(true);
+    m_results->verticalHeader()->hide();
+    m_results->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_results->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_results->setWordWrap(false);
+    layout->addWidget(m_results);
+    
+    layout->addWidget(m_status);
+}
+
+void SearchDialog::search(const QString &query)
+{
+    m_queryLine->setText(query);
+    runSearch();
+}
+
+void SearchDialog::runSearch()
+{
+    m_results->setRowCount(0);
+    const SearchQuery query = SearchQuery::parse(m_queryLine->text());
+    if (!m_store || query.isEmpty()) {
+        m_status->setText(m_store ? tr("Enter at least one word, nick or channel")
+                                  : tr("Connect to a network to search its history"));
+        return;
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    const LogStore::SearchResults results = m_store->search(query, MaxResults);
+    const qint64 elapsed = timer.elapsed();
+    
+    m_results->setUpdatesEnabled(false);
+    m_results->setRowCount(int(results.hits.size()));
+    for (int row = 0; row < results.hits.size(); ++row) {
+        const LogStore::SearchHit &hit = results.hits.at(row);
+        const QString time = QDateTime::fromMSecsSinceEpoch(hit.line.timestamp).toString("yyyy-MM-dd HH:mm:ss");
+        m_results->setItem(row, 0, new QTableWidgetItem(time));
+        m_results->setItem(row, 1, new QTableWidgetItem(hit.buffer));
+        m_results->setItem(row, 2, new QTableWidgetItem(hit.line.sender));
+        m_results->setItem(row, 3, new QTableWidgetItem(hit.line.text));
+    }
+    m_results->resizeColumnsToContents();
+    m_results->setUpdatesEnabled(true);
+    
+    QString status = results.hits.size() >= MaxResults
+        ? tr("Newest %1 matches, %2 ms").arg(MaxResults).arg(elapsed)
+        : tr("%1 matches, %2 ms").arg(results.hits.size()).arg(elapsed);
+    if (results.pendingSegments > 0) {
+        status += tr(" (%1 older log segments are still being indexed)").arg(results.pendingSegments);
+    }
+    m_status->setText(status);
+}
@@ -0,0 +1,239 @@
+#include "SearchIndex.h"
+#include <QDateTime>
+#include <QStringList>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+static const char Magic[8] = { 'Q', 'T', 'I', 'R', 'C', 'F', 'T', 'S' };
+static const quint32 Version = 1;
+static const int HeaderSize = 16;
+static const int MaxWordLength = 32;
+
+static void appendVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+// Reads a varint at *pos, not past end; false if it runs over
+static bool readVarint(const uchar *data, qint64 end, qint64 *pos, quint64 *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && *pos < end; shift += 7) {
+        const uchar byte = data[(*pos)++];
+        *value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SearchQuery SearchQuery::parse(const QString &text)
+{
+    SearchQuery query;
+    const QStringList parts = text.split(' ', Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        const QString lower = part.toLower();
+        if (lower.startsWith("from:") && part.size() > 5) {
+            query.terms.append(SearchIndex::senderTerm(part.mid(5)));
+        } else if (lower.startsWith("in:") && part.size() > 3) {
+            query.terms.append(SearchIndex::bufferTerm(part.mid(3)));
+        } else if (lower.startsWith("after:") || lower.startsWith("before:")) {
+            const bool after = lower.startsWith("after:");
+            const QDateTime time = QDateTime::fromString(part.mid(after ? 6 : 7), Qt::ISODate);
+            if (time.isValid()) {
+                (after ? query.after : query.before) = time.toMSecsSinceEpoch();
+            }
+        } else {
+            query.terms += SearchIndex::words(part);
+        }
+    }
+    return query;
+}
+
+QVector<QByteArray> SearchIndex::words(const QString &text)
+{
+    QVector<QByteArray> words;
+    const int length = int(text.size());
+    for (int i = 0; i < length;) {
+        if (!text.at(i).isLetterOrNumber()) {
+            ++i;
+            continue;
+        }
+        int end = i;
+        while (end < length && text.at(end).isLetterOrNumber()) {
+            ++end;
+        }
+        // One-letter words are too common to be worth a posting list
+        if (end - i >= 2) {
+            words.append(text.mid(i, qMin(end - i, MaxWordLength)).toLower().toUtf8());
+        }
+        i = end;
+    }
+    return words;
+}
+
+QVector<QByteArray> SearchIndex::terms(const QString &buffer, const QString &sender, const QString &text)
+{
+    QVector<QByteArray> terms = words(text);
+    terms.append(senderTerm(sender));
+    terms.append(bufferTerm(buffer));
+    return terms;
+}
+
+void SearchIndex::add(quint32 offset, const QVector<QByteArray> &terms)
+{
+    for (const QByteArray &term : terms) {
+        Postings &postings = m_terms[term];
+        if (postings.count > 0 && postings.last == offset) {
+            continue;  // the word repeats within the line
+        }
+        appendVarint(postings.bytes, offset - postings.last);
+        postings.last = offset;
+        ++postings.count;
+    }
+}
+
+QVector<quint32> SearchIndex::postings(const QByteArray &term) const
+{
+    const auto it = m_terms.constFind(term);
+    if (it == m_terms.constEnd()) {
+        return QVector<quint32>();
+    }
+    return decode(it->bytes.constData(), int(it->bytes.size()), it->count);
+}
+
+QByteArray SearchIndex::serialize() const
+{
+    QVector<QByteArray> sorted;
+    sorted.reserve(m_terms.size());
+    for (auto it = m_terms.constBegin(); it != m_terms.constEnd(); ++it) {
+        sorted.append(it.key());
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    QByteArray entries;
+    QByteArray directory;
+    const int base = HeaderSize + 4 * int(sorted.size());
+    for (const QByteArray &term : sorted) {
+        const Postings &postings = m_terms[term];
+        char offset[4];
+        qToLittleEndian<quint32>(quint32(base + entries.size()), offset);
+        directory.append(offset, 4);
+
+        appendVarint(entries, quint64(term.size()));
+        entries += term;
+        appendVarint(entries, quint64(postings.count));
+        appendVarint(entries, quint64(postings.bytes.size()));
+        entries += postings.bytes;
+    }
+
+    char header[HeaderSize];
+    memcpy(header, Magic, sizeof(Magic));
+    qToLittleEndian<quint32>(Version, header + 8);
+    qToLittleEndian<quint32>(quint32(sorted.size()), header + 12);
+    return QByteArray(header, HeaderSize) + directory + entries;
+}
+
+QVector<quint32> SearchIndex::decode(const char *data, int length, int count)
+{
+    QVector<quint32> offsets;
+    offsets.reserve(count);
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    qint64 pos = 0;
+    quint64 delta;
+    quint32 offset = 0;
+    while (offsets.size() < count && readVarint(bytes, length, &pos, &delta)) {
+        offset += quint32(delta);
+        offsets.append(offset);
+    }
+    return offsets;
+}
+
+QVector<quint32> SearchIndex::intersect(QVector<QVector<quint32>> lists)
+{
+    if (lists.isEmpty()) {
+        return QVector<quint32>();
+    }
+
+    // Shortest first, so every later step only shrinks it
+    std::sort(lists.begin(), lists.end(), [](const QVector<quint32> &a, const QVector<quint32> &b) {
+        return a.size() < b.size();
+    });
+    QVector<quint32> result = lists.first();
+    for (int i = 1; i < lists.size() && !result.isEmpty(); ++i) {
+        const QVector<quint32> &list = lists.at(i);
+        QVector<quint32> kept;
+        auto from = list.constBegin();
+        for (quint32 offset : result) {
+            from = std::lower_bound(from, list.constEnd(), offset);
+            if (from == list.constEnd()) {
+                break;
+            }
+            if (*from == offset) {
+                kept.append(offset);
+            }
+        }
+        result.swap(kept);
+    }
+    return result;
+}
+
+bool SearchIndexFile::open(const QString &path)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < HeaderSize) {
+        return false;
+    }
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data || memcmp(m_data, Magic, sizeof(Magic)) != 0
+        || qFromLittleEndian<quint32>(m_data + 8) != Version) {
+        return false;
+    }
+    m_termCount = qFromLittleEndian<quint32>(m_data + 12);
+    if (HeaderSize + 4 * qint64(m_termCount) > m_size) {
+        m_termCount = 0;
+    }
+    return true;
+}
+
+QVector<quint32> SearchIndexFile::postings(const QByteArray &term) const
+{
+    // Binary search over the sorted directory, reading terms in place
+    quint32 low = 0;
+    quint32 high = m_termCount;
+    while (low < high) {
+        const quint32 middle = low + (high - low) / 2;
+        qint64 pos = qFromLittleEndian<quint32>(m_data + HeaderSize + 4 * middle);
+        quint64 length;
+        if (!readVarint(m_data, m_size, &pos, &length) || pos + qint64(length) > m_size) {
+            return QVector<quint32>();
+        }
+        const quint64 termLength = quint64(term.size());
+        int compare = memcmp(m_data + pos, term.constData(), size_t(qMin(length, termLength)));
+        if (compare == 0 && length != termLength) {
+            compare = length < termLength ? -1 : 1;
+        }
+        if (compare < 0) {
+            low = middle + 1;
+        } else if (compare > 0) {
+            high = middle;
+        } else {
+            pos += qint64(length);
+            quint64 count;
+            quint64 bytes;
+            if (!readVarint(m_data, m_size, &pos, &count) || !readVarint(m_data, m_size, &pos, &bytes)
+                || pos + qint64(bytes) > m_size) {
+                return QVector<quint32>();
+            }
+            return SearchIndex::decode(reinterpret_cast<const char *>(m_data + pos), int(bytes), int(count));
+        }
+    }
+    return QVector<quint32>();
+}
@@ -0,0 +1,239 @@
+#include "SessionSnapshot.h"
+#include "IrcLog.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const char Magic[8] = { 'Q', 'T', 'I', 'R', 'C', 'S', 'E', 'S' };
+const quint32 Version = 1;
+
+template <typename T>
+void appendInt(QByteArray &out, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian<T>(value, bytes);
+    out.append(bytes, int(sizeof(T)));
+}
+
+void appendString(QByteArray &out, const QString &text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    appendInt<quint32>(out, quint32(utf8.size()));
+    out.append(utf8);
+}
+
+// Bounds-checked cursor over the mapped file; once anything runs past the
+// end, every read fails and ok() stays false
+class Reader
+{
+public:
+    Reader(const uchar *data, qint64 size) : m_data(data), m_size(size), m_pos(0), m_ok(true) {}
+
+    bool ok() const { return m_ok; }
+
+    template <typename T>
+    T integer()
+    {
+        if (!take(sizeof(T))) {
+            return T(0);
+        }
+        return qFromLittleEndian<T>(m_data + m_pos - qint64(sizeof(T)));
+    }
+
+    QString string()
+    {
+        const quint32 length = integer<quint32>();
+        if (!take(length)) {
+            return QString();
+        }
+        return QString::fromUtf8(reinterpret_cast<const char *>(m_data + m_pos - length), int(length));
+    }
+
+    // A count of records each at least minimumSize bytes long; rejects
+    // counts the rest of the file could not hold before allocating for them
+    int count(qint64 minimumSize)
+    {
+        const quint32 n = integer<quint32>();
+        if (m_ok && qint64(n) * minimumSize > m_size - m_pos) {
+            m_ok = false;
+        }
+        return m_ok ? int(n) : 0;
+    }
+
+    bool take(qint64 length)
+    {
+        if (!m_ok || length > m_size - m_pos) {
+            m_ok = false;
+            return false;
+        }
+        m_pos += length;
+        return true;
+    }
+
+private:
+    const uchar *m_data;
+    qint64 m_size;
+    qint64 m_pos;
+    bool m_ok;
+};
+
+} // namespace
+
+QByteArray SessionSnapshot::serialize() const
+{
+    QByteArray out(Magic, int(sizeof(Magic)));
+    appendInt<quint32>(out, Version);
+    appendInt<quint32>(out, quint32(networks.size()));
+    appendInt<qint32>(out, currentNetwork);
+    appendInt<qint32>(out, currentBuffer);
+
+    for (const Network &network : networks) {
+        appendInt<quint32>(out, quint32(network.addresses.size()));
+        for (const IrcServerAddress &address : network.addresses) {
+            appendString(out, address.host);
+            appendInt<quint16>(out, address.port);
+            appendInt<quint8>(out, address.tls ? 1 : 0);
+        }
+        appendString(out, network.nickname);
+        appendInt<quint8>(out, network.connected ? 1 : 0);
+
+        appendInt<quint32>(out, quint32(network.buffers.size()));
+        for (const Buffer &buffer : network.buffers) {
+            appendString(out, buffer.name);
+            appendString(out, buffer.topic);
+            appendString(out, buffer.members.join(' '));
+            appendInt<quint32>(out, quint32(buffer.lines.size()));
+            for (const MessageLogModel::Entry &line : buffer.lines) {
+                appendInt<qint64>(out, line.timestamp);
+                appendInt<quint8>(out, quint8(line.kind));
+                appendString(out, line.sender);
+                appendString(out, line.text);
+            }
+        }
+    }
+    return out;
+}
+
+bool SessionSnapshot::parse(const uchar *data, qint64 size, SessionSnapshot *snapshot)
+{
+    if (size < qint64(sizeof(Magic)) || std::memcmp(data, Magic, sizeof(Magic)) != 0) {
+        return false;
+    }
+    Reader in(data + sizeof(Magic), size - qint64(sizeof(Magic)));
+    if (in.integer<quint32>() != Version) {
+        return false;
+    }
+
+    SessionSnapshot result;
+    const int networkCount = in.count(13);
+    result.currentNetwork = in.integer<qint32>();
+    result.currentBuffer = in.integer<qint32>();
+    result.networks.reserve(networkCount);
+    for (int n = 0; n < networkCount && in.ok(); ++n) {
+        Network network;
+        const int addressCount = in.count(7);
+        for (int a = 0; a < addressCount && in.ok(); ++a) {
+            IrcServerAddress address;
+            address.host = in.string();
+            address.port = in.integer<quint16>();
+            address.tls = in.integer<quint8>() != 0;
+            network.addresses.append(address);
+        }
+        network.nickname = in.string();
+        network.connected = in.integer<quint8>() & 1;
+
+        const int bufferCount = in.count(16);
+        network.buffers.reserve(bufferCount);
+        for (int b = 0; b < bufferCount && in.ok(); ++b) {
+            Buffer buffer;
+            buffer.name = in.string();
+            buffer.topic = in.string();
+            buffer.members = in.string().split(' ', Qt::SkipEmptyParts);
+            const int lineCount = in.count(17);
+            buffer.lines.resize(lineCount);
+            for (MessageLogModel::Entry &line : buffer.lines) {
+                line.timestamp = in.integer<qint64>();
+                line.kind = in.integer<quint8>() == MessageLogModel::System ? MessageLogModel::System
+                                                                            : MessageLogModel::Message;
+                line.sender = in.string();
+                line.text = in.string();
+            }
+            network.buffers.append(buffer);
+        }
+        if (!network.addresses.isEmpty() && !network.buffers.isEmpty()) {
+            result.networks.append(network);
+        }
+    }
+    if (!in.ok()) {
+        return false;
+    }
+    *snapshot = result;
+    return true;
+}
+
+bool SessionSnapshot::write(const QString &path, const QByteArray &data)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qCWarning(lcIrcSession) << "Cannot write" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+SessionSnapshot SessionSnapshot::read(const QString &path)
+{
+    SessionSnapshot snapshot;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return snapshot;
+    }
+    const uchar *data = file.map(0, file.size());
+    if (!data) {
+        qCWarning(lcIrcSession) << "Cannot map" << path << ":" << file.errorString();
+        return snapshot;
+    }
+    if (!parse(data, file.size(), &snapshot)) {
+        qCWarning(lcIrcSession) << "Ignoring unreadable session snapshot" << path;
+    }
+    file.unmap(const_cast<uchar *>(data));
+    return snapshot;
+}
+
+QString SessionSnapshot::defaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/session";
+}
+
+SessionSnapshot::Network SessionSnapshot::fromCore(const IrcCoreProtocol::Network &network)
+{
+    Network restored;
+    restored.addresses = network.addresses;
+    restored.nickname = network.nickname;
+    restored.buffers.reserve(network.buffers.size());
+    for (const IrcCoreProtocol::Buffer &buffer : network.buffers) {
+        Buffer converted;
+        converted.name = buffer.name;
+        converted.topic = buffer.topic;
+        converted.members = buffer.members;
+        converted.linesInLog = false;
+        converted.lines.reserve(buffer.lines.size());
+        for (const IrcCoreProtocol::Line &line : buffer.lines) {
+            MessageLogModel::Entry entry;
+            entry.timestamp = line.timestamp;
+            entry.kind = line.system ? MessageLogModel::System : MessageLogModel::Message;
+            entry.sender = line.sender;
+            entry.text = line.text;
+            converted.lines.append(entry);
+        }
+        restored.buffers.append(converted);
+    }
+    return restored;
+}
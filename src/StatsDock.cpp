@@ -0,0 +1,74 @@
+#include "StatsDock.h"
+#include "IrcConnection.h"
+#include "IrcNetworkPool.h"
+#include "IrcStats.h"
+#include <QFileDialog>
+#include <QFontDatabase>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+StatsDock::StatsDock(QWidget *parent)
+    : QDockWidget(tr("Statistics"), parent)
+    , m_view(new QPlainTextEdit)
+    , m_refreshTimer(new QTimer(this))
+{
+    setObjectName("StatsDock");
+    
+    QWidget *contents = new QWidget;
+    QVBoxLayout *layout = new QVBoxLayout(contents);
+    layout->setContentsMargins(4, 4, 4, 4);
+    
+    m_view->setReadOnly(true);
+    m_view->setLineWrapMode(QPlainTextEdit::NoWrap);
+    m_view->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    layout->addWidget(m_view);
+    
+    QPushButton *dumpButton = new QPushButton(tr("Dump to File..."));
+    connect(dumpButton, &QPushButton::clicked, this, &StatsDock::onDumpClicked);
+    layout->addWidget(dumpButton);
+    
+    setWidget(contents);
+    
+    // Only spend time on formatting while someone is looking
+    m_refreshTimer->setInterval(1000);
+    connect(m_refreshTimer, &QTimer::timeout, this, &StatsDock::refresh);
+    connect(this, &QDockWidget::visibilityChanged, this, &StatsDock::onVisibilityChanged);
+}
+
+void StatsDock::addConnection(IrcConnection *connection)
+{
+    m_connections.append(connection);
+}
+
+void StatsDock::removeConnection(IrcConnection *connection)
+{
+    m_connections.removeAll(connection);
+}
+
+void StatsDock::refresh()
+{
+    QString text = IrcStats::format(IrcStats::snapshot()) + IrcNetworkPool::shared()->statsText();
+    for (IrcConnection *connection : qAsConst(m_connections)) {
+        text += QString("\n[%1]\n").arg(connection->server()) + connection->statsText();
+    }
+    m_view->setPlainText(text);
+}
+
+void StatsDock::onDumpClicked()
+{
+    const QString path = QFileDialog::getSaveFileName(this, tr("Dump Statistics"), "irc-stats.txt");
+    if (!path.isEmpty() && !IrcStats::dump(path)) {
+        QMessageBox::warning(this, tr("Dump Statistics"), tr("Could not write %1").arg(path));
+    }
+}
+
+void StatsDock::onVisibilityChanged(bool visible)
+{
+    if (visible) {
+        refresh();
+        m_refreshTimer->start();
+    } else {
+        m_refreshTimer->stop();
+    }
+}
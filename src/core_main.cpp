@@ -0,0 +1,60 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include "IrcCoreProtocol.h"
+#include "IrcCoreServer.h"
+#include "IrcLog.h"
+#include "IrcNetworkPool.h"
+#include "IrcTls.h"
+
+// The headless core: stays connected while no window is open. Windows
+// started with --attach show its networks and send through it.
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // The same data directory as the client, for TLS pins and filters
+    app.setApplicationName("IRC Client");
+    app.setApplicationVersion("1.0");
+    app.setOrganizationName("QtIRC");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Keeps IRC connections and recent history for windows to attach to.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption({ "core-name", "Local socket to listen on (default: one per user).", "name" });
+    parser.addOption({ "history-mb", "Memory for buffered lines, all networks together (default 64).", "MiB", "64" });
+    parser.addOption({ "log-file", "Write the log here instead of to stderr.", "file" });
+    parser.addOption({ "capture", "Record all IRC traffic to a binary capture file.", "file" });
+    parser.addOption({ "network-threads", "Threads shared by all server connections.", "count" });
+    parser.addOption({ "tls-ca", "Also trust the CA certificates in this PEM file.", "file" });
+    parser.addOption({ "tls-cert", "Client certificate (PEM), to log in with SASL EXTERNAL.", "file" });
+    parser.addOption({ "tls-key", "Private key (PEM) of the client certificate.", "file" });
+    parser.addOption({ "tls-pin", "Trust servers seen before by certificate fingerprint." });
+    parser.process(app);
+
+    IrcNetworkPool::setDefaultThreadCount(parser.value("network-threads").toInt());
+
+    IrcTlsOptions tls;
+    tls.caFile = parser.value("tls-ca");
+    tls.certificateFile = parser.value("tls-cert");
+    tls.keyFile = parser.value("tls-key");
+    tls.pinning = parser.isSet("tls-pin");
+    IrcTls::setDefaultOptions(tls);
+
+    IrcLog::start(parser.value("log-file"), parser.value("capture"));
+
+    const QString name = parser.isSet("core-name") ? parser.value("core-name")
+                                                   : IrcCoreProtocol::defaultServerName();
+    const qint64 budget = qMax<qint64>(1, parser.value("history-mb").toLongLong()) * 1024 * 1024;
+
+    int result = 1;
+    {
+        IrcCoreServer core(budget);
+        if (core.listen(name)) {
+            result = app.exec();
+        }
+    }
+
+    IrcLog::stop();
+    return result;
+}
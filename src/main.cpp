@@ -1,4 +1,10 @@
 #include <QApplication>
+#include <QCommandLineParser>
+#include "DccManager.h"
+#include "IrcCoreProtocol.h"
+#include "IrcLog.h"
+#include "IrcNetworkPool.h"
+#include "IrcTls.h"
 #include "MainWindow.h"
 
 int main(int argc, char *argv[])
@@ -9,8 +15,69 @@ int main(int argc, char *argv[])
     app.setApplicationVersion("1.0");
     app.setOrganizationName("QtIRC");
     
-    MainWindow window;
-    window.show();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption({ "log-file", "Write the log here instead of to stderr.", "file" });
+    parser.addOption({ "capture", "Record all IRC traffic to a binary capture file.", "file" });
+    parser.addOption({ "network-threads", "Threads shared by all server connections.", "count" });
+    parser.addOption({ "max-fps", "Redraw chat buffers at most this often per second (default 60).", "fps" });
+    parser.addOption({ "tls-ca", "Also trust the CA certificates in this PEM file.", "file" });
+    parser.addOption({ "tls-cert", "Client certificate (PEM), to log in with SASL EXTERNAL.", "file" });
+    parser.addOption({ "tls-key", "Private key (PEM) of the client certificate.", "file" });
+    parser.addOption({ "tls-pin", "Trust servers seen before by certificate fingerprint." });
+    parser.addOption({ "dcc-dir", "Save DCC downloads here (default: the Downloads folder).", "directory" });
+    parser.addOption({ "dcc-address", "Address to offer DCC sends on, e.g. behind NAT.", "address" });
+    parser.addOption({ "dcc-ports", "Ports to listen on for DCC sends, e.g. 5000-5010.", "range" });
+    parser.addOption({ "dcc-rate", "Cap all DCC transfers together at this many KiB/s.", "rate" });
+    parser.addOption({ "no-restore", "Start empty instead of restoring the last session." });
+    parser.addOption({ "attach", "Show the networks of the running IRCClientCore and connect through it." });
+    parser.addOption({ "core-name", "Local socket of the core to attach to (default: the user's).", "name" });
+    parser.process(app);
     
-    return app.exec();
+    IrcNetworkPool::setDefaultThreadCount(parser.value("network-threads").toInt());
+    if (parser.isSet("max-fps")) {
+        ChatWidget::setFrameRate(parser.value("max-fps").toInt());
+    }
+    
+    IrcTlsOptions tls;
+    tls.caFile = parser.value("tls-ca");
+    tls.certificateFile = parser.value("tls-cert");
+    tls.keyFile = parser.value("tls-key");
+    tls.pinning = parser.isSet("tls-pin");
+    IrcTls::setDefaultOptions(tls);
+    
+    DccOptions dcc;
+    dcc.downloadDirectory = parser.value("dcc-dir");
+    dcc.address = QHostAddress(parser.value("dcc-address"));
+    const QStringList ports = parser.value("dcc-ports").split('-');
+    dcc.firstPort = ports.value(0).toUShort();
+    dcc.lastPort = ports.size() > 1 ? ports.at(1).toUShort() : dcc.firstPort;
+    dcc.rateLimit = parser.value("dcc-rate").toLongLong() * 1024;
+    DccManager::setDefaultOptions(dcc);
+    
+    // Logging moves to a background thread from here on
+    IrcLog::start(parser.value("log-file"), parser.value("capture"));
+    
+    int result;
+    {
+        MainWindow window;
+        bool attached = false;
+        if (parser.isSet("attach")) {
+            const QString name = parser.isSet("core-name") ? parser.value("core-name")
+                                                           : IrcCoreProtocol::defaultServerName();
+            attached = window.attachToCore(name);
+            if (!attached) {
+                qWarning("No core is running at %s; connecting directly", qPrintable(name));
+            }
+        }
+        if (!attached && !parser.isSet("no-restore")) {
+            window.restoreSession();
+        }
+        window.show();
+        result = app.exec();
+    }
+    
+    IrcLog::stop();
+    return result;
 }
@@ -0,0 +1,288 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include "IrcCoreProtocol.h"
+
+// The core's frames: what Writer builds, Reader reads back, and neither a
+// frame cut short nor one with impossible counts gets a Reader past the
+// end of its data.
+namespace {
+
+IrcCoreProtocol::Network sampleNetwork()
+{
+    IrcCoreProtocol::Network network;
+    network.id = 42;
+    IrcServerAddress address;
+    address.host = "irc.example";
+    address.port = 6697;
+    address.tls = true;
+    network.addresses.append(address);
+    network.nickname = "nick";
+    network.connected = true;
+    network.localAddress = "192.0.2.1";
+    network.isupport = QStringList{ "CHANTYPES=#&", "CASEMAPPING=rfc1459", "WHOX" };
+    for (int b = 0; b < 2; ++b) {
+        IrcCoreProtocol::Buffer buffer;
+        buffer.name = b == 0 ? QString("Server") : QString("#chan");
+        buffer.topic = QString::fromUtf8("caf\xc3\xa9");
+        buffer.members = b == 0 ? QStringList() : QStringList{ "@op", "plain" };
+        for (int l = 0; l < 3; ++l) {
+            IrcCoreProtocol::Line line;
+            line.timestamp = 1700000000000LL + l;
+            line.system = l == 0;
+            line.sender = "someone";
+            line.text = QString("line %1").arg(l);
+            buffer.lines.append(line);
+        }
+        network.buffers.append(buffer);
+    }
+    return network;
+}
+
+// The payload of a frame: past the length and the type
+QByteArray payload(IrcCoreProtocol::Writer &writer)
+{
+    return writer.frame().mid(5);
+}
+
+} // namespace
+
+class TestIrcCoreProtocol : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void frameHeader();
+    void network();
+    void event();
+    void truncated();
+    void hugeCounts();
+    void readFrames();
+    void badFrames();
+};
+
+void TestIrcCoreProtocol::frameHeader()
+{
+    IrcCoreProtocol::Writer writer(IrcCoreProtocol::SendLine);
+    writer.integer<quint32>(7);
+    writer.string("PRIVMSG #c :hi");
+    const QByteArray frame = writer.frame();
+    QCOMPARE(qFromLittleEndian<quint32>(frame.constData()), quint32(frame.size() - 4));
+    QCOMPARE(quint8(frame.at(4)), quint8(IrcCoreProtocol::SendLine));
+
+    IrcCoreProtocol::Reader in(frame.constData() + 5, frame.size() - 5);
+    QCOMPARE(in.integer<quint32>(), quint32(7));
+    QCOMPARE(in.string(), QString("PRIVMSG #c :hi"));
+    QVERIFY(in.ok());
+    QVERIFY(in.atEnd());
+}
+
+void TestIrcCoreProtocol::network()
+{
+    const IrcCoreProtocol::Network written = sampleNetwork();
+    IrcCoreProtocol::Writer writer(IrcCoreProtocol::Snapshot);
+    writer.network(written);
+    const QByteArray data = payload(writer);
+
+    IrcCoreProtocol::Reader in(data.constData(), data.size());
+    const IrcCoreProtocol::Network read = in.network();
+    QVERIFY(in.ok());
+    QVERIFY(in.atEnd());
+    QCOMPARE(read.id, written.id);
+    QCOMPARE(read.addresses.size(), 1);
+    QCOMPARE(read.addresses.first().host, written.addresses.first().host);
+    QCOMPARE(read.addresses.first().port, written.addresses.first().port);
+    QCOMPARE(read.addresses.first().tls, written.addresses.first().tls);
+    QCOMPARE(read.nickname, written.nickname);
+    QCOMPARE(read.connected, written.connected);
+    QCOMPARE(read.localAddress, written.localAddress);
+    QCOMPARE(read.isupport, written.isupport);
+    QCOMPARE(read.buffers.size(), written.buffers.size());
+    for (int b = 0; b < written.buffers.size(); ++b) {
+        QCOMPARE(read.buffers.at(b).name, written.buffers.at(b).name);
+        QCOMPARE(read.buffers.at(b).topic, written.buffers.at(b).topic);
+        QCOMPARE(read.buffers.at(b).members, written.buffers.at(b).members);
+        QCOMPARE(read.buffers.at(b).lines.size(), written.buffers.at(b).lines.size());
+        for (int l = 0; l < written.buffers.at(b).lines.size(); ++l) {
+            const IrcCoreProtocol::Line &x = written.buffers.at(b).lines.at(l);
+            const IrcCoreProtocol::Line &y = read.buffers.at(b).lines.at(l);
+            QCOMPARE(y.timestamp, x.timestamp);
+            QCOMPARE(y.system, x.system);
+            QCOMPARE(y.sender, x.sender);
+            QCOMPARE(y.text, x.text);
+        }
+    }
+
+    // A network without an address or buffers cannot be restored
+    IrcCoreProtocol::Network bare = written;
+    bare.addresses.clear();
+    IrcCoreProtocol::Writer bareWriter(IrcCoreProtocol::Snapshot);
+    bareWriter.network(bare);
+    const QByteArray bareData = payload(bareWriter);
+    IrcCoreProtocol::Reader bareIn(bareData.constData(), bareData.size());
+    bareIn.network();
+    QVERIFY(!bareIn.ok());
+}
+
+void TestIrcCoreProtocol::event()
+{
+    IrcStringPool sent;
+    IrcEvent written(IrcEvent::Quit, "someone", QString(), "bye");
+    written.channels = { sent.intern(QString("#a")), sent.intern(QString("#b")) };
+    written.sentTime = 123456;
+    written.highlight = true;
+
+    IrcCoreProtocol::Writer writer(IrcCoreProtocol::Events);
+    writer.event(written, sent);
+    const QByteArray data = payload(writer);
+
+    // Ids come from the receiving pool
+    IrcStringPool received;
+    received.intern(QString("padding"));
+    IrcCoreProtocol::Reader in(data.constData(), data.size());
+    const IrcEvent read = in.event(received);
+    QVERIFY(in.ok());
+    QVERIFY(in.atEnd());
+    QCOMPARE(read.type, IrcEvent::Quit);
+    QCOMPARE(read.sender, QString("someone"));
+    QCOMPARE(read.senderId, received.intern(QString("someone")));
+    QVERIFY(read.target.isEmpty());
+    QCOMPARE(read.targetId, IrcStringPool::NullId);
+    QCOMPARE(read.text, QString("bye"));
+    QCOMPARE(read.channels.size(), 2);
+    QCOMPARE(received.string(read.channels.at(0)), QString("#a"));
+    QCOMPARE(received.string(read.channels.at(1)), QString("#b"));
+    QCOMPARE(read.sentTime, qint64(123456));
+    QVERIFY(read.highlight);
+
+    // An event type from a newer core
+    QByteArray unknown = data;
+    unknown[0] = char(IrcEvent::ISupport + 1);
+    IrcCoreProtocol::Reader unknownIn(unknown.constData(), unknown.size());
+    unknownIn.event(received);
+    QVERIFY(!unknownIn.ok());
+}
+
+void TestIrcCoreProtocol::truncated()
+{
+    IrcCoreProtocol::Writer writer(IrcCoreProtocol::Snapshot);
+    writer.network(sampleNetwork());
+    const QByteArray data = payload(writer);
+    for (int size = 0; size < data.size(); ++size) {
+        // A copy of just that much, so reading past it would be caught
+        const QByteArray part = data.left(size);
+        IrcCoreProtocol::Reader in(part.constData(), part.size());
+        in.network();
+        if (in.ok()) {
+            QFAIL(qPrintable(QString("accepted %1 of %2 bytes").arg(size).arg(data.size())));
+        }
+    }
+
+    IrcCoreProtocol::Writer lines(IrcCoreProtocol::SnapshotLines);
+    lines.lines(sampleNetwork().buffers.first().lines);
+    const QByteArray linesData = payload(lines);
+    for (int size = 0; size < linesData.size(); ++size) {
+        const QByteArray part = linesData.left(size);
+        IrcCoreProtocol::Reader in(part.constData(), part.size());
+        in.lines();
+        QVERIFY(!in.ok());
+    }
+}
+
+void TestIrcCoreProtocol::hugeCounts()
+{
+    // Counts far beyond what the frame holds are refused before anything
+    // is allocated for them
+    QByteArray data(4, '\0');
+    qToLittleEndian<quint32>(0xFFFFFFFFu, data.data());
+    {
+        IrcCoreProtocol::Reader in(data.constData(), data.size());
+        QVERIFY(in.strings().isEmpty());
+        QVERIFY(!in.ok());
+    }
+    {
+        IrcCoreProtocol::Reader in(data.constData(), data.size());
+        QVERIFY(in.lines().isEmpty());
+        QVERIFY(!in.ok());
+    }
+    {
+        IrcCoreProtocol::Reader in(data.constData(), data.size());
+        QVERIFY(in.addresses().isEmpty());
+        QVERIFY(!in.ok());
+    }
+    {
+        // A string longer than the frame
+        IrcCoreProtocol::Reader in(data.constData(), data.size());
+        QVERIFY(in.bytes().isEmpty());
+        QVERIFY(!in.ok());
+    }
+}
+
+void TestIrcCoreProtocol::readFrames()
+{
+    IrcCoreProtocol::Writer first(IrcCoreProtocol::Connect);
+    first.integer<quint32>(1);
+    IrcCoreProtocol::Writer second(IrcCoreProtocol::SnapshotEnd);
+    IrcCoreProtocol::Writer third(IrcCoreProtocol::Disconnect);
+    third.integer<quint32>(3);
+    const QByteArray stream = first.frame() + second.frame() + third.frame();
+
+    // Fed a byte at a time, each frame is handled once it is complete
+    QVector<IrcCoreProtocol::FrameType> types;
+    QVector<quint32> ids;
+    QByteArray buffer;
+    for (char byte : stream) {
+        buffer += byte;
+        QVERIFY(IrcCoreProtocol::readFrames(buffer, [&](IrcCoreProtocol::FrameType type,
+                                                        IrcCoreProtocol::Reader &in) {
+            types.append(type);
+            if (type != IrcCoreProtocol::SnapshotEnd) {
+                ids.append(in.integer<quint32>());
+            }
+            return in.atEnd();
+        }));
+    }
+    QVERIFY(buffer.isEmpty());
+    QCOMPARE(types, (QVector<IrcCoreProtocol::FrameType>{ IrcCoreProtocol::Connect, IrcCoreProtocol::SnapshotEnd,
+                                                          IrcCoreProtocol::Disconnect }));
+    QCOMPARE(ids, (QVector<quint32>{ 1, 3 }));
+}
+
+void TestIrcCoreProtocol::badFrames()
+{
+    auto accept = [](IrcCoreProtocol::FrameType, IrcCoreProtocol::Reader &) { return true; };
+
+    QByteArray empty(4, '\0');
+    QVERIFY(!IrcCoreProtocol::readFrames(empty, accept));
+
+    // Refused from the length alone, without waiting for the body
+    QByteArray oversized(4, '\0');
+    qToLittleEndian<quint32>(IrcCoreProtocol::MaxFrameSize + 1, oversized.data());
+    QVERIFY(!IrcCoreProtocol::readFrames(oversized, accept));
+
+    // A handler that reads past the payload fails the stream
+    IrcCoreProtocol::Writer writer(IrcCoreProtocol::Connect);
+    writer.integer<quint16>(1);
+    QByteArray shortPayload = writer.frame();
+    QVERIFY(!IrcCoreProtocol::readFrames(shortPayload, [](IrcCoreProtocol::FrameType,
+                                                          IrcCoreProtocol::Reader &in) {
+        in.integer<quint32>();
+        return true;
+    }));
+
+    // Random streams never get a reader past the data
+    QRandomGenerator random(1);
+    for (int round = 0; round < 2000; ++round) {
+        QByteArray stream;
+        const int length = int(random.bounded(64));
+        for (int i = 0; i < length; ++i) {
+            stream += char(random.bounded(i < 4 ? 16 : 256));
+        }
+        IrcCoreProtocol::readFrames(stream, [](IrcCoreProtocol::FrameType, IrcCoreProtocol::Reader &in) {
+            in.network();
+            return in.ok();
+        });
+    }
+}
+
+QTEST_APPLESS_MAIN(TestIrcCoreProtocol)
+#include "tst_irccoreprotocol.moc"
@@ -0,0 +1,250 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include "IrcFilter.h"
+
+// The compiled IrcFilter automata against a plain matcher: every highlight
+// word looked for with indexOf() and its boundaries checked by hand, every
+// ignore mask globbed on its own.
+namespace {
+
+char fold(char c)
+{
+    return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+QByteArray folded(const QString &text)
+{
+    QByteArray bytes = text.trimmed().toUtf8();
+    for (char &c : bytes) {
+        c = fold(c);
+    }
+    return bytes;
+}
+
+bool isWordByte(char c)
+{
+    const uchar u = uchar(c);
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9')
+           || u == '_' || u >= 0x80;
+}
+
+bool plainHighlights(const QStringList &words, const QByteArray &text)
+{
+    QByteArray haystack = text;
+    for (char &c : haystack) {
+        c = fold(c);
+    }
+    for (const QString &word : words) {
+        const QByteArray needle = folded(word);
+        if (needle.isEmpty()) {
+            continue;
+        }
+        for (int at = haystack.indexOf(needle); at >= 0; at = haystack.indexOf(needle, at + 1)) {
+            const int end = at + needle.size();
+            const bool before = !isWordByte(needle.at(0)) || at == 0 || !isWordByte(haystack.at(at - 1));
+            const bool after = !isWordByte(needle.at(needle.size() - 1)) || end == haystack.size()
+                               || !isWordByte(haystack.at(end));
+            if (before && after) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool globs(const char *mask, const char *text)
+{
+    if (*mask == '\0') {
+        return *text == '\0';
+    }
+    if (*mask == '*') {
+        return globs(mask + 1, text) || (*text != '\0' && globs(mask, text + 1));
+    }
+    return *text != '\0' && (*mask == '?' || *mask == fold(*text)) && globs(mask + 1, text + 1);
+}
+
+bool plainIgnores(const QStringList &masks, const QByteArray &prefix)
+{
+    for (const QString &mask : masks) {
+        const QByteArray pattern = folded(IrcFilterRules::normalizeMask(mask));
+        if (!pattern.isEmpty() && globs(pattern.constData(), prefix.constData())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QByteArray randomBytes(QRandomGenerator &random, const char *alphabet, int maxLength)
+{
+    const int size = int(qstrlen(alphabet));
+    QByteArray bytes;
+    const int length = int(random.bounded(maxLength + 1));
+    for (int i = 0; i < length; ++i) {
+        bytes += alphabet[random.bounded(size)];
+    }
+    return bytes;
+}
+
+} // namespace
+
+class TestIrcFilter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void highlights_data();
+    void highlights();
+    void ignores_data();
+    void ignores();
+    void empty();
+
+    void randomHighlights();
+    void randomIgnores();
+    void complexMasks();
+};
+
+void TestIrcFilter::highlights_data()
+{
+    QTest::addColumn<QStringList>("words");
+    QTest::addColumn<QByteArray>("text");
+    QTest::addColumn<bool>("expected");
+
+    const QStringList bob{ "bob" };
+    QTest::newRow("alone") << bob << QByteArray("bob") << true;
+    QTest::newRow("addressed") << bob << QByteArray("bob: hi") << true;
+    QTest::newRow("inside") << bob << QByteArray("hi bob, there") << true;
+    QTest::newRow("case") << bob << QByteArray("BoB?") << true;
+    QTest::newRow("longer word") << bob << QByteArray("bobcat") << false;
+    QTest::newRow("suffix") << bob << QByteArray("jimbob") << false;
+    QTest::newRow("underscore") << bob << QByteArray("bob_") << false;
+    QTest::newRow("digit") << bob << QByteArray("bob2") << false;
+    QTest::newRow("later") << bob << QByteArray("bobcat and bob") << true;
+    QTest::newRow("utf-8 neighbour") << QStringList{ QString::fromUtf8("caf\xc3\xa9") }
+                                     << QByteArray("caf\xc3\xa9s") << false;
+    QTest::newRow("utf-8 alone") << QStringList{ QString::fromUtf8("caf\xc3\xa9") }
+                                 << QByteArray("un caf\xc3\xa9!") << true;
+    QTest::newRow("punctuation word") << QStringList{ "c++" } << QByteArray("c++x") << true;
+    QTest::newRow("suffix of another") << QStringList{ "abcd", "bc" } << QByteArray("x bc y") << true;
+    QTest::newRow("overlapping") << QStringList{ "ab", "bab" } << QByteArray("abab") << false;
+    QTest::newRow("trimmed") << QStringList{ "  bob " } << QByteArray("bob") << true;
+}
+
+void TestIrcFilter::highlights()
+{
+    QFETCH(QStringList, words);
+    QFETCH(QByteArray, text);
+    QFETCH(bool, expected);
+
+    const IrcFilter filter(words, QStringList());
+    QCOMPARE(plainHighlights(words, text), expected);
+    QCOMPARE(filter.highlights(text), expected);
+}
+
+void TestIrcFilter::ignores_data()
+{
+    QTest::addColumn<QStringList>("masks");
+    QTest::addColumn<QByteArray>("prefix");
+    QTest::addColumn<bool>("expected");
+
+    QTest::newRow("nick") << QStringList{ "spammer" } << QByteArray("spammer!u@h") << true;
+    QTest::newRow("nick case") << QStringList{ "Spammer" } << QByteArray("SPAMMER!u@h") << true;
+    QTest::newRow("other nick") << QStringList{ "spammer" } << QByteArray("spammer2!u@h") << false;
+    QTest::newRow("host") << QStringList{ "*@bad.example" } << QByteArray("n!u@bad.example") << true;
+    QTest::newRow("user") << QStringList{ "n!bot" } << QByteArray("n!bot@anywhere") << true;
+    QTest::newRow("question") << QStringList{ "n?!*@*" } << QByteArray("n1!u@h") << true;
+    QTest::newRow("question too short") << QStringList{ "n?!*@*" } << QByteArray("n!u@h") << false;
+    QTest::newRow("star run") << QStringList{ "a***b!*@*" } << QByteArray("ab!u@h") << true;
+    QTest::newRow("second mask") << QStringList{ "x!*@*", "*!*@*.example" }
+                                 << QByteArray("n!u@h.example") << true;
+    QTest::newRow("no mask") << QStringList{ "x!*@*", "y!*@*" } << QByteArray("n!u@h") << false;
+}
+
+void TestIrcFilter::ignores()
+{
+    QFETCH(QStringList, masks);
+    QFETCH(QByteArray, prefix);
+    QFETCH(bool, expected);
+
+    const IrcFilter filter(QStringList(), masks);
+    QCOMPARE(plainIgnores(masks, prefix), expected);
+    QCOMPARE(filter.ignores(prefix), expected);
+}
+
+void TestIrcFilter::empty()
+{
+    const IrcFilter none;
+    QVERIFY(!none.highlights(QByteArray("anything")));
+    QVERIFY(!none.ignores(QByteArray("n!u@h")));
+
+    const IrcFilter blank(QStringList{ "", "  " }, QStringList{ "" });
+    QVERIFY(!blank.highlights(QByteArray("a b")));
+    QVERIFY(!blank.ignores(QByteArray("n!u@h")));
+}
+
+void TestIrcFilter::randomHighlights()
+{
+    // A small alphabet, so words overlap and touch each other often
+    QRandomGenerator random(1);
+    for (int round = 0; round < 200; ++round) {
+        QStringList words;
+        const int count = 1 + int(random.bounded(8));
+        for (int i = 0; i < count; ++i) {
+            words.append(QString::fromLatin1(randomBytes(random, "abAB_ .", 4)));
+        }
+        const IrcFilter filter(words, QStringList());
+        for (int i = 0; i < 50; ++i) {
+            const QByteArray text = randomBytes(random, "abAB_ .", 24);
+            if (filter.highlights(text) != plainHighlights(words, text)) {
+                QFAIL(qPrintable(QString("words %1, text \"%2\"")
+                                 .arg(words.join('|'), QString::fromLatin1(text))));
+            }
+        }
+    }
+}
+
+void TestIrcFilter::randomIgnores()
+{
+    QRandomGenerator random(2);
+    for (int round = 0; round < 200; ++round) {
+        QStringList masks;
+        const int count = 1 + int(random.bounded(6));
+        for (int i = 0; i < count; ++i) {
+            masks.append(QString::fromLatin1(randomBytes(random, "abA*?!@", 8)));
+        }
+        const IrcFilter filter(QStringList(), masks);
+        for (int i = 0; i < 50; ++i) {
+            const QByteArray prefix = randomBytes(random, "aAb", 4) + '!' + randomBytes(random, "ab", 3)
+                                      + '@' + randomBytes(random, "ab.", 5);
+            if (filter.ignores(prefix) != plainIgnores(masks, prefix)) {
+                QFAIL(qPrintable(QString("masks %1, prefix \"%2\"")
+                                 .arg(masks.join('|'), QString::fromLatin1(prefix))));
+            }
+        }
+    }
+}
+
+void TestIrcFilter::complexMasks()
+{
+    // Enough stars to push the DFA past MaxIgnoreStates, so some masks are
+    // tried one by one; the answers must not change
+    QRandomGenerator random(3);
+    QStringList masks;
+    for (int i = 0; i < 24; ++i) {
+        QByteArray mask = "*";
+        for (int j = 0; j < 6; ++j) {
+            mask += randomBytes(random, "abcd", 2) + '*';
+        }
+        masks.append(QString::fromLatin1(mask + "!*@*"));
+    }
+    const IrcFilter filter(QStringList(), masks);
+    QVERIFY(filter.ignoreStateCount() <= IrcFilter::MaxIgnoreStates);
+    for (int i = 0; i < 500; ++i) {
+        const QByteArray prefix = randomBytes(random, "abcd", 20) + "!u@h";
+        if (filter.ignores(prefix) != plainIgnores(masks, prefix)) {
+            QFAIL(qPrintable(QString("prefix \"%1\"").arg(QString::fromLatin1(prefix))));
+        }
+    }
+}
+
+QTEST_APPLESS_MAIN(TestIrcFilter)
+#include "tst_ircfilter.moc"
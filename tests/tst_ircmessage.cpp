@@ -0,0 +1,277 @@
+#include <QtTest>
+#include "IrcMessage.h"
+
+// Conformance of IrcMessage to RFC 1459/2812 framing and IRCv3
+// message-tags: tags and their escaping, prefix, command, trailing and
+// empty parameters, and the 15 parameter limit.
+class TestIrcMessage : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void tags_data();
+    void tags();
+    void invalidTagKeys_data();
+    void invalidTagKeys();
+    void duplicateTags();
+    void tagWithoutValue();
+
+    void prefix_data();
+    void prefix();
+
+    void command_data();
+    void command();
+
+    void params_data();
+    void params();
+    void paramOutOfRange();
+    void joinedParams();
+
+    void paramLimit_data();
+    void paramLimit();
+};
+
+void TestIrcMessage::tags_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::addColumn<QString>("key");
+    QTest::addColumn<QString>("value");
+
+    QTest::newRow("plain") << QByteArray("@id=123 PRIVMSG #c :hi") << "id" << "123";
+    QTest::newRow("second") << QByteArray("@a=1;b=2 PRIVMSG #c :hi") << "b" << "2";
+    QTest::newRow("vendor") << QByteArray("@example.com/foo=bar CMD") << "example.com/foo" << "bar";
+    QTest::newRow("client") << QByteArray("@+draft/reply=abc CMD") << "+draft/reply" << "abc";
+    QTest::newRow("semicolon") << QByteArray("@k=a\\:b CMD") << "k" << "a;b";
+    QTest::newRow("space") << QByteArray("@k=a\\sb CMD") << "k" << "a b";
+    QTest::newRow("backslash") << QByteArray("@k=a\\\\b CMD") << "k" << "a\\b";
+    QTest::newRow("cr lf") << QByteArray("@k=a\\rb\\nc CMD") << "k" << "a\rb\nc";
+    QTest::newRow("unknown escape") << QByteArray("@k=a\\xb CMD") << "k" << "axb";
+    QTest::newRow("trailing backslash") << QByteArray("@k=ab\\ CMD") << "k" << "ab";
+    QTest::newRow("utf-8") << QByteArray("@k=caf\xc3\xa9 CMD") << "k" << QString::fromUtf8("caf\xc3\xa9");
+    QTest::newRow("with prefix") << QByteArray("@time=2024-01-01T00:00:00.000Z :n!u@h PRIVMSG #c :x")
+                                 << "time" << "2024-01-01T00:00:00.000Z";
+}
+
+void TestIrcMessage::tags()
+{
+    QFETCH(QByteArray, line);
+    QFETCH(QString, key);
+    QFETCH(QString, value);
+
+    const IrcMessage message(line);
+    QVERIFY(message.isValid());
+    QVERIFY(message.hasTag(key.toLatin1().constData()));
+    QCOMPARE(message.tag(key.toLatin1().constData()), value);
+}
+
+void TestIrcMessage::invalidTagKeys_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("underscore") << QByteArray("@bad_key=1;ok=2 CMD") << 1;
+    QTest::newRow("empty vendor") << QByteArray("@/x=1;ok=2 CMD") << 1;
+    QTest::newRow("vendor only") << QByteArray("@example.com/=1 CMD") << 0;
+    QTest::newRow("bad vendor") << QByteArray("@ex_ample/x=1 CMD") << 0;
+    QTest::newRow("empty key") << QByteArray("@=1;ok=2 CMD") << 1;
+    QTest::newRow("empty tags") << QByteArray("@ CMD") << 0;
+}
+
+void TestIrcMessage::invalidTagKeys()
+{
+    QFETCH(QByteArray, line);
+    QFETCH(int, count);
+
+    // A bad tag is dropped; the rest of the line still parses
+    const IrcMessage message(line);
+    QVERIFY(message.isValid());
+    QCOMPARE(message.tagCount(), count);
+    QCOMPARE(message.command(), QByteArray("CMD"));
+}
+
+void TestIrcMessage::duplicateTags()
+{
+    const IrcMessage message("@k=1;other=x;k=2 CMD");
+    QCOMPARE(message.tagCount(), 3);
+    QCOMPARE(message.tag("k"), QString("2"));
+}
+
+void TestIrcMessage::tagWithoutValue()
+{
+    const IrcMessage message("@flag;empty= CMD");
+    QVERIFY(message.hasTag("flag"));
+    QVERIFY(message.hasTag("empty"));
+    QVERIFY(message.tag("flag").isEmpty());
+    QVERIFY(message.tag("empty").isEmpty());
+    QVERIFY(!message.hasTag("missing"));
+}
+
+void TestIrcMessage::prefix_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::addColumn<bool>("hasPrefix");
+    QTest::addColumn<QString>("nick");
+    QTest::addColumn<QString>("user");
+    QTest::addColumn<QString>("host");
+
+    QTest::newRow("full") << QByteArray(":nick!user@host.example PRIVMSG #c :hi")
+                          << true << "nick" << "user" << "host.example";
+    QTest::newRow("server") << QByteArray(":irc.example.net NOTICE * :hi")
+                            << true << "irc.example.net" << QString() << QString();
+    QTest::newRow("nick@host") << QByteArray(":nick@host PRIVMSG #c :hi")
+                               << true << "nick" << QString() << "host";
+    QTest::newRow("none") << QByteArray("PING :token")
+                          << false << QString() << QString() << QString();
+    QTest::newRow("after tags") << QByteArray("@a=b :n!u@h JOIN #c")
+                                << true << "n" << "u" << "h";
+}
+
+void TestIrcMessage::prefix()
+{
+    QFETCH(QByteArray, line);
+    QFETCH(bool, hasPrefix);
+    QFETCH(QString, nick);
+    QFETCH(QString, user);
+    QFETCH(QString, host);
+
+    const IrcMessage message(line);
+    QVERIFY(message.isValid());
+    QCOMPARE(message.hasPrefix(), hasPrefix);
+    QCOMPARE(message.nick(), nick);
+    QCOMPARE(message.user(), user);
+    QCOMPARE(message.host(), host);
+    QCOMPARE(message.nickBytes(), nick.toUtf8());
+}
+
+void TestIrcMessage::command_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<QByteArray>("command");
+    QTest::addColumn<int>("numeric");
+
+    QTest::newRow("verb") << QByteArray("PRIVMSG #c :hi") << true << QByteArray("PRIVMSG") << -1;
+    QTest::newRow("numeric") << QByteArray(":srv 001 me :Welcome") << true << QByteArray("001") << 1;
+    QTest::newRow("numeric 433") << QByteArray(":srv 433 * me :In use") << true << QByteArray("433") << 433;
+    QTest::newRow("not numeric") << QByteArray("12A x") << true << QByteArray("12A") << -1;
+    QTest::newRow("four digits") << QByteArray("1234 x") << true << QByteArray("1234") << -1;
+    QTest::newRow("crlf") << QByteArray("PING :x\r\n") << true << QByteArray("PING") << -1;
+    QTest::newRow("leading spaces") << QByteArray("  PING x") << true << QByteArray("PING") << -1;
+    QTest::newRow("empty") << QByteArray("") << false << QByteArray() << -1;
+    QTest::newRow("only crlf") << QByteArray("\r\n") << false << QByteArray() << -1;
+    QTest::newRow("only tags") << QByteArray("@a=b") << false << QByteArray() << -1;
+    QTest::newRow("only prefix") << QByteArray(":n!u@h") << false << QByteArray() << -1;
+}
+
+void TestIrcMessage::command()
+{
+    QFETCH(QByteArray, line);
+    QFETCH(bool, valid);
+    QFETCH(QByteArray, command);
+    QFETCH(int, numeric);
+
+    IrcMessage message;
+    QCOMPARE(message.parse(line), valid);
+    QCOMPARE(message.isValid(), valid);
+    QCOMPARE(message.command(), command);
+    QCOMPARE(message.isNumeric(), numeric >= 0);
+    QCOMPARE(message.numeric(), numeric);
+    if (valid) {
+        QVERIFY(message.isCommand(command.constData()));
+    }
+}
+
+void TestIrcMessage::params_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::addColumn<QStringList>("params");
+    QTest::addColumn<bool>("trailing");
+
+    QTest::newRow("none") << QByteArray("QUIT") << QStringList() << false;
+    QTest::newRow("none, spaces") << QByteArray("QUIT   ") << QStringList() << false;
+    QTest::newRow("middles") << QByteArray("MODE #c +o nick") << QStringList{"#c", "+o", "nick"} << false;
+    QTest::newRow("extra spaces") << QByteArray("MODE  #c   +o") << QStringList{"#c", "+o"} << false;
+    QTest::newRow("trailing") << QByteArray("PRIVMSG #c :hello  world ")
+                              << QStringList{"#c", "hello  world "} << true;
+    QTest::newRow("trailing colon") << QByteArray("PRIVMSG #c ::)") << QStringList{"#c", ":)"} << true;
+    QTest::newRow("trailing only") << QByteArray("PING :irc.example") << QStringList{"irc.example"} << true;
+    QTest::newRow("empty trailing") << QByteArray("PRIVMSG #c :") << QStringList{"#c", QString()} << true;
+    QTest::newRow("empty trailing crlf") << QByteArray("TOPIC #c :\r\n") << QStringList{"#c", QString()} << true;
+    QTest::newRow("colon inside middle") << QByteArray("CMD a:b :c") << QStringList{"a:b", "c"} << true;
+    QTest::newRow("crlf stripped") << QByteArray("PRIVMSG #c :hi\r\n") << QStringList{"#c", "hi"} << true;
+    QTest::newRow("lf stripped") << QByteArray("PRIVMSG #c hi\n") << QStringList{"#c", "hi"} << false;
+}
+
+void TestIrcMessage::params()
+{
+    QFETCH(QByteArray, line);
+    QFETCH(QStringList, params);
+    QFETCH(bool, trailing);
+
+    const IrcMessage message(line);
+    QVERIFY(message.isValid());
+    QCOMPARE(message.paramCount(), params.size());
+    QCOMPARE(message.hasTrailing(), trailing);
+    for (int i = 0; i < params.size(); ++i) {
+        QCOMPARE(message.param(i), params.at(i));
+        QCOMPARE(message.paramBytes(i), params.at(i).toUtf8());
+    }
+}
+
+void TestIrcMessage::paramOutOfRange()
+{
+    const IrcMessage message("PRIVMSG #c :hi");
+    QVERIFY(message.param(-1).isNull());
+    QVERIFY(message.param(2).isNull());
+    QVERIFY(message.paramBytes(5).isEmpty());
+}
+
+void TestIrcMessage::joinedParams()
+{
+    const IrcMessage message(":srv 005 me CHANTYPES=# PREFIX=(ov)@+ :are supported by this server");
+    QCOMPARE(message.joinedParams(), QString("me CHANTYPES=# PREFIX=(ov)@+ are supported by this server"));
+    QCOMPARE(message.joinedParams(1), QString("CHANTYPES=# PREFIX=(ov)@+ are supported by this server"));
+    QCOMPARE(message.joinedParams(10), QString());
+}
+
+void TestIrcMessage::paramLimit_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::addColumn<QString>("last");
+
+    QByteArray middles = "CMD";
+    for (int i = 1; i <= IrcMessage::MaxMiddleParams; ++i) {
+        middles += ' ' + QByteArray::number(i);
+    }
+
+    QTest::newRow("15th without colon") << middles + " 15" << "15";
+    QTest::newRow("15th keeps spaces") << middles + " 15 16 17" << "15 16 17";
+    QTest::newRow("15th with colon") << middles + " :15 16" << "15 16";
+    QTest::newRow("15th starting with colon") << middles + " ::15" << ":15";
+}
+
+void TestIrcMessage::paramLimit()
+{
+    QFETCH(QByteArray, line);
+    QFETCH(QString, last);
+
+    // After 14 middle parameters the rest of the line is the trailing one
+    const IrcMessage message(line);
+    QVERIFY(message.isValid());
+    QCOMPARE(message.paramCount(), IrcMessage::MaxMiddleParams + 1);
+    QVERIFY(message.hasTrailing());
+    QCOMPARE(message.param(IrcMessage::MaxMiddleParams - 1), QString("14"));
+    QCOMPARE(message.param(IrcMessage::MaxMiddleParams), last);
+
+    // Fourteen middles alone are not cut short
+    QByteArray fourteen = "CMD";
+    for (int i = 1; i <= IrcMessage::MaxMiddleParams; ++i) {
+        fourteen += ' ' + QByteArray::number(i);
+    }
+    const IrcMessage middles(fourteen);
+    QCOMPARE(middles.paramCount(), IrcMessage::MaxMiddleParams);
+    QVERIFY(!middles.hasTrailing());
+}
+
+QTEST_APPLESS_MAIN(TestIrcMessage)
+#include "tst_ircmessage.moc"
@@ -0,0 +1,226 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include "IrcTextCodec.h"
+
+// Every scan path IrcTextCodec has on this machine against each other and
+// against a plain decoder that works out each code point and checks it
+// against RFC 3629, rather than the byte ranges the codec uses.
+namespace {
+
+const char *const Implementations[] = { "scalar", "sse2", "avx2" };
+
+QStringList availableImplementations()
+{
+    const QByteArray original = IrcTextCodec::implementation();
+    QStringList names;
+    for (const char *name : Implementations) {
+        if (IrcTextCodec::setImplementation(name)) {
+            names.append(QString::fromLatin1(name));
+        }
+    }
+    IrcTextCodec::setImplementation(original.constData());
+    return names;
+}
+
+bool plainValidUtf8(const QByteArray &bytes)
+{
+    int i = 0;
+    while (i < bytes.size()) {
+        const uchar lead = uchar(bytes.at(i));
+        int length;
+        uint codePoint;
+        if (lead < 0x80) {
+            ++i;
+            continue;
+        } else if ((lead & 0xE0) == 0xC0) {
+            length = 2;
+            codePoint = lead & 0x1F;
+        } else if ((lead & 0xF0) == 0xE0) {
+            length = 3;
+            codePoint = lead & 0x0F;
+        } else if ((lead & 0xF8) == 0xF0) {
+            length = 4;
+            codePoint = lead & 0x07;
+        } else {
+            return false;
+        }
+        if (i + length > bytes.size()) {
+            return false;
+        }
+        for (int j = 1; j < length; ++j) {
+            const uchar next = uchar(bytes.at(i + j));
+            if ((next & 0xC0) != 0x80) {
+                return false;
+            }
+            codePoint = (codePoint << 6) | (next & 0x3F);
+        }
+        const uint smallest = length == 2 ? 0x80 : length == 3 ? 0x800 : 0x10000;
+        if (codePoint < smallest || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+int plainAsciiPrefix(const QByteArray &bytes)
+{
+    int i = 0;
+    while (i < bytes.size() && uchar(bytes.at(i)) < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+// Lead and continuation bytes from each edge of the ranges, so random
+// sequences hit the overlong, surrogate and out-of-range cases often
+QByteArray randomBytes(QRandomGenerator &random, int maxLength)
+{
+    static const uchar alphabet[] = {
+        'a', 'Z', ' ', 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC1, 0xC2,
+        0xDF, 0xE0, 0xE1, 0xED, 0xEF, 0xF0, 0xF4, 0xF5, 0xFF,
+    };
+    QByteArray bytes;
+    const int length = int(random.bounded(maxLength + 1));
+    for (int i = 0; i < length; ++i) {
+        bytes += char(alphabet[random.bounded(int(sizeof(alphabet)))]);
+    }
+    return bytes;
+}
+
+} // namespace
+
+class TestIrcTextCodec : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanupTestCase();
+
+    void validity_data();
+    void validity();
+    void asciiPrefix();
+    void randomBytesAgree();
+    void decode();
+
+private:
+    QByteArray m_original = IrcTextCodec::implementation();
+};
+
+void TestIrcTextCodec::init()
+{
+    QVERIFY(IrcTextCodec::setImplementation(m_original.constData()));
+}
+
+void TestIrcTextCodec::cleanupTestCase()
+{
+    IrcTextCodec::setImplementation(m_original.constData());
+}
+
+void TestIrcTextCodec::validity_data()
+{
+    QTest::addColumn<QByteArray>("sequence");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("ascii") << QByteArray("plain") << true;
+    QTest::newRow("two bytes") << QByteArray("\xc3\xa9") << true;
+    QTest::newRow("three bytes") << QByteArray("\xe2\x82\xac") << true;
+    QTest::newRow("four bytes") << QByteArray("\xf0\x9f\x98\x80") << true;
+    QTest::newRow("last code point") << QByteArray("\xf4\x8f\xbf\xbf") << true;
+    QTest::newRow("before surrogates") << QByteArray("\xed\x9f\xbf") << true;
+    QTest::newRow("after surrogates") << QByteArray("\xee\x80\x80") << true;
+
+    QTest::newRow("overlong two C0") << QByteArray("\xc0\x80") << false;
+    QTest::newRow("overlong two C1") << QByteArray("\xc1\xbf") << false;
+    QTest::newRow("overlong three") << QByteArray("\xe0\x9f\xbf") << false;
+    QTest::newRow("overlong four") << QByteArray("\xf0\x8f\xbf\xbf") << false;
+    QTest::newRow("first surrogate") << QByteArray("\xed\xa0\x80") << false;
+    QTest::newRow("last surrogate") << QByteArray("\xed\xbf\xbf") << false;
+    QTest::newRow("past U+10FFFF") << QByteArray("\xf4\x90\x80\x80") << false;
+    QTest::newRow("F5 lead") << QByteArray("\xf5\x80\x80\x80") << false;
+    QTest::newRow("FF") << QByteArray("\xff") << false;
+    QTest::newRow("stray continuation") << QByteArray("\x80") << false;
+    QTest::newRow("latin-1") << QByteArray("caf\xe9") << false;
+
+    QTest::newRow("cut two") << QByteArray("\xc3") << false;
+    QTest::newRow("cut three") << QByteArray("\xe2\x82") << false;
+    QTest::newRow("cut four") << QByteArray("\xf0\x9f\x98") << false;
+    QTest::newRow("cut by ascii") << QByteArray("\xe2\x82x") << false;
+}
+
+void TestIrcTextCodec::validity()
+{
+    QFETCH(QByteArray, sequence);
+    QFETCH(bool, valid);
+    QCOMPARE(plainValidUtf8(sequence), valid);
+
+    // After every length of ASCII up to past two AVX2 blocks, so the
+    // sequence starts, straddles and ends at each vector boundary, and once
+    // with ASCII after it too
+    for (const QString &name : availableImplementations()) {
+        QVERIFY(IrcTextCodec::setImplementation(qPrintable(name)));
+        for (int lead = 0; lead <= 70; ++lead) {
+            for (const QByteArray &tail : { QByteArray(), QByteArray(20, 'y') }) {
+                const QByteArray line = QByteArray(lead, 'x') + sequence + tail;
+                const IrcTextCodec::Encoding encoding = IrcTextCodec::classify(line.constData(), int(line.size()));
+                if (IrcTextCodec::isValidUtf8(line.constData(), int(line.size())) != valid
+                    || (encoding != IrcTextCodec::Invalid) != valid) {
+                    QFAIL(qPrintable(QString("%1 after %2 bytes (%3)").arg(name).arg(lead)
+                                     .arg(QString::fromLatin1(line.toHex()))));
+                }
+            }
+        }
+    }
+}
+
+void TestIrcTextCodec::asciiPrefix()
+{
+    // One high byte at each position of a line longer than two AVX2 blocks
+    for (const QString &name : availableImplementations()) {
+        QVERIFY(IrcTextCodec::setImplementation(qPrintable(name)));
+        for (int length = 0; length <= 80; ++length) {
+            const QByteArray ascii(length, 'a');
+            QCOMPARE(IrcTextCodec::asciiPrefixLength(ascii.constData(), length), length);
+            for (int at = 0; at < length; ++at) {
+                QByteArray line = ascii;
+                line[at] = char(0x80);
+                QCOMPARE(IrcTextCodec::asciiPrefixLength(line.constData(), length), at);
+            }
+        }
+    }
+}
+
+void TestIrcTextCodec::randomBytesAgree()
+{
+    const QStringList names = availableImplementations();
+    QRandomGenerator random(1);
+    for (int round = 0; round < 20000; ++round) {
+        // Mostly ASCII in front, so the vector loops run before the mix
+        const QByteArray line = QByteArray(int(random.bounded(40)), 'q') + randomBytes(random, 24);
+        const bool valid = plainValidUtf8(line);
+        const int ascii = plainAsciiPrefix(line);
+        for (const QString &name : names) {
+            IrcTextCodec::setImplementation(qPrintable(name));
+            if (IrcTextCodec::isValidUtf8(line.constData(), int(line.size())) != valid
+                || IrcTextCodec::asciiPrefixLength(line.constData(), int(line.size())) != ascii) {
+                QFAIL(qPrintable(QString("%1: %2").arg(name, QString::fromLatin1(line.toHex()))));
+            }
+        }
+    }
+}
+
+void TestIrcTextCodec::decode()
+{
+    QCOMPARE(IrcTextCodec::decode("plain", 5), QString("plain"));
+    QCOMPARE(IrcTextCodec::decode("caf\xc3\xa9", 5), QString::fromUtf8("caf\xc3\xa9"));
+    QCOMPARE(IrcTextCodec::decode("caf\xe9", 4, IrcTextCodec::Latin1), QString::fromUtf8("caf\xc3\xa9"));
+    QCOMPARE(IrcTextCodec::decode("\x80", 1, IrcTextCodec::Windows1252), QString(QChar(0x20AC)));
+    QCOMPARE(IrcTextCodec::decode("\x81", 1, IrcTextCodec::Windows1252), QString(QChar(0x0081)));
+    QCOMPARE(IrcTextCodec::decode("\xed\xa0\x80", 3, IrcTextCodec::Latin1),
+             QString::fromLatin1("\xed\xa0\x80"));
+    QVERIFY(IrcTextCodec::decode("", 0).isEmpty());
+}
+
+QTEST_APPLESS_MAIN(TestIrcTextCodec)
+#include "tst_irctextcodec.moc"
@@ -0,0 +1,172 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include "SessionSnapshot.h"
+
+// SessionSnapshot::parse() on what serialize() writes, and on every way a
+// file can be cut short or damaged: it must say no rather than read past
+// the end or allocate for counts the file cannot hold.
+namespace {
+
+SessionSnapshot sample()
+{
+    SessionSnapshot snapshot;
+    snapshot.currentNetwork = 1;
+    snapshot.currentBuffer = 2;
+    for (int n = 0; n < 2; ++n) {
+        SessionSnapshot::Network network;
+        IrcServerAddress address;
+        address.host = QString("irc%1.example").arg(n);
+        address.port = quint16(6697 + n);
+        address.tls = n == 0;
+        network.addresses.append(address);
+        network.nickname = QString::fromUtf8("nick\xc3\xa9%1").arg(n);
+        network.connected = n == 1;
+        for (int b = 0; b < 3; ++b) {
+            SessionSnapshot::Buffer buffer;
+            buffer.name = b == 0 ? QString("Server") : QString("#chan%1").arg(b);
+            buffer.topic = b == 2 ? QString::fromUtf8("topic \xe2\x82\xac") : QString();
+            buffer.members = b == 0 ? QStringList() : QStringList{ "@op", "+voice", "plain" };
+            for (int l = 0; l < 4; ++l) {
+                MessageLogModel::Entry line;
+                line.timestamp = 1700000000000LL + l;
+                line.kind = l == 0 ? MessageLogModel::System : MessageLogModel::Message;
+                line.sender = l == 0 ? QString() : QString("someone");
+                line.text = QString("line %1").arg(l);
+                buffer.lines.append(line);
+            }
+            network.buffers.append(buffer);
+        }
+        snapshot.networks.append(network);
+    }
+    return snapshot;
+}
+
+bool parse(const QByteArray &data, SessionSnapshot *snapshot)
+{
+    return SessionSnapshot::parse(reinterpret_cast<const uchar *>(data.constData()), data.size(), snapshot);
+}
+
+} // namespace
+
+class TestSessionSnapshot : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void truncated();
+    void foreign();
+    void hugeCounts();
+    void damaged();
+};
+
+void TestSessionSnapshot::roundTrip()
+{
+    const SessionSnapshot written = sample();
+    SessionSnapshot read;
+    QVERIFY(parse(written.serialize(), &read));
+
+    QCOMPARE(read.currentNetwork, written.currentNetwork);
+    QCOMPARE(read.currentBuffer, written.currentBuffer);
+    QCOMPARE(read.networks.size(), written.networks.size());
+    for (int n = 0; n < written.networks.size(); ++n) {
+        const SessionSnapshot::Network &a = written.networks.at(n);
+        const SessionSnapshot::Network &b = read.networks.at(n);
+        QCOMPARE(b.addresses.size(), a.addresses.size());
+        QCOMPARE(b.addresses.first().host, a.addresses.first().host);
+        QCOMPARE(b.addresses.first().port, a.addresses.first().port);
+        QCOMPARE(b.addresses.first().tls, a.addresses.first().tls);
+        QCOMPARE(b.nickname, a.nickname);
+        QCOMPARE(b.connected, a.connected);
+        QCOMPARE(b.buffers.size(), a.buffers.size());
+        for (int i = 0; i < a.buffers.size(); ++i) {
+            QCOMPARE(b.buffers.at(i).name, a.buffers.at(i).name);
+            QCOMPARE(b.buffers.at(i).topic, a.buffers.at(i).topic);
+            QCOMPARE(b.buffers.at(i).members, a.buffers.at(i).members);
+            QCOMPARE(b.buffers.at(i).lines.size(), a.buffers.at(i).lines.size());
+            for (int l = 0; l < a.buffers.at(i).lines.size(); ++l) {
+                const MessageLogModel::Entry &x = a.buffers.at(i).lines.at(l);
+                const MessageLogModel::Entry &y = b.buffers.at(i).lines.at(l);
+                QCOMPARE(y.timestamp, x.timestamp);
+                QCOMPARE(y.kind, x.kind);
+                QCOMPARE(y.sender, x.sender);
+                QCOMPARE(y.text, x.text);
+            }
+        }
+    }
+
+    SessionSnapshot empty;
+    QVERIFY(parse(SessionSnapshot().serialize(), &empty));
+    QVERIFY(empty.isEmpty());
+}
+
+void TestSessionSnapshot::truncated()
+{
+    // Every prefix of a good file is refused and leaves the result alone
+    const QByteArray data = sample().serialize();
+    for (int size = 0; size < data.size(); ++size) {
+        SessionSnapshot read;
+        read.currentNetwork = 7;
+        if (parse(data.left(size), &read)) {
+            QFAIL(qPrintable(QString("accepted %1 of %2 bytes").arg(size).arg(data.size())));
+        }
+        QCOMPARE(read.currentNetwork, 7);
+    }
+}
+
+void TestSessionSnapshot::foreign()
+{
+    QByteArray data = sample().serialize();
+    SessionSnapshot read;
+
+    QByteArray magic = data;
+    magic[0] = 'X';
+    QVERIFY(!parse(magic, &read));
+
+    // The version follows the 8-byte magic
+    QByteArray version = data;
+    version[8] = char(version.at(8) + 1);
+    QVERIFY(!parse(version, &read));
+
+    QVERIFY(!parse(QByteArray("QTIRCSES"), &read));
+}
+
+void TestSessionSnapshot::hugeCounts()
+{
+    // A network count no file this size could hold
+    QByteArray data = SessionSnapshot().serialize();
+    qToLittleEndian<quint32>(0xFFFFFFFFu, data.data() + 12);
+    SessionSnapshot read;
+    QVERIFY(!parse(data, &read));
+
+    // The same for the line count of the last buffer, which sits right
+    // after its members string
+    SessionSnapshot one;
+    SessionSnapshot::Network network;
+    network.addresses.append(IrcServerAddress());
+    network.buffers.append(SessionSnapshot::Buffer());
+    one.networks.append(network);
+    QByteArray lines = one.serialize();
+    qToLittleEndian<quint32>(0x7FFFFFFFu, lines.data() + lines.size() - 4);
+    QVERIFY(!parse(lines, &read));
+}
+
+void TestSessionSnapshot::damaged()
+{
+    // Random bytes overwritten: any answer will do, as long as parsing
+    // stays inside the data
+    const QByteArray data = sample().serialize();
+    QRandomGenerator random(1);
+    for (int round = 0; round < 2000; ++round) {
+        QByteArray copy = data;
+        const int flips = 1 + int(random.bounded(4));
+        for (int i = 0; i < flips; ++i) {
+            copy[int(random.bounded(int(copy.size())))] = char(random.bounded(256));
+        }
+        SessionSnapshot read;
+        parse(copy, &read);
+    }
+}
+
+QTEST_APPLESS_MAIN(TestSessionSnapshot)
+#include "tst_sessionsnapshot.moc"